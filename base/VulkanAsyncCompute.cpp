@@ -0,0 +1,279 @@
+/*
+* Vulkan async compute
+*
+* Schedules simulation steps on a dedicated compute queue so they overlap with rendering of the previous step's results
+*
+* Copyright (C) 2016-2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanAsyncCompute.h"
+#include "VulkanDevice.h"
+
+namespace vks
+{
+	/**
+	* Create the command buffers and semaphores used for scheduling the steps
+	*
+	* @param device Device to submit to, timeline semaphores are used if they have been enabled for it
+	* @param graphicsQueue Queue the graphics work consuming the results is submitted to (used for uploading initial buffer data)
+	* @param graphicsWaitStageMask (Optional) Pipeline stages of the graphics submissions that wait for the results of a step
+	*/
+	void AsyncCompute::create(vks::VulkanDevice* device, VkQueue graphicsQueue, VkPipelineStageFlags graphicsWaitStageMask)
+	{
+		this->device = device;
+		this->graphicsQueue = graphicsQueue;
+		this->graphicsWaitStageMask = graphicsWaitStageMask;
+		queueFamilyIndex = device->queueFamilyIndices.compute;
+		graphicsQueueFamilyIndex = device->queueFamilyIndices.graphics;
+		vkGetDeviceQueue(device->logicalDevice, queueFamilyIndex, 0, &queue);
+
+		commandPool = device->createCommandPool(queueFamilyIndex);
+		for (uint32_t i = 0; i < slotCount; i++)
+		{
+			commandBuffers[i] = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, commandPool);
+			VkFenceCreateInfo fenceInfo = vks::initializers::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
+			VK_CHECK_RESULT(vkCreateFence(device->logicalDevice, &fenceInfo, nullptr, &fences[i]));
+		}
+
+		VkSemaphoreCreateInfo semaphoreInfo = vks::initializers::semaphoreCreateInfo();
+		if (device->timelineSemaphores)
+		{
+			VkSemaphoreTypeCreateInfoKHR semaphoreTypeInfo{};
+			semaphoreTypeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+			semaphoreTypeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+			semaphoreTypeInfo.initialValue = 0;
+			semaphoreInfo.pNext = &semaphoreTypeInfo;
+			VK_CHECK_RESULT(vkCreateSemaphore(device->logicalDevice, &semaphoreInfo, nullptr, &computeTimeline));
+			VK_CHECK_RESULT(vkCreateSemaphore(device->logicalDevice, &semaphoreInfo, nullptr, &graphicsTimeline));
+		}
+		else
+		{
+			VK_CHECK_RESULT(vkCreateSemaphore(device->logicalDevice, &semaphoreInfo, nullptr, &computeComplete));
+			VK_CHECK_RESULT(vkCreateSemaphore(device->logicalDevice, &semaphoreInfo, nullptr, &graphicsComplete));
+		}
+	}
+
+	/**
+	* Release all resources, waits for submitted steps (buffers created with createDoubleBuffer are owned by the caller)
+	*/
+	void AsyncCompute::destroy()
+	{
+		if (!device || !commandPool)
+		{
+			return;
+		}
+		waitIdle();
+		for (uint32_t i = 0; i < slotCount; i++)
+		{
+			vkDestroyFence(device->logicalDevice, fences[i], nullptr);
+			fences[i] = VK_NULL_HANDLE;
+		}
+		vkDestroyCommandPool(device->logicalDevice, commandPool, nullptr);
+		commandPool = VK_NULL_HANDLE;
+		VkSemaphore* semaphores[] = { &computeTimeline, &graphicsTimeline, &computeComplete, &graphicsComplete };
+		for (VkSemaphore* semaphore : semaphores)
+		{
+			if (*semaphore)
+			{
+				vkDestroySemaphore(device->logicalDevice, *semaphore, nullptr);
+				*semaphore = VK_NULL_HANDLE;
+			}
+		}
+	}
+
+	/**
+	* Create the device local buffers of a double buffered resource
+	*
+	* @param usageFlags Usage flags for the buffers, transfer destination usage is added for uploading the initial data
+	* @param size Size of each buffer in bytes
+	* @param buffers Buffers to create (one per slot), shared concurrently by the graphics and compute queue families
+	* @param data (Optional) Initial data for both buffers, uploaded through the graphics queue before the function returns
+	*/
+	void AsyncCompute::createDoubleBuffer(VkBufferUsageFlags usageFlags, VkDeviceSize size, vks::Buffer buffers[slotCount], const void* data)
+	{
+		const uint32_t queueFamilyIndices[] = { graphicsQueueFamilyIndex, queueFamilyIndex };
+		usageFlags |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		for (uint32_t i = 0; i < slotCount; i++)
+		{
+			vks::Buffer& buffer = buffers[i];
+			buffer.device = device->logicalDevice;
+			VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo(usageFlags, size);
+			if (hasDedicatedQueue())
+			{
+				bufferCreateInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+				bufferCreateInfo.queueFamilyIndexCount = 2;
+				bufferCreateInfo.pQueueFamilyIndices = queueFamilyIndices;
+			}
+			VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &buffer.buffer));
+			VkMemoryRequirements memReqs;
+			vkGetBufferMemoryRequirements(device->logicalDevice, buffer.buffer, &memReqs);
+			VK_CHECK_RESULT(device->memoryAllocator.allocateBufferMemory(buffer.buffer, usageFlags, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &buffer.allocation));
+			buffer.memory = buffer.allocation.memory;
+			buffer.alignment = memReqs.alignment;
+			buffer.size = size;
+			buffer.usageFlags = usageFlags;
+			buffer.memoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+			buffer.setupDescriptor();
+			VK_CHECK_RESULT(buffer.bind());
+		}
+
+		if (data)
+		{
+			vks::Buffer stagingBuffer;
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, size, const_cast<void*>(data)));
+			VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			VkBufferCopy copyRegion{};
+			copyRegion.size = size;
+			for (uint32_t i = 0; i < slotCount; i++)
+			{
+				vkCmdCopyBuffer(copyCmd, stagingBuffer.buffer, buffers[i].buffer, 1, &copyRegion);
+			}
+			device->flushCommandBuffer(copyCmd, graphicsQueue, true);
+			stagingBuffer.destroy();
+		}
+	}
+
+	/**
+	* Start recording the next step
+	*
+	* Waits until the last submission of the step's command buffer has finished executing. The returned command buffer starts with a memory
+	* barrier that makes the previous step's shader writes visible to this step's compute shaders.
+	*
+	* @return Command buffer to record the step's dispatches into, submitted with submit()
+	*/
+	VkCommandBuffer AsyncCompute::beginStep()
+	{
+		step++;
+		const uint32_t slot = getSlot();
+		VK_CHECK_RESULT(vkWaitForFences(device->logicalDevice, 1, &fences[slot], VK_TRUE, UINT64_MAX));
+		VK_CHECK_RESULT(vkResetFences(device->logicalDevice, 1, &fences[slot]));
+
+		VkCommandBuffer commandBuffer = commandBuffers[slot];
+		VkCommandBufferBeginInfo beginInfo = vks::initializers::commandBufferBeginInfo();
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+
+		VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		return commandBuffer;
+	}
+
+	/**
+	* Submit the step recorded since the last call to beginStep to the compute queue
+	*/
+	void AsyncCompute::submit()
+	{
+		const uint32_t slot = getSlot();
+		VkCommandBuffer commandBuffer = commandBuffers[slot];
+		VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+
+		const VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		VkSubmitInfo computeSubmitInfo = vks::initializers::submitInfo();
+		computeSubmitInfo.commandBufferCount = 1;
+		computeSubmitInfo.pCommandBuffers = &commandBuffer;
+		computeSubmitInfo.pWaitDstStageMask = &waitStageMask;
+
+		VkTimelineSemaphoreSubmitInfoKHR computeTimelineInfo{};
+		// Overwriting a slot must wait for the graphics submissions still reading its previous contents
+		const uint64_t waitValue = serialize ? graphicsValue : slotReadValues[slot];
+		if (computeTimeline)
+		{
+			computeTimelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+			computeTimelineInfo.waitSemaphoreValueCount = 1;
+			computeTimelineInfo.pWaitSemaphoreValues = &waitValue;
+			computeTimelineInfo.signalSemaphoreValueCount = 1;
+			computeTimelineInfo.pSignalSemaphoreValues = &step;
+			computeSubmitInfo.pNext = &computeTimelineInfo;
+			computeSubmitInfo.waitSemaphoreCount = 1;
+			computeSubmitInfo.pWaitSemaphores = &graphicsTimeline;
+			computeSubmitInfo.signalSemaphoreCount = 1;
+			computeSubmitInfo.pSignalSemaphores = &computeTimeline;
+		}
+		else
+		{
+			// A binary semaphore can't be signalled again before its signal has been waited on, so a second step before the next graphics
+			// submission would leave the graphics work waiting for the first step only
+			assert(!computeSignalPending && "Only one step can be submitted per graphics submission without timeline semaphores");
+			// Binary semaphores can only be waited on once per signal, so a step only waits if a graphics submission was made since the last step
+			computeSubmitInfo.waitSemaphoreCount = graphicsSignalPending ? 1 : 0;
+			computeSubmitInfo.pWaitSemaphores = &graphicsComplete;
+			computeSubmitInfo.signalSemaphoreCount = 1;
+			computeSubmitInfo.pSignalSemaphores = &computeComplete;
+			graphicsSignalPending = false;
+			computeSignalPending = true;
+		}
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &computeSubmitInfo, fences[slot]));
+		submittedStep = step;
+	}
+
+	/**
+	* Get a graphics submit info that waits for the results of the last submitted step
+	*
+	* @param submitInfo Submit info of the graphics work (including its own semaphores), it's not modified
+	*
+	* @return Copy of the submit info with the step's semaphores added, only valid until the next call to this function
+	*/
+	VkSubmitInfo AsyncCompute::getGraphicsSubmitInfo(const VkSubmitInfo& submitInfo)
+	{
+		waitSemaphores.assign(submitInfo.pWaitSemaphores, submitInfo.pWaitSemaphores + submitInfo.waitSemaphoreCount);
+		waitStageMasks.assign(submitInfo.pWaitDstStageMask, submitInfo.pWaitDstStageMask + submitInfo.waitSemaphoreCount);
+		signalSemaphores.assign(submitInfo.pSignalSemaphores, submitInfo.pSignalSemaphores + submitInfo.signalSemaphoreCount);
+		// Values for binary semaphores are ignored
+		waitValues.assign(waitSemaphores.size(), 0);
+		signalValues.assign(signalSemaphores.size(), 0);
+
+		VkSubmitInfo graphicsSubmitInfo = submitInfo;
+		if (computeTimeline)
+		{
+			if (submittedStep > 0)
+			{
+				waitSemaphores.push_back(computeTimeline);
+				waitStageMasks.push_back(graphicsWaitStageMask);
+				waitValues.push_back(submittedStep);
+				// The graphics work reads the slot written by the last step
+				slotReadValues[submittedStep % slotCount] = graphicsValue + 1;
+			}
+			signalSemaphores.push_back(graphicsTimeline);
+			signalValues.push_back(++graphicsValue);
+
+			timelineSubmitInfo = {};
+			timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+			timelineSubmitInfo.pNext = submitInfo.pNext;
+			timelineSubmitInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+			timelineSubmitInfo.pWaitSemaphoreValues = waitValues.data();
+			timelineSubmitInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+			timelineSubmitInfo.pSignalSemaphoreValues = signalValues.data();
+			graphicsSubmitInfo.pNext = &timelineSubmitInfo;
+		}
+		else
+		{
+			if (computeSignalPending)
+			{
+				waitSemaphores.push_back(computeComplete);
+				waitStageMasks.push_back(graphicsWaitStageMask);
+				computeSignalPending = false;
+			}
+			if (!graphicsSignalPending)
+			{
+				signalSemaphores.push_back(graphicsComplete);
+				graphicsSignalPending = true;
+			}
+		}
+		graphicsSubmitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+		graphicsSubmitInfo.pWaitSemaphores = waitSemaphores.data();
+		graphicsSubmitInfo.pWaitDstStageMask = waitStageMasks.data();
+		graphicsSubmitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+		graphicsSubmitInfo.pSignalSemaphores = signalSemaphores.data();
+		return graphicsSubmitInfo;
+	}
+
+	/** @brief Wait until all submitted steps have finished executing */
+	void AsyncCompute::waitIdle()
+	{
+		VK_CHECK_RESULT(vkWaitForFences(device->logicalDevice, slotCount, fences, VK_TRUE, UINT64_MAX));
+	}
+}
@@ -0,0 +1,106 @@
+/*
+* Vulkan async compute
+*
+* Schedules simulation steps on a dedicated compute queue so they overlap with rendering of the previous step's results
+*
+* Copyright (C) 2016-2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanBuffer.h"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	struct VulkanDevice;
+
+	/**
+	* @brief Overlaps compute simulation steps with the graphics work consuming their results
+	*
+	* Steps are recorded into command buffers of the device's compute queue family, which is a dedicated (compute only) family if the device
+	* offers one. Simulation state is double buffered: step n writes the buffers of slot n % 2 and reads the previous step's results from the
+	* other slot, while the graphics queue may still be rendering from that other slot. Double buffers are created with concurrent sharing
+	* between the graphics and compute queue families, so they need no queue family ownership transfers.
+	*
+	* If timeline semaphores have been enabled for the device, each step signals the compute timeline with its step number and each graphics
+	* submission waits for the last submitted step and signals the graphics timeline. A step only waits for the graphics submissions that read
+	* the slot it's going to overwrite, so it executes concurrently with the rendering of the previous step. Setting serialize makes steps wait
+	* for all graphics submissions instead (for comparison). Without timeline semaphores, steps and graphics submissions are chained with binary
+	* semaphores and always serialized, and exactly one step may be submitted per graphics submission.
+	*
+	* Per frame usage (after prepareFrame, so a failed swap chain acquire doesn't leave an unmatched step):
+	*   VkCommandBuffer commandBuffer = asyncCompute.beginStep();
+	*   // Record dispatches writing slot asyncCompute.getSlot() and reading slot asyncCompute.getPreviousSlot()
+	*   asyncCompute.submit();
+	*   // Record graphics work reading slot asyncCompute.getSlot()
+	*   VkSubmitInfo graphicsSubmitInfo = asyncCompute.getGraphicsSubmitInfo(submitInfo);
+	*   vkQueueSubmit(queue, 1, &graphicsSubmitInfo, fence);
+	*/
+	class AsyncCompute
+	{
+	public:
+		static const uint32_t slotCount = 2;
+
+		/** @brief If true, steps wait for all prior graphics submissions instead of only those reading the slot they overwrite */
+		bool serialize = false;
+
+		void create(vks::VulkanDevice* device, VkQueue graphicsQueue, VkPipelineStageFlags graphicsWaitStageMask = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+		void destroy();
+		void createDoubleBuffer(VkBufferUsageFlags usageFlags, VkDeviceSize size, vks::Buffer buffers[slotCount], const void* data = nullptr);
+		VkCommandBuffer beginStep();
+		void submit();
+		VkSubmitInfo getGraphicsSubmitInfo(const VkSubmitInfo& submitInfo);
+		void waitIdle();
+
+		/** @brief Slot written by the current step */
+		uint32_t getSlot() const { return static_cast<uint32_t>(step % slotCount); }
+		/** @brief Slot containing the results of the previous step */
+		uint32_t getPreviousSlot() const { return static_cast<uint32_t>((step + slotCount - 1) % slotCount); }
+		VkQueue getQueue() const { return queue; }
+		uint32_t getQueueFamilyIndex() const { return queueFamilyIndex; }
+		/** @brief True if compute work is submitted to a different queue family than graphics work */
+		bool hasDedicatedQueue() const { return queueFamilyIndex != graphicsQueueFamilyIndex; }
+		/** @brief True if steps can overlap with graphics work (timeline semaphores are enabled and serialize is not set) */
+		bool isOverlapping() const { return (computeTimeline != VK_NULL_HANDLE) && !serialize; }
+		bool usesTimelineSemaphores() const { return computeTimeline != VK_NULL_HANDLE; }
+
+	private:
+		vks::VulkanDevice* device = nullptr;
+		VkQueue queue = VK_NULL_HANDLE;
+		VkQueue graphicsQueue = VK_NULL_HANDLE;
+		uint32_t queueFamilyIndex = 0;
+		uint32_t graphicsQueueFamilyIndex = 0;
+		VkPipelineStageFlags graphicsWaitStageMask = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+		VkCommandPool commandPool = VK_NULL_HANDLE;
+		VkCommandBuffer commandBuffers[slotCount]{};
+		// Signalled by the last submission of a slot's command buffer
+		VkFence fences[slotCount]{};
+		// Number of the step currently being recorded (or last submitted), steps start at 1
+		uint64_t step = 0;
+		uint64_t submittedStep = 0;
+		// Timeline semaphores signalled with the step number (compute) and the graphics submission number (graphics)
+		VkSemaphore computeTimeline = VK_NULL_HANDLE;
+		VkSemaphore graphicsTimeline = VK_NULL_HANDLE;
+		uint64_t graphicsValue = 0;
+		// Last graphics submission reading from each slot
+		uint64_t slotReadValues[slotCount]{};
+		// Binary semaphores chaining steps and graphics submissions if timeline semaphores are not available
+		VkSemaphore computeComplete = VK_NULL_HANDLE;
+		VkSemaphore graphicsComplete = VK_NULL_HANDLE;
+		bool computeSignalPending = false;
+		bool graphicsSignalPending = false;
+		// Storage for the semaphores of the graphics submit info returned by getGraphicsSubmitInfo
+		std::vector<VkSemaphore> waitSemaphores;
+		std::vector<VkPipelineStageFlags> waitStageMasks;
+		std::vector<uint64_t> waitValues;
+		std::vector<VkSemaphore> signalSemaphores;
+		std::vector<uint64_t> signalValues;
+		VkTimelineSemaphoreSubmitInfoKHR timelineSubmitInfo{};
+	};
+}
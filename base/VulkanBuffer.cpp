@@ -19,9 +19,20 @@ namespace vks
 	* @param offset (Optional) Byte offset from beginning
 	* 
 	* @return VkResult of the buffer mapping call
+	*
+	* @note Memory from the device's memory allocator is persistently mapped, so this only returns a pointer into that mapping
 	*/
 	VkResult Buffer::map(VkDeviceSize size, VkDeviceSize offset)
 	{
+		if (allocation.allocator)
+		{
+			if (!allocation.mapped)
+			{
+				return VK_ERROR_MEMORY_MAP_FAILED;
+			}
+			mapped = static_cast<char*>(allocation.mapped) + offset;
+			return VK_SUCCESS;
+		}
 		return vkMapMemory(device, memory, offset, size, 0, &mapped);
 	}
 
@@ -34,7 +45,10 @@ namespace vks
 	{
 		if (mapped)
 		{
-			vkUnmapMemory(device, memory);
+			if (!allocation.allocator)
+			{
+				vkUnmapMemory(device, memory);
+			}
 			mapped = nullptr;
 		}
 	}
@@ -45,10 +59,12 @@ namespace vks
 	* @param offset (Optional) Byte offset (from the beginning) for the memory region to bind
 	* 
 	* @return VkResult of the bindBufferMemory call
+	*
+	* @note The offset is relative to the start of the buffer's allocation
 	*/
 	VkResult Buffer::bind(VkDeviceSize offset)
 	{
-		return vkBindBufferMemory(device, buffer, memory, offset);
+		return vkBindBufferMemory(device, buffer, memory, allocation.offset + offset);
 	}
 
 	/**
@@ -90,6 +106,11 @@ namespace vks
 	*/
 	VkResult Buffer::flush(VkDeviceSize size, VkDeviceSize offset)
 	{
+		if (allocation.allocator)
+		{
+			VkMappedMemoryRange mappedRange = allocation.allocator->getMappedMemoryRange(allocation, size, offset);
+			return vkFlushMappedMemoryRanges(device, 1, &mappedRange);
+		}
 		VkMappedMemoryRange mappedRange = {};
 		mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
 		mappedRange.memory = memory;
@@ -110,6 +131,11 @@ namespace vks
 	*/
 	VkResult Buffer::invalidate(VkDeviceSize size, VkDeviceSize offset)
 	{
+		if (allocation.allocator)
+		{
+			VkMappedMemoryRange mappedRange = allocation.allocator->getMappedMemoryRange(allocation, size, offset);
+			return vkInvalidateMappedMemoryRanges(device, 1, &mappedRange);
+		}
 		VkMappedMemoryRange mappedRange = {};
 		mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
 		mappedRange.memory = memory;
@@ -127,7 +153,13 @@ namespace vks
 		{
 			vkDestroyBuffer(device, buffer, nullptr);
 		}
-		if (memory)
+		if (allocation.allocator)
+		{
+			mapped = nullptr;
+			allocation.allocator->free(&allocation);
+			memory = VK_NULL_HANDLE;
+		}
+		else if (memory)
 		{
 			vkFreeMemory(device, memory, nullptr);
 		}
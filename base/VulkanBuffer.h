@@ -14,6 +14,7 @@
 
 #include "vulkan/vulkan.h"
 #include "VulkanTools.h"
+#include "VulkanMemoryAllocator.h"
 
 namespace vks
 {	
@@ -26,6 +27,8 @@ namespace vks
 		VkDevice device;
 		VkBuffer buffer = VK_NULL_HANDLE;
 		VkDeviceMemory memory = VK_NULL_HANDLE;
+		/** @brief Memory range of the buffer if it has been allocated through the device's memory allocator (memory may be shared with other resources) */
+		Allocation allocation;
 		VkDescriptorBufferInfo descriptor;
 		VkDeviceSize size = 0;
 		VkDeviceSize alignment = 0;
@@ -70,6 +70,8 @@ namespace vks
 		}
 		if (logicalDevice)
 		{
+			stagingUploader.destroy();
+			memoryAllocator.destroy();
 			vkDestroyDevice(logicalDevice, nullptr);
 		}
 	}
@@ -253,6 +255,35 @@ namespace vks
 			deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 		}
 
+		// Timeline semaphores are enabled whenever the device supports them, the staging uploader and async compute use them for their tickets
+		// A chain with the Vulkan 1.2 feature structure must not also contain the extension's structure, so the feature is enabled in there instead
+		VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineSemaphoreFeatures{};
+		bool timelineSemaphoresRequested = false;
+		VkPhysicalDeviceVulkan12Features* vulkan12Features = nullptr;
+		for (VkBaseOutStructure* next = static_cast<VkBaseOutStructure*>(pNextChain); next != nullptr; next = next->pNext) {
+			if (next->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES) {
+				timelineSemaphoresRequested = true;
+			}
+			if (next->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES) {
+				vulkan12Features = reinterpret_cast<VkPhysicalDeviceVulkan12Features*>(next);
+			}
+		}
+		if (!timelineSemaphoresRequested) {
+			if (vulkan12Features) {
+				// Timeline semaphores are a required feature of Vulkan 1.2
+				vulkan12Features->timelineSemaphore = VK_TRUE;
+			}
+			else if (extensionSupported(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME)) {
+				if (std::find(deviceExtensions.begin(), deviceExtensions.end(), std::string(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME)) == deviceExtensions.end()) {
+					deviceExtensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+				}
+				timelineSemaphoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+				timelineSemaphoreFeatures.timelineSemaphore = VK_TRUE;
+				timelineSemaphoreFeatures.pNext = pNextChain;
+				pNextChain = &timelineSemaphoreFeatures;
+			}
+		}
+
 		VkDeviceCreateInfo deviceCreateInfo = {};
 		deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 		deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());;
@@ -269,6 +300,19 @@ namespace vks
 			deviceCreateInfo.pNext = &physicalDeviceFeatures2;
 		}
 
+		// Check if the chain enables timeline semaphores (added above if supported) or indirect draw counts
+		timelineSemaphores = false;
+		drawIndirectCount = false;
+		for (const VkBaseInStructure* next = static_cast<const VkBaseInStructure*>(pNextChain); next != nullptr; next = next->pNext) {
+			if (next->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES) {
+				timelineSemaphores |= (reinterpret_cast<const VkPhysicalDeviceTimelineSemaphoreFeatures*>(next)->timelineSemaphore == VK_TRUE);
+			}
+			if (next->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES) {
+				timelineSemaphores |= (reinterpret_cast<const VkPhysicalDeviceVulkan12Features*>(next)->timelineSemaphore == VK_TRUE);
+				drawIndirectCount |= (reinterpret_cast<const VkPhysicalDeviceVulkan12Features*>(next)->drawIndirectCount == VK_TRUE);
+			}
+		}
+
 #if (defined(VK_USE_PLATFORM_IOS_MVK) || defined(VK_USE_PLATFORM_MACOS_MVK)) && defined(VK_KHR_portability_subset)
 		// SRS - When running on iOS/macOS with MoltenVK and VK_KHR_portability_subset is defined and supported by the device, enable the extension
 		if (extensionSupported(VK_KHR_PORTABILITY_SUBSET_EXTENSION_NAME))
@@ -289,6 +333,7 @@ namespace vks
 			deviceCreateInfo.enabledExtensionCount = (uint32_t)deviceExtensions.size();
 			deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
 		}
+		this->enabledExtensions.assign(deviceExtensions.begin(), deviceExtensions.end());
 
 		this->enabledFeatures = enabledFeatures;
 
@@ -301,6 +346,9 @@ namespace vks
 		// Create a default command pool for graphics command buffers
 		commandPool = createCommandPool(queueFamilyIndices.graphics);
 
+		memoryAllocator.create(physicalDevice, logicalDevice);
+		stagingUploader.create(this);
+
 		return result;
 	}
 
@@ -315,6 +363,8 @@ namespace vks
 	* @param data Pointer to the data that should be copied to the buffer after creation (optional, if not set, no data is copied over)
 	*
 	* @return VK_SUCCESS if buffer handle and memory have been created and (optionally passed) data has been copied
+	*
+	* @note The memory is a dedicated allocation owned by the caller (and released with vkFreeMemory), use the vks::Buffer variant to sub-allocate from the device's memory allocator
 	*/
 	VkResult VulkanDevice::createBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize size, VkBuffer *buffer, VkDeviceMemory *memory, void *data)
 	{
@@ -371,10 +421,13 @@ namespace vks
 	* @param buffer Pointer to a vk::Vulkan buffer object
 	* @param size Size of the buffer in bytes
 	* @param data Pointer to the data that should be copied to the buffer after creation (optional, if not set, no data is copied over)
+	* @param allocationFlags (Optional) Flags passed to the memory allocator, e.g. MemoryAllocator::Transient for short lived staging buffers
 	*
 	* @return VK_SUCCESS if buffer handle and memory have been created and (optionally passed) data has been copied
+	*
+	* @note The buffer's memory is sub-allocated and may be shared with other resources, use the vks::Buffer functions for mapping, flushing and destroying it
 	*/
-	VkResult VulkanDevice::createBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, vks::Buffer *buffer, VkDeviceSize size, void *data)
+	VkResult VulkanDevice::createBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, vks::Buffer *buffer, VkDeviceSize size, void *data, uint32_t allocationFlags)
 	{
 		buffer->device = logicalDevice;
 
@@ -382,21 +435,12 @@ namespace vks
 		VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo(usageFlags, size);
 		VK_CHECK_RESULT(vkCreateBuffer(logicalDevice, &bufferCreateInfo, nullptr, &buffer->buffer));
 
-		// Create the memory backing up the buffer handle
+		// Sub-allocate the memory backing up the buffer handle from the device's memory allocator
+		// Buffers using device addresses are placed in blocks allocated with VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT
 		VkMemoryRequirements memReqs;
-		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
 		vkGetBufferMemoryRequirements(logicalDevice, buffer->buffer, &memReqs);
-		memAlloc.allocationSize = memReqs.size;
-		// Find a memory type index that fits the properties of the buffer
-		memAlloc.memoryTypeIndex = getMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags);
-		// If the buffer has VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT set we also need to enable the appropriate flag during allocation
-		VkMemoryAllocateFlagsInfoKHR allocFlagsInfo{};
-		if (usageFlags & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) {
-			allocFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO_KHR;
-			allocFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
-			memAlloc.pNext = &allocFlagsInfo;
-		}
-		VK_CHECK_RESULT(vkAllocateMemory(logicalDevice, &memAlloc, nullptr, &buffer->memory));
+		VK_CHECK_RESULT(memoryAllocator.allocateBufferMemory(buffer->buffer, usageFlags, memoryPropertyFlags, &buffer->allocation, allocationFlags));
+		buffer->memory = buffer->allocation.memory;
 
 		buffer->alignment = memReqs.alignment;
 		buffer->size = size;
@@ -520,6 +564,9 @@ namespace vks
 
 		VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
 
+		// Submit queued uploads first, the command buffer may use resources that haven't been uploaded yet
+		stagingUploader.flush();
+
 		VkSubmitInfo submitInfo = vks::initializers::submitInfo();
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &commandBuffer;
@@ -555,6 +602,18 @@ namespace vks
 		return (std::find(supportedExtensions.begin(), supportedExtensions.end(), extension) != supportedExtensions.end());
 	}
 
+	/**
+	* Check if an extension has been enabled at device creation
+	*
+	* @param extension Name of the extension to check
+	*
+	* @return True if the extension was passed to (or added by) createLogicalDevice
+	*/
+	bool VulkanDevice::extensionEnabled(std::string extension)
+	{
+		return (std::find(enabledExtensions.begin(), enabledExtensions.end(), extension) != enabledExtensions.end());
+	}
+
 	/**
 	* Select the best-fit depth format for this device from a list of possible depth (and stencil) formats
 	*
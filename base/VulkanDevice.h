@@ -11,6 +11,8 @@
 #pragma once
 
 #include "VulkanBuffer.h"
+#include "VulkanMemoryAllocator.h"
+#include "VulkanStagingUploader.h"
 #include "VulkanTools.h"
 #include "vulkan/vulkan.h"
 #include <algorithm>
@@ -39,6 +41,16 @@ struct VulkanDevice
 	std::vector<std::string> supportedExtensions;
 	/** @brief Default command pool for the graphics queue family index */
 	VkCommandPool commandPool = VK_NULL_HANDLE;
+	/** @brief Sub-allocator used for the memory of buffers and textures created through the helper classes */
+	vks::MemoryAllocator memoryAllocator;
+	/** @brief Batches staging uploads of buffer and image data (used by the texture and glTF loaders) */
+	vks::StagingUploader stagingUploader;
+	/** @brief Set if timeline semaphores have been enabled in the pNext chain passed at device creation */
+	bool timelineSemaphores = false;
+	/** @brief Set if the Vulkan 1.2 drawIndirectCount feature has been enabled in the pNext chain passed at device creation */
+	bool drawIndirectCount = false;
+	/** @brief List of extensions enabled at device creation */
+	std::vector<std::string> enabledExtensions;
 	/** @brief Contains queue family indices */
 	struct
 	{
@@ -54,9 +66,9 @@ struct VulkanDevice
 	~VulkanDevice();
 	uint32_t        getMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties, VkBool32 *memTypeFound = nullptr) const;
 	uint32_t        getQueueFamilyIndex(VkQueueFlags queueFlags) const;
-	VkResult        createLogicalDevice(VkPhysicalDeviceFeatures enabledFeatures, std::vector<const char *> enabledExtensions, void *pNextChain, bool useSwapChain = true, VkQueueFlags requestedQueueTypes = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+	VkResult        createLogicalDevice(VkPhysicalDeviceFeatures enabledFeatures, std::vector<const char *> enabledExtensions, void *pNextChain, bool useSwapChain = true, VkQueueFlags requestedQueueTypes = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT);
 	VkResult        createBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize size, VkBuffer *buffer, VkDeviceMemory *memory, void *data = nullptr);
-	VkResult        createBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, vks::Buffer *buffer, VkDeviceSize size, void *data = nullptr);
+	VkResult        createBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, vks::Buffer *buffer, VkDeviceSize size, void *data = nullptr, uint32_t allocationFlags = vks::MemoryAllocator::AllocationFlagsNone);
 	void            copyBuffer(vks::Buffer *src, vks::Buffer *dst, VkQueue queue, VkBufferCopy *copyRegion = nullptr);
 	VkCommandPool   createCommandPool(uint32_t queueFamilyIndex, VkCommandPoolCreateFlags createFlags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 	VkCommandBuffer createCommandBuffer(VkCommandBufferLevel level, VkCommandPool pool, bool begin = false);
@@ -64,6 +76,7 @@ struct VulkanDevice
 	void            flushCommandBuffer(VkCommandBuffer commandBuffer, VkQueue queue, VkCommandPool pool, bool free = true);
 	void            flushCommandBuffer(VkCommandBuffer commandBuffer, VkQueue queue, bool free = true);
 	bool            extensionSupported(std::string extension);
+	bool            extensionEnabled(std::string extension);
 	VkFormat        getSupportedDepthFormat(bool checkSamplingSupport);
 };
 }        // namespace vks
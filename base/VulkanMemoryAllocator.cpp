@@ -0,0 +1,447 @@
+/*
+* Vulkan device memory allocator
+*
+* Sub-allocates buffer and image memory from larger device memory blocks
+*
+* Copyright (C) 2016-2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanMemoryAllocator.h"
+
+namespace vks
+{
+	static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	/**
+	* Find a range inside the block that fits the requested size and alignment
+	*
+	* @param size Size of the allocation in bytes
+	* @param alignment Required alignment of the allocation's offset
+	* @param allocation Allocation to fill with the offset and range occupied in the block
+	*
+	* @return True if the block had enough space left
+	*/
+	bool MemoryBlock::allocate(VkDeviceSize size, VkDeviceSize alignment, Allocation* allocation)
+	{
+		if (linear)
+		{
+			// Linear strategy: bump the current offset, space is only reclaimed once all allocations of the block have been freed
+			const VkDeviceSize offset = alignUp(linearOffset, alignment);
+			if (offset + size > this->size)
+			{
+				return false;
+			}
+			allocation->offset = offset;
+			allocation->rangeOffset = linearOffset;
+			allocation->rangeSize = offset + size - linearOffset;
+			linearOffset = offset + size;
+			allocationCount++;
+			return true;
+		}
+
+		// Free-list strategy: pick the smallest free range that fits (best fit)
+		size_t bestIndex = freeRanges.size();
+		for (size_t i = 0; i < freeRanges.size(); i++)
+		{
+			const Range& range = freeRanges[i];
+			const VkDeviceSize offset = alignUp(range.offset, alignment);
+			if ((offset + size <= range.offset + range.size) && ((bestIndex == freeRanges.size()) || (range.size < freeRanges[bestIndex].size)))
+			{
+				bestIndex = i;
+			}
+		}
+		if (bestIndex == freeRanges.size())
+		{
+			return false;
+		}
+		Range& range = freeRanges[bestIndex];
+		const VkDeviceSize offset = alignUp(range.offset, alignment);
+		// Alignment padding at the front of the range stays with the allocation and is returned on free
+		allocation->offset = offset;
+		allocation->rangeOffset = range.offset;
+		allocation->rangeSize = offset + size - range.offset;
+		if (allocation->rangeSize == range.size)
+		{
+			freeRanges.erase(freeRanges.begin() + bestIndex);
+		}
+		else
+		{
+			range.offset += allocation->rangeSize;
+			range.size -= allocation->rangeSize;
+		}
+		allocationCount++;
+		return true;
+	}
+
+	/**
+	* Return the range of an allocation to the block
+	*/
+	void MemoryBlock::free(const Allocation& allocation)
+	{
+		assert(allocationCount > 0);
+		allocationCount--;
+		if (linear)
+		{
+			if (allocationCount == 0)
+			{
+				linearOffset = 0;
+			}
+			return;
+		}
+
+		// Insert the range sorted by offset and merge it with adjacent free ranges
+		Range range = { allocation.rangeOffset, allocation.rangeSize };
+		auto next = std::lower_bound(freeRanges.begin(), freeRanges.end(), range, [](const Range& a, const Range& b) { return a.offset < b.offset; });
+		if ((next != freeRanges.end()) && (range.offset + range.size == next->offset))
+		{
+			range.size += next->size;
+			next = freeRanges.erase(next);
+		}
+		if (next != freeRanges.begin())
+		{
+			auto prev = next - 1;
+			if (prev->offset + prev->size == range.offset)
+			{
+				prev->size += range.size;
+				return;
+			}
+		}
+		freeRanges.insert(next, range);
+	}
+
+	/**
+	* Initialize the allocator for the given device
+	*
+	* @param physicalDevice Physical device to read memory properties and limits from
+	* @param device Logical device to allocate memory from
+	*/
+	void MemoryAllocator::create(VkPhysicalDevice physicalDevice, VkDevice device)
+	{
+		this->device = device;
+		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+		VkPhysicalDeviceProperties deviceProperties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+		nonCoherentAtomSize = std::max(deviceProperties.limits.nonCoherentAtomSize, (VkDeviceSize)1);
+
+		pools.resize(memoryProperties.memoryTypeCount * PoolTypeCount);
+		for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+		{
+			// Use 64 MiB blocks by default, small heaps (e.g. the 256 MiB host visible device local heap found on many discrete GPUs) get proportionally smaller blocks
+			const VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[i].heapIndex].size;
+			VkDeviceSize blockSize = (preferredBlockSize > 0) ? preferredBlockSize : 64ull * 1024 * 1024;
+			if (heapSize <= 1024ull * 1024 * 1024)
+			{
+				blockSize = std::min(blockSize, alignUp(heapSize / 8, 32));
+			}
+			for (uint32_t j = 0; j < PoolTypeCount; j++)
+			{
+				pools[i * PoolTypeCount + j].blockSize = blockSize;
+			}
+		}
+	}
+
+	/**
+	* Release all memory blocks
+	*
+	* @note All resources placed in memory from this allocator must have been destroyed before calling this
+	*/
+	void MemoryAllocator::destroy()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto& pool : pools)
+		{
+			for (auto block : pool.blocks)
+			{
+				vkFreeMemory(device, block->memory, nullptr);
+				delete block;
+			}
+			pool.blocks.clear();
+		}
+		pools.clear();
+	}
+
+	uint32_t MemoryAllocator::findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties) const
+	{
+		for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+		{
+			if (((typeBits & (1 << i)) != 0) && ((memoryProperties.memoryTypes[i].propertyFlags & properties) == properties))
+			{
+				return i;
+			}
+		}
+		return VK_MAX_MEMORY_TYPES;
+	}
+
+	VkResult MemoryAllocator::allocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex, bool deviceAddress, VkDeviceMemory* memory, void** mapped)
+	{
+		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+		memAlloc.allocationSize = size;
+		memAlloc.memoryTypeIndex = memoryTypeIndex;
+		VkMemoryAllocateFlagsInfoKHR allocFlagsInfo{};
+		if (deviceAddress)
+		{
+			allocFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO_KHR;
+			allocFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
+			memAlloc.pNext = &allocFlagsInfo;
+		}
+		VkResult result = vkAllocateMemory(device, &memAlloc, nullptr, memory);
+		if (result != VK_SUCCESS)
+		{
+			return result;
+		}
+		// Host visible memory is mapped once and stays mapped, as a memory object can't be mapped more than once at a time
+		*mapped = nullptr;
+		if (memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		{
+			result = vkMapMemory(device, *memory, 0, VK_WHOLE_SIZE, 0, mapped);
+			if (result != VK_SUCCESS)
+			{
+				vkFreeMemory(device, *memory, nullptr);
+				*memory = VK_NULL_HANDLE;
+			}
+		}
+		return result;
+	}
+
+	VkResult MemoryAllocator::allocateDedicated(const VkMemoryRequirements& memoryRequirements, uint32_t memoryTypeIndex, bool deviceAddress, Allocation* allocation)
+	{
+		VkResult result = allocateDeviceMemory(memoryRequirements.size, memoryTypeIndex, deviceAddress, &allocation->memory, &allocation->mapped);
+		if (result != VK_SUCCESS)
+		{
+			return result;
+		}
+		allocation->offset = 0;
+		allocation->rangeOffset = 0;
+		allocation->rangeSize = memoryRequirements.size;
+		allocation->block = nullptr;
+		dedicatedAllocationCount++;
+		dedicatedBytes += memoryRequirements.size;
+		return VK_SUCCESS;
+	}
+
+	/**
+	* Allocate memory for a resource
+	*
+	* @param memoryRequirements Memory requirements of the resource
+	* @param memoryPropertyFlags Memory properties required for the resource
+	* @param allocation Pointer to the allocation to fill
+	* @param flags (Optional) Allocation flags (see AllocationFlags)
+	* @param optimalImage (Optional) Set to true for images with optimal tiling (placed in separate blocks to honor bufferImageGranularity)
+	* @param deviceAddress (Optional) Set to true for buffers using shader device addresses
+	*
+	* @return VK_SUCCESS if the memory has been allocated
+	*/
+	VkResult MemoryAllocator::allocate(const VkMemoryRequirements& memoryRequirements, VkMemoryPropertyFlags memoryPropertyFlags, Allocation* allocation, uint32_t flags, bool optimalImage, bool deviceAddress)
+	{
+		assert(device != VK_NULL_HANDLE);
+		const uint32_t memoryTypeIndex = findMemoryType(memoryRequirements.memoryTypeBits, memoryPropertyFlags);
+		if (memoryTypeIndex == VK_MAX_MEMORY_TYPES)
+		{
+			return VK_ERROR_FEATURE_NOT_PRESENT;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		*allocation = Allocation();
+		allocation->allocator = this;
+		allocation->memoryTypeIndex = memoryTypeIndex;
+		allocation->size = memoryRequirements.size;
+
+		PoolType poolType = PoolBuffers;
+		if (optimalImage)
+		{
+			poolType = PoolOptimalImages;
+		}
+		else if (deviceAddress)
+		{
+			poolType = PoolDeviceAddressBuffers;
+		}
+		else if (flags & Transient)
+		{
+			poolType = PoolTransient;
+		}
+		Pool& pool = pools[memoryTypeIndex * PoolTypeCount + poolType];
+
+		VkResult result = VK_SUCCESS;
+		if ((flags & Dedicated) || (memoryRequirements.size > pool.blockSize / 2))
+		{
+			result = allocateDedicated(memoryRequirements, memoryTypeIndex, deviceAddress, allocation);
+		}
+		else
+		{
+			// Non-coherent memory is flushed and invalidated in multiples of nonCoherentAtomSize, so keep allocations from sharing an atom
+			VkDeviceSize alignment = std::max(memoryRequirements.alignment, (VkDeviceSize)1);
+			if ((memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & (VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) == VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+			{
+				alignment = std::max(alignment, nonCoherentAtomSize);
+			}
+
+			MemoryBlock* block = nullptr;
+			for (auto poolBlock : pool.blocks)
+			{
+				if (poolBlock->allocate(memoryRequirements.size, alignment, allocation))
+				{
+					block = poolBlock;
+					break;
+				}
+			}
+			if (block == nullptr)
+			{
+				// No space left in the existing blocks, create a new one
+				MemoryBlock* newBlock = new MemoryBlock();
+				newBlock->size = pool.blockSize;
+				newBlock->linear = (poolType == PoolTransient);
+				newBlock->freeRanges.push_back({ 0, newBlock->size });
+				result = allocateDeviceMemory(newBlock->size, memoryTypeIndex, deviceAddress, &newBlock->memory, &newBlock->mapped);
+				if (result == VK_SUCCESS)
+				{
+					pool.blocks.push_back(newBlock);
+					block = newBlock;
+					block->allocate(memoryRequirements.size, alignment, allocation);
+				}
+				else
+				{
+					// Fall back to a dedicated allocation if a whole block doesn't fit into the heap anymore
+					delete newBlock;
+					result = allocateDedicated(memoryRequirements, memoryTypeIndex, deviceAddress, allocation);
+				}
+			}
+			if (block != nullptr)
+			{
+				allocation->block = block;
+				allocation->memory = block->memory;
+				allocation->mapped = block->mapped ? static_cast<char*>(block->mapped) + allocation->offset : nullptr;
+				wastedBytes += allocation->rangeSize - allocation->size;
+			}
+		}
+
+		if (result != VK_SUCCESS)
+		{
+			*allocation = Allocation();
+			return result;
+		}
+		allocationCount++;
+		usedBytes += allocation->size;
+		return VK_SUCCESS;
+	}
+
+	/**
+	* Allocate memory for a buffer
+	*
+	* @note The buffer still needs to be bound to allocation.memory at allocation.offset
+	*/
+	VkResult MemoryAllocator::allocateBufferMemory(VkBuffer buffer, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, Allocation* allocation, uint32_t flags)
+	{
+		VkMemoryRequirements memReqs;
+		vkGetBufferMemoryRequirements(device, buffer, &memReqs);
+		return allocate(memReqs, memoryPropertyFlags, allocation, flags, false, (usageFlags & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) != 0);
+	}
+
+	/**
+	* Allocate memory for an image
+	*
+	* @note The image still needs to be bound to allocation.memory at allocation.offset
+	*/
+	VkResult MemoryAllocator::allocateImageMemory(VkImage image, VkImageTiling tiling, VkMemoryPropertyFlags memoryPropertyFlags, Allocation* allocation, uint32_t flags)
+	{
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(device, image, &memReqs);
+		// Linear images may share blocks with buffers, as both are linear resources in terms of bufferImageGranularity
+		return allocate(memReqs, memoryPropertyFlags, allocation, flags & ~Transient, tiling == VK_IMAGE_TILING_OPTIMAL, false);
+	}
+
+	/**
+	* Return the memory of an allocation to the allocator
+	*
+	* @note Empty blocks are released, except for the last block of a pool to avoid allocating and freeing blocks over and over again
+	*/
+	void MemoryAllocator::free(Allocation* allocation)
+	{
+		if ((allocation->allocator != this) || (allocation->memory == VK_NULL_HANDLE))
+		{
+			return;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		allocationCount--;
+		usedBytes -= allocation->size;
+		MemoryBlock* block = allocation->block;
+		if (block == nullptr)
+		{
+			dedicatedAllocationCount--;
+			dedicatedBytes -= allocation->rangeSize;
+			vkFreeMemory(device, allocation->memory, nullptr);
+		}
+		else
+		{
+			wastedBytes -= allocation->rangeSize - allocation->size;
+			block->free(*allocation);
+			if (block->allocationCount == 0)
+			{
+				for (auto& pool : pools)
+				{
+					auto it = std::find(pool.blocks.begin(), pool.blocks.end(), block);
+					if (it != pool.blocks.end())
+					{
+						if (pool.blocks.size() > 1)
+						{
+							vkFreeMemory(device, block->memory, nullptr);
+							delete block;
+							pool.blocks.erase(it);
+						}
+						break;
+					}
+				}
+			}
+		}
+		*allocation = Allocation();
+	}
+
+	/**
+	* Get a memory range for flushing or invalidating (parts of) a host visible allocation
+	*
+	* @param allocation Allocation the range is part of
+	* @param size (Optional) Size of the range, VK_WHOLE_SIZE for the rest of the allocation
+	* @param offset (Optional) Offset of the range relative to the start of the allocation
+	*
+	* @return Range that's aligned to nonCoherentAtomSize and covers the requested range
+	*/
+	VkMappedMemoryRange MemoryAllocator::getMappedMemoryRange(const Allocation& allocation, VkDeviceSize size, VkDeviceSize offset) const
+	{
+		VkMappedMemoryRange mappedRange = vks::initializers::mappedMemoryRange();
+		mappedRange.memory = allocation.memory;
+		const VkDeviceSize memorySize = allocation.block ? allocation.block->size : allocation.rangeSize;
+		const VkDeviceSize start = (allocation.offset + offset) / nonCoherentAtomSize * nonCoherentAtomSize;
+		const VkDeviceSize end = alignUp((size == VK_WHOLE_SIZE) ? allocation.offset + allocation.size : allocation.offset + offset + size, nonCoherentAtomSize);
+		mappedRange.offset = start;
+		mappedRange.size = (end >= memorySize) ? VK_WHOLE_SIZE : end - start;
+		return mappedRange;
+	}
+
+	/**
+	* Get statistics on the memory currently allocated
+	*/
+	MemoryAllocator::Stats MemoryAllocator::getStats()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Stats stats;
+		stats.dedicatedAllocationCount = dedicatedAllocationCount;
+		stats.allocationCount = allocationCount;
+		stats.allocatedBytes = dedicatedBytes;
+		stats.usedBytes = usedBytes;
+		stats.wastedBytes = wastedBytes;
+		for (auto& pool : pools)
+		{
+			for (auto block : pool.blocks)
+			{
+				stats.blockCount++;
+				stats.allocatedBytes += block->size;
+			}
+		}
+		return stats;
+	}
+}
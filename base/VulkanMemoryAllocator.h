@@ -0,0 +1,147 @@
+/*
+* Vulkan device memory allocator
+*
+* Sub-allocates buffer and image memory from larger device memory blocks
+*
+* Copyright (C) 2016-2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	class MemoryAllocator;
+	struct MemoryBlock;
+
+	/**
+	* @brief A range of device memory handed out by the memory allocator
+	* @note Resources need to be bound at memory + offset
+	*/
+	struct Allocation
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		/** @brief Offset of the (aligned) allocation inside the device memory object */
+		VkDeviceSize offset = 0;
+		/** @brief Requested size of the allocation */
+		VkDeviceSize size = 0;
+		/** @brief Host pointer to the start of the allocation if the memory is host visible (memory blocks are persistently mapped) */
+		void* mapped = nullptr;
+		uint32_t memoryTypeIndex = 0;
+		/** @brief Allocator that owns this allocation, nullptr if the memory wasn't allocated through the allocator */
+		MemoryAllocator* allocator = nullptr;
+		/** @brief Block this allocation was taken from, nullptr for dedicated allocations */
+		MemoryBlock* block = nullptr;
+		/** @brief Range occupied inside the block including alignment padding (used to return the range on free) */
+		VkDeviceSize rangeOffset = 0;
+		VkDeviceSize rangeSize = 0;
+	};
+
+	/** @brief Device memory block that allocations are sub-allocated from */
+	struct MemoryBlock
+	{
+		struct Range
+		{
+			VkDeviceSize offset;
+			VkDeviceSize size;
+		};
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize size = 0;
+		void* mapped = nullptr;
+		bool linear = false;
+		uint32_t allocationCount = 0;
+		/** @brief Free ranges sorted by offset (free-list strategy) */
+		std::vector<Range> freeRanges;
+		/** @brief Current end of the used part of the block (linear strategy) */
+		VkDeviceSize linearOffset = 0;
+		bool allocate(VkDeviceSize size, VkDeviceSize alignment, Allocation* allocation);
+		void free(const Allocation& allocation);
+	};
+
+	/**
+	* @brief Sub-allocating device memory allocator
+	*
+	* Memory is allocated in large blocks per memory type and resources are placed inside these blocks. This keeps the number of device memory
+	* allocations low (implementations may only support a few thousand, see maxMemoryAllocationCount) and reduces the cost of creating resources.
+	*
+	* Each memory type has separate pools for buffers (and linear images), buffers using device addresses, optimal tiling images and transient
+	* (staging) buffers. Keeping linear and optimal resources in different blocks means that bufferImageGranularity never needs to be considered when
+	* placing resources. Transient allocations use a linear strategy that's reset once all allocations of a block have been freed, all other pools use
+	* a best fit free-list that merges adjacent free ranges.
+	* Allocations that are large compared to the block size (or explicitly requested to be dedicated) get their own device memory object.
+	*/
+	class MemoryAllocator
+	{
+	public:
+		enum AllocationFlags {
+			AllocationFlagsNone = 0x00000000,
+			/** @brief Always use a separate device memory allocation */
+			Dedicated = 0x00000001,
+			/** @brief Short lived allocation (e.g. staging buffers), uses a linear allocation strategy */
+			Transient = 0x00000002
+		};
+
+		struct Stats
+		{
+			/** @brief Number of device memory blocks used for sub-allocation */
+			uint32_t blockCount = 0;
+			/** @brief Number of allocations with their own device memory object */
+			uint32_t dedicatedAllocationCount = 0;
+			/** @brief Number of live allocations (including dedicated ones) */
+			uint32_t allocationCount = 0;
+			/** @brief Total size of device memory allocated (blocks and dedicated allocations) */
+			VkDeviceSize allocatedBytes = 0;
+			/** @brief Bytes requested by live allocations */
+			VkDeviceSize usedBytes = 0;
+			/** @brief Bytes lost to alignment padding */
+			VkDeviceSize wastedBytes = 0;
+		};
+
+		/** @brief Size of new memory blocks, defaults to 64 MiB (smaller for small heaps) if not set before calling create */
+		VkDeviceSize preferredBlockSize = 0;
+
+		void create(VkPhysicalDevice physicalDevice, VkDevice device);
+		void destroy();
+		VkResult allocate(const VkMemoryRequirements& memoryRequirements, VkMemoryPropertyFlags memoryPropertyFlags, Allocation* allocation, uint32_t flags = AllocationFlagsNone, bool optimalImage = false, bool deviceAddress = false);
+		VkResult allocateBufferMemory(VkBuffer buffer, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, Allocation* allocation, uint32_t flags = AllocationFlagsNone);
+		VkResult allocateImageMemory(VkImage image, VkImageTiling tiling, VkMemoryPropertyFlags memoryPropertyFlags, Allocation* allocation, uint32_t flags = AllocationFlagsNone);
+		void free(Allocation* allocation);
+		VkMappedMemoryRange getMappedMemoryRange(const Allocation& allocation, VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0) const;
+		Stats getStats();
+
+	private:
+		enum PoolType {
+			PoolBuffers = 0,
+			PoolDeviceAddressBuffers,
+			PoolOptimalImages,
+			PoolTransient,
+			PoolTypeCount
+		};
+		struct Pool
+		{
+			std::vector<MemoryBlock*> blocks;
+			VkDeviceSize blockSize = 0;
+		};
+		VkDevice device = VK_NULL_HANDLE;
+		VkPhysicalDeviceMemoryProperties memoryProperties{};
+		VkDeviceSize nonCoherentAtomSize = 1;
+		std::vector<Pool> pools;
+		std::mutex mutex;
+		// Counters for the statistics
+		uint32_t dedicatedAllocationCount = 0;
+		uint32_t allocationCount = 0;
+		VkDeviceSize dedicatedBytes = 0;
+		VkDeviceSize usedBytes = 0;
+		VkDeviceSize wastedBytes = 0;
+		uint32_t findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties) const;
+		VkResult allocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex, bool deviceAddress, VkDeviceMemory* memory, void** mapped);
+		VkResult allocateDedicated(const VkMemoryRequirements& memoryRequirements, uint32_t memoryTypeIndex, bool deviceAddress, Allocation* allocation);
+	};
+}
@@ -0,0 +1,173 @@
+/*
+* Vulkan GPU profiler
+*
+* Measures the GPU time of named command buffer regions with timestamp queries
+*
+* Copyright (C) 2016-2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanProfiler.h"
+
+namespace vks
+{
+	/**
+	* Create the timestamp query pools
+	*
+	* @param device Logical device to create the query pools on
+	* @param deviceProperties Properties of the physical device (for the timestamp period)
+	* @param timestampValidBits Number of valid timestamp bits of the queue the command buffers are submitted to
+	* @param slotCount Number of frames in flight or pre-recorded command buffers
+	* @param maxScopes Maximum number of scopes per slot
+	* @param hostQueryReset If true, pools are reset on the host (requires the hostQueryReset feature to be enabled for the device)
+	*/
+	void GpuProfiler::create(VkDevice device, const VkPhysicalDeviceProperties& deviceProperties, uint32_t timestampValidBits, uint32_t slotCount, uint32_t maxScopes, bool hostQueryReset)
+	{
+		enabled = (timestampValidBits > 0) && (deviceProperties.limits.timestampPeriod > 0.0f);
+		if (!enabled)
+		{
+			return;
+		}
+		this->maxScopes = maxScopes;
+		timestampPeriod = deviceProperties.limits.timestampPeriod;
+		timestampMask = (timestampValidBits >= 64) ? ~0ull : ((1ull << timestampValidBits) - 1);
+		slots.resize(slotCount);
+		// Each scope uses a pair of timestamps
+		queryRing.create(device, VK_QUERY_TYPE_TIMESTAMP, maxScopes * 2, slotCount, 0, hostQueryReset);
+	}
+
+	void GpuProfiler::destroy()
+	{
+		if (enabled)
+		{
+			queryRing.destroy();
+		}
+		slots.clear();
+		scopes.clear();
+		enabled = false;
+	}
+
+	uint32_t GpuProfiler::getScopeIndex(const std::string& name)
+	{
+		for (uint32_t i = 0; i < static_cast<uint32_t>(scopes.size()); i++)
+		{
+			if (scopes[i].name == name)
+			{
+				return i;
+			}
+		}
+		Scope scope;
+		scope.name = name;
+		scopes.push_back(scope);
+		return static_cast<uint32_t>(scopes.size() - 1);
+	}
+
+	/**
+	* Start recording scopes for a slot, discards the scopes previously recorded for that slot
+	*
+	* @note Must be recorded outside of a render pass, as it may reset the slot's query pool
+	*/
+	void GpuProfiler::beginFrame(VkCommandBuffer commandBuffer, uint32_t slot)
+	{
+		if (!enabled || slot >= slots.size())
+		{
+			return;
+		}
+		slots[slot].recordedScopes.clear();
+		slots[slot].openScopes.clear();
+		queryRing.cmdReset(commandBuffer, slot);
+	}
+
+	/** @brief Begin a named scope, scopes can be nested and scopes with the same name share their timings */
+	void GpuProfiler::beginScope(VkCommandBuffer commandBuffer, uint32_t slot, const std::string& name)
+	{
+		if (!enabled || slot >= slots.size())
+		{
+			return;
+		}
+		Slot& currentSlot = slots[slot];
+		if (currentSlot.recordedScopes.size() >= maxScopes)
+		{
+			// Keep the begin/end calls balanced, the scope is not measured
+			currentSlot.openScopes.push_back(UINT32_MAX);
+			return;
+		}
+		const uint32_t firstQuery = static_cast<uint32_t>(currentSlot.recordedScopes.size()) * 2;
+		currentSlot.openScopes.push_back(static_cast<uint32_t>(currentSlot.recordedScopes.size()));
+		currentSlot.recordedScopes.push_back({ getScopeIndex(name), firstQuery });
+		queryRing.cmdWriteTimestamp(commandBuffer, slot, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, firstQuery);
+	}
+
+	void GpuProfiler::endScope(VkCommandBuffer commandBuffer, uint32_t slot)
+	{
+		if (!enabled || slot >= slots.size() || slots[slot].openScopes.empty())
+		{
+			return;
+		}
+		Slot& currentSlot = slots[slot];
+		const uint32_t recordedScope = currentSlot.openScopes.back();
+		currentSlot.openScopes.pop_back();
+		if (recordedScope != UINT32_MAX)
+		{
+			queryRing.cmdWriteTimestamp(commandBuffer, slot, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, currentSlot.recordedScopes[recordedScope].firstQuery + 1);
+		}
+	}
+
+	/** @brief Needs to be called after the command buffer of a slot has been submitted */
+	void GpuProfiler::markSubmitted(uint32_t slot)
+	{
+		if (enabled && slot < slots.size())
+		{
+			slots[slot].submitted = true;
+		}
+	}
+
+	/**
+	* Read the timestamps of a slot's last submission and update the times of the recorded scopes
+	*
+	* @param slot Slot whose last submission has finished executing on the GPU
+	*
+	* @return True if new times were read
+	*/
+	bool GpuProfiler::resolve(uint32_t slot)
+	{
+		for (Scope& scope : scopes)
+		{
+			scope.updated = false;
+		}
+		if (!enabled || slot >= slots.size() || !slots[slot].submitted || slots[slot].recordedScopes.empty())
+		{
+			return false;
+		}
+		if (!queryRing.readResults(slot))
+		{
+			return false;
+		}
+		// Sum up the times of scopes that have been recorded multiple times in a frame
+		std::vector<double> times(scopes.size(), 0.0);
+		std::vector<bool> measured(scopes.size(), false);
+		for (const RecordedScope& recordedScope : slots[slot].recordedScopes)
+		{
+			if (!queryRing.isAvailable(recordedScope.firstQuery) || !queryRing.isAvailable(recordedScope.firstQuery + 1))
+			{
+				continue;
+			}
+			const uint64_t delta = (queryRing.getResult(recordedScope.firstQuery + 1) - queryRing.getResult(recordedScope.firstQuery)) & timestampMask;
+			times[recordedScope.scopeIndex] += (double)delta * timestampPeriod / 1000000.0;
+			measured[recordedScope.scopeIndex] = true;
+		}
+		for (size_t i = 0; i < scopes.size(); i++)
+		{
+			if (!measured[i])
+			{
+				continue;
+			}
+			Scope& scope = scopes[i];
+			scope.averageTime = (scope.averageTime == 0.0) ? times[i] : scope.averageTime + (times[i] - scope.averageTime) * smoothing;
+			scope.time = times[i];
+			scope.updated = true;
+		}
+		return true;
+	}
+}
@@ -0,0 +1,90 @@
+/*
+* Vulkan GPU profiler
+*
+* Measures the GPU time of named command buffer regions with timestamp queries
+*
+* Copyright (C) 2016-2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanQueryRing.h"
+
+namespace vks
+{
+	/**
+	* @brief Scoped GPU profiler based on timestamp queries
+	*
+	* Named regions of a command buffer (e.g. shadow pass, G-Buffer, SSAO, composition, UI) are enclosed in timestamp pairs. Timestamps are written to
+	* a query ring with one pool per slot, where a slot is either a frame in flight or a pre-recorded command buffer. The timestamps of a slot are
+	* resolved once that slot's last submission has finished (e.g. in prepareFrame), so reading them never stalls the CPU.
+	*
+	* Timestamp differences are masked with the queue's timestampValidBits and converted to milliseconds using the device's timestampPeriod.
+	* If the queue doesn't support timestamps, the profiler is disabled and all recording functions are no-ops.
+	*
+	* Usage when recording the command buffer for a slot:
+	*   profiler.beginFrame(commandBuffer, slot);            // Outside of a render pass
+	*   profiler.beginScope(commandBuffer, slot, "G-Buffer");
+	*   ...
+	*   profiler.endScope(commandBuffer, slot);
+	*/
+	class GpuProfiler
+	{
+	public:
+		struct Scope
+		{
+			std::string name;
+			/** @brief Time of the last resolved frame in ms */
+			double time = 0.0;
+			/** @brief Exponential moving average of the time in ms, used for display */
+			double averageTime = 0.0;
+			/** @brief Set if the last call to resolve read a new time for this scope */
+			bool updated = false;
+		};
+
+		/** @brief Weight of a new sample for the moving average */
+		double smoothing = 0.05;
+
+		void create(VkDevice device, const VkPhysicalDeviceProperties& deviceProperties, uint32_t timestampValidBits, uint32_t slotCount, uint32_t maxScopes = 32, bool hostQueryReset = false);
+		void destroy();
+		void beginFrame(VkCommandBuffer commandBuffer, uint32_t slot);
+		void beginScope(VkCommandBuffer commandBuffer, uint32_t slot, const std::string& name);
+		void endScope(VkCommandBuffer commandBuffer, uint32_t slot);
+		void markSubmitted(uint32_t slot);
+		bool resolve(uint32_t slot);
+		/** @brief Returns all scopes in the order they were first recorded */
+		const std::vector<Scope>& getScopes() const { return scopes; }
+		/** @brief Returns true if the profiler has been created and the queue supports timestamps */
+		bool isEnabled() const { return enabled; }
+
+	private:
+		struct RecordedScope
+		{
+			uint32_t scopeIndex;
+			uint32_t firstQuery;
+		};
+		struct Slot
+		{
+			// Scopes recorded into the slot's command buffer (in recording order)
+			std::vector<RecordedScope> recordedScopes;
+			// Indices into recordedScopes of scopes that have been begun but not ended yet
+			std::vector<uint32_t> openScopes;
+			// The slot's timestamps are only read once its command buffer has been submitted
+			bool submitted = false;
+		};
+		bool enabled = false;
+		uint32_t maxScopes = 0;
+		double timestampPeriod = 1.0;
+		uint64_t timestampMask = ~0ull;
+		vks::QueryRing queryRing;
+		std::vector<Slot> slots;
+		std::vector<Scope> scopes;
+		uint32_t getScopeIndex(const std::string& name);
+	};
+}
@@ -0,0 +1,151 @@
+/*
+* Vulkan query ring
+*
+* Per-frame query pools with non-blocking readback of occlusion, pipeline statistics and timestamp queries
+*
+* Copyright (C) 2016-2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <algorithm>
+
+#include "VulkanQueryRing.h"
+
+namespace vks
+{
+	/**
+	* Create one query pool per frame in flight
+	*
+	* @param device Logical device to create the query pools on
+	* @param queryType Type of the queries (occlusion, pipeline statistics or timestamp)
+	* @param queryCount Number of queries per frame
+	* @param frameCount Number of frames in flight (number of pools in the ring)
+	* @param pipelineStatistics Statistics counters to collect for pipeline statistics queries
+	* @param hostQueryReset If true, pools are reset on the host (requires the hostQueryReset feature to be enabled for the device)
+	*/
+	void QueryRing::create(VkDevice device, VkQueryType queryType, uint32_t queryCount, uint32_t frameCount, VkQueryPipelineStatisticFlags pipelineStatistics, bool hostQueryReset)
+	{
+		this->device = device;
+		this->queryCount = queryCount;
+		valuesPerQuery = 1;
+		if (queryType == VK_QUERY_TYPE_PIPELINE_STATISTICS)
+		{
+			// One value per enabled statistics counter
+			valuesPerQuery = 0;
+			for (VkQueryPipelineStatisticFlags flags = pipelineStatistics; flags != 0; flags &= flags - 1)
+			{
+				valuesPerQuery++;
+			}
+		}
+		results.assign(queryCount * valuesPerQuery, 0);
+		readback.resize(queryCount * (valuesPerQuery + 1));
+		availability.assign(queryCount, 0);
+		resultsAvailable = false;
+
+		if (hostQueryReset)
+		{
+			// Core in Vulkan 1.2, the extension entry point is an alias
+			vkResetQueryPoolEXT = reinterpret_cast<PFN_vkResetQueryPoolEXT>(vkGetDeviceProcAddr(device, "vkResetQueryPoolEXT"));
+			if (!vkResetQueryPoolEXT)
+			{
+				vkResetQueryPoolEXT = reinterpret_cast<PFN_vkResetQueryPoolEXT>(vkGetDeviceProcAddr(device, "vkResetQueryPool"));
+			}
+		}
+
+		VkQueryPoolCreateInfo queryPoolInfo{};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = queryType;
+		queryPoolInfo.queryCount = queryCount;
+		queryPoolInfo.pipelineStatistics = pipelineStatistics;
+		frames.resize(frameCount);
+		for (Frame& frame : frames)
+		{
+			VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &frame.queryPool));
+			// Queries need to be reset before their first use
+			if (vkResetQueryPoolEXT)
+			{
+				vkResetQueryPoolEXT(device, frame.queryPool, 0, queryCount);
+			}
+		}
+	}
+
+	void QueryRing::destroy()
+	{
+		for (Frame& frame : frames)
+		{
+			vkDestroyQueryPool(device, frame.queryPool, nullptr);
+		}
+		frames.clear();
+	}
+
+	/**
+	* Read the results of the queries last recorded for a frame without waiting for them
+	*
+	* @param frameIndex Frame whose pool is about to be reused, the GPU should have finished the last submission of that frame's work (e.g. its fence has been waited on)
+	*
+	* @return True if any results were available
+	*/
+	bool QueryRing::readResults(uint32_t frameIndex)
+	{
+		Frame& frame = frames[frameIndex];
+		if (!frame.used)
+		{
+			return false;
+		}
+		// Each query returns its values followed by an availability value, VK_NOT_READY is returned if any query is not available
+		const uint32_t stride = valuesPerQuery + 1;
+		VkResult result = vkGetQueryPoolResults(device, frame.queryPool, 0, queryCount, readback.size() * sizeof(uint64_t), readback.data(), stride * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+		if (result != VK_NOT_READY)
+		{
+			VK_CHECK_RESULT(result);
+		}
+		bool updated = false;
+		for (uint32_t query = 0; query < queryCount; query++)
+		{
+			const uint64_t* values = &readback[query * stride];
+			availability[query] = (values[valuesPerQuery] != 0) ? 1 : 0;
+			if (availability[query])
+			{
+				std::copy(values, values + valuesPerQuery, &results[query * valuesPerQuery]);
+				updated = true;
+			}
+		}
+		resultsAvailable |= updated;
+		if (vkResetQueryPoolEXT)
+		{
+			vkResetQueryPoolEXT(device, frame.queryPool, 0, queryCount);
+		}
+		return updated;
+	}
+
+	/**
+	* Record the reset of a frame's query pool, this is a no-op if host query reset is used
+	*
+	* @note Must be recorded outside of a render pass
+	*/
+	void QueryRing::cmdReset(VkCommandBuffer commandBuffer, uint32_t frameIndex)
+	{
+		if (!vkResetQueryPoolEXT)
+		{
+			vkCmdResetQueryPool(commandBuffer, frames[frameIndex].queryPool, 0, queryCount);
+		}
+	}
+
+	void QueryRing::cmdBeginQuery(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t query, VkQueryControlFlags flags)
+	{
+		vkCmdBeginQuery(commandBuffer, frames[frameIndex].queryPool, query, flags);
+		frames[frameIndex].used = true;
+	}
+
+	void QueryRing::cmdEndQuery(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t query)
+	{
+		vkCmdEndQuery(commandBuffer, frames[frameIndex].queryPool, query);
+	}
+
+	void QueryRing::cmdWriteTimestamp(VkCommandBuffer commandBuffer, uint32_t frameIndex, VkPipelineStageFlagBits pipelineStage, uint32_t query)
+	{
+		vkCmdWriteTimestamp(commandBuffer, pipelineStage, frames[frameIndex].queryPool, query);
+		frames[frameIndex].used = true;
+	}
+}
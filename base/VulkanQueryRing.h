@@ -0,0 +1,76 @@
+/*
+* Vulkan query ring
+*
+* Per-frame query pools with non-blocking readback of occlusion, pipeline statistics and timestamp queries
+*
+* Copyright (C) 2016-2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	/**
+	* @brief Ring of query pools, one per frame in flight
+	*
+	* Queries recorded for a frame are written to that frame's pool. Results are read once the frame's pool is about to be reused, i.e. after
+	* the fence of that frame has been waited on, so the results are maxFramesInFlight frames old and reading them never stalls the CPU.
+	* Results are fetched with VK_QUERY_RESULT_WITH_AVAILABILITY_BIT instead of VK_QUERY_RESULT_WAIT_BIT, queries that are not (yet) available
+	* keep their last known value.
+	*
+	* If host query reset is enabled (VK_EXT_host_query_reset or Vulkan 1.2), pools are reset on the host at creation and right after their results
+	* have been read, otherwise cmdReset needs to be recorded before the first query of a frame (outside of a render pass). As no state changes at
+	* record time, this also works with command buffers that are recorded once and submitted repeatedly (one pool per command buffer).
+	*
+	* Usage per frame (after the frame's fence has been waited on, e.g. after prepareFrame with multiple frames in flight):
+	*   queryRing.readResults(currentFrame);
+	*   queryRing.cmdReset(commandBuffer, currentFrame);
+	*   queryRing.cmdBeginQuery(commandBuffer, currentFrame, 0); ... queryRing.cmdEndQuery(commandBuffer, currentFrame, 0);
+	*/
+	class QueryRing
+	{
+	public:
+		void create(VkDevice device, VkQueryType queryType, uint32_t queryCount, uint32_t frameCount, VkQueryPipelineStatisticFlags pipelineStatistics = 0, bool hostQueryReset = false);
+		void destroy();
+		bool readResults(uint32_t frameIndex);
+		void cmdReset(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+		void cmdBeginQuery(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t query, VkQueryControlFlags flags = 0);
+		void cmdEndQuery(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t query);
+		void cmdWriteTimestamp(VkCommandBuffer commandBuffer, uint32_t frameIndex, VkPipelineStageFlagBits pipelineStage, uint32_t query);
+		/** @brief Returns a value of the latest available result for a query (for pipeline statistics, value is the index of the enabled statistic) */
+		uint64_t getResult(uint32_t query, uint32_t value = 0) const { return results[query * valuesPerQuery + value]; }
+		/** @brief Latest available results of all queries, valuesPerQuery values per query */
+		const std::vector<uint64_t>& getResults() const { return results; }
+		uint32_t getQueryCount() const { return queryCount; }
+		uint32_t getValuesPerQuery() const { return valuesPerQuery; }
+		/** @brief Returns true if the query was available during the last call to readResults */
+		bool isAvailable(uint32_t query) const { return availability[query] != 0; }
+		/** @brief Returns true once at least one result has been read back */
+		bool hasResults() const { return resultsAvailable; }
+
+	private:
+		struct Frame
+		{
+			VkQueryPool queryPool = VK_NULL_HANDLE;
+			// Set once queries have been recorded for this frame, the pool is not read before that
+			bool used = false;
+		};
+		VkDevice device = VK_NULL_HANDLE;
+		uint32_t queryCount = 0;
+		uint32_t valuesPerQuery = 1;
+		std::vector<Frame> frames;
+		std::vector<uint64_t> results;
+		// Readback staging area with an additional availability value per query
+		std::vector<uint64_t> readback;
+		std::vector<uint8_t> availability;
+		bool resultsAvailable = false;
+		PFN_vkResetQueryPoolEXT vkResetQueryPoolEXT = nullptr;
+	};
+}
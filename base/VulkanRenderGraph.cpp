@@ -0,0 +1,607 @@
+/*
+* Vulkan render graph
+*
+* Declarative frame graph for offscreen passes with automatic barriers, pass culling and transient attachment aliasing
+*
+* Copyright (C) 2016-2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <algorithm>
+#include <cassert>
+
+#include "VulkanRenderGraph.h"
+#include "VulkanInitializers.hpp"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	void RenderGraph::Pass::addColorOutput(uint32_t image)
+	{
+		colorOutputs.push_back(image);
+	}
+
+	void RenderGraph::Pass::setDepthStencilOutput(uint32_t image)
+	{
+		depthStencilOutput = image;
+	}
+
+	void RenderGraph::Pass::addSampledInput(uint32_t image, VkPipelineStageFlags stageMask)
+	{
+		sampledInputs.push_back({ image, stageMask });
+	}
+
+	void RenderGraph::Pass::setRecordFunction(std::function<void(VkCommandBuffer)> function)
+	{
+		recordFunction = function;
+	}
+
+	/** @brief Declare a transient image, returns the handle used to reference the image in passes */
+	uint32_t RenderGraph::addImage(const std::string& name, const ImageInfo& imageInfo)
+	{
+		Image image;
+		image.name = name;
+		image.info = imageInfo;
+		images.push_back(image);
+		return static_cast<uint32_t>(images.size() - 1);
+	}
+
+	/** @brief Add a pass, passes are executed in the order they have been added */
+	RenderGraph::Pass& RenderGraph::addPass(const std::string& name)
+	{
+		passes.push_back(Pass());
+		passes.back().name = name;
+		return passes.back();
+	}
+
+	void RenderGraph::addOutput(uint32_t image)
+	{
+		images[image].output = true;
+	}
+
+	/**
+	* Cull unused passes, create all Vulkan objects for the remaining passes and derive their barriers
+	*
+	* @param device Device to create the images, render passes and framebuffers on, image memory is allocated with its memory allocator
+	*/
+	void RenderGraph::compile(vks::VulkanDevice* device)
+	{
+		// A graph may be compiled again (e.g. after changing aliasing), everything derived by a previous compile is released first
+		releaseResources();
+		this->device = device;
+		cullPasses();
+		collectAccesses();
+		createImages();
+		allocateMemory();
+		createRenderPasses();
+		deriveBarriers();
+	}
+
+	// Walk the passes backwards starting at the outputs, a pass is live if any of the images it renders to is used later on
+	void RenderGraph::cullPasses()
+	{
+		for (Image& image : images)
+		{
+			image.used = image.output;
+		}
+		for (size_t p = passes.size(); p-- > 0;)
+		{
+			Pass& pass = passes[p];
+			bool live = false;
+			for (uint32_t image : pass.colorOutputs)
+			{
+				live |= images[image].used;
+			}
+			if (pass.depthStencilOutput != UINT32_MAX)
+			{
+				live |= images[pass.depthStencilOutput].used;
+			}
+			pass.culled = !live;
+			if (!live)
+			{
+				stats.culledPassCount++;
+				continue;
+			}
+			// All attachments of a live pass are needed, as are the images it samples and the passes writing them
+			for (uint32_t image : pass.colorOutputs)
+			{
+				images[image].used = true;
+			}
+			if (pass.depthStencilOutput != UINT32_MAX)
+			{
+				images[pass.depthStencilOutput].used = true;
+			}
+			for (const Pass::SampledInput& input : pass.sampledInputs)
+			{
+				images[input.image].used = true;
+			}
+		}
+		stats.passCount = static_cast<uint32_t>(passes.size()) - stats.culledPassCount;
+	}
+
+	void RenderGraph::collectAccesses()
+	{
+		for (uint32_t p = 0; p < static_cast<uint32_t>(passes.size()); p++)
+		{
+			const Pass& pass = passes[p];
+			if (pass.culled)
+			{
+				continue;
+			}
+			std::vector<std::pair<uint32_t, Access>> passAccesses;
+			for (const Pass::SampledInput& input : pass.sampledInputs)
+			{
+				passAccesses.push_back({ input.image, { p, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, input.stageMask, VK_ACCESS_SHADER_READ_BIT, false } });
+				images[input.image].usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+			}
+			for (uint32_t image : pass.colorOutputs)
+			{
+				passAccesses.push_back({ image, { p, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, true } });
+				images[image].usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+				images[image].aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			}
+			if (pass.depthStencilOutput != UINT32_MAX)
+			{
+				Image& image = images[pass.depthStencilOutput];
+				passAccesses.push_back({ pass.depthStencilOutput, { p, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, true } });
+				image.usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+				image.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+				if (vks::tools::formatHasStencil(image.info.format))
+				{
+					image.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+				}
+			}
+			for (const auto& passAccess : passAccesses)
+			{
+				Image& image = images[passAccess.first];
+				// An image can't be sampled and rendered to in the same pass
+				assert(image.accesses.empty() || (image.accesses.back().passIndex != p));
+				image.accesses.push_back(passAccess.second);
+				image.firstPass = std::min(image.firstPass, p);
+				image.lastPass = std::max(image.lastPass, p);
+			}
+		}
+		for (Image& image : images)
+		{
+			if (!image.used)
+			{
+				continue;
+			}
+			// Images need to be written before they can be read
+			assert(!image.accesses.empty() && image.accesses.front().write);
+			const Access& lastAccess = image.accesses.back();
+			if (image.output)
+			{
+				image.usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+				image.lastPass = static_cast<uint32_t>(passes.size());
+				image.finalStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+				image.finalWriteAccessMask = 0;
+			}
+			else
+			{
+				image.finalStageMask = lastAccess.stageMask;
+				image.finalWriteAccessMask = lastAccess.write ? lastAccess.accessMask : 0;
+			}
+		}
+	}
+
+	void RenderGraph::createImages()
+	{
+		for (Image& image : images)
+		{
+			if (!image.used)
+			{
+				continue;
+			}
+			VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+			imageCI.imageType = VK_IMAGE_TYPE_2D;
+			imageCI.format = image.info.format;
+			imageCI.extent = { image.info.width, image.info.height, 1 };
+			imageCI.mipLevels = 1;
+			imageCI.arrayLayers = 1;
+			imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageCI.usage = image.usage;
+			imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCI, nullptr, &image.image));
+			vkGetImageMemoryRequirements(device->logicalDevice, image.image, &image.memoryRequirements);
+			stats.imageCount++;
+			stats.unaliasedMemorySize += image.memoryRequirements.size;
+		}
+	}
+
+	bool RenderGraph::lifetimesOverlap(const Image& a, const Image& b) const
+	{
+		if (!aliasing)
+		{
+			return true;
+		}
+		return (a.firstPass <= b.lastPass) && (b.firstPass <= a.lastPass);
+	}
+
+	bool RenderGraph::memoryOverlaps(const Image& a, const Image& b) const
+	{
+		return (a.heap == b.heap) && (a.offset < b.offset + b.memoryRequirements.size) && (b.offset < a.offset + a.memoryRequirements.size);
+	}
+
+	/*
+		Images are placed largest first at the lowest offset that doesn't overlap any already placed image whose lifetime overlaps its own
+		Images with incompatible memory types are placed in separate heaps
+	*/
+	void RenderGraph::allocateMemory()
+	{
+		std::vector<uint32_t> order;
+		for (uint32_t i = 0; i < static_cast<uint32_t>(images.size()); i++)
+		{
+			if (images[i].used)
+			{
+				order.push_back(i);
+			}
+		}
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return images[a].memoryRequirements.size > images[b].memoryRequirements.size; });
+
+		for (uint32_t index : order)
+		{
+			Image& image = images[index];
+			const VkMemoryRequirements& memReqs = image.memoryRequirements;
+			uint32_t heapIndex = 0;
+			while ((heapIndex < heaps.size()) && ((heaps[heapIndex].memoryTypeBits & memReqs.memoryTypeBits) == 0))
+			{
+				heapIndex++;
+			}
+			if (heapIndex == heaps.size())
+			{
+				heaps.push_back(Heap());
+			}
+			Heap& heap = heaps[heapIndex];
+			// Move the image past all conflicting images until there is no conflict left, the offset only ever increases
+			VkDeviceSize offset = 0;
+			bool moved = true;
+			while (moved)
+			{
+				moved = false;
+				for (uint32_t other : heap.images)
+				{
+					const Image& otherImage = images[other];
+					const VkDeviceSize otherEnd = otherImage.offset + otherImage.memoryRequirements.size;
+					if (lifetimesOverlap(image, otherImage) && (offset < otherEnd) && (otherImage.offset < offset + memReqs.size))
+					{
+						offset = (otherEnd + memReqs.alignment - 1) / memReqs.alignment * memReqs.alignment;
+						moved = true;
+					}
+				}
+			}
+			image.heap = heapIndex;
+			image.offset = offset;
+			heap.images.push_back(index);
+			heap.memoryTypeBits &= memReqs.memoryTypeBits;
+			heap.alignment = std::max(heap.alignment, memReqs.alignment);
+			heap.size = std::max(heap.size, offset + memReqs.size);
+		}
+
+		for (Heap& heap : heaps)
+		{
+			VkMemoryRequirements memReqs{};
+			memReqs.size = heap.size;
+			memReqs.alignment = heap.alignment;
+			memReqs.memoryTypeBits = heap.memoryTypeBits;
+			VK_CHECK_RESULT(device->memoryAllocator.allocate(memReqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &heap.allocation, vks::MemoryAllocator::AllocationFlagsNone, true));
+			stats.memorySize += heap.size;
+			for (uint32_t index : heap.images)
+			{
+				Image& image = images[index];
+				VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image.image, heap.allocation.memory, heap.allocation.offset + image.offset));
+				VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+				viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+				viewCI.format = image.info.format;
+				viewCI.subresourceRange = { image.aspectMask, 0, 1, 0, 1 };
+				// Depth/stencil images are sampled through their depth aspect
+				if (image.aspectMask & VK_IMAGE_ASPECT_DEPTH_BIT)
+				{
+					viewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+				}
+				viewCI.image = image.image;
+				VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCI, nullptr, &image.view));
+			}
+		}
+	}
+
+	/*
+		Render passes use the layouts of the attachment accesses as their initial and final layouts, so they don't do any layout transitions
+		All synchronization with other passes is done by the barriers recorded before the render pass
+	*/
+	void RenderGraph::createRenderPasses()
+	{
+		for (uint32_t p = 0; p < static_cast<uint32_t>(passes.size()); p++)
+		{
+			Pass& pass = passes[p];
+			if (pass.culled)
+			{
+				continue;
+			}
+			std::vector<uint32_t> attachmentImages = pass.colorOutputs;
+			if (pass.depthStencilOutput != UINT32_MAX)
+			{
+				attachmentImages.push_back(pass.depthStencilOutput);
+			}
+			assert(!attachmentImages.empty());
+			pass.width = images[attachmentImages[0]].info.width;
+			pass.height = images[attachmentImages[0]].info.height;
+
+			std::vector<VkAttachmentDescription> attachmentDescs;
+			std::vector<VkImageView> attachmentViews;
+			pass.clearValues.clear();
+			for (uint32_t image : attachmentImages)
+			{
+				const Image& attachmentImage = images[image];
+				assert((attachmentImage.info.width == pass.width) && (attachmentImage.info.height == pass.height));
+				// Position of this pass's access in the image's accesses
+				size_t accessIndex = 0;
+				while (attachmentImage.accesses[accessIndex].passIndex != p)
+				{
+					accessIndex++;
+				}
+				bool writtenBefore = false;
+				for (size_t i = 0; i < accessIndex; i++)
+				{
+					writtenBefore |= attachmentImage.accesses[i].write;
+				}
+				const bool usedAfter = attachmentImage.output || (accessIndex + 1 < attachmentImage.accesses.size());
+				const VkImageLayout layout = attachmentImage.accesses[accessIndex].layout;
+
+				VkAttachmentDescription attachmentDesc{};
+				attachmentDesc.format = attachmentImage.info.format;
+				attachmentDesc.samples = VK_SAMPLE_COUNT_1_BIT;
+				attachmentDesc.loadOp = writtenBefore ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+				attachmentDesc.storeOp = usedAfter ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+				attachmentDesc.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+				attachmentDesc.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+				if (attachmentImage.aspectMask & VK_IMAGE_ASPECT_STENCIL_BIT)
+				{
+					attachmentDesc.stencilLoadOp = attachmentDesc.loadOp;
+					attachmentDesc.stencilStoreOp = attachmentDesc.storeOp;
+				}
+				attachmentDesc.initialLayout = layout;
+				attachmentDesc.finalLayout = layout;
+				attachmentDescs.push_back(attachmentDesc);
+				attachmentViews.push_back(attachmentImage.view);
+				pass.clearValues.push_back(attachmentImage.info.clearValue);
+			}
+
+			std::vector<VkAttachmentReference> colorReferences;
+			for (uint32_t i = 0; i < static_cast<uint32_t>(pass.colorOutputs.size()); i++)
+			{
+				colorReferences.push_back({ i, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
+			}
+			VkAttachmentReference depthReference = { static_cast<uint32_t>(pass.colorOutputs.size()), VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+			VkSubpassDescription subpass = {};
+			subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+			subpass.colorAttachmentCount = static_cast<uint32_t>(colorReferences.size());
+			subpass.pColorAttachments = colorReferences.data();
+			subpass.pDepthStencilAttachment = (pass.depthStencilOutput != UINT32_MAX) ? &depthReference : nullptr;
+
+			VkRenderPassCreateInfo renderPassCI = vks::initializers::renderPassCreateInfo();
+			renderPassCI.attachmentCount = static_cast<uint32_t>(attachmentDescs.size());
+			renderPassCI.pAttachments = attachmentDescs.data();
+			renderPassCI.subpassCount = 1;
+			renderPassCI.pSubpasses = &subpass;
+			VK_CHECK_RESULT(vkCreateRenderPass(device->logicalDevice, &renderPassCI, nullptr, &pass.renderPass));
+
+			VkFramebufferCreateInfo framebufferCI = vks::initializers::framebufferCreateInfo();
+			framebufferCI.renderPass = pass.renderPass;
+			framebufferCI.attachmentCount = static_cast<uint32_t>(attachmentViews.size());
+			framebufferCI.pAttachments = attachmentViews.data();
+			framebufferCI.width = pass.width;
+			framebufferCI.height = pass.height;
+			framebufferCI.layers = 1;
+			VK_CHECK_RESULT(vkCreateFramebuffer(device->logicalDevice, &framebufferCI, nullptr, &pass.framebuffer));
+		}
+	}
+
+	/*
+		Barriers are derived per image from its accesses in execution order:
+		- The first access transitions from the undefined layout and waits for the last accesses of all images sharing its memory
+		- Later accesses need a barrier if they write, if the previous access wrote or if the layout changes, reads following reads in the same layout don't
+		- Outputs are transitioned to the shader read only layout after the last pass
+		All barriers of a pass are recorded with a single pipeline barrier command
+	*/
+	void RenderGraph::deriveBarriers()
+	{
+		for (uint32_t i = 0; i < static_cast<uint32_t>(images.size()); i++)
+		{
+			const Image& image = images[i];
+			if (!image.used)
+			{
+				continue;
+			}
+			VkImageMemoryBarrier barrier = vks::initializers::imageMemoryBarrier();
+			barrier.image = image.image;
+			barrier.subresourceRange = { image.aspectMask, 0, 1, 0, 1 };
+			VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VkPipelineStageFlags stageMask = 0;
+			VkAccessFlags accessMask = 0;
+			bool written = false;
+			for (size_t a = 0; a < image.accesses.size(); a++)
+			{
+				const Access& access = image.accesses[a];
+				VkPipelineStageFlags srcStageMask = stageMask;
+				barrier.srcAccessMask = written ? accessMask : 0;
+				if (a == 0)
+				{
+					srcStageMask = 0;
+					barrier.srcAccessMask = 0;
+					for (const Image& other : images)
+					{
+						if (other.used && memoryOverlaps(image, other))
+						{
+							srcStageMask |= other.finalStageMask;
+							barrier.srcAccessMask |= other.finalWriteAccessMask;
+						}
+					}
+				}
+				else if (!written && !access.write && (access.layout == layout))
+				{
+					stageMask |= access.stageMask;
+					accessMask |= access.accessMask;
+					continue;
+				}
+				barrier.oldLayout = layout;
+				barrier.newLayout = access.layout;
+				barrier.dstAccessMask = access.accessMask;
+				Pass& pass = passes[access.passIndex];
+				pass.barriers.push_back(barrier);
+				pass.srcStageMask |= srcStageMask;
+				pass.dstStageMask |= access.stageMask;
+				layout = access.layout;
+				stageMask = access.stageMask;
+				accessMask = access.accessMask;
+				written = access.write;
+			}
+			if (image.output && (written || (layout != VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)))
+			{
+				barrier.oldLayout = layout;
+				barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+				barrier.srcAccessMask = written ? accessMask : 0;
+				barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+				finalBarriers.push_back(barrier);
+				finalSrcStageMask |= stageMask;
+			}
+		}
+		for (const Pass& pass : passes)
+		{
+			if (!pass.barriers.empty())
+			{
+				stats.barrierCount += static_cast<uint32_t>(pass.barriers.size());
+				stats.barrierBatchCount++;
+			}
+		}
+		if (!finalBarriers.empty())
+		{
+			stats.barrierCount += static_cast<uint32_t>(finalBarriers.size());
+			stats.barrierBatchCount++;
+		}
+	}
+
+	/**
+	* Record all live passes and their barriers
+	*
+	* @param commandBuffer Command buffer to record to, must be outside of a render pass
+	* @param profiler Optional GPU profiler, each pass (including its barriers) is enclosed in a scope named after the pass
+	* @param profilerSlot Profiler slot of the command buffer
+	*/
+	void RenderGraph::execute(VkCommandBuffer commandBuffer, vks::GpuProfiler* profiler, uint32_t profilerSlot)
+	{
+		for (const Pass& pass : passes)
+		{
+			if (pass.culled)
+			{
+				continue;
+			}
+			if (profiler)
+			{
+				profiler->beginScope(commandBuffer, profilerSlot, pass.name);
+			}
+			if (!pass.barriers.empty())
+			{
+				vkCmdPipelineBarrier(commandBuffer, pass.srcStageMask, pass.dstStageMask, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(pass.barriers.size()), pass.barriers.data());
+			}
+
+			VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+			renderPassBeginInfo.renderPass = pass.renderPass;
+			renderPassBeginInfo.framebuffer = pass.framebuffer;
+			renderPassBeginInfo.renderArea.extent.width = pass.width;
+			renderPassBeginInfo.renderArea.extent.height = pass.height;
+			renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(pass.clearValues.size());
+			renderPassBeginInfo.pClearValues = pass.clearValues.data();
+			vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+			// Viewport and scissor cover the attachments of the pass
+			VkViewport viewport = vks::initializers::viewport((float)pass.width, (float)pass.height, 0.0f, 1.0f);
+			vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+			VkRect2D scissor = vks::initializers::rect2D(pass.width, pass.height, 0, 0);
+			vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+			if (pass.recordFunction)
+			{
+				pass.recordFunction(commandBuffer);
+			}
+
+			vkCmdEndRenderPass(commandBuffer);
+			if (profiler)
+			{
+				profiler->endScope(commandBuffer, profilerSlot);
+			}
+		}
+		if (!finalBarriers.empty())
+		{
+			vkCmdPipelineBarrier(commandBuffer, finalSrcStageMask, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(finalBarriers.size()), finalBarriers.data());
+		}
+	}
+
+	void RenderGraph::destroy()
+	{
+		releaseResources();
+		images.clear();
+		passes.clear();
+	}
+
+	// Destroy the Vulkan objects of the last compile and reset all state derived from the declared images and passes
+	void RenderGraph::releaseResources()
+	{
+		if (device)
+		{
+			for (Pass& pass : passes)
+			{
+				if (pass.framebuffer != VK_NULL_HANDLE)
+				{
+					vkDestroyFramebuffer(device->logicalDevice, pass.framebuffer, nullptr);
+				}
+				if (pass.renderPass != VK_NULL_HANDLE)
+				{
+					vkDestroyRenderPass(device->logicalDevice, pass.renderPass, nullptr);
+				}
+			}
+			for (Image& image : images)
+			{
+				if (image.view != VK_NULL_HANDLE)
+				{
+					vkDestroyImageView(device->logicalDevice, image.view, nullptr);
+				}
+				if (image.image != VK_NULL_HANDLE)
+				{
+					vkDestroyImage(device->logicalDevice, image.image, nullptr);
+				}
+			}
+			for (Heap& heap : heaps)
+			{
+				device->memoryAllocator.free(&heap.allocation);
+			}
+		}
+		for (Image& image : images)
+		{
+			Image declared;
+			declared.name = image.name;
+			declared.info = image.info;
+			declared.output = image.output;
+			image = declared;
+		}
+		for (Pass& pass : passes)
+		{
+			pass.culled = false;
+			pass.width = 0;
+			pass.height = 0;
+			pass.renderPass = VK_NULL_HANDLE;
+			pass.framebuffer = VK_NULL_HANDLE;
+			pass.clearValues.clear();
+			pass.barriers.clear();
+			pass.srcStageMask = 0;
+			pass.dstStageMask = 0;
+		}
+		heaps.clear();
+		finalBarriers.clear();
+		finalSrcStageMask = 0;
+		stats = Stats();
+	}
+}
@@ -0,0 +1,195 @@
+/*
+* Vulkan render graph
+*
+* Declarative frame graph for offscreen passes with automatic barriers, pass culling and transient attachment aliasing
+*
+* Copyright (C) 2016-2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.h"
+#include "VulkanMemoryAllocator.h"
+#include "VulkanProfiler.h"
+
+namespace vks
+{
+	/**
+	* @brief Render graph for the offscreen passes of a frame
+	*
+	* Passes declare the transient images they render to (color and depth/stencil attachments) and the images they sample from. Passes are
+	* executed in declaration order and images marked as graph outputs are sampled by work recorded after the graph (e.g. a composition pass
+	* rendering to the swap chain). Compiling the graph:
+	* - Culls all passes that don't (indirectly) contribute to an output, images only used by culled passes are not created
+	* - Creates the images with usage flags derived from their accesses, plus a render pass and framebuffer for each pass
+	* - Derives load and store ops: the first write of a frame clears an image to its clear value, attachments no later pass reads are not stored
+	* - Derives the image memory barriers (including all layout transitions) between passes, render passes don't transition any layouts themselves
+	* - Places images with non-overlapping lifetimes at the same memory offsets, so transient attachments share memory
+	*
+	* Images are transient: their contents are not preserved across frames, the first access of a frame always transitions from the undefined layout.
+	* Barriers for the first access also wait for the last access of all images that share its memory, which covers the reuse of memory within a frame
+	* as well as the previous frame's accesses.
+	*
+	* Usage:
+	*   uint32_t albedo = graph.addImage("albedo", { VK_FORMAT_R8G8B8A8_UNORM, width, height });
+	*   RenderGraph::Pass& pass = graph.addPass("G-Buffer");
+	*   pass.addColorOutput(albedo);
+	*   pass.setRecordFunction([&](VkCommandBuffer commandBuffer) { ... });
+	*   graph.addOutput(albedo);
+	*   graph.compile(vulkanDevice);
+	*   graph.execute(commandBuffer);
+	*/
+	class RenderGraph
+	{
+	public:
+		struct ImageInfo
+		{
+			VkFormat format = VK_FORMAT_UNDEFINED;
+			uint32_t width = 0;
+			uint32_t height = 0;
+			/** @brief Value the image is cleared to by its first write in a frame */
+			VkClearValue clearValue{};
+		};
+
+		class Pass
+		{
+		public:
+			/** @brief Render to an image as the next color attachment */
+			void addColorOutput(uint32_t image);
+			/** @brief Render to an image as the depth/stencil attachment */
+			void setDepthStencilOutput(uint32_t image);
+			/** @brief Sample from an image written by an earlier pass in the given shader stages */
+			void addSampledInput(uint32_t image, VkPipelineStageFlags stageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+			/** @brief Set the function recording the commands of the pass, it's called inside of the pass's render pass */
+			void setRecordFunction(std::function<void(VkCommandBuffer)> function);
+			/** @brief Render pass the pipelines used by this pass need to be compatible with, VK_NULL_HANDLE if the pass has been culled */
+			VkRenderPass getRenderPass() const { return renderPass; }
+			bool isCulled() const { return culled; }
+			const std::string& getName() const { return name; }
+
+		private:
+			friend class RenderGraph;
+			std::string name;
+			std::vector<uint32_t> colorOutputs;
+			uint32_t depthStencilOutput = UINT32_MAX;
+			struct SampledInput
+			{
+				uint32_t image;
+				VkPipelineStageFlags stageMask;
+			};
+			std::vector<SampledInput> sampledInputs;
+			std::function<void(VkCommandBuffer)> recordFunction;
+			bool culled = false;
+			uint32_t width = 0;
+			uint32_t height = 0;
+			VkRenderPass renderPass = VK_NULL_HANDLE;
+			VkFramebuffer framebuffer = VK_NULL_HANDLE;
+			std::vector<VkClearValue> clearValues;
+			// Barriers recorded before the render pass is started
+			std::vector<VkImageMemoryBarrier> barriers;
+			VkPipelineStageFlags srcStageMask = 0;
+			VkPipelineStageFlags dstStageMask = 0;
+		};
+
+		struct Stats
+		{
+			uint32_t passCount = 0;
+			uint32_t culledPassCount = 0;
+			uint32_t imageCount = 0;
+			/** @brief Number of image memory barriers recorded per frame */
+			uint32_t barrierCount = 0;
+			/** @brief Number of pipeline barrier commands recorded per frame */
+			uint32_t barrierBatchCount = 0;
+			/** @brief Size of the device memory backing the images */
+			VkDeviceSize memorySize = 0;
+			/** @brief Size of the device memory the images would require without aliasing */
+			VkDeviceSize unaliasedMemorySize = 0;
+		};
+
+		/** @brief Place images with non-overlapping lifetimes at the same memory offsets, needs to be set before calling compile */
+		bool aliasing = true;
+
+		uint32_t addImage(const std::string& name, const ImageInfo& imageInfo);
+		Pass& addPass(const std::string& name);
+		/** @brief Mark an image as sampled (in fragment shaders) by work recorded after the graph, it's transitioned to the shader read only layout at the end of the graph */
+		void addOutput(uint32_t image);
+		/** @brief Can be called again to recompile the graph, the Vulkan objects of the previous compile are destroyed (they must not be in use anymore) */
+		void compile(vks::VulkanDevice* device);
+		void execute(VkCommandBuffer commandBuffer, vks::GpuProfiler* profiler = nullptr, uint32_t profilerSlot = 0);
+		/** @brief Destroy all Vulkan objects and clear the declared images and passes */
+		void destroy();
+
+		/** @brief Image handle of a compiled image, VK_NULL_HANDLE if the image has been culled */
+		VkImage getImage(uint32_t image) const { return images[image].image; }
+		VkImageView getImageView(uint32_t image) const { return images[image].view; }
+		const Stats& getStats() const { return stats; }
+
+	private:
+		struct Access
+		{
+			uint32_t passIndex;
+			VkImageLayout layout;
+			VkPipelineStageFlags stageMask;
+			VkAccessFlags accessMask;
+			bool write;
+		};
+		struct Image
+		{
+			std::string name;
+			ImageInfo info;
+			VkImageUsageFlags usage = 0;
+			VkImageAspectFlags aspectMask = 0;
+			bool output = false;
+			bool used = false;
+			// Accesses by live passes in execution order
+			std::vector<Access> accesses;
+			// Index of the first and last live pass accessing the image, outputs live until the end of the graph
+			uint32_t firstPass = UINT32_MAX;
+			uint32_t lastPass = 0;
+			// Stages and accesses of the last access in a frame (for barriers of images reusing its memory)
+			VkPipelineStageFlags finalStageMask = 0;
+			VkAccessFlags finalWriteAccessMask = 0;
+			VkMemoryRequirements memoryRequirements{};
+			uint32_t heap = UINT32_MAX;
+			VkDeviceSize offset = 0;
+			VkImage image = VK_NULL_HANDLE;
+			VkImageView view = VK_NULL_HANDLE;
+		};
+		// Memory shared by images with non-overlapping lifetimes
+		struct Heap
+		{
+			uint32_t memoryTypeBits = ~0u;
+			VkDeviceSize size = 0;
+			VkDeviceSize alignment = 1;
+			std::vector<uint32_t> images;
+			vks::Allocation allocation;
+		};
+		vks::VulkanDevice* device = nullptr;
+		std::vector<Image> images;
+		// Deque, so references returned by addPass stay valid
+		std::deque<Pass> passes;
+		std::vector<Heap> heaps;
+		// Barriers recorded after the last pass (transitions of the outputs)
+		std::vector<VkImageMemoryBarrier> finalBarriers;
+		VkPipelineStageFlags finalSrcStageMask = 0;
+		Stats stats;
+
+		void releaseResources();
+		void cullPasses();
+		void collectAccesses();
+		void createImages();
+		void allocateMemory();
+		void createRenderPasses();
+		void deriveBarriers();
+		bool lifetimesOverlap(const Image& a, const Image& b) const;
+		bool memoryOverlaps(const Image& a, const Image& b) const;
+	};
+}
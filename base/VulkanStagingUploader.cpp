@@ -0,0 +1,557 @@
+/*
+* Vulkan staging uploader
+*
+* Batches buffer and image uploads through a persistently mapped staging ring buffer on the transfer queue
+*
+* Copyright (C) 2016-2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanStagingUploader.h"
+#include "VulkanDevice.h"
+
+namespace vks
+{
+	// Number of batches that can be in flight at the same time
+	static const uint32_t batchCount = 4;
+
+	static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	/**
+	* Set up the uploader for a device, the staging ring and command buffers are only created with the first upload
+	*
+	* @param device Device to upload to, must have been created (queue family indices are taken from it)
+	*/
+	void StagingUploader::create(vks::VulkanDevice* device)
+	{
+		this->device = device;
+	}
+
+	void StagingUploader::prepareResources()
+	{
+		transferFamily = device->queueFamilyIndices.transfer;
+		graphicsFamily = device->queueFamilyIndices.graphics;
+		vkGetDeviceQueue(device->logicalDevice, transferFamily, 0, &transferQueue);
+		vkGetDeviceQueue(device->logicalDevice, graphicsFamily, 0, &graphicsQueue);
+		const bool separateQueues = (transferFamily != graphicsFamily);
+
+		transferCommandPool = device->createCommandPool(transferFamily);
+		graphicsCommandPool = separateQueues ? device->createCommandPool(graphicsFamily) : transferCommandPool;
+
+		batches.resize(batchCount);
+		for (auto& batch : batches)
+		{
+			batch.transferCommandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, transferCommandPool);
+			batch.graphicsCommandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, graphicsCommandPool);
+			VkFenceCreateInfo fenceInfo = vks::initializers::fenceCreateInfo();
+			VK_CHECK_RESULT(vkCreateFence(device->logicalDevice, &fenceInfo, nullptr, &batch.fence));
+			if (separateQueues)
+			{
+				VkSemaphoreCreateInfo semaphoreInfo = vks::initializers::semaphoreCreateInfo();
+				VK_CHECK_RESULT(vkCreateSemaphore(device->logicalDevice, &semaphoreInfo, nullptr, &batch.transferComplete));
+			}
+		}
+
+		if (device->timelineSemaphores)
+		{
+			VkSemaphoreTypeCreateInfoKHR semaphoreTypeInfo{};
+			semaphoreTypeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+			semaphoreTypeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+			semaphoreTypeInfo.initialValue = 0;
+			VkSemaphoreCreateInfo semaphoreInfo = vks::initializers::semaphoreCreateInfo();
+			semaphoreInfo.pNext = &semaphoreTypeInfo;
+			VK_CHECK_RESULT(vkCreateSemaphore(device->logicalDevice, &semaphoreInfo, nullptr, &timelineSemaphore));
+		}
+
+		// The ring is a dedicated, persistently mapped host visible buffer
+		VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, ringSize);
+		VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &ring.buffer));
+		VK_CHECK_RESULT(device->memoryAllocator.allocateBufferMemory(ring.buffer, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &ring.allocation, vks::MemoryAllocator::Dedicated));
+		VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, ring.buffer, ring.allocation.memory, ring.allocation.offset));
+		// Buffer to image copy offsets need to be a multiple of the texel block size (and 4)
+		ringAlignment = std::max<VkDeviceSize>(16, device->properties.limits.optimalBufferCopyOffsetAlignment);
+	}
+
+	/**
+	* Release all resources, waits for outstanding uploads
+	*/
+	void StagingUploader::destroy()
+	{
+		if (!device || batches.empty())
+		{
+			return;
+		}
+		waitIdle();
+		for (auto& batch : batches)
+		{
+			vkDestroyFence(device->logicalDevice, batch.fence, nullptr);
+			if (batch.transferComplete)
+			{
+				vkDestroySemaphore(device->logicalDevice, batch.transferComplete, nullptr);
+			}
+		}
+		batches.clear();
+		if (graphicsCommandPool != transferCommandPool)
+		{
+			vkDestroyCommandPool(device->logicalDevice, graphicsCommandPool, nullptr);
+		}
+		vkDestroyCommandPool(device->logicalDevice, transferCommandPool, nullptr);
+		if (timelineSemaphore)
+		{
+			vkDestroySemaphore(device->logicalDevice, timelineSemaphore, nullptr);
+			timelineSemaphore = VK_NULL_HANDLE;
+		}
+		vkDestroyBuffer(device->logicalDevice, ring.buffer, nullptr);
+		device->memoryAllocator.free(&ring.allocation);
+		ring.buffer = VK_NULL_HANDLE;
+	}
+
+	StagingUploader::Batch& StagingUploader::beginBatch()
+	{
+		if (batches.empty())
+		{
+			prepareResources();
+		}
+		Batch& batch = batches[currentBatch];
+		if (batch.recording)
+		{
+			return batch;
+		}
+		// Batches are reused in a round robin fashion, so the next one may still be executing
+		while (batch.inFlight)
+		{
+			retireBatches(true);
+		}
+		VkCommandBufferBeginInfo beginInfo = vks::initializers::commandBufferBeginInfo();
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		VK_CHECK_RESULT(vkBeginCommandBuffer(batch.transferCommandBuffer, &beginInfo));
+		VK_CHECK_RESULT(vkBeginCommandBuffer(batch.graphicsCommandBuffer, &beginInfo));
+		batch.ticket = ++lastTicket;
+		batch.recording = true;
+		batch.bufferBarriers.clear();
+		batch.imageBarriers.clear();
+		batch.mipmapImages.clear();
+		batch.dstStageMask = 0;
+		batch.waitSemaphores.clear();
+		batch.waitStageMasks.clear();
+		return batch;
+	}
+
+	/**
+	* Reserve staging memory for an upload in the current batch
+	*
+	* @return False if the current batch had to be submitted to make room (the caller needs to begin a new batch)
+	*/
+	bool StagingUploader::reserveStaging(VkDeviceSize size, VkBuffer* buffer, VkDeviceSize* offset, void** mapped)
+	{
+		if (size > ringSize)
+		{
+			// Uploads larger than the ring get a separate staging buffer that's released once the batch has completed
+			Batch& batch = batches[currentBatch];
+			StagingBuffer staging;
+			VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, size);
+			VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &staging.buffer));
+			VK_CHECK_RESULT(device->memoryAllocator.allocateBufferMemory(staging.buffer, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging.allocation, vks::MemoryAllocator::Transient));
+			VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, staging.buffer, staging.allocation.memory, staging.allocation.offset));
+			batch.oversizedBuffers.push_back(staging);
+			*buffer = staging.buffer;
+			*offset = 0;
+			*mapped = staging.allocation.mapped;
+			return true;
+		}
+		while (true)
+		{
+			VkDeviceSize position = alignUp(ringHead, ringAlignment);
+			// Allocations must not wrap around the end of the ring
+			if ((position % ringSize) + size > ringSize)
+			{
+				position = alignUp(position, ringSize);
+			}
+			if (position + size - ringTail <= ringSize)
+			{
+				ringHead = position + size;
+				*buffer = ring.buffer;
+				*offset = position % ringSize;
+				*mapped = static_cast<uint8_t*>(ring.allocation.mapped) + *offset;
+				return true;
+			}
+			// Not enough space left, wait for the oldest batch to free its part of the ring
+			bool inFlight = false;
+			for (auto& batch : batches)
+			{
+				inFlight |= batch.inFlight;
+			}
+			if (inFlight)
+			{
+				retireBatches(true);
+			}
+			else if (batches[currentBatch].recording)
+			{
+				// The pending batch itself fills the ring, so it needs to be submitted first
+				submitBatch();
+				return false;
+			}
+			else
+			{
+				// Nothing is using the ring anymore
+				ringTail = ringHead;
+			}
+		}
+	}
+
+	/**
+	* Upload data to a buffer
+	*
+	* @param buffer Destination buffer, must have been created with VK_BUFFER_USAGE_TRANSFER_DST_BIT and exclusive sharing mode
+	* @param data Pointer to the data to upload, it's copied into the staging ring so it can be released once the function returns
+	* @param size Size of the data in bytes
+	* @param dstOffset (Optional) Offset into the destination buffer
+	* @param dstAccessMask (Optional) Access mask of the first use of the buffer after the upload
+	* @param dstStageMask (Optional) Pipeline stages of the first use of the buffer after the upload
+	*
+	* @return Ticket of the batch containing the upload
+	*/
+	StagingUploader::Ticket StagingUploader::uploadBuffer(VkBuffer buffer, const void* data, VkDeviceSize size, VkDeviceSize dstOffset, VkAccessFlags dstAccessMask, VkPipelineStageFlags dstStageMask)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		VkBuffer stagingBuffer;
+		VkDeviceSize stagingOffset;
+		void* mapped;
+		beginBatch();
+		while (!reserveStaging(size, &stagingBuffer, &stagingOffset, &mapped))
+		{
+			beginBatch();
+		}
+		Batch& batch = batches[currentBatch];
+		memcpy(mapped, data, size);
+
+		VkBufferCopy copyRegion{};
+		copyRegion.srcOffset = stagingOffset;
+		copyRegion.dstOffset = dstOffset;
+		copyRegion.size = size;
+		vkCmdCopyBuffer(batch.transferCommandBuffer, stagingBuffer, buffer, 1, &copyRegion);
+
+		VkBufferMemoryBarrier barrier = vks::initializers::bufferMemoryBarrier();
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer = buffer;
+		barrier.offset = dstOffset;
+		barrier.size = size;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = dstAccessMask;
+		if (transferFamily != graphicsFamily)
+		{
+			// Release ownership on the transfer queue, the matching acquire is recorded for the graphics queue
+			barrier.srcQueueFamilyIndex = transferFamily;
+			barrier.dstQueueFamilyIndex = graphicsFamily;
+			VkBufferMemoryBarrier releaseBarrier = barrier;
+			releaseBarrier.dstAccessMask = 0;
+			vkCmdPipelineBarrier(batch.transferCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &releaseBarrier, 0, nullptr);
+			barrier.srcAccessMask = 0;
+		}
+		batch.bufferBarriers.push_back(barrier);
+		batch.dstStageMask |= dstStageMask;
+		return batch.ticket;
+	}
+
+	/**
+	* Upload data to an image
+	*
+	* @param info Image, subresources and the layout and access of the image after the upload
+	* @param data Pointer to the data to upload, it's copied into the staging ring so it can be released once the function returns
+	* @param size Size of the data in bytes
+	* @param regions Copy regions with buffer offsets relative to data, regions should cover whole subresources as they are copied on the transfer queue
+	*
+	* @return Ticket of the batch containing the upload
+	*/
+	StagingUploader::Ticket StagingUploader::uploadImage(const ImageUploadInfo& info, const void* data, VkDeviceSize size, const std::vector<VkBufferImageCopy>& regions)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		VkBuffer stagingBuffer;
+		VkDeviceSize stagingOffset;
+		void* mapped;
+		beginBatch();
+		while (!reserveStaging(size, &stagingBuffer, &stagingOffset, &mapped))
+		{
+			beginBatch();
+		}
+		Batch& batch = batches[currentBatch];
+		memcpy(mapped, data, size);
+
+		// Images in the general layout (e.g. partially resident images that are sampled while other parts are uploaded) stay in that layout
+		const VkImageLayout copyLayout = (info.initialLayout == VK_IMAGE_LAYOUT_GENERAL) ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		const bool ownershipTransfer = (transferFamily != graphicsFamily) && !info.concurrentSharing;
+
+		VkImageMemoryBarrier barrier = vks::initializers::imageMemoryBarrier();
+		barrier.image = info.image;
+		barrier.subresourceRange = info.subresourceRange;
+		barrier.oldLayout = info.initialLayout;
+		barrier.newLayout = copyLayout;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(batch.transferCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		std::vector<VkBufferImageCopy> copyRegions(regions);
+		for (auto& region : copyRegions)
+		{
+			region.bufferOffset += stagingOffset;
+		}
+		vkCmdCopyBufferToImage(batch.transferCommandBuffer, stagingBuffer, info.image, copyLayout, static_cast<uint32_t>(copyRegions.size()), copyRegions.data());
+
+		// Images that get their mip chain generated stay in transfer dst layout until the blits on the graphics queue
+		barrier.oldLayout = copyLayout;
+		barrier.newLayout = info.generateMipmaps ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : info.finalLayout;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = info.generateMipmaps ? (VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT) : info.dstAccessMask;
+		if (ownershipTransfer)
+		{
+			// Release ownership on the transfer queue, the matching acquire (with the same layouts) is recorded for the graphics queue
+			barrier.srcQueueFamilyIndex = transferFamily;
+			barrier.dstQueueFamilyIndex = graphicsFamily;
+			VkImageMemoryBarrier releaseBarrier = barrier;
+			releaseBarrier.dstAccessMask = 0;
+			vkCmdPipelineBarrier(batch.transferCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &releaseBarrier);
+			barrier.srcAccessMask = 0;
+		}
+		else if (transferFamily != graphicsFamily)
+		{
+			// Concurrent images need no ownership transfer, the semaphore wait on the graphics queue already makes the copies available
+			barrier.srcAccessMask = 0;
+		}
+		batch.imageBarriers.push_back(barrier);
+		if (info.generateMipmaps)
+		{
+			batch.mipmapImages.push_back(info);
+			batch.dstStageMask |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+		}
+		else
+		{
+			batch.dstStageMask |= info.dstStageMask;
+		}
+		return batch.ticket;
+	}
+
+	/**
+	* Make the transfers of the batch that's currently being recorded wait on a semaphore
+	*
+	* @param semaphore Binary semaphore signalled by a prior queue operation, e.g. a sparse binding of the memory the uploads are written to
+	* @param waitStageMask Pipeline stages that wait on the semaphore, must be supported by the transfer queue
+	*
+	* @note Only applies to uploads recorded until the batch is submitted, so all uploads that depend on the semaphore should fit into the staging ring
+	*/
+	void StagingUploader::addWaitSemaphore(VkSemaphore semaphore, VkPipelineStageFlags waitStageMask)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Batch& batch = beginBatch();
+		batch.waitSemaphores.push_back(semaphore);
+		// A wait stage mask of zero is invalid, the transfers are the first work of the batch that needs to wait
+		batch.waitStageMasks.push_back((waitStageMask != 0) ? waitStageMask : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TRANSFER_BIT));
+	}
+
+	void StagingUploader::recordMipmaps(VkCommandBuffer commandBuffer, const ImageUploadInfo& info)
+	{
+		const uint32_t baseLevel = info.subresourceRange.baseMipLevel;
+		const uint32_t levelCount = info.subresourceRange.levelCount;
+
+		VkImageMemoryBarrier barrier = vks::initializers::imageMemoryBarrier();
+		barrier.image = info.image;
+		barrier.subresourceRange = info.subresourceRange;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		// Each level is downsampled from the previous one and then turned into a source for the next blit
+		for (uint32_t i = 1; i < levelCount; i++)
+		{
+			VkImageBlit imageBlit{};
+			imageBlit.srcSubresource.aspectMask = info.subresourceRange.aspectMask;
+			imageBlit.srcSubresource.baseArrayLayer = info.subresourceRange.baseArrayLayer;
+			imageBlit.srcSubresource.layerCount = info.subresourceRange.layerCount;
+			imageBlit.srcSubresource.mipLevel = baseLevel + i - 1;
+			imageBlit.srcOffsets[1].x = int32_t(std::max(info.extent.width >> (i - 1), 1u));
+			imageBlit.srcOffsets[1].y = int32_t(std::max(info.extent.height >> (i - 1), 1u));
+			imageBlit.srcOffsets[1].z = int32_t(std::max(info.extent.depth >> (i - 1), 1u));
+			imageBlit.dstSubresource = imageBlit.srcSubresource;
+			imageBlit.dstSubresource.mipLevel = baseLevel + i;
+			imageBlit.dstOffsets[1].x = int32_t(std::max(info.extent.width >> i, 1u));
+			imageBlit.dstOffsets[1].y = int32_t(std::max(info.extent.height >> i, 1u));
+			imageBlit.dstOffsets[1].z = int32_t(std::max(info.extent.depth >> i, 1u));
+			vkCmdBlitImage(commandBuffer, info.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, info.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageBlit, VK_FILTER_LINEAR);
+
+			barrier.subresourceRange.baseMipLevel = baseLevel + i;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+		}
+
+		barrier.subresourceRange = info.subresourceRange;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.newLayout = info.finalLayout;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = info.dstAccessMask;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, info.dstStageMask, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
+
+	StagingUploader::Ticket StagingUploader::submitBatch()
+	{
+		Batch& batch = batches[currentBatch];
+		const bool separateQueues = (transferFamily != graphicsFamily);
+
+		// A batch may contain no copies at all (e.g. only a semaphore wait added with addWaitSemaphore), it then has no barriers and no destination stages
+		if (!batch.bufferBarriers.empty() || !batch.imageBarriers.empty())
+		{
+			// With separate queues the semaphore wait covers the transfer work, otherwise the barriers need to wait for the copies
+			VkPipelineStageFlags srcStageMask = separateQueues ? VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT;
+			vkCmdPipelineBarrier(batch.graphicsCommandBuffer, srcStageMask, batch.dstStageMask, 0, 0, nullptr,
+				static_cast<uint32_t>(batch.bufferBarriers.size()), batch.bufferBarriers.data(),
+				static_cast<uint32_t>(batch.imageBarriers.size()), batch.imageBarriers.data());
+		}
+		for (auto& image : batch.mipmapImages)
+		{
+			recordMipmaps(batch.graphicsCommandBuffer, image);
+		}
+		VK_CHECK_RESULT(vkEndCommandBuffer(batch.transferCommandBuffer));
+		VK_CHECK_RESULT(vkEndCommandBuffer(batch.graphicsCommandBuffer));
+
+		VkTimelineSemaphoreSubmitInfoKHR timelineSubmitInfo{};
+		timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+		timelineSubmitInfo.signalSemaphoreValueCount = 1;
+		timelineSubmitInfo.pSignalSemaphoreValues = &batch.ticket;
+
+		VkSubmitInfo graphicsSubmitInfo = vks::initializers::submitInfo();
+		if (timelineSemaphore)
+		{
+			graphicsSubmitInfo.pNext = &timelineSubmitInfo;
+			graphicsSubmitInfo.signalSemaphoreCount = 1;
+			graphicsSubmitInfo.pSignalSemaphores = &timelineSemaphore;
+		}
+		VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+		if (separateQueues)
+		{
+			VkSubmitInfo transferSubmitInfo = vks::initializers::submitInfo();
+			transferSubmitInfo.commandBufferCount = 1;
+			transferSubmitInfo.pCommandBuffers = &batch.transferCommandBuffer;
+			transferSubmitInfo.waitSemaphoreCount = static_cast<uint32_t>(batch.waitSemaphores.size());
+			transferSubmitInfo.pWaitSemaphores = batch.waitSemaphores.data();
+			transferSubmitInfo.pWaitDstStageMask = batch.waitStageMasks.data();
+			transferSubmitInfo.signalSemaphoreCount = 1;
+			transferSubmitInfo.pSignalSemaphores = &batch.transferComplete;
+			VK_CHECK_RESULT(vkQueueSubmit(transferQueue, 1, &transferSubmitInfo, VK_NULL_HANDLE));
+
+			graphicsSubmitInfo.waitSemaphoreCount = 1;
+			graphicsSubmitInfo.pWaitSemaphores = &batch.transferComplete;
+			graphicsSubmitInfo.pWaitDstStageMask = &waitStageMask;
+			graphicsSubmitInfo.commandBufferCount = 1;
+			graphicsSubmitInfo.pCommandBuffers = &batch.graphicsCommandBuffer;
+			VK_CHECK_RESULT(vkQueueSubmit(graphicsQueue, 1, &graphicsSubmitInfo, batch.fence));
+		}
+		else
+		{
+			// Transfer and graphics share a queue, so both command buffers go into a single submission
+			VkCommandBuffer commandBuffers[2] = { batch.transferCommandBuffer, batch.graphicsCommandBuffer };
+			graphicsSubmitInfo.commandBufferCount = 2;
+			graphicsSubmitInfo.pCommandBuffers = commandBuffers;
+			graphicsSubmitInfo.waitSemaphoreCount = static_cast<uint32_t>(batch.waitSemaphores.size());
+			graphicsSubmitInfo.pWaitSemaphores = batch.waitSemaphores.data();
+			graphicsSubmitInfo.pWaitDstStageMask = batch.waitStageMasks.data();
+			VK_CHECK_RESULT(vkQueueSubmit(graphicsQueue, 1, &graphicsSubmitInfo, batch.fence));
+		}
+
+		batch.recording = false;
+		batch.inFlight = true;
+		batch.ringEnd = ringHead;
+		currentBatch = (currentBatch + 1) % batchCount;
+		return batch.ticket;
+	}
+
+	/**
+	* Release the resources of completed batches in submission order
+	*
+	* @param waitForOldest If true, blocks until the oldest batch in flight has completed
+	*/
+	void StagingUploader::retireBatches(bool waitForOldest)
+	{
+		for (uint32_t i = 0; i < batchCount; i++)
+		{
+			Batch& batch = batches[(currentBatch + i) % batchCount];
+			if (!batch.inFlight)
+			{
+				continue;
+			}
+			if (waitForOldest)
+			{
+				VK_CHECK_RESULT(vkWaitForFences(device->logicalDevice, 1, &batch.fence, VK_TRUE, UINT64_MAX));
+				waitForOldest = false;
+			}
+			else if (vkGetFenceStatus(device->logicalDevice, batch.fence) != VK_SUCCESS)
+			{
+				break;
+			}
+			VK_CHECK_RESULT(vkResetFences(device->logicalDevice, 1, &batch.fence));
+			for (auto& staging : batch.oversizedBuffers)
+			{
+				vkDestroyBuffer(device->logicalDevice, staging.buffer, nullptr);
+				device->memoryAllocator.free(&staging.allocation);
+			}
+			batch.oversizedBuffers.clear();
+			ringTail = std::max(ringTail, batch.ringEnd);
+			completedTicket = std::max(completedTicket, batch.ticket);
+			batch.inFlight = false;
+		}
+	}
+
+	/**
+	* Submit all pending uploads
+	*
+	* @return Ticket of the submitted batch (or of the last submitted batch if no uploads were pending)
+	*/
+	StagingUploader::Ticket StagingUploader::flush()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!batches.empty() && batches[currentBatch].recording)
+		{
+			return submitBatch();
+		}
+		return lastTicket;
+	}
+
+	/** @brief Returns true if all uploads of the given ticket have finished executing on the GPU */
+	bool StagingUploader::isComplete(Ticket ticket)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (ticket > completedTicket && !batches.empty())
+		{
+			retireBatches(false);
+		}
+		return ticket <= completedTicket;
+	}
+
+	/** @brief Block until the uploads of the given ticket have finished, submits them first if they are still pending */
+	void StagingUploader::wait(Ticket ticket)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (batches.empty())
+		{
+			return;
+		}
+		if (batches[currentBatch].recording && batches[currentBatch].ticket <= ticket)
+		{
+			submitBatch();
+		}
+		while (ticket > completedTicket)
+		{
+			retireBatches(true);
+		}
+	}
+
+	/** @brief Submit pending uploads and wait for all of them to finish */
+	void StagingUploader::waitIdle()
+	{
+		wait(lastTicket);
+	}
+}
@@ -0,0 +1,135 @@
+/*
+* Vulkan staging uploader
+*
+* Batches buffer and image uploads through a persistently mapped staging ring buffer on the transfer queue
+*
+* Copyright (C) 2016-2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanMemoryAllocator.h"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	struct VulkanDevice;
+
+	/**
+	* @brief Asynchronous upload of buffer and image data
+	*
+	* Upload data is copied into a staging ring buffer and the copies are recorded into a batch that is submitted to the transfer queue
+	* with a single submission once flush is called (or the ring runs out of space). If the transfer queue belongs to a different queue family
+	* than the graphics queue, the uploaded resources are released by the transfer queue and acquired by the graphics queue (queue family ownership
+	* transfer). The acquire barriers, final image layout transitions and mip map generation are recorded into a command buffer submitted to the
+	* graphics queue that waits on the transfer submission.
+	*
+	* As the last submission of a batch is on the graphics queue, all work submitted to the graphics queue afterwards sees the uploaded data without
+	* any further synchronization, so the application doesn't need to wait for uploads. Each upload returns a ticket that can be used to check or wait for
+	* completion on the host, e.g. before reusing host data or for resources used on other queues. If timeline semaphores have been enabled for the
+	* device, tickets are values of a timeline semaphore that can also be waited on by the GPU.
+	*
+	* @note Submits to the device's first graphics and transfer queue, these must not be used by other threads during calls to the uploader
+	*/
+	class StagingUploader
+	{
+	public:
+		typedef uint64_t Ticket;
+
+		/** @brief Size of the staging ring buffer, can be changed before the first upload */
+		VkDeviceSize ringSize = 32 * 1024 * 1024;
+
+		struct ImageUploadInfo
+		{
+			VkImage image = VK_NULL_HANDLE;
+			/** @brief Subresources of the image covered by the upload, these are transitioned from initialLayout to finalLayout */
+			VkImageSubresourceRange subresourceRange{};
+			/** @brief Layout of the subresources before the upload, contents outside of the copy regions are only preserved if this is not undefined. Images in the general layout are copied to without a layout change */
+			VkImageLayout initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VkImageLayout finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			/** @brief Access and stages of the first use of the image after the upload */
+			VkAccessFlags dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			VkPipelineStageFlags dstStageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+			/** @brief If true, only the first mip level is uploaded and the remaining levels of the subresource range are generated with linear blits on the graphics queue */
+			bool generateMipmaps = false;
+			/** @brief Size of the first mip level (only required for mip map generation) */
+			VkExtent3D extent{};
+			/** @brief Set for images created with VK_SHARING_MODE_CONCURRENT (for the graphics and transfer queue families), these don't need a queue family ownership transfer */
+			bool concurrentSharing = false;
+		};
+
+		void create(vks::VulkanDevice* device);
+		void destroy();
+		Ticket uploadBuffer(VkBuffer buffer, const void* data, VkDeviceSize size, VkDeviceSize dstOffset = 0, VkAccessFlags dstAccessMask = VK_ACCESS_MEMORY_READ_BIT, VkPipelineStageFlags dstStageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+		Ticket uploadImage(const ImageUploadInfo& info, const void* data, VkDeviceSize size, const std::vector<VkBufferImageCopy>& regions);
+		void addWaitSemaphore(VkSemaphore semaphore, VkPipelineStageFlags waitStageMask);
+		Ticket flush();
+		bool isComplete(Ticket ticket);
+		void wait(Ticket ticket);
+		void waitIdle();
+		/** @brief Returns the timeline semaphore signalled with the ticket values, VK_NULL_HANDLE if timeline semaphores are not enabled for the device */
+		VkSemaphore getTimelineSemaphore() const { return timelineSemaphore; }
+
+	private:
+		struct StagingBuffer
+		{
+			VkBuffer buffer = VK_NULL_HANDLE;
+			vks::Allocation allocation;
+		};
+		struct Batch
+		{
+			VkCommandBuffer transferCommandBuffer = VK_NULL_HANDLE;
+			VkCommandBuffer graphicsCommandBuffer = VK_NULL_HANDLE;
+			// Signalled by the transfer queue submission and waited on by the graphics queue submission (separate queues only)
+			VkSemaphore transferComplete = VK_NULL_HANDLE;
+			VkFence fence = VK_NULL_HANDLE;
+			Ticket ticket = 0;
+			bool recording = false;
+			bool inFlight = false;
+			// Ring position after the last staging allocation of this batch, the ring's tail is advanced to it once the batch has completed
+			VkDeviceSize ringEnd = 0;
+			// Barriers for the graphics queue (ownership acquire or final layout transitions) and images that need their mip chain generated
+			std::vector<VkBufferMemoryBarrier> bufferBarriers;
+			std::vector<VkImageMemoryBarrier> imageBarriers;
+			std::vector<ImageUploadInfo> mipmapImages;
+			VkPipelineStageFlags dstStageMask = 0;
+			// Semaphores the batch's first submission waits on (e.g. signalled by sparse binding)
+			std::vector<VkSemaphore> waitSemaphores;
+			std::vector<VkPipelineStageFlags> waitStageMasks;
+			// Separate staging buffers for uploads that don't fit into the ring
+			std::vector<StagingBuffer> oversizedBuffers;
+		};
+
+		vks::VulkanDevice* device = nullptr;
+		VkQueue transferQueue = VK_NULL_HANDLE;
+		VkQueue graphicsQueue = VK_NULL_HANDLE;
+		uint32_t transferFamily = 0;
+		uint32_t graphicsFamily = 0;
+		VkCommandPool transferCommandPool = VK_NULL_HANDLE;
+		VkCommandPool graphicsCommandPool = VK_NULL_HANDLE;
+		VkSemaphore timelineSemaphore = VK_NULL_HANDLE;
+		StagingBuffer ring;
+		VkDeviceSize ringAlignment = 16;
+		// Monotonically increasing ring positions, the actual offset is position % ringSize
+		VkDeviceSize ringHead = 0;
+		VkDeviceSize ringTail = 0;
+		std::vector<Batch> batches;
+		uint32_t currentBatch = 0;
+		Ticket lastTicket = 0;
+		Ticket completedTicket = 0;
+		std::mutex mutex;
+
+		void prepareResources();
+		Batch& beginBatch();
+		bool reserveStaging(VkDeviceSize size, VkBuffer* buffer, VkDeviceSize* offset, void** mapped);
+		Ticket submitBatch();
+		void retireBatches(bool waitForOldest);
+		void recordMipmaps(VkCommandBuffer commandBuffer, const ImageUploadInfo& info);
+	};
+}
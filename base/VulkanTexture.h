@@ -28,6 +28,11 @@
 
 namespace vks
 {
+/*
+	Texture uploads of optimal tiled images are queued on the device's staging uploader and are not submitted when loading returns
+	They are submitted with StagingUploader::flush, which VulkanDevice::flushCommandBuffer and VulkanExampleBase::prepareFrame call before their own work
+	Anything that uses a texture through another submission has to call device->stagingUploader.flush() first (and wait for its ticket on other queues)
+*/
 class Texture
 {
   public:
@@ -35,6 +40,8 @@ class Texture
 	VkImage               image;
 	VkImageLayout         imageLayout;
 	VkDeviceMemory        deviceMemory;
+	/** @brief Memory range of the image if it has been allocated through the device's memory allocator (deviceMemory may be shared with other resources) */
+	vks::Allocation       allocation;
 	VkImageView           view;
 	uint32_t              width, height;
 	uint32_t              mipLevels;
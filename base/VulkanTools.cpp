@@ -441,5 +441,136 @@ namespace vks
 			return (value + alignment - 1) & ~(alignment - 1);
 		}
 
+		/*
+			Pipeline cache files
+
+			The data returned by vkGetPipelineCacheData is prefixed with a small header of our own that stores the device and driver the data was created with
+			along with the size and a checksum of the payload. The driver version is not part of the Vulkan pipeline cache header, and while drivers are required
+			to reject incompatible data, some implementations are known to crash on stale or damaged blobs, so we validate everything before handing it over.
+		*/
+
+		struct PipelineCacheFileHeader
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint32_t vendorID;
+			uint32_t deviceID;
+			uint32_t driverVersion;
+			uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+			uint64_t dataSize;
+			uint64_t checksum;
+		};
+
+		static const uint32_t pipelineCacheFileMagic = 0x43504B56; // "VKPC"
+		static const uint32_t pipelineCacheFileVersion = 1;
+
+		// 64-bit FNV-1a hash, good enough to detect truncated or damaged files
+		static uint64_t pipelineCacheChecksum(const char* data, size_t size)
+		{
+			uint64_t hash = 14695981039346656037ull;
+			for (size_t i = 0; i < size; i++) {
+				hash ^= static_cast<uint8_t>(data[i]);
+				hash *= 1099511628211ull;
+			}
+			return hash;
+		}
+
+		std::vector<char> loadPipelineCacheData(const std::string &filename, const VkPhysicalDeviceProperties &deviceProperties)
+		{
+			std::vector<char> data;
+			std::ifstream is(filename, std::ios::binary | std::ios::in | std::ios::ate);
+			if (!is.is_open()) {
+				return data;
+			}
+			const size_t fileSize = static_cast<size_t>(is.tellg());
+			is.seekg(0, std::ios::beg);
+
+			PipelineCacheFileHeader header{};
+			if ((fileSize < sizeof(header)) || !is.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+				return data;
+			}
+			// Discard data that has been written by a different version of this code, or for a different device or driver
+			if ((header.magic != pipelineCacheFileMagic) ||
+				(header.version != pipelineCacheFileVersion) ||
+				(header.vendorID != deviceProperties.vendorID) ||
+				(header.deviceID != deviceProperties.deviceID) ||
+				(header.driverVersion != deviceProperties.driverVersion) ||
+				(memcmp(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) != 0) ||
+				(header.dataSize != fileSize - sizeof(header))) {
+				return data;
+			}
+
+			data.resize(static_cast<size_t>(header.dataSize));
+			if (!is.read(data.data(), data.size()) || (pipelineCacheChecksum(data.data(), data.size()) != header.checksum)) {
+				data.clear();
+				return data;
+			}
+
+			// Also validate the header of the Vulkan pipeline cache data itself (VkPipelineCacheHeaderVersionOne)
+			const size_t vkHeaderSize = 16 + VK_UUID_SIZE;
+			uint32_t vkHeader[4];
+			if (data.size() < vkHeaderSize) {
+				data.clear();
+				return data;
+			}
+			memcpy(vkHeader, data.data(), sizeof(vkHeader));
+			if ((vkHeader[0] < vkHeaderSize) ||
+				(vkHeader[1] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE) ||
+				(vkHeader[2] != deviceProperties.vendorID) ||
+				(vkHeader[3] != deviceProperties.deviceID) ||
+				(memcmp(data.data() + sizeof(vkHeader), deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) != 0)) {
+				data.clear();
+			}
+			return data;
+		}
+
+		bool savePipelineCacheData(const std::string &filename, VkDevice device, VkPipelineCache pipelineCache, const VkPhysicalDeviceProperties &deviceProperties)
+		{
+			size_t dataSize = 0;
+			if ((vkGetPipelineCacheData(device, pipelineCache, &dataSize, nullptr) != VK_SUCCESS) || (dataSize == 0)) {
+				return false;
+			}
+			std::vector<char> data(dataSize);
+			if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, data.data()) != VK_SUCCESS) {
+				return false;
+			}
+
+			PipelineCacheFileHeader header{};
+			header.magic = pipelineCacheFileMagic;
+			header.version = pipelineCacheFileVersion;
+			header.vendorID = deviceProperties.vendorID;
+			header.deviceID = deviceProperties.deviceID;
+			header.driverVersion = deviceProperties.driverVersion;
+			memcpy(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE);
+			header.dataSize = dataSize;
+			header.checksum = pipelineCacheChecksum(data.data(), dataSize);
+
+			// Write to a temporary file first and replace the target once everything has been written
+			const std::string tempFilename = filename + ".tmp";
+			{
+				std::ofstream os(tempFilename, std::ios::binary | std::ios::out | std::ios::trunc);
+				if (!os.is_open()) {
+					return false;
+				}
+				os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+				os.write(data.data(), dataSize);
+				os.flush();
+				if (!os.good()) {
+					os.close();
+					std::remove(tempFilename.c_str());
+					return false;
+				}
+			}
+#if defined(_WIN32)
+			const bool renamed = MoveFileExA(tempFilename.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+			const bool renamed = std::rename(tempFilename.c_str(), filename.c_str()) == 0;
+#endif
+			if (!renamed) {
+				std::remove(tempFilename.c_str());
+			}
+			return renamed;
+		}
+
 	}
 }
@@ -133,5 +133,10 @@ namespace vks
 		bool fileExists(const std::string &filename);
 
 		uint32_t alignedSize(uint32_t value, uint32_t alignment);
+
+		/** @brief Loads pipeline cache data previously stored with savePipelineCacheData, returns an empty vector if the file is missing, corrupted or was written for a different device, driver or pipeline cache UUID */
+		std::vector<char> loadPipelineCacheData(const std::string &filename, const VkPhysicalDeviceProperties &deviceProperties);
+		/** @brief Stores the contents of a pipeline cache in a file, writes to a temporary file first that then replaces the target so an interrupted write never leaves a broken cache behind */
+		bool savePipelineCacheData(const std::string &filename, VkDevice device, VkPipelineCache pipelineCache, const VkPhysicalDeviceProperties &deviceProperties);
 	}
 }
@@ -311,13 +311,19 @@ namespace vks
 	}
 
 	/** Update vertex and index buffer containing the imGui elements when required */
-	bool UIOverlay::update()
+	bool UIOverlay::update(uint32_t frameIndex)
 	{
 		ImDrawData* imDrawData = ImGui::GetDrawData();
 		bool updateCmdBuffers = false;
 
 		if (!imDrawData) { return false; };
 
+		assert(frameIndex < buffers.size());
+		vks::Buffer &vertexBuffer = buffers[frameIndex].vertexBuffer;
+		vks::Buffer &indexBuffer = buffers[frameIndex].indexBuffer;
+		int32_t &vertexCount = buffers[frameIndex].vertexCount;
+		int32_t &indexCount = buffers[frameIndex].indexCount;
+
 		// Note: Alignment is done inside buffer creation
 		VkDeviceSize vertexBufferSize = imDrawData->TotalVtxCount * sizeof(ImDrawVert);
 		VkDeviceSize indexBufferSize = imDrawData->TotalIdxCount * sizeof(ImDrawIdx);
@@ -367,7 +373,7 @@ namespace vks
 		return updateCmdBuffers;
 	}
 
-	void UIOverlay::draw(const VkCommandBuffer commandBuffer)
+	void UIOverlay::draw(const VkCommandBuffer commandBuffer, uint32_t frameIndex)
 	{
 		ImDrawData* imDrawData = ImGui::GetDrawData();
 		int32_t vertexOffset = 0;
@@ -386,9 +392,10 @@ namespace vks
 		pushConstBlock.translate = glm::vec2(-1.0f);
 		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstBlock), &pushConstBlock);
 
+		assert(frameIndex < buffers.size());
 		VkDeviceSize offsets[1] = { 0 };
-		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer.buffer, offsets);
-		vkCmdBindIndexBuffer(commandBuffer, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &buffers[frameIndex].vertexBuffer.buffer, offsets);
+		vkCmdBindIndexBuffer(commandBuffer, buffers[frameIndex].indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT16);
 
 		for (int32_t i = 0; i < imDrawData->CmdListsCount; i++)
 		{
@@ -417,8 +424,10 @@ namespace vks
 
 	void UIOverlay::freeResources()
 	{
-		vertexBuffer.destroy();
-		indexBuffer.destroy();
+		for (auto& frameBuffers : buffers) {
+			frameBuffers.vertexBuffer.destroy();
+			frameBuffers.indexBuffer.destroy();
+		}
 		vkDestroyImageView(device->logicalDevice, fontView, nullptr);
 		vkDestroyImage(device->logicalDevice, fontImage, nullptr);
 		vkFreeMemory(device->logicalDevice, fontMemory, nullptr);
@@ -39,10 +39,14 @@ namespace vks
 		VkSampleCountFlagBits rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 		uint32_t subpass = 0;
 
-		vks::Buffer vertexBuffer;
-		vks::Buffer indexBuffer;
-		int32_t vertexCount = 0;
-		int32_t indexCount = 0;
+		// Geometry buffers are kept per frame in flight, so they can be updated while the GPU is still reading those of a previous frame
+		struct FrameBuffers {
+			vks::Buffer vertexBuffer;
+			vks::Buffer indexBuffer;
+			int32_t vertexCount = 0;
+			int32_t indexCount = 0;
+		};
+		std::vector<FrameBuffers> buffers{ 1 };
 
 		std::vector<VkPipelineShaderStageCreateInfo> shaders;
 
@@ -72,8 +76,8 @@ namespace vks
 		void preparePipeline(const VkPipelineCache pipelineCache, const VkRenderPass renderPass, const VkFormat colorFormat, const VkFormat depthFormat);
 		void prepareResources();
 
-		bool update();
-		void draw(const VkCommandBuffer commandBuffer);
+		bool update(uint32_t frameIndex = 0);
+		void draw(const VkCommandBuffer commandBuffer, uint32_t frameIndex = 0);
 		void resize(uint32_t width, uint32_t height);
 
 		void freeResources();
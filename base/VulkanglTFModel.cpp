@@ -12,11 +12,22 @@
 #define TINYGLTF_NO_STB_IMAGE_WRITE
 
 #include "VulkanglTFModel.h"
+#include "frustum.hpp"
+
+#include <unordered_map>
+#include <sys/stat.h>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 VkDescriptorSetLayout vkglTF::descriptorSetLayoutImage = VK_NULL_HANDLE;
 VkDescriptorSetLayout vkglTF::descriptorSetLayoutUbo = VK_NULL_HANDLE;
 VkMemoryPropertyFlags vkglTF::memoryPropertyFlags = 0;
 uint32_t vkglTF::descriptorBindingFlags = vkglTF::DescriptorBindingFlags::ImageBaseColor;
+uint32_t vkglTF::loadingThreadCount = 0;
+vkglTF::VertexLayout vkglTF::vertexLayout;
 
 /*
 	We use a custom image loading function with tinyglTF, so we can do custom stuff loading ktx textures
@@ -33,6 +44,42 @@ bool loadImageDataFunc(tinygltf::Image* image, const int imageIndex, std::string
 	return tinygltf::LoadImageData(image, imageIndex, error, warning, req_width, req_height, bytes, size, userData);
 }
 
+bool loadImageDataFuncDeferred(tinygltf::Image* image, const int imageIndex, std::string* error, std::string* warning, int req_width, int req_height, const unsigned char* bytes, int size, void* userData)
+{
+	// This function is used for multi-threaded loading, it only stores the encoded image data so images can be decoded in parallel after parsing
+	if (image->uri.find_last_of(".") != std::string::npos) {
+		if (image->uri.substr(image->uri.find_last_of(".") + 1) == "ktx") {
+			return true;
+		}
+	}
+	std::vector<std::vector<unsigned char>>* encodedImages = static_cast<std::vector<std::vector<unsigned char>>*>(userData);
+	if (encodedImages->size() <= static_cast<size_t>(imageIndex)) {
+		encodedImages->resize(imageIndex + 1);
+	}
+	(*encodedImages)[imageIndex].assign(bytes, bytes + size);
+	return true;
+}
+
+/*
+	Decodes image data stored by loadImageDataFuncDeferred, always decodes to RGBA so no conversion is required at upload
+*/
+bool decodeImageData(tinygltf::Image& image, const std::vector<unsigned char>& encodedImage)
+{
+	int width, height, components;
+	unsigned char* data = stbi_load_from_memory(encodedImage.data(), static_cast<int>(encodedImage.size()), &width, &height, &components, STBI_rgb_alpha);
+	if (!data) {
+		return false;
+	}
+	image.width = width;
+	image.height = height;
+	image.component = 4;
+	image.bits = 8;
+	image.pixel_type = TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
+	image.image.assign(data, data + static_cast<size_t>(width) * height * 4);
+	stbi_image_free(data);
+	return true;
+}
+
 bool loadImageDataFuncEmpty(tinygltf::Image* image, const int imageIndex, std::string* error, std::string* warning, int req_width, int req_height, const unsigned char* bytes, int size, void* userData) 
 {
 	// This function will be used for samples that don't require images to be loaded
@@ -40,6 +87,255 @@ bool loadImageDataFuncEmpty(tinygltf::Image* image, const int imageIndex, std::s
 }
 
 
+bool isKtxFile(const std::string& uri)
+{
+	const size_t extensionPos = uri.find_last_of(".");
+	return (extensionPos != std::string::npos) && (uri.substr(extensionPos + 1) == "ktx");
+}
+
+bool readFileData(const std::string& filename, std::vector<unsigned char>& data)
+{
+	std::ifstream file(filename, std::ios::binary | std::ios::ate);
+	if (!file.is_open()) {
+		return false;
+	}
+	data.resize(static_cast<size_t>(file.tellg()));
+	file.seekg(0, std::ios::beg);
+	file.read(reinterpret_cast<char*>(data.data()), data.size());
+	return file.good();
+}
+
+/*
+	Binary mesh cache
+
+	Stores the processed scene (nodes, meshes, materials, skins, animations and image references) together with the converted vertex and index data
+	next to the glTF file, so later runs can skip parsing the glTF file and converting its accessors
+	The cache file is memory mapped, vertex and index data is copied straight from the mapping into staging memory
+*/
+namespace
+{
+	const uint32_t meshCacheMagic = 0x43474B56; // "VKGC"
+	// Must be increased whenever the layout of the cache file or of the cached structures (e.g. vkglTF::Vertex) changes
+	const uint32_t meshCacheVersion = 2;
+	// Vertex and index data is aligned to allow for fast copies into staging memory
+	const uint64_t meshCacheBlobAlignment = 256;
+	// File loading flags that change the cached data
+	const uint32_t meshCacheFlagsMask = vkglTF::FileLoadingFlags::PreTransformVertices | vkglTF::FileLoadingFlags::PreMultiplyVertexColors | vkglTF::FileLoadingFlags::FlipY | vkglTF::FileLoadingFlags::DontLoadImages;
+
+	struct MeshCacheHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		// Source glTF file the cache has been created from, the cache is rebuilt if any of these differ
+		uint64_t sourceHash;
+		uint64_t sourceSize;
+		uint64_t sourceTimestamp;
+		uint32_t fileLoadingFlags;
+		float scale;
+		// Vertex data is stored in the vertex layout that was active when the cache was written
+		uint32_t vertexSize;
+		uint32_t indexSize;
+		uint64_t vertexLayoutHash;
+		uint64_t tablesOffset;
+		uint64_t tablesSize;
+		uint64_t vertexDataOffset;
+		uint64_t vertexDataSize;
+		uint64_t indexDataOffset;
+		uint64_t indexDataSize;
+	};
+
+	class MeshCacheWriter
+	{
+	public:
+		std::vector<unsigned char> data;
+		void writeBytes(const void* bytes, size_t size)
+		{
+			const unsigned char* source = static_cast<const unsigned char*>(bytes);
+			data.insert(data.end(), source, source + size);
+		}
+		template<typename T>
+		void write(const T& value)
+		{
+			writeBytes(&value, sizeof(T));
+		}
+		void writeString(const std::string& value)
+		{
+			write(static_cast<uint32_t>(value.size()));
+			writeBytes(value.data(), value.size());
+		}
+		template<typename T>
+		void writeVector(const std::vector<T>& values)
+		{
+			write(static_cast<uint64_t>(values.size()));
+			writeBytes(values.data(), values.size() * sizeof(T));
+		}
+	};
+
+	// All reads are bounds checked, once a read exceeds the data, failed is set and all further reads return zero
+	class MeshCacheReader
+	{
+	public:
+		bool failed = false;
+		MeshCacheReader(const unsigned char* data, size_t size) : current(data), end(data + size) {}
+		const unsigned char* readBytes(size_t size)
+		{
+			if (failed || (size > static_cast<size_t>(end - current))) {
+				failed = true;
+				return nullptr;
+			}
+			const unsigned char* bytes = current;
+			current += size;
+			return bytes;
+		}
+		template<typename T>
+		T read()
+		{
+			T value{};
+			const unsigned char* bytes = readBytes(sizeof(T));
+			if (bytes) {
+				memcpy(&value, bytes, sizeof(T));
+			}
+			return value;
+		}
+		std::string readString()
+		{
+			const uint32_t size = read<uint32_t>();
+			const unsigned char* bytes = readBytes(size);
+			return bytes ? std::string(reinterpret_cast<const char*>(bytes), size) : std::string();
+		}
+		template<typename T>
+		void readVector(std::vector<T>& values)
+		{
+			const uint64_t count = read<uint64_t>();
+			if (failed || (count > static_cast<uint64_t>(end - current) / sizeof(T))) {
+				failed = true;
+				return;
+			}
+			values.resize(static_cast<size_t>(count));
+			if (count > 0) {
+				memcpy(values.data(), readBytes(static_cast<size_t>(count) * sizeof(T)), static_cast<size_t>(count) * sizeof(T));
+			}
+		}
+	private:
+		const unsigned char* current;
+		const unsigned char* end;
+	};
+
+	// Read-only memory mapping of a file
+	class MappedFile
+	{
+	public:
+		const unsigned char* data = nullptr;
+		size_t size = 0;
+		~MappedFile()
+		{
+			close();
+		}
+		bool open(const std::string& filename)
+		{
+#if defined(_WIN32)
+			file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE) {
+				return false;
+			}
+			LARGE_INTEGER fileSize;
+			if (!GetFileSizeEx(file, &fileSize) || (fileSize.QuadPart == 0)) {
+				close();
+				return false;
+			}
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (!mapping) {
+				close();
+				return false;
+			}
+			data = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			if (!data) {
+				close();
+				return false;
+			}
+			size = static_cast<size_t>(fileSize.QuadPart);
+#else
+			int fd = ::open(filename.c_str(), O_RDONLY);
+			if (fd < 0) {
+				return false;
+			}
+			struct stat fileStat;
+			if ((fstat(fd, &fileStat) != 0) || (fileStat.st_size == 0)) {
+				::close(fd);
+				return false;
+			}
+			void* mapped = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+			// The mapping stays valid after closing the file descriptor
+			::close(fd);
+			if (mapped == MAP_FAILED) {
+				return false;
+			}
+			data = static_cast<const unsigned char*>(mapped);
+			size = static_cast<size_t>(fileStat.st_size);
+#endif
+			return true;
+		}
+		void close()
+		{
+#if defined(_WIN32)
+			if (data) {
+				UnmapViewOfFile(data);
+			}
+			if (mapping) {
+				CloseHandle(mapping);
+				mapping = nullptr;
+			}
+			if (file != INVALID_HANDLE_VALUE) {
+				CloseHandle(file);
+				file = INVALID_HANDLE_VALUE;
+			}
+#else
+			if (data) {
+				munmap(const_cast<unsigned char*>(data), size);
+			}
+#endif
+			data = nullptr;
+			size = 0;
+		}
+#if defined(_WIN32)
+	private:
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = nullptr;
+#endif
+	};
+
+	bool getFileInfo(const std::string& filename, uint64_t& size, uint64_t& timestamp)
+	{
+		struct stat fileStat;
+		if (stat(filename.c_str(), &fileStat) != 0) {
+			return false;
+		}
+		size = static_cast<uint64_t>(fileStat.st_size);
+		timestamp = static_cast<uint64_t>(fileStat.st_mtime);
+		return true;
+	}
+
+	// 64 bit FNV-1a hash of the file's contents
+	bool hashFile(const std::string& filename, uint64_t& hash)
+	{
+		std::vector<unsigned char> data;
+		if (!readFileData(filename, data)) {
+			return false;
+		}
+		hash = 14695981039346656037ull;
+		for (unsigned char byte : data) {
+			hash ^= byte;
+			hash *= 1099511628211ull;
+		}
+		return true;
+	}
+
+	uint64_t alignCacheOffset(uint64_t offset)
+	{
+		return (offset + meshCacheBlobAlignment - 1) & ~(meshCacheBlobAlignment - 1);
+	}
+}
+
 /*
 	glTF texture loading class
 */
@@ -57,7 +353,14 @@ void vkglTF::Texture::destroy()
 	{
 		vkDestroyImageView(device->logicalDevice, view, nullptr);
 		vkDestroyImage(device->logicalDevice, image, nullptr);
-		vkFreeMemory(device->logicalDevice, deviceMemory, nullptr);
+		if (allocation.allocator)
+		{
+			allocation.allocator->free(&allocation);
+		}
+		else
+		{
+			vkFreeMemory(device->logicalDevice, deviceMemory, nullptr);
+		}
 		vkDestroySampler(device->logicalDevice, sampler, nullptr);
 	}
 }
@@ -115,30 +418,6 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 		assert(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT);
 		assert(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT);
 
-		VkMemoryAllocateInfo memAllocInfo{};
-		memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		VkMemoryRequirements memReqs{};
-
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingMemory;
-
-		VkBufferCreateInfo bufferCreateInfo{};
-		bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-		bufferCreateInfo.size = bufferSize;
-		bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-		vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-		memAllocInfo.allocationSize = memReqs.size;
-		memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-		VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-		uint8_t* data;
-		VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void**)&data));
-		memcpy(data, buffer, bufferSize);
-		vkUnmapMemory(device->logicalDevice, stagingMemory);
-
 		VkImageCreateInfo imageCreateInfo{};
 		imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -153,30 +432,9 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 		imageCreateInfo.extent = { width, height, 1 };
 		imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
-		vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
-		memAllocInfo.allocationSize = memReqs.size;
-		memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
-		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
-
-		VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-		VkImageSubresourceRange subresourceRange = {};
-		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		subresourceRange.levelCount = 1;
-		subresourceRange.layerCount = 1;
-
-		{
-			VkImageMemoryBarrier imageMemoryBarrier{};
-			imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-			imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-			imageMemoryBarrier.srcAccessMask = 0;
-			imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			imageMemoryBarrier.image = image;
-			imageMemoryBarrier.subresourceRange = subresourceRange;
-			vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-		}
+		VK_CHECK_RESULT(device->memoryAllocator.allocateImageMemory(image, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &allocation));
+		deviceMemory = allocation.memory;
+		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, allocation.offset));
 
 		VkBufferImageCopy bufferCopyRegion = {};
 		bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -187,97 +445,20 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 		bufferCopyRegion.imageExtent.height = height;
 		bufferCopyRegion.imageExtent.depth = 1;
 
-		vkCmdCopyBufferToImage(copyCmd, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
-
-		{
-			VkImageMemoryBarrier imageMemoryBarrier{};
-			imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-			imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-			imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-			imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-			imageMemoryBarrier.image = image;
-			imageMemoryBarrier.subresourceRange = subresourceRange;
-			vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-		}
-
-		device->flushCommandBuffer(copyCmd, copyQueue, true);
-
-		vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
-		vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
-
-		// Generate the mip chain (glTF uses jpg and png, so we need to create this manually)
-		VkCommandBuffer blitCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-		for (uint32_t i = 1; i < mipLevels; i++) {
-			VkImageBlit imageBlit{};
-
-			imageBlit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			imageBlit.srcSubresource.layerCount = 1;
-			imageBlit.srcSubresource.mipLevel = i - 1;
-			imageBlit.srcOffsets[1].x = int32_t(width >> (i - 1));
-			imageBlit.srcOffsets[1].y = int32_t(height >> (i - 1));
-			imageBlit.srcOffsets[1].z = 1;
-
-			imageBlit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			imageBlit.dstSubresource.layerCount = 1;
-			imageBlit.dstSubresource.mipLevel = i;
-			imageBlit.dstOffsets[1].x = int32_t(width >> i);
-			imageBlit.dstOffsets[1].y = int32_t(height >> i);
-			imageBlit.dstOffsets[1].z = 1;
-
-			VkImageSubresourceRange mipSubRange = {};
-			mipSubRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			mipSubRange.baseMipLevel = i;
-			mipSubRange.levelCount = 1;
-			mipSubRange.layerCount = 1;
-
-			{
-				VkImageMemoryBarrier imageMemoryBarrier{};
-				imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-				imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-				imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-				imageMemoryBarrier.srcAccessMask = 0;
-				imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-				imageMemoryBarrier.image = image;
-				imageMemoryBarrier.subresourceRange = mipSubRange;
-				vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-			}
-
-			vkCmdBlitImage(blitCmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageBlit, VK_FILTER_LINEAR);
-
-			{
-				VkImageMemoryBarrier imageMemoryBarrier{};
-				imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-				imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-				imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-				imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-				imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-				imageMemoryBarrier.image = image;
-				imageMemoryBarrier.subresourceRange = mipSubRange;
-				vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-			}
-		}
-
-		subresourceRange.levelCount = mipLevels;
+		// The first mip level is uploaded through the device's staging uploader, the mip chain is generated by the uploader on the graphics queue
+		// (glTF uses jpg and png, so we need to create this manually)
+		vks::StagingUploader::ImageUploadInfo uploadInfo;
+		uploadInfo.image = image;
+		uploadInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1 };
+		uploadInfo.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		uploadInfo.generateMipmaps = true;
+		uploadInfo.extent = { width, height, 1 };
+		device->stagingUploader.uploadImage(uploadInfo, buffer, bufferSize, { bufferCopyRegion });
 		imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-		{
-			VkImageMemoryBarrier imageMemoryBarrier{};
-			imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-			imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-			imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-			imageMemoryBarrier.image = image;
-			imageMemoryBarrier.subresourceRange = subresourceRange;
-			vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+		if (deleteBuffer) {
+			delete[] buffer;
 		}
-
-        if (deleteBuffer) {
-            delete[] buffer;
-        }
-
-		device->flushCommandBuffer(blitCmd, copyQueue, true);
 	}
 	else {
 		// Texture is stored in an external ktx file
@@ -320,30 +501,6 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 		VkFormatProperties formatProperties;
 		vkGetPhysicalDeviceFormatProperties(device->physicalDevice, format, &formatProperties);
 
-		VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingMemory;
-
-		VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo();
-		bufferCreateInfo.size = ktxTextureSize;
-		// This buffer is used as a transfer source for the buffer copy
-		bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-
-		VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
-		VkMemoryRequirements memReqs;
-		vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-		memAllocInfo.allocationSize = memReqs.size;
-		memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-		VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-		uint8_t* data;
-		VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void**)&data));
-		memcpy(data, ktxTextureData, ktxTextureSize);
-		vkUnmapMemory(device->logicalDevice, stagingMemory);
-
 		std::vector<VkBufferImageCopy> bufferCopyRegions;
 		for (uint32_t i = 0; i < mipLevels; i++)
 		{
@@ -376,11 +533,9 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 		imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
 
-		vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
-		memAllocInfo.allocationSize = memReqs.size;
-		memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
-		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
+		VK_CHECK_RESULT(device->memoryAllocator.allocateImageMemory(image, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &allocation));
+		deviceMemory = allocation.memory;
+		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, allocation.offset));
 
 		VkImageSubresourceRange subresourceRange = {};
 		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -388,15 +543,13 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 		subresourceRange.levelCount = mipLevels;
 		subresourceRange.layerCount = 1;
 
-		vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
-		vkCmdCopyBufferToImage(copyCmd, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(bufferCopyRegions.size()), bufferCopyRegions.data());
-		vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange);
-		device->flushCommandBuffer(copyCmd, copyQueue);
+		vks::StagingUploader::ImageUploadInfo uploadInfo;
+		uploadInfo.image = image;
+		uploadInfo.subresourceRange = subresourceRange;
+		uploadInfo.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		device->stagingUploader.uploadImage(uploadInfo, ktxTextureData, ktxTextureSize, bufferCopyRegions);
 		this->imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-		vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
-		vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
-
 		ktxTexture_Destroy(ktxTexture);
 	}
 
@@ -488,20 +641,20 @@ void vkglTF::Primitive::setDimensions(glm::vec3 min, glm::vec3 max) {
 vkglTF::Mesh::Mesh(vks::VulkanDevice *device, glm::mat4 matrix) {
 	this->device = device;
 	this->uniformBlock.matrix = matrix;
-	VK_CHECK_RESULT(device->createBuffer(
-		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		sizeof(uniformBlock),
-		&uniformBuffer.buffer,
-		&uniformBuffer.memory,
-		&uniformBlock));
-	VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, uniformBuffer.memory, 0, sizeof(uniformBlock), 0, &uniformBuffer.mapped));
+	// Scenes can contain lots of meshes, so the (small) uniform buffers are sub-allocated instead of getting their own memory allocation
+	VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, sizeof(uniformBlock));
+	VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &uniformBuffer.buffer));
+	VK_CHECK_RESULT(device->memoryAllocator.allocateBufferMemory(uniformBuffer.buffer, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &uniformBuffer.allocation));
+	uniformBuffer.memory = uniformBuffer.allocation.memory;
+	VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, uniformBuffer.buffer, uniformBuffer.memory, uniformBuffer.allocation.offset));
+	uniformBuffer.mapped = uniformBuffer.allocation.mapped;
+	memcpy(uniformBuffer.mapped, &uniformBlock, sizeof(uniformBlock));
 	uniformBuffer.descriptor = { uniformBuffer.buffer, 0, sizeof(uniformBlock) };
 };
 
 vkglTF::Mesh::~Mesh() {
 	vkDestroyBuffer(device->logicalDevice, uniformBuffer.buffer, nullptr);
-	vkFreeMemory(device->logicalDevice, uniformBuffer.memory, nullptr);
+	device->memoryAllocator.free(&uniformBuffer.allocation);
     for(auto primitive : primitives)
     {
         delete primitive;
@@ -525,28 +678,51 @@ glm::mat4 vkglTF::Node::getMatrix() {
 	return m;
 }
 
+/*
+	Recalculates the world matrices of the node and its children and updates the uniform buffers of their meshes
+	Joint matrices are calculated from the cached world matrices of the joints, use Model::updateTransforms to update the whole scene in a single pass
+*/
 void vkglTF::Node::update() {
-	if (mesh) {
-		glm::mat4 m = getMatrix();
-		if (skin) {
-			mesh->uniformBlock.matrix = m;
-			// Update join matrices
-			glm::mat4 inverseTransform = glm::inverse(m);
-			for (size_t i = 0; i < skin->joints.size(); i++) {
-				vkglTF::Node *jointNode = skin->joints[i];
-				glm::mat4 jointMat = jointNode->getMatrix() * skin->inverseBindMatrices[i];
-				jointMat = inverseTransform * jointMat;
-				mesh->uniformBlock.jointMatrix[i] = jointMat;
-			}
-			mesh->uniformBlock.jointcount = (float)skin->joints.size();
-			memcpy(mesh->uniformBuffer.mapped, &mesh->uniformBlock, sizeof(mesh->uniformBlock));
-		} else {
-			memcpy(mesh->uniformBuffer.mapped, &m, sizeof(glm::mat4));
-		}
+	worldMatrix = parent ? parent->getMatrix() * localMatrix() : localMatrix();
+	transformDirty = false;
+	std::vector<Node*> stack(children.begin(), children.end());
+	while (!stack.empty()) {
+		Node* node = stack.back();
+		stack.pop_back();
+		node->worldMatrix = node->parent->worldMatrix * node->localMatrix();
+		node->transformDirty = false;
+		stack.insert(stack.end(), node->children.begin(), node->children.end());
+	}
+	updateUniformBuffer();
+	stack.assign(children.begin(), children.end());
+	while (!stack.empty()) {
+		Node* node = stack.back();
+		stack.pop_back();
+		node->updateUniformBuffer();
+		stack.insert(stack.end(), node->children.begin(), node->children.end());
 	}
+}
 
-	for (auto& child : children) {
-		child->update();
+void vkglTF::Node::updateUniformBuffer() {
+	if (!mesh) {
+		return;
+	}
+	if (skin) {
+		mesh->uniformBlock.matrix = worldMatrix;
+		// Update joint matrices
+		const glm::mat4 inverseTransform = glm::inverse(worldMatrix);
+		const size_t maxJointCount = sizeof(mesh->uniformBlock.jointMatrix) / sizeof(glm::mat4);
+		const size_t jointCount = std::min(skin->joints.size(), maxJointCount);
+		for (size_t i = 0; i < jointCount; i++) {
+			mesh->uniformBlock.jointMatrix[i] = inverseTransform * skin->joints[i]->worldMatrix * skin->inverseBindMatrices[i];
+		}
+		mesh->uniformBlock.jointcount = (float)jointCount;
+		// Only copy the joint matrices used by the skin
+		unsigned char* mapped = static_cast<unsigned char*>(mesh->uniformBuffer.mapped);
+		memcpy(mapped, &mesh->uniformBlock, offsetof(Mesh::UniformBlock, jointMatrix) + jointCount * sizeof(glm::mat4));
+		memcpy(mapped + offsetof(Mesh::UniformBlock, jointcount), &mesh->uniformBlock.jointcount, sizeof(float));
+	} else {
+		memcpy(mesh->uniformBuffer.mapped, &worldMatrix, sizeof(glm::mat4));
 	}
 }
 
@@ -560,147 +736,408 @@ vkglTF::Node::~Node() {
 }
 
 /*
-	glTF default vertex layout with easy Vulkan mapping functions
+	Vertex layout with optional quantization of vertex components
 */
 
-VkVertexInputBindingDescription vkglTF::Vertex::vertexInputBindingDescription;
-std::vector<VkVertexInputAttributeDescription> vkglTF::Vertex::vertexInputAttributeDescriptions;
-VkPipelineVertexInputStateCreateInfo vkglTF::Vertex::pipelineVertexInputStateCreateInfo;
+namespace
+{
+	int16_t packSnorm16(float value)
+	{
+		return static_cast<int16_t>(roundf(std::min(std::max(value, -1.0f), 1.0f) * 32767.0f));
+	}
 
-VkVertexInputBindingDescription vkglTF::Vertex::inputBindingDescription(uint32_t binding) {
-	return VkVertexInputBindingDescription({ binding, sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX });
-}
+	int8_t packSnorm8(float value)
+	{
+		return static_cast<int8_t>(roundf(std::min(std::max(value, -1.0f), 1.0f) * 127.0f));
+	}
 
-VkVertexInputAttributeDescription vkglTF::Vertex::inputAttributeDescription(uint32_t binding, uint32_t location, VertexComponent component) {
-	switch (component) {
-		case VertexComponent::Position: 
-			return VkVertexInputAttributeDescription({ location, binding, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, pos) });
+	uint32_t packUnorm(float value, float maxValue)
+	{
+		return static_cast<uint32_t>(roundf(std::min(std::max(value, 0.0f), 1.0f) * maxValue));
+	}
+
+	// Maps [-1, 1] to 10 bit unsigned normalized, the shader decodes with value * 2.0 - 1.0
+	uint32_t pack1010102(const glm::vec4& value)
+	{
+		const uint32_t x = packUnorm(value.x * 0.5f + 0.5f, 1023.0f);
+		const uint32_t y = packUnorm(value.y * 0.5f + 0.5f, 1023.0f);
+		const uint32_t z = packUnorm(value.z * 0.5f + 0.5f, 1023.0f);
+		const uint32_t w = (value.w < 0.0f) ? 0 : 3;
+		return x | (y << 10) | (z << 20) | (w << 30);
+	}
+
+	// Octahedral normal encoding (see "A Survey of Efficient Representations for Independent Unit Vectors", Cigolle et al. 2014)
+	glm::vec2 encodeOctahedral(glm::vec3 normal)
+	{
+		normal /= (fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z));
+		glm::vec2 result(normal.x, normal.y);
+		if (normal.z < 0.0f) {
+			result.x = (1.0f - fabsf(normal.y)) * (normal.x >= 0.0f ? 1.0f : -1.0f);
+			result.y = (1.0f - fabsf(normal.x)) * (normal.y >= 0.0f ? 1.0f : -1.0f);
+		}
+		return result;
+	}
+
+	// Quantizes weights and distributes the rounding error, so the quantized weights still sum up to one
+	template<typename T>
+	void packWeights(const glm::vec4& weights, float maxValue, T* dst)
+	{
+		int32_t sum = 0;
+		uint32_t largest = 0;
+		for (uint32_t i = 0; i < 4; i++) {
+			dst[i] = static_cast<T>(packUnorm(weights[i], maxValue));
+			sum += dst[i];
+			if (dst[i] > dst[largest]) {
+				largest = i;
+			}
+		}
+		if (sum > 0) {
+			dst[largest] = static_cast<T>(static_cast<int32_t>(dst[largest]) + static_cast<int32_t>(maxValue) - sum);
+		}
+	}
+
+	// Returns the Vulkan format for storing a component in the given format, VK_FORMAT_UNDEFINED if the combination isn't supported
+	VkFormat getVertexComponentFormat(vkglTF::VertexComponent component, vkglTF::VertexComponentFormat format)
+	{
+		using vkglTF::VertexComponent;
+		using vkglTF::VertexComponentFormat;
+		switch (component) {
+		case VertexComponent::Position:
+			if (format == VertexComponentFormat::Float) return VK_FORMAT_R32G32B32_SFLOAT;
+			if (format == VertexComponentFormat::Half) return VK_FORMAT_R16G16B16A16_SFLOAT;
+			break;
 		case VertexComponent::Normal:
-			return VkVertexInputAttributeDescription({ location, binding, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, normal) });
+			if (format == VertexComponentFormat::Float) return VK_FORMAT_R32G32B32_SFLOAT;
+			if (format == VertexComponentFormat::Snorm16) return VK_FORMAT_R16G16B16A16_SNORM;
+			if (format == VertexComponentFormat::Snorm8) return VK_FORMAT_R8G8B8A8_SNORM;
+			if (format == VertexComponentFormat::Octahedral) return VK_FORMAT_R16G16_SNORM;
+			if (format == VertexComponentFormat::Packed1010102) return VK_FORMAT_A2B10G10R10_UNORM_PACK32;
+			break;
 		case VertexComponent::UV:
-			return VkVertexInputAttributeDescription({ location, binding, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, uv) });
+			if (format == VertexComponentFormat::Float) return VK_FORMAT_R32G32_SFLOAT;
+			if (format == VertexComponentFormat::Half) return VK_FORMAT_R16G16_SFLOAT;
+			break;
 		case VertexComponent::Color:
-			return VkVertexInputAttributeDescription({ location, binding, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(Vertex, color) });
+			if (format == VertexComponentFormat::Float) return VK_FORMAT_R32G32B32A32_SFLOAT;
+			if (format == VertexComponentFormat::Half) return VK_FORMAT_R16G16B16A16_SFLOAT;
+			if (format == VertexComponentFormat::Unorm16) return VK_FORMAT_R16G16B16A16_UNORM;
+			if (format == VertexComponentFormat::Unorm8) return VK_FORMAT_R8G8B8A8_UNORM;
+			break;
 		case VertexComponent::Tangent:
-			return VkVertexInputAttributeDescription({ location, binding, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(Vertex, tangent)} );
+			if (format == VertexComponentFormat::Float) return VK_FORMAT_R32G32B32A32_SFLOAT;
+			if (format == VertexComponentFormat::Snorm16) return VK_FORMAT_R16G16B16A16_SNORM;
+			if (format == VertexComponentFormat::Snorm8) return VK_FORMAT_R8G8B8A8_SNORM;
+			if (format == VertexComponentFormat::Packed1010102) return VK_FORMAT_A2B10G10R10_UNORM_PACK32;
+			break;
 		case VertexComponent::Joint0:
-			return VkVertexInputAttributeDescription({ location, binding, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(Vertex, joint0) });
+			if (format == VertexComponentFormat::Float) return VK_FORMAT_R32G32B32A32_SFLOAT;
+			if (format == VertexComponentFormat::Uint16) return VK_FORMAT_R16G16B16A16_UINT;
+			if (format == VertexComponentFormat::Uint8) return VK_FORMAT_R8G8B8A8_UINT;
+			break;
 		case VertexComponent::Weight0:
-			return VkVertexInputAttributeDescription({ location, binding, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(Vertex, weight0) });
-		default:
-			return VkVertexInputAttributeDescription({});
+			if (format == VertexComponentFormat::Float) return VK_FORMAT_R32G32B32A32_SFLOAT;
+			if (format == VertexComponentFormat::Unorm16) return VK_FORMAT_R16G16B16A16_UNORM;
+			if (format == VertexComponentFormat::Unorm8) return VK_FORMAT_R8G8B8A8_UNORM;
+			break;
+		}
+		return VK_FORMAT_UNDEFINED;
 	}
-}
 
-std::vector<VkVertexInputAttributeDescription> vkglTF::Vertex::inputAttributeDescriptions(uint32_t binding, const std::vector<VertexComponent> components) {
-	std::vector<VkVertexInputAttributeDescription> result;
-	uint32_t location = 0;
-	for (VertexComponent component : components) {
-		result.push_back(Vertex::inputAttributeDescription(binding, location, component));
-		location++;
+	uint32_t getVertexFormatSize(VkFormat format)
+	{
+		switch (format) {
+		case VK_FORMAT_R32G32B32A32_SFLOAT:
+			return 16;
+		case VK_FORMAT_R32G32B32_SFLOAT:
+			return 12;
+		case VK_FORMAT_R32G32_SFLOAT:
+		case VK_FORMAT_R16G16B16A16_SFLOAT:
+		case VK_FORMAT_R16G16B16A16_SNORM:
+		case VK_FORMAT_R16G16B16A16_UNORM:
+		case VK_FORMAT_R16G16B16A16_UINT:
+			return 8;
+		default:
+			return 4;
+		}
 	}
-	return result;
 }
 
-/** @brief Returns the default pipeline vertex input state create info structure for the requested vertex components */
-VkPipelineVertexInputStateCreateInfo* vkglTF::Vertex::getPipelineVertexInputState(const std::vector<VertexComponent> components) {
-	vertexInputBindingDescription = Vertex::inputBindingDescription(0);
-	Vertex::vertexInputAttributeDescriptions = Vertex::inputAttributeDescriptions(0, components);
-	pipelineVertexInputStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	pipelineVertexInputStateCreateInfo.vertexBindingDescriptionCount = 1;
-	pipelineVertexInputStateCreateInfo.pVertexBindingDescriptions = &Vertex::vertexInputBindingDescription;
-	pipelineVertexInputStateCreateInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(Vertex::vertexInputAttributeDescriptions.size());
-	pipelineVertexInputStateCreateInfo.pVertexAttributeDescriptions = Vertex::vertexInputAttributeDescriptions.data();
-	return &pipelineVertexInputStateCreateInfo;
+void vkglTF::VertexLayout::add(VertexComponent component, VertexComponentFormat format)
+{
+	assert(getAttribute(component) == nullptr);
+	Attribute attribute{};
+	attribute.component = component;
+	attribute.format = format;
+	attribute.vkFormat = getVertexComponentFormat(component, format);
+	assert(attribute.vkFormat != VK_FORMAT_UNDEFINED && "Vertex component format not supported for this component");
+	attribute.offset = stride;
+	stride += getVertexFormatSize(attribute.vkFormat);
+	attributes.push_back(attribute);
 }
 
-vkglTF::Texture* vkglTF::Model::getTexture(uint32_t index)
+void vkglTF::VertexLayout::clear()
 {
+	attributes.clear();
+	stride = 0;
+}
 
-	if (index < textures.size()) {
-		return &textures[index];
+const vkglTF::VertexLayout::Attribute* vkglTF::VertexLayout::getAttribute(VertexComponent component) const
+{
+	for (const Attribute& attribute : attributes) {
+		if (attribute.component == component) {
+			return &attribute;
+		}
 	}
 	return nullptr;
 }
 
-void vkglTF::Model::createEmptyTexture(VkQueue transferQueue)
+uint32_t vkglTF::VertexLayout::getStride() const
 {
-	emptyTexture.device = device;
-	emptyTexture.width = 1;
-	emptyTexture.height = 1;
-	emptyTexture.layerCount = 1;
-	emptyTexture.mipLevels = 1;
-
-	size_t bufferSize = emptyTexture.width * emptyTexture.height * 4;
-	unsigned char* buffer = new unsigned char[bufferSize];
-	memset(buffer, 0, bufferSize);
-
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingMemory;
-	VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo();
-	bufferCreateInfo.size = bufferSize;
-	// This buffer is used as a transfer source for the buffer copy
-	bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-
-	VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
-	VkMemoryRequirements memReqs;
-	vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-	memAllocInfo.allocationSize = memReqs.size;
-	memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-	VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-	// Copy texture data into staging buffer
-	uint8_t* data;
-	VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void**)&data));
-	memcpy(data, buffer, bufferSize);
-	vkUnmapMemory(device->logicalDevice, stagingMemory);
-
-	VkBufferImageCopy bufferCopyRegion = {};
-	bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	bufferCopyRegion.imageSubresource.layerCount = 1;
-	bufferCopyRegion.imageExtent.width = emptyTexture.width;
-	bufferCopyRegion.imageExtent.height = emptyTexture.height;
-	bufferCopyRegion.imageExtent.depth = 1;
-
-	// Create optimal tiled target image
-	VkImageCreateInfo imageCreateInfo = vks::initializers::imageCreateInfo();
-	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-	imageCreateInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
-	imageCreateInfo.mipLevels = 1;
-	imageCreateInfo.arrayLayers = 1;
-	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	imageCreateInfo.extent = { emptyTexture.width, emptyTexture.height, 1 };
-	imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-	VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &emptyTexture.image));
-
-	vkGetImageMemoryRequirements(device->logicalDevice, emptyTexture.image, &memReqs);
-	memAllocInfo.allocationSize = memReqs.size;
-	memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &emptyTexture.deviceMemory));
-	VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, emptyTexture.image, emptyTexture.deviceMemory, 0));
+	return attributes.empty() ? static_cast<uint32_t>(sizeof(Vertex)) : stride;
+}
 
-	VkImageSubresourceRange subresourceRange{};
-	subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	subresourceRange.baseMipLevel = 0;
-	subresourceRange.levelCount = 1;
-	subresourceRange.layerCount = 1;
+uint64_t vkglTF::VertexLayout::getHash() const
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (const Attribute& attribute : attributes) {
+		hash = (hash ^ static_cast<uint64_t>(attribute.component)) * 1099511628211ull;
+		hash = (hash ^ static_cast<uint64_t>(attribute.format)) * 1099511628211ull;
+	}
+	return hash;
+}
 
-	VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-	vks::tools::setImageLayout(copyCmd, emptyTexture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
-	vkCmdCopyBufferToImage(copyCmd, stagingBuffer, emptyTexture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
-	vks::tools::setImageLayout(copyCmd, emptyTexture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange);
-	device->flushCommandBuffer(copyCmd, transferQueue);
-	emptyTexture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+void vkglTF::VertexLayout::pack(const Vertex& vertex, unsigned char* dst) const
+{
+	for (const Attribute& attribute : attributes) {
+		unsigned char* attributeDst = dst + attribute.offset;
+		// Source value of the component, unused components are zero
+		glm::vec4 value(0.0f);
+		switch (attribute.component) {
+		case VertexComponent::Position:
+			value = glm::vec4(vertex.pos, 1.0f);
+			break;
+		case VertexComponent::Normal:
+			value = glm::vec4(vertex.normal, 0.0f);
+			break;
+		case VertexComponent::UV:
+			value = glm::vec4(vertex.uv, 0.0f, 0.0f);
+			break;
+		case VertexComponent::Color:
+			value = vertex.color;
+			break;
+		case VertexComponent::Tangent:
+			value = vertex.tangent;
+			break;
+		case VertexComponent::Joint0:
+			value = vertex.joint0;
+			break;
+		case VertexComponent::Weight0:
+			value = vertex.weight0;
+			break;
+		}
+		switch (attribute.vkFormat) {
+		case VK_FORMAT_R32G32B32A32_SFLOAT:
+		case VK_FORMAT_R32G32B32_SFLOAT:
+		case VK_FORMAT_R32G32_SFLOAT:
+			memcpy(attributeDst, &value, getVertexFormatSize(attribute.vkFormat));
+			break;
+		case VK_FORMAT_R16G16B16A16_SFLOAT:
+		case VK_FORMAT_R16G16_SFLOAT: {
+			uint16_t* halfDst = reinterpret_cast<uint16_t*>(attributeDst);
+			const uint32_t componentCount = getVertexFormatSize(attribute.vkFormat) / sizeof(uint16_t);
+			for (uint32_t i = 0; i < componentCount; i++) {
+				halfDst[i] = glm::packHalf1x16(value[i]);
+			}
+			break;
+		}
+		case VK_FORMAT_R16G16B16A16_SNORM: {
+			int16_t* snormDst = reinterpret_cast<int16_t*>(attributeDst);
+			for (uint32_t i = 0; i < 4; i++) {
+				snormDst[i] = packSnorm16(value[i]);
+			}
+			break;
+		}
+		case VK_FORMAT_R8G8B8A8_SNORM: {
+			int8_t* snormDst = reinterpret_cast<int8_t*>(attributeDst);
+			for (uint32_t i = 0; i < 4; i++) {
+				snormDst[i] = packSnorm8(value[i]);
+			}
+			break;
+		}
+		case VK_FORMAT_R16G16_SNORM: {
+			const glm::vec2 octahedral = encodeOctahedral(glm::vec3(value));
+			int16_t* snormDst = reinterpret_cast<int16_t*>(attributeDst);
+			snormDst[0] = packSnorm16(octahedral.x);
+			snormDst[1] = packSnorm16(octahedral.y);
+			break;
+		}
+		case VK_FORMAT_A2B10G10R10_UNORM_PACK32: {
+			const uint32_t packed = pack1010102(value);
+			memcpy(attributeDst, &packed, sizeof(uint32_t));
+			break;
+		}
+		case VK_FORMAT_R16G16B16A16_UNORM: {
+			uint16_t* unormDst = reinterpret_cast<uint16_t*>(attributeDst);
+			if (attribute.component == VertexComponent::Weight0) {
+				packWeights(value, 65535.0f, unormDst);
+			} else {
+				for (uint32_t i = 0; i < 4; i++) {
+					unormDst[i] = static_cast<uint16_t>(packUnorm(value[i], 65535.0f));
+				}
+			}
+			break;
+		}
+		case VK_FORMAT_R8G8B8A8_UNORM: {
+			uint8_t* unormDst = attributeDst;
+			if (attribute.component == VertexComponent::Weight0) {
+				packWeights(value, 255.0f, unormDst);
+			} else {
+				for (uint32_t i = 0; i < 4; i++) {
+					unormDst[i] = static_cast<uint8_t>(packUnorm(value[i], 255.0f));
+				}
+			}
+			break;
+		}
+		case VK_FORMAT_R16G16B16A16_UINT: {
+			uint16_t* uintDst = reinterpret_cast<uint16_t*>(attributeDst);
+			for (uint32_t i = 0; i < 4; i++) {
+				uintDst[i] = static_cast<uint16_t>(value[i]);
+			}
+			break;
+		}
+		case VK_FORMAT_R8G8B8A8_UINT: {
+			for (uint32_t i = 0; i < 4; i++) {
+				attributeDst[i] = static_cast<uint8_t>(value[i]);
+			}
+			break;
+		}
+		default:
+			break;
+		}
+	}
+}
+
+/*
+	glTF default vertex layout with easy Vulkan mapping functions
+*/
+
+VkVertexInputBindingDescription vkglTF::Vertex::vertexInputBindingDescription;
+std::vector<VkVertexInputAttributeDescription> vkglTF::Vertex::vertexInputAttributeDescriptions;
+VkPipelineVertexInputStateCreateInfo vkglTF::Vertex::pipelineVertexInputStateCreateInfo;
+
+VkVertexInputBindingDescription vkglTF::Vertex::inputBindingDescription(uint32_t binding, uint32_t stride) {
+	// The global layout may have been changed since the model was loaded, so the model's own stride takes precedence
+	return VkVertexInputBindingDescription({ binding, (stride > 0) ? stride : vertexLayout.getStride(), VK_VERTEX_INPUT_RATE_VERTEX });
+}
+
+VkVertexInputAttributeDescription vkglTF::Vertex::inputAttributeDescription(uint32_t binding, uint32_t location, VertexComponent component) {
+	// Custom vertex layout
+	if (!vertexLayout.attributes.empty()) {
+		const VertexLayout::Attribute* attribute = vertexLayout.getAttribute(component);
+		assert(attribute && "Vertex component is not part of the current vertex layout");
+		return VkVertexInputAttributeDescription({ location, binding, attribute->vkFormat, attribute->offset });
+	}
+	switch (component) {
+		case VertexComponent::Position: 
+			return VkVertexInputAttributeDescription({ location, binding, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, pos) });
+		case VertexComponent::Normal:
+			return VkVertexInputAttributeDescription({ location, binding, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, normal) });
+		case VertexComponent::UV:
+			return VkVertexInputAttributeDescription({ location, binding, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, uv) });
+		case VertexComponent::Color:
+			return VkVertexInputAttributeDescription({ location, binding, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(Vertex, color) });
+		case VertexComponent::Tangent:
+			return VkVertexInputAttributeDescription({ location, binding, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(Vertex, tangent)} );
+		case VertexComponent::Joint0:
+			return VkVertexInputAttributeDescription({ location, binding, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(Vertex, joint0) });
+		case VertexComponent::Weight0:
+			return VkVertexInputAttributeDescription({ location, binding, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(Vertex, weight0) });
+		default:
+			return VkVertexInputAttributeDescription({});
+	}
+}
+
+std::vector<VkVertexInputAttributeDescription> vkglTF::Vertex::inputAttributeDescriptions(uint32_t binding, const std::vector<VertexComponent> components) {
+	std::vector<VkVertexInputAttributeDescription> result;
+	uint32_t location = 0;
+	for (VertexComponent component : components) {
+		result.push_back(Vertex::inputAttributeDescription(binding, location, component));
+		location++;
+	}
+	return result;
+}
+
+/** @brief Returns the default pipeline vertex input state create info structure for the requested vertex components */
+VkPipelineVertexInputStateCreateInfo* vkglTF::Vertex::getPipelineVertexInputState(const std::vector<VertexComponent> components, uint32_t stride) {
+	vertexInputBindingDescription = Vertex::inputBindingDescription(0, stride);
+	Vertex::vertexInputAttributeDescriptions = Vertex::inputAttributeDescriptions(0, components);
+	pipelineVertexInputStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	pipelineVertexInputStateCreateInfo.vertexBindingDescriptionCount = 1;
+	pipelineVertexInputStateCreateInfo.pVertexBindingDescriptions = &Vertex::vertexInputBindingDescription;
+	pipelineVertexInputStateCreateInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(Vertex::vertexInputAttributeDescriptions.size());
+	pipelineVertexInputStateCreateInfo.pVertexAttributeDescriptions = Vertex::vertexInputAttributeDescriptions.data();
+	return &pipelineVertexInputStateCreateInfo;
+}
+
+vkglTF::Texture* vkglTF::Model::getTexture(uint32_t index)
+{
+
+	if (index < textures.size()) {
+		return &textures[index];
+	}
+	return nullptr;
+}
+
+void vkglTF::Model::createEmptyTexture(VkQueue transferQueue)
+{
+	emptyTexture.device = device;
+	emptyTexture.width = 1;
+	emptyTexture.height = 1;
+	emptyTexture.layerCount = 1;
+	emptyTexture.mipLevels = 1;
+
+	size_t bufferSize = emptyTexture.width * emptyTexture.height * 4;
+	unsigned char* buffer = new unsigned char[bufferSize];
+	memset(buffer, 0, bufferSize);
+
+	VkBufferImageCopy bufferCopyRegion = {};
+	bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	bufferCopyRegion.imageSubresource.layerCount = 1;
+	bufferCopyRegion.imageExtent.width = emptyTexture.width;
+	bufferCopyRegion.imageExtent.height = emptyTexture.height;
+	bufferCopyRegion.imageExtent.depth = 1;
 
-	// Clean up staging resources
-	vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
-	vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
+	// Create optimal tiled target image
+	VkImageCreateInfo imageCreateInfo = vks::initializers::imageCreateInfo();
+	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageCreateInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+	imageCreateInfo.mipLevels = 1;
+	imageCreateInfo.arrayLayers = 1;
+	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageCreateInfo.extent = { emptyTexture.width, emptyTexture.height, 1 };
+	imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &emptyTexture.image));
+
+	VK_CHECK_RESULT(device->memoryAllocator.allocateImageMemory(emptyTexture.image, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &emptyTexture.allocation));
+	emptyTexture.deviceMemory = emptyTexture.allocation.memory;
+	VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, emptyTexture.image, emptyTexture.deviceMemory, emptyTexture.allocation.offset));
+
+	VkImageSubresourceRange subresourceRange{};
+	subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	subresourceRange.baseMipLevel = 0;
+	subresourceRange.levelCount = 1;
+	subresourceRange.layerCount = 1;
+
+	vks::StagingUploader::ImageUploadInfo uploadInfo;
+	uploadInfo.image = emptyTexture.image;
+	uploadInfo.subresourceRange = subresourceRange;
+	uploadInfo.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	device->stagingUploader.uploadImage(uploadInfo, buffer, bufferSize, { bufferCopyRegion });
+	emptyTexture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	delete[] buffer;
 
 	VkSamplerCreateInfo samplerCreateInfo = vks::initializers::samplerCreateInfo();
 	samplerCreateInfo.magFilter = VK_FILTER_LINEAR;
@@ -754,6 +1191,16 @@ vkglTF::Model::~Model()
 	}
 	vkDestroyDescriptorPool(device->logicalDevice, descriptorPool, nullptr);
 	emptyTexture.destroy();
+	if (gpuDriven.pipeline != VK_NULL_HANDLE) {
+		vkDestroyPipeline(device->logicalDevice, gpuDriven.pipeline, nullptr);
+		vkDestroyPipelineLayout(device->logicalDevice, gpuDriven.pipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(device->logicalDevice, gpuDriven.descriptorSetLayout, nullptr);
+		vkDestroyDescriptorPool(device->logicalDevice, gpuDriven.descriptorPool, nullptr);
+		gpuDriven.drawData.destroy();
+		gpuDriven.commands.destroy();
+		gpuDriven.counts.destroy();
+		gpuDriven.countsReadback.destroy();
+	}
 }
 
 void vkglTF::Model::loadNode(vkglTF::Node *parent, const tinygltf::Node &node, uint32_t nodeIndex, const tinygltf::Model &model, std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer, float globalscale)
@@ -797,7 +1244,7 @@ void vkglTF::Model::loadNode(vkglTF::Node *parent, const tinygltf::Node &node, u
 
 	// Node contains mesh data
 	if (node.mesh > -1) {
-		const tinygltf::Mesh mesh = model.meshes[node.mesh];
+		const tinygltf::Mesh &mesh = model.meshes[node.mesh];
 		Mesh *newMesh = new Mesh(device, newNode->matrix);
 		newMesh->name = mesh.name;
 		for (size_t j = 0; j < mesh.primitives.size(); j++) {
@@ -805,144 +1252,33 @@ void vkglTF::Model::loadNode(vkglTF::Node *parent, const tinygltf::Node &node, u
 			if (primitive.indices < 0) {
 				continue;
 			}
-			uint32_t indexStart = static_cast<uint32_t>(indexBuffer.size());
-			uint32_t vertexStart = static_cast<uint32_t>(vertexBuffer.size());
-			uint32_t indexCount = 0;
-			uint32_t vertexCount = 0;
-			glm::vec3 posMin{};
-			glm::vec3 posMax{};
-			bool hasSkin = false;
-			// Vertices
-			{
-				const float *bufferPos = nullptr;
-				const float *bufferNormals = nullptr;
-				const float *bufferTexCoords = nullptr;
-				const float* bufferColors = nullptr;
-				const float *bufferTangents = nullptr;
-				uint32_t numColorComponents;
-				const uint16_t *bufferJoints = nullptr;
-				const float *bufferWeights = nullptr;
-
-				// Position attribute is required
-				assert(primitive.attributes.find("POSITION") != primitive.attributes.end());
-
-				const tinygltf::Accessor &posAccessor = model.accessors[primitive.attributes.find("POSITION")->second];
-				const tinygltf::BufferView &posView = model.bufferViews[posAccessor.bufferView];
-				bufferPos = reinterpret_cast<const float *>(&(model.buffers[posView.buffer].data[posAccessor.byteOffset + posView.byteOffset]));
-				posMin = glm::vec3(posAccessor.minValues[0], posAccessor.minValues[1], posAccessor.minValues[2]);
-				posMax = glm::vec3(posAccessor.maxValues[0], posAccessor.maxValues[1], posAccessor.maxValues[2]);
-
-				if (primitive.attributes.find("NORMAL") != primitive.attributes.end()) {
-					const tinygltf::Accessor &normAccessor = model.accessors[primitive.attributes.find("NORMAL")->second];
-					const tinygltf::BufferView &normView = model.bufferViews[normAccessor.bufferView];
-					bufferNormals = reinterpret_cast<const float *>(&(model.buffers[normView.buffer].data[normAccessor.byteOffset + normView.byteOffset]));
-				}
-
-				if (primitive.attributes.find("TEXCOORD_0") != primitive.attributes.end()) {
-					const tinygltf::Accessor &uvAccessor = model.accessors[primitive.attributes.find("TEXCOORD_0")->second];
-					const tinygltf::BufferView &uvView = model.bufferViews[uvAccessor.bufferView];
-					bufferTexCoords = reinterpret_cast<const float *>(&(model.buffers[uvView.buffer].data[uvAccessor.byteOffset + uvView.byteOffset]));
-				}
-
-				if (primitive.attributes.find("COLOR_0") != primitive.attributes.end())
-				{
-					const tinygltf::Accessor& colorAccessor = model.accessors[primitive.attributes.find("COLOR_0")->second];
-					const tinygltf::BufferView& colorView = model.bufferViews[colorAccessor.bufferView];
-					// Color buffer are either of type vec3 or vec4
-					numColorComponents = colorAccessor.type == TINYGLTF_PARAMETER_TYPE_FLOAT_VEC3 ? 3 : 4;
-					bufferColors = reinterpret_cast<const float*>(&(model.buffers[colorView.buffer].data[colorAccessor.byteOffset + colorView.byteOffset]));
-				}
-
-				if (primitive.attributes.find("TANGENT") != primitive.attributes.end())
-				{
-					const tinygltf::Accessor &tangentAccessor = model.accessors[primitive.attributes.find("TANGENT")->second];
-					const tinygltf::BufferView &tangentView = model.bufferViews[tangentAccessor.bufferView];
-					bufferTangents = reinterpret_cast<const float *>(&(model.buffers[tangentView.buffer].data[tangentAccessor.byteOffset + tangentView.byteOffset]));
-				}
-
-				// Skinning
-				// Joints
-				if (primitive.attributes.find("JOINTS_0") != primitive.attributes.end()) {
-					const tinygltf::Accessor &jointAccessor = model.accessors[primitive.attributes.find("JOINTS_0")->second];
-					const tinygltf::BufferView &jointView = model.bufferViews[jointAccessor.bufferView];
-					bufferJoints = reinterpret_cast<const uint16_t *>(&(model.buffers[jointView.buffer].data[jointAccessor.byteOffset + jointView.byteOffset]));
-				}
 
-				if (primitive.attributes.find("WEIGHTS_0") != primitive.attributes.end()) {
-					const tinygltf::Accessor &uvAccessor = model.accessors[primitive.attributes.find("WEIGHTS_0")->second];
-					const tinygltf::BufferView &uvView = model.bufferViews[uvAccessor.bufferView];
-					bufferWeights = reinterpret_cast<const float *>(&(model.buffers[uvView.buffer].data[uvAccessor.byteOffset + uvView.byteOffset]));
-				}
+			// Position attribute is required
+			assert(primitive.attributes.find("POSITION") != primitive.attributes.end());
 
-				hasSkin = (bufferJoints && bufferWeights);
-
-				vertexCount = static_cast<uint32_t>(posAccessor.count);
-
-				for (size_t v = 0; v < posAccessor.count; v++) {
-					Vertex vert{};
-					vert.pos = glm::vec4(glm::make_vec3(&bufferPos[v * 3]), 1.0f);
-					vert.normal = glm::normalize(glm::vec3(bufferNormals ? glm::make_vec3(&bufferNormals[v * 3]) : glm::vec3(0.0f)));
-					vert.uv = bufferTexCoords ? glm::make_vec2(&bufferTexCoords[v * 2]) : glm::vec3(0.0f);
-					if (bufferColors) {
-						switch (numColorComponents) {
-							case 3: 
-								vert.color = glm::vec4(glm::make_vec3(&bufferColors[v * 3]), 1.0f);
-							case 4:
-								vert.color = glm::make_vec4(&bufferColors[v * 4]);
-						}
-					}
-					else {
-						vert.color = glm::vec4(1.0f);
-					}
-					vert.tangent = bufferTangents ? glm::vec4(glm::make_vec4(&bufferTangents[v * 4])) : glm::vec4(0.0f);
-					vert.joint0 = hasSkin ? glm::vec4(glm::make_vec4(&bufferJoints[v * 4])) : glm::vec4(0.0f);
-					vert.weight0 = hasSkin ? glm::make_vec4(&bufferWeights[v * 4]) : glm::vec4(0.0f);
-					vertexBuffer.push_back(vert);
-				}
+			const tinygltf::Accessor &posAccessor = model.accessors[primitive.attributes.find("POSITION")->second];
+			const tinygltf::Accessor &indexAccessor = model.accessors[primitive.indices];
+			if ((indexAccessor.componentType != TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT) && (indexAccessor.componentType != TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT) && (indexAccessor.componentType != TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE)) {
+				std::cerr << "Index component type " << indexAccessor.componentType << " not supported!" << std::endl;
+				continue;
 			}
-			// Indices
-			{
-				const tinygltf::Accessor &accessor = model.accessors[primitive.indices];
-				const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
-				const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
 
-				indexCount = static_cast<uint32_t>(accessor.count);
-
-				switch (accessor.componentType) {
-				case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT: {
-					uint32_t *buf = new uint32_t[accessor.count];
-					memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(uint32_t));
-					for (size_t index = 0; index < accessor.count; index++) {
-						indexBuffer.push_back(buf[index] + vertexStart);
-					}
-                    delete[] buf;
-					break;
-				}
-				case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT: {
-					uint16_t *buf = new uint16_t[accessor.count];
-					memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(uint16_t));
-					for (size_t index = 0; index < accessor.count; index++) {
-						indexBuffer.push_back(buf[index] + vertexStart);
-					}
-                    delete[] buf;
-                    break;
-				}
-				case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE: {
-					uint8_t *buf = new uint8_t[accessor.count];
-					memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(uint8_t));
-					for (size_t index = 0; index < accessor.count; index++) {
-						indexBuffer.push_back(buf[index] + vertexStart);
-					}
-                    delete[] buf;
-                    break;
-				}
-				default:
-					std::cerr << "Index component type " << accessor.componentType << " not supported!" << std::endl;
-					return;
-				}
-			}
-			Primitive *newPrimitive = new Primitive(indexStart, indexCount, primitive.material > -1 ? materials[primitive.material] : materials.back());
-			newPrimitive->firstVertex = vertexStart;
+			// Only reserve the ranges for this primitive's vertices and indices here, the data is converted once all nodes have been loaded
+			PrimitiveLoadInfo loadInfo{};
+			loadInfo.primitive = &primitive;
+			loadInfo.firstVertex = static_cast<uint32_t>(vertexBuffer.size());
+			loadInfo.firstIndex = static_cast<uint32_t>(indexBuffer.size());
+			const uint32_t vertexCount = static_cast<uint32_t>(posAccessor.count);
+			const uint32_t indexCount = static_cast<uint32_t>(indexAccessor.count);
+			vertexBuffer.resize(vertexBuffer.size() + vertexCount);
+			indexBuffer.resize(indexBuffer.size() + indexCount);
+			primitiveLoads.push_back(loadInfo);
+
+			glm::vec3 posMin = glm::vec3(posAccessor.minValues[0], posAccessor.minValues[1], posAccessor.minValues[2]);
+			glm::vec3 posMax = glm::vec3(posAccessor.maxValues[0], posAccessor.maxValues[1], posAccessor.maxValues[2]);
+
+			Primitive *newPrimitive = new Primitive(loadInfo.firstIndex, indexCount, primitive.material > -1 ? materials[primitive.material] : materials.back());
+			newPrimitive->firstVertex = loadInfo.firstVertex;
 			newPrimitive->vertexCount = vertexCount;
 			newPrimitive->setDimensions(posMin, posMax);
 			newMesh->primitives.push_back(newPrimitive);
@@ -957,6 +1293,132 @@ void vkglTF::Model::loadNode(vkglTF::Node *parent, const tinygltf::Node &node, u
 	linearNodes.push_back(newNode);
 }
 
+/*
+	Converts the vertex and index data of a primitive into the ranges reserved by loadNode
+	Primitives write to disjoint ranges, so this can be called for multiple primitives in parallel
+*/
+void vkglTF::Model::loadPrimitiveData(const tinygltf::Model &model, const PrimitiveLoadInfo &loadInfo, std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer)
+{
+	const tinygltf::Primitive &primitive = *loadInfo.primitive;
+	const uint32_t vertexStart = loadInfo.firstVertex;
+	// Vertices
+	{
+		const float *bufferPos = nullptr;
+		const float *bufferNormals = nullptr;
+		const float *bufferTexCoords = nullptr;
+		const float* bufferColors = nullptr;
+		const float *bufferTangents = nullptr;
+		uint32_t numColorComponents;
+		const uint16_t *bufferJoints = nullptr;
+		const float *bufferWeights = nullptr;
+		bool hasSkin = false;
+
+		const tinygltf::Accessor &posAccessor = model.accessors[primitive.attributes.find("POSITION")->second];
+		const tinygltf::BufferView &posView = model.bufferViews[posAccessor.bufferView];
+		bufferPos = reinterpret_cast<const float *>(&(model.buffers[posView.buffer].data[posAccessor.byteOffset + posView.byteOffset]));
+
+		if (primitive.attributes.find("NORMAL") != primitive.attributes.end()) {
+			const tinygltf::Accessor &normAccessor = model.accessors[primitive.attributes.find("NORMAL")->second];
+			const tinygltf::BufferView &normView = model.bufferViews[normAccessor.bufferView];
+			bufferNormals = reinterpret_cast<const float *>(&(model.buffers[normView.buffer].data[normAccessor.byteOffset + normView.byteOffset]));
+		}
+
+		if (primitive.attributes.find("TEXCOORD_0") != primitive.attributes.end()) {
+			const tinygltf::Accessor &uvAccessor = model.accessors[primitive.attributes.find("TEXCOORD_0")->second];
+			const tinygltf::BufferView &uvView = model.bufferViews[uvAccessor.bufferView];
+			bufferTexCoords = reinterpret_cast<const float *>(&(model.buffers[uvView.buffer].data[uvAccessor.byteOffset + uvView.byteOffset]));
+		}
+
+		if (primitive.attributes.find("COLOR_0") != primitive.attributes.end())
+		{
+			const tinygltf::Accessor& colorAccessor = model.accessors[primitive.attributes.find("COLOR_0")->second];
+			const tinygltf::BufferView& colorView = model.bufferViews[colorAccessor.bufferView];
+			// Color buffer are either of type vec3 or vec4
+			numColorComponents = colorAccessor.type == TINYGLTF_PARAMETER_TYPE_FLOAT_VEC3 ? 3 : 4;
+			bufferColors = reinterpret_cast<const float*>(&(model.buffers[colorView.buffer].data[colorAccessor.byteOffset + colorView.byteOffset]));
+		}
+
+		if (primitive.attributes.find("TANGENT") != primitive.attributes.end())
+		{
+			const tinygltf::Accessor &tangentAccessor = model.accessors[primitive.attributes.find("TANGENT")->second];
+			const tinygltf::BufferView &tangentView = model.bufferViews[tangentAccessor.bufferView];
+			bufferTangents = reinterpret_cast<const float *>(&(model.buffers[tangentView.buffer].data[tangentAccessor.byteOffset + tangentView.byteOffset]));
+		}
+
+		// Skinning
+		// Joints
+		if (primitive.attributes.find("JOINTS_0") != primitive.attributes.end()) {
+			const tinygltf::Accessor &jointAccessor = model.accessors[primitive.attributes.find("JOINTS_0")->second];
+			const tinygltf::BufferView &jointView = model.bufferViews[jointAccessor.bufferView];
+			bufferJoints = reinterpret_cast<const uint16_t *>(&(model.buffers[jointView.buffer].data[jointAccessor.byteOffset + jointView.byteOffset]));
+		}
+
+		if (primitive.attributes.find("WEIGHTS_0") != primitive.attributes.end()) {
+			const tinygltf::Accessor &uvAccessor = model.accessors[primitive.attributes.find("WEIGHTS_0")->second];
+			const tinygltf::BufferView &uvView = model.bufferViews[uvAccessor.bufferView];
+			bufferWeights = reinterpret_cast<const float *>(&(model.buffers[uvView.buffer].data[uvAccessor.byteOffset + uvView.byteOffset]));
+		}
+
+		hasSkin = (bufferJoints && bufferWeights);
+
+		Vertex* vertices = &vertexBuffer[vertexStart];
+		for (size_t v = 0; v < posAccessor.count; v++) {
+			Vertex& vert = vertices[v];
+			vert.pos = glm::vec4(glm::make_vec3(&bufferPos[v * 3]), 1.0f);
+			vert.normal = glm::normalize(glm::vec3(bufferNormals ? glm::make_vec3(&bufferNormals[v * 3]) : glm::vec3(0.0f)));
+			vert.uv = bufferTexCoords ? glm::make_vec2(&bufferTexCoords[v * 2]) : glm::vec3(0.0f);
+			if (bufferColors) {
+				switch (numColorComponents) {
+					case 3: 
+						vert.color = glm::vec4(glm::make_vec3(&bufferColors[v * 3]), 1.0f);
+						break;
+					case 4:
+						vert.color = glm::make_vec4(&bufferColors[v * 4]);
+						break;
+				}
+			}
+			else {
+				vert.color = glm::vec4(1.0f);
+			}
+			vert.tangent = bufferTangents ? glm::vec4(glm::make_vec4(&bufferTangents[v * 4])) : glm::vec4(0.0f);
+			vert.joint0 = hasSkin ? glm::vec4(glm::make_vec4(&bufferJoints[v * 4])) : glm::vec4(0.0f);
+			vert.weight0 = hasSkin ? glm::make_vec4(&bufferWeights[v * 4]) : glm::vec4(0.0f);
+		}
+	}
+	// Indices
+	{
+		const tinygltf::Accessor &accessor = model.accessors[primitive.indices];
+		const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
+		const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
+		const unsigned char* data = &buffer.data[accessor.byteOffset + bufferView.byteOffset];
+
+		uint32_t* indices = &indexBuffer[loadInfo.firstIndex];
+		switch (accessor.componentType) {
+		case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT: {
+			const uint32_t *buf = reinterpret_cast<const uint32_t*>(data);
+			for (size_t index = 0; index < accessor.count; index++) {
+				indices[index] = buf[index] + vertexStart;
+			}
+			break;
+		}
+		case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT: {
+			const uint16_t *buf = reinterpret_cast<const uint16_t*>(data);
+			for (size_t index = 0; index < accessor.count; index++) {
+				indices[index] = buf[index] + vertexStart;
+			}
+			break;
+		}
+		case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE: {
+			const uint8_t *buf = data;
+			for (size_t index = 0; index < accessor.count; index++) {
+				indices[index] = buf[index] + vertexStart;
+			}
+			break;
+		}
+		}
+	}
+}
+
 void vkglTF::Model::loadSkins(tinygltf::Model &gltfModel)
 {
 	for (tinygltf::Skin &source : gltfModel.skins) {
@@ -1164,61 +1626,551 @@ void vkglTF::Model::loadAnimations(tinygltf::Model &gltfModel)
 	}
 }
 
-void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device, VkQueue transferQueue, uint32_t fileLoadingFlags, float scale)
+/*
+	Restores the scene from a memory mapped mesh cache file
+	Returns false if the cache is outdated (or invalid), the scene then needs to be loaded from the glTF file
+	Vertex and index data is not copied, the returned pointers point into the mapped cache file
+*/
+bool vkglTF::Model::loadMeshCache(const unsigned char* data, size_t size, const std::string& filename, uint32_t fileLoadingFlags, float scale, tinygltf::Model& gltfModel, std::vector<std::vector<unsigned char>>& encodedImages, const void** vertexData, size_t* vertexDataSize, const void** indexData, size_t* indexDataSize)
 {
-	tinygltf::Model gltfModel;
-	tinygltf::TinyGLTF gltfContext;
-	if (fileLoadingFlags & FileLoadingFlags::DontLoadImages) {
-		gltfContext.SetImageLoader(loadImageDataFuncEmpty, nullptr);
-	} else {
-		gltfContext.SetImageLoader(loadImageDataFunc, nullptr);
+	if (size < sizeof(MeshCacheHeader)) {
+		return false;
+	}
+	MeshCacheHeader header;
+	memcpy(&header, data, sizeof(MeshCacheHeader));
+	if ((header.magic != meshCacheMagic) || (header.version != meshCacheVersion) || (header.indexSize != sizeof(uint32_t))) {
+		return false;
+	}
+	if ((header.vertexSize != vertexLayout.getStride()) || (header.vertexLayoutHash != vertexLayout.getHash()) || (header.vertexSize == 0)) {
+		return false;
+	}
+	if ((header.fileLoadingFlags != (fileLoadingFlags & meshCacheFlagsMask)) || (header.scale != scale)) {
+		return false;
+	}
+	if ((header.tablesOffset + header.tablesSize > size) || (header.vertexDataOffset + header.vertexDataSize > size) || (header.indexDataOffset + header.indexDataSize > size)) {
+		return false;
 	}
-#if defined(__ANDROID__)
-	// On Android all assets are packed with the apk in a compressed form, so we need to open them using the asset manager
-	// We let tinygltf handle this, by passing the asset manager of our app
-	tinygltf::asset_manager = androidApp->activity->assetManager;
-#endif
-	size_t pos = filename.find_last_of('/');
-	path = filename.substr(0, pos);
 
-	std::string error, warning;
+	// Check if the source file has changed since the cache was written
+	uint64_t sourceSize, sourceTimestamp, sourceHash;
+	if (!getFileInfo(filename, sourceSize, sourceTimestamp) || (sourceSize != header.sourceSize) || (sourceTimestamp != header.sourceTimestamp)) {
+		return false;
+	}
+	if (!hashFile(filename, sourceHash) || (sourceHash != header.sourceHash)) {
+		return false;
+	}
 
-	this->device = device;
+	MeshCacheReader reader(data + header.tablesOffset, static_cast<size_t>(header.tablesSize));
 
-#if defined(__ANDROID__)
-	// On Android all assets are packed with the apk in a compressed form, so we need to open them using the asset manager
-	// We let tinygltf handle this, by passing the asset manager of our app
-	tinygltf::asset_manager = androidApp->activity->assetManager;
-#endif
-	bool fileLoaded = gltfContext.LoadASCIIFromFile(&gltfModel, &error, &warning, filename);
+	// External buffers the vertex data has been read from
+	const uint32_t dependencyCount = reader.read<uint32_t>();
+	for (uint32_t i = 0; (i < dependencyCount) && !reader.failed; i++) {
+		const std::string uri = reader.readString();
+		const uint64_t dependencySize = reader.read<uint64_t>();
+		const uint64_t dependencyTimestamp = reader.read<uint64_t>();
+		if (!getFileInfo(path + "/" + uri, sourceSize, sourceTimestamp) || (sourceSize != dependencySize) || (sourceTimestamp != dependencyTimestamp)) {
+			return false;
+		}
+	}
+	if (reader.failed) {
+		return false;
+	}
+
+	std::vector<Node*> cachedNodes;
+	auto discard = [&]() {
+		for (auto node : nodes) {
+			delete node;
+		}
+		for (auto skin : skins) {
+			delete skin;
+		}
+		nodes.clear();
+		linearNodes.clear();
+		skins.clear();
+		animations.clear();
+		materials.clear();
+		textures.clear();
+		gltfModel.images.clear();
+		encodedImages.clear();
+		std::cerr << "Mesh cache for \"" << filename << "\" is invalid and will be rebuilt" << std::endl;
+		return false;
+	};
+
+	metallicRoughnessWorkflow = reader.read<uint32_t>() != 0;
+
+	// Images, only embedded images store their (encoded) data, images from external files are loaded from the file
+	const uint32_t imageCount = reader.read<uint32_t>();
+	for (uint32_t i = 0; (i < imageCount) && !reader.failed; i++) {
+		tinygltf::Image image;
+		image.name = reader.readString();
+		image.uri = reader.readString();
+		std::vector<unsigned char> encodedImage;
+		if (image.uri.empty()) {
+			reader.readVector(encodedImage);
+		}
+		gltfModel.images.push_back(image);
+		encodedImages.push_back(std::move(encodedImage));
+	}
+	if (reader.failed) {
+		return discard();
+	}
+	textures.resize(gltfModel.images.size());
+
+	// Materials
+	auto getCachedTexture = [&](int32_t index) -> vkglTF::Texture* {
+		if (index == -2) {
+			return &emptyTexture;
+		}
+		return ((index >= 0) && (index < static_cast<int32_t>(textures.size()))) ? &textures[index] : nullptr;
+	};
+	const uint32_t materialCount = reader.read<uint32_t>();
+	for (uint32_t i = 0; (i < materialCount) && !reader.failed; i++) {
+		vkglTF::Material material(device);
+		material.alphaMode = static_cast<Material::AlphaMode>(reader.read<uint32_t>());
+		material.alphaCutoff = reader.read<float>();
+		material.metallicFactor = reader.read<float>();
+		material.roughnessFactor = reader.read<float>();
+		material.baseColorFactor = reader.read<glm::vec4>();
+		material.baseColorTexture = getCachedTexture(reader.read<int32_t>());
+		material.metallicRoughnessTexture = getCachedTexture(reader.read<int32_t>());
+		material.normalTexture = getCachedTexture(reader.read<int32_t>());
+		material.occlusionTexture = getCachedTexture(reader.read<int32_t>());
+		material.emissiveTexture = getCachedTexture(reader.read<int32_t>());
+		materials.push_back(material);
+	}
+	if (reader.failed || materials.empty()) {
+		return discard();
+	}
+
+	// Nodes are stored in the order of linearNodes, children are always stored before their parent
+	const size_t cachedVertexCount = static_cast<size_t>(header.vertexDataSize / header.vertexSize);
+	const size_t cachedIndexCount = static_cast<size_t>(header.indexDataSize / sizeof(uint32_t));
+	std::vector<int32_t> parentIndices;
+	const uint32_t nodeCount = reader.read<uint32_t>();
+	for (uint32_t i = 0; (i < nodeCount) && !reader.failed; i++) {
+		vkglTF::Node* node = new Node{};
+		cachedNodes.push_back(node);
+		node->index = reader.read<uint32_t>();
+		const int32_t parentIndex = reader.read<int32_t>();
+		if ((parentIndex != -1) && ((parentIndex <= static_cast<int32_t>(i)) || (parentIndex >= static_cast<int32_t>(nodeCount)))) {
+			reader.failed = true;
+		}
+		parentIndices.push_back(parentIndex);
+		node->name = reader.readString();
+		node->skinIndex = reader.read<int32_t>();
+		node->translation = reader.read<glm::vec3>();
+		node->rotation = reader.read<glm::quat>();
+		node->scale = reader.read<glm::vec3>();
+		node->matrix = reader.read<glm::mat4>();
+		if (reader.read<uint32_t>() != 0) {
+			Mesh* mesh = new Mesh(device, node->matrix);
+			node->mesh = mesh;
+			mesh->name = reader.readString();
+			const uint32_t primitiveCount = reader.read<uint32_t>();
+			for (uint32_t j = 0; (j < primitiveCount) && !reader.failed; j++) {
+				const uint32_t firstIndex = reader.read<uint32_t>();
+				const uint32_t indexCount = reader.read<uint32_t>();
+				const uint32_t firstVertex = reader.read<uint32_t>();
+				const uint32_t vertexCount = reader.read<uint32_t>();
+				const uint32_t materialIndex = reader.read<uint32_t>();
+				const glm::vec3 posMin = reader.read<glm::vec3>();
+				const glm::vec3 posMax = reader.read<glm::vec3>();
+				if ((materialIndex >= materials.size()) || (static_cast<size_t>(firstIndex) + indexCount > cachedIndexCount) || (static_cast<size_t>(firstVertex) + vertexCount > cachedVertexCount)) {
+					reader.failed = true;
+					break;
+				}
+				Primitive* primitive = new Primitive(firstIndex, indexCount, materials[materialIndex]);
+				primitive->firstVertex = firstVertex;
+				primitive->vertexCount = vertexCount;
+				primitive->setDimensions(posMin, posMax);
+				mesh->primitives.push_back(primitive);
+			}
+		}
+	}
+	if (reader.failed) {
+		// Nodes haven't been linked yet, so they need to be deleted separately
+		for (auto node : cachedNodes) {
+			delete node;
+		}
+		return discard();
+	}
+	for (size_t i = 0; i < cachedNodes.size(); i++) {
+		Node* node = cachedNodes[i];
+		node->parent = (parentIndices[i] > -1) ? cachedNodes[parentIndices[i]] : nullptr;
+		if (node->parent) {
+			node->parent->children.push_back(node);
+		} else {
+			nodes.push_back(node);
+		}
+		linearNodes.push_back(node);
+	}
+
+	// Skins
+	const uint32_t skinCount = reader.read<uint32_t>();
+	for (uint32_t i = 0; (i < skinCount) && !reader.failed; i++) {
+		Skin* skin = new Skin{};
+		skins.push_back(skin);
+		skin->name = reader.readString();
+		const int32_t skeletonRoot = reader.read<int32_t>();
+		if (skeletonRoot > -1) {
+			skin->skeletonRoot = nodeFromIndex(skeletonRoot);
+		}
+		const uint32_t jointCount = reader.read<uint32_t>();
+		for (uint32_t j = 0; (j < jointCount) && !reader.failed; j++) {
+			Node* joint = nodeFromIndex(reader.read<uint32_t>());
+			if (joint) {
+				skin->joints.push_back(joint);
+			}
+		}
+		reader.readVector(skin->inverseBindMatrices);
+	}
+
+	// Animations
+	const uint32_t animationCount = reader.read<uint32_t>();
+	for (uint32_t i = 0; (i < animationCount) && !reader.failed; i++) {
+		vkglTF::Animation animation{};
+		animation.name = reader.readString();
+		animation.start = reader.read<float>();
+		animation.end = reader.read<float>();
+		const uint32_t samplerCount = reader.read<uint32_t>();
+		for (uint32_t j = 0; (j < samplerCount) && !reader.failed; j++) {
+			vkglTF::AnimationSampler sampler{};
+			sampler.interpolation = static_cast<AnimationSampler::InterpolationType>(reader.read<uint32_t>());
+			reader.readVector(sampler.inputs);
+			reader.readVector(sampler.outputsVec4);
+			animation.samplers.push_back(sampler);
+		}
+		const uint32_t channelCount = reader.read<uint32_t>();
+		for (uint32_t j = 0; (j < channelCount) && !reader.failed; j++) {
+			vkglTF::AnimationChannel channel{};
+			channel.path = static_cast<AnimationChannel::PathType>(reader.read<uint32_t>());
+			channel.node = nodeFromIndex(reader.read<uint32_t>());
+			channel.samplerIndex = reader.read<uint32_t>();
+			if (!channel.node || (channel.samplerIndex >= animation.samplers.size())) {
+				reader.failed = true;
+				break;
+			}
+			animation.channels.push_back(channel);
+		}
+		animations.push_back(animation);
+	}
+	if (reader.failed) {
+		return discard();
+	}
+
+	*vertexData = data + header.vertexDataOffset;
+	*vertexDataSize = static_cast<size_t>(header.vertexDataSize);
+	*indexData = data + header.indexDataOffset;
+	*indexDataSize = static_cast<size_t>(header.indexDataSize);
+	return true;
+}
+
+/*
+	Writes the loaded scene to a mesh cache file
+	Failing to write the cache isn't an error, the scene is then loaded from the glTF file again on the next run
+*/
+void vkglTF::Model::writeMeshCache(const std::string& cacheFilename, const std::string& filename, uint32_t fileLoadingFlags, float scale, const tinygltf::Model& gltfModel, const std::vector<std::vector<unsigned char>>& encodedImages, const std::vector<uint32_t>& indexBuffer, const void* vertexData, size_t vertexDataSize)
+{
+	MeshCacheHeader header{};
+	header.magic = meshCacheMagic;
+	header.version = meshCacheVersion;
+	if (!getFileInfo(filename, header.sourceSize, header.sourceTimestamp) || !hashFile(filename, header.sourceHash)) {
+		return;
+	}
+	header.fileLoadingFlags = fileLoadingFlags & meshCacheFlagsMask;
+	header.scale = scale;
+	header.vertexSize = vertexLayout.getStride();
+	header.indexSize = sizeof(uint32_t);
+	header.vertexLayoutHash = vertexLayout.getHash();
+
+	MeshCacheWriter tables;
+
+	// External buffers the vertex data has been read from, the cache is also rebuilt if one of these changes
+	std::vector<std::string> dependencies;
+	for (const tinygltf::Buffer& buffer : gltfModel.buffers) {
+		if (!buffer.uri.empty() && (buffer.uri.compare(0, 5, "data:") != 0)) {
+			dependencies.push_back(buffer.uri);
+		}
+	}
+	tables.write(static_cast<uint32_t>(dependencies.size()));
+	for (const std::string& uri : dependencies) {
+		uint64_t dependencySize, dependencyTimestamp;
+		if (!getFileInfo(path + "/" + uri, dependencySize, dependencyTimestamp)) {
+			return;
+		}
+		tables.writeString(uri);
+		tables.write(dependencySize);
+		tables.write(dependencyTimestamp);
+	}
+
+	tables.write<uint32_t>(metallicRoughnessWorkflow ? 1 : 0);
+
+	// Images
+	tables.write(static_cast<uint32_t>(textures.size()));
+	for (size_t i = 0; i < textures.size(); i++) {
+		const tinygltf::Image& image = gltfModel.images[i];
+		tables.writeString(image.name);
+		tables.writeString(image.uri);
+		if (image.uri.empty()) {
+			tables.writeVector(encodedImages[i]);
+		}
+	}
+
+	// Materials
+	auto getTextureIndex = [&](const vkglTF::Texture* texture) -> int32_t {
+		if (!texture) {
+			return -1;
+		}
+		return (texture == &emptyTexture) ? -2 : static_cast<int32_t>(texture - textures.data());
+	};
+	tables.write(static_cast<uint32_t>(materials.size()));
+	for (const vkglTF::Material& material : materials) {
+		tables.write(static_cast<uint32_t>(material.alphaMode));
+		tables.write(material.alphaCutoff);
+		tables.write(material.metallicFactor);
+		tables.write(material.roughnessFactor);
+		tables.write(material.baseColorFactor);
+		tables.write(getTextureIndex(material.baseColorTexture));
+		tables.write(getTextureIndex(material.metallicRoughnessTexture));
+		tables.write(getTextureIndex(material.normalTexture));
+		tables.write(getTextureIndex(material.occlusionTexture));
+		tables.write(getTextureIndex(material.emissiveTexture));
+	}
+
+	// Nodes
+	std::unordered_map<const Node*, int32_t> linearIndices;
+	for (size_t i = 0; i < linearNodes.size(); i++) {
+		linearIndices[linearNodes[i]] = static_cast<int32_t>(i);
+	}
+	tables.write(static_cast<uint32_t>(linearNodes.size()));
+	for (const Node* node : linearNodes) {
+		tables.write(node->index);
+		tables.write(node->parent ? linearIndices[node->parent] : -1);
+		tables.writeString(node->name);
+		tables.write(node->skinIndex);
+		tables.write(node->translation);
+		tables.write(node->rotation);
+		tables.write(node->scale);
+		tables.write(node->matrix);
+		tables.write<uint32_t>(node->mesh ? 1 : 0);
+		if (node->mesh) {
+			tables.writeString(node->mesh->name);
+			tables.write(static_cast<uint32_t>(node->mesh->primitives.size()));
+			for (const Primitive* primitive : node->mesh->primitives) {
+				tables.write(primitive->firstIndex);
+				tables.write(primitive->indexCount);
+				tables.write(primitive->firstVertex);
+				tables.write(primitive->vertexCount);
+				tables.write(static_cast<uint32_t>(&primitive->material - materials.data()));
+				tables.write(primitive->dimensions.min);
+				tables.write(primitive->dimensions.max);
+			}
+		}
+	}
+
+	// Skins
+	tables.write(static_cast<uint32_t>(skins.size()));
+	for (const Skin* skin : skins) {
+		tables.writeString(skin->name);
+		tables.write(skin->skeletonRoot ? static_cast<int32_t>(skin->skeletonRoot->index) : -1);
+		tables.write(static_cast<uint32_t>(skin->joints.size()));
+		for (const Node* joint : skin->joints) {
+			tables.write(joint->index);
+		}
+		tables.writeVector(skin->inverseBindMatrices);
+	}
+
+	// Animations
+	tables.write(static_cast<uint32_t>(animations.size()));
+	for (const Animation& animation : animations) {
+		tables.writeString(animation.name);
+		tables.write(animation.start);
+		tables.write(animation.end);
+		tables.write(static_cast<uint32_t>(animation.samplers.size()));
+		for (const AnimationSampler& sampler : animation.samplers) {
+			tables.write(static_cast<uint32_t>(sampler.interpolation));
+			tables.writeVector(sampler.inputs);
+			tables.writeVector(sampler.outputsVec4);
+		}
+		tables.write(static_cast<uint32_t>(animation.channels.size()));
+		for (const AnimationChannel& channel : animation.channels) {
+			tables.write(static_cast<uint32_t>(channel.path));
+			tables.write(channel.node->index);
+			tables.write(channel.samplerIndex);
+		}
+	}
+
+	header.tablesOffset = sizeof(MeshCacheHeader);
+	header.tablesSize = tables.data.size();
+	header.vertexDataOffset = alignCacheOffset(header.tablesOffset + header.tablesSize);
+	header.vertexDataSize = vertexDataSize;
+	header.indexDataOffset = alignCacheOffset(header.vertexDataOffset + header.vertexDataSize);
+	header.indexDataSize = indexBuffer.size() * sizeof(uint32_t);
+
+	// The cache is written to a temporary file first, so an interrupted write can't leave a truncated cache file behind
+	const std::string tempFilename = cacheFilename + ".tmp";
+	std::ofstream file(tempFilename, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		std::cerr << "Could not write mesh cache \"" << cacheFilename << "\"" << std::endl;
+		return;
+	}
+	const std::vector<char> padding(meshCacheBlobAlignment, 0);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(MeshCacheHeader));
+	file.write(reinterpret_cast<const char*>(tables.data.data()), tables.data.size());
+	file.write(padding.data(), header.vertexDataOffset - (header.tablesOffset + header.tablesSize));
+	file.write(static_cast<const char*>(vertexData), header.vertexDataSize);
+	file.write(padding.data(), header.indexDataOffset - (header.vertexDataOffset + header.vertexDataSize));
+	file.write(reinterpret_cast<const char*>(indexBuffer.data()), header.indexDataSize);
+	const bool written = file.good();
+	file.close();
+	std::remove(cacheFilename.c_str());
+	if (!written || (std::rename(tempFilename.c_str(), cacheFilename.c_str()) != 0)) {
+		std::remove(tempFilename.c_str());
+		std::cerr << "Could not write mesh cache \"" << cacheFilename << "\"" << std::endl;
+	}
+}
+
+void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device, VkQueue transferQueue, uint32_t fileLoadingFlags, float scale)
+{
+	tinygltf::Model gltfModel;
+	tinygltf::TinyGLTF gltfContext;
+
+	const uint32_t threadCount = (loadingThreadCount > 0) ? loadingThreadCount : std::max(std::thread::hardware_concurrency(), 1u);
+	const bool multiThreaded = threadCount > 1;
+#if defined(__ANDROID__)
+	// Assets are read-only on Android, so no cache can be written next to them
+	const bool useMeshCache = false;
+#else
+	const bool useMeshCache = (fileLoadingFlags & FileLoadingFlags::UseMeshCache) != 0;
+#endif
+	const bool loadImageData = !(fileLoadingFlags & FileLoadingFlags::DontLoadImages);
+
+	// Image decoding is deferred until after parsing, so images can be decoded in parallel and their encoded data can be stored in the mesh cache
+	const bool deferImageDecoding = multiThreaded || useMeshCache;
+	std::vector<std::vector<unsigned char>> encodedImages;
+	if (!loadImageData) {
+		gltfContext.SetImageLoader(loadImageDataFuncEmpty, nullptr);
+	} else if (deferImageDecoding) {
+		gltfContext.SetImageLoader(loadImageDataFuncDeferred, &encodedImages);
+	} else {
+		gltfContext.SetImageLoader(loadImageDataFunc, nullptr);
+	}
+#if defined(__ANDROID__)
+	// On Android all assets are packed with the apk in a compressed form, so we need to open them using the asset manager
+	// We let tinygltf handle this, by passing the asset manager of our app
+	tinygltf::asset_manager = androidApp->activity->assetManager;
+#endif
+	size_t pos = filename.find_last_of('/');
+	path = filename.substr(0, pos);
+
+	std::string error, warning;
+
+	this->device = device;
+	this->fileLoadingFlags = fileLoadingFlags;
 
 	std::vector<uint32_t> indexBuffer;
 	std::vector<Vertex> vertexBuffer;
+	// Vertex data converted to the current vertex layout (if one is set)
+	std::vector<unsigned char> packedVertexBuffer;
+	// Vertex and index data to upload, either from the above buffers or from the mapped mesh cache file
+	const void* vertexData = nullptr;
+	const void* indexData = nullptr;
+	size_t vertexBufferSize = 0;
+	size_t indexBufferSize = 0;
+
+	vks::JobSystem jobSystem;
+	vks::JobCounter imagesLoaded;
+	if (multiThreaded) {
+		jobSystem.setThreadCount(threadCount);
+	}
+
+	// Try to restore the scene from the mesh cache first
+	const std::string cacheFilename = filename + ".vkcache";
+	MappedFile cacheFile;
+	bool cacheLoaded = false;
+	if (useMeshCache && cacheFile.open(cacheFilename)) {
+		cacheLoaded = loadMeshCache(cacheFile.data, cacheFile.size, filename, fileLoadingFlags, scale, gltfModel, encodedImages, &vertexData, &vertexBufferSize, &indexData, &indexBufferSize);
+	}
+
+	bool fileLoaded = cacheLoaded || gltfContext.LoadASCIIFromFile(&gltfModel, &error, &warning, filename);
 
 	if (fileLoaded) {
-		if (!(fileLoadingFlags & FileLoadingFlags::DontLoadImages)) {
-			loadImages(gltfModel, device, transferQueue);
-		}
-		loadMaterials(gltfModel);
-		const tinygltf::Scene &scene = gltfModel.scenes[gltfModel.defaultScene > -1 ? gltfModel.defaultScene : 0];
-		for (size_t i = 0; i < scene.nodes.size(); i++) {
-			const tinygltf::Node node = gltfModel.nodes[scene.nodes[i]];
-			loadNode(nullptr, node, scene.nodes[i], gltfModel, indexBuffer, vertexBuffer, scale);
+		if (loadImageData) {
+			// With deferred decoding, images are decoded and uploaded by jobs that run while the rest of the file is processed
+			// Decoded images are submitted for upload in groups of imagesPerUpload, so the copies overlap with decoding the remaining images
+			// without each image becoming a separate transfer submission (uploads that don't fit into the staging ring are submitted right away)
+			const uint32_t imagesPerUpload = 8;
+			std::atomic<uint32_t> decodedImages{ 0 };
+			encodedImages.resize(gltfModel.images.size());
+			textures.resize(gltfModel.images.size());
+			auto loadImage = [&](size_t i) {
+				tinygltf::Image& image = gltfModel.images[i];
+				std::vector<unsigned char>& encodedImage = encodedImages[i];
+				if (deferImageDecoding) {
+					// Images restored from the mesh cache only store the uri of external image files
+					if (encodedImage.empty() && image.image.empty() && !image.uri.empty() && !isKtxFile(image.uri)) {
+						readFileData(path + "/" + tinygltf::dlib::urldecode(image.uri), encodedImage);
+					}
+					if (!encodedImage.empty() && !decodeImageData(image, encodedImage)) {
+						vks::tools::exitFatal("Could not decode image \"" + image.uri + "\"", -1);
+					}
+				}
+				textures[i].fromglTfImage(image, path, device, transferQueue);
+				if ((++decodedImages % imagesPerUpload) == 0) {
+					device->stagingUploader.flush();
+				}
+				// Encoded data of embedded images needs to be kept until it has been written to the mesh cache
+				if (!useMeshCache || cacheLoaded || !image.uri.empty()) {
+					std::vector<unsigned char>().swap(encodedImage);
+				}
+				std::vector<unsigned char>().swap(image.image);
+			};
+			if (multiThreaded) {
+				for (size_t i = 0; i < gltfModel.images.size(); i++) {
+					jobSystem.addJob([&loadImage, i]() { loadImage(i); }, &imagesLoaded);
+				}
+			} else {
+				for (size_t i = 0; i < gltfModel.images.size(); i++) {
+					loadImage(i);
+				}
+			}
+			createEmptyTexture(transferQueue);
 		}
-		if (gltfModel.animations.size() > 0) {
-			loadAnimations(gltfModel);
+		if (!cacheLoaded) {
+			loadMaterials(gltfModel);
+			const tinygltf::Scene &scene = gltfModel.scenes[gltfModel.defaultScene > -1 ? gltfModel.defaultScene : 0];
+			for (size_t i = 0; i < scene.nodes.size(); i++) {
+				const tinygltf::Node node = gltfModel.nodes[scene.nodes[i]];
+				loadNode(nullptr, node, scene.nodes[i], gltfModel, indexBuffer, vertexBuffer, scale);
+			}
+			// Convert vertex and index data into the ranges reserved by loadNode
+			if (multiThreaded) {
+				jobSystem.parallelFor(static_cast<uint32_t>(primitiveLoads.size()), [&](uint32_t i) {
+					loadPrimitiveData(gltfModel, primitiveLoads[i], indexBuffer, vertexBuffer);
+				}, 1);
+			} else {
+				for (auto& loadInfo : primitiveLoads) {
+					loadPrimitiveData(gltfModel, loadInfo, indexBuffer, vertexBuffer);
+				}
+			}
+			primitiveLoads.clear();
+			if (gltfModel.animations.size() > 0) {
+				loadAnimations(gltfModel);
+			}
+			loadSkins(gltfModel);
 		}
-		loadSkins(gltfModel);
 
+		// Assign skins
 		for (auto node : linearNodes) {
-			// Assign skins
 			if (node->skinIndex > -1) {
 				node->skin = skins[node->skinIndex];
 			}
-			// Initial pose
-			if (node->mesh) {
-				node->update();
-			}
+		}
+		// Initial pose
+		buildNodeHierarchy();
+		updateTransforms();
+		if (multiThreaded) {
+			jobSystem.wait(imagesLoaded);
 		}
 	}
 	else {
@@ -1227,73 +2179,84 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 		return;
 	}
 
-	// Pre-Calculations for requested features
-	if ((fileLoadingFlags & FileLoadingFlags::PreTransformVertices) || (fileLoadingFlags & FileLoadingFlags::PreMultiplyVertexColors) || (fileLoadingFlags & FileLoadingFlags::FlipY)) {
-		const bool preTransform = fileLoadingFlags & FileLoadingFlags::PreTransformVertices;
-		const bool preMultiplyColor = fileLoadingFlags & FileLoadingFlags::PreMultiplyVertexColors;
-		const bool flipY = fileLoadingFlags & FileLoadingFlags::FlipY;
-		for (Node* node : linearNodes) {
-			if (node->mesh) {
-				const glm::mat4 localMatrix = node->getMatrix();
-				for (Primitive* primitive : node->mesh->primitives) {
-					for (uint32_t i = 0; i < primitive->vertexCount; i++) {
-						Vertex& vertex = vertexBuffer[primitive->firstVertex + i];
-						// Pre-transform vertex positions by node-hierarchy
-						if (preTransform) {
-							vertex.pos = glm::vec3(localMatrix * glm::vec4(vertex.pos, 1.0f));
-							vertex.normal = glm::normalize(glm::mat3(localMatrix) * vertex.normal);
-						}
-						// Flip Y-Axis of vertex positions
-						if (flipY) {
-							vertex.pos.y *= -1.0f;
-							vertex.normal.y *= -1.0f;
-						}
-						// Pre-Multiply vertex colors with material base color
-						if (preMultiplyColor) {
-							vertex.color = primitive->material.baseColorFactor * vertex.color;
+	if (!cacheLoaded) {
+		// Pre-Calculations for requested features
+		if ((fileLoadingFlags & FileLoadingFlags::PreTransformVertices) || (fileLoadingFlags & FileLoadingFlags::PreMultiplyVertexColors) || (fileLoadingFlags & FileLoadingFlags::FlipY)) {
+			const bool preTransform = fileLoadingFlags & FileLoadingFlags::PreTransformVertices;
+			const bool preMultiplyColor = fileLoadingFlags & FileLoadingFlags::PreMultiplyVertexColors;
+			const bool flipY = fileLoadingFlags & FileLoadingFlags::FlipY;
+			for (Node* node : linearNodes) {
+				if (node->mesh) {
+					const glm::mat4 localMatrix = node->worldMatrix;
+					for (Primitive* primitive : node->mesh->primitives) {
+						for (uint32_t i = 0; i < primitive->vertexCount; i++) {
+							Vertex& vertex = vertexBuffer[primitive->firstVertex + i];
+							// Pre-transform vertex positions by node-hierarchy
+							if (preTransform) {
+								vertex.pos = glm::vec3(localMatrix * glm::vec4(vertex.pos, 1.0f));
+								vertex.normal = glm::normalize(glm::mat3(localMatrix) * vertex.normal);
+							}
+							// Flip Y-Axis of vertex positions
+							if (flipY) {
+								vertex.pos.y *= -1.0f;
+								vertex.normal.y *= -1.0f;
+							}
+							// Pre-Multiply vertex colors with material base color
+							if (preMultiplyColor) {
+								vertex.color = primitive->material.baseColorFactor * vertex.color;
+							}
 						}
 					}
 				}
 			}
 		}
-	}
 
-	for (auto extension : gltfModel.extensionsUsed) {
-		if (extension == "KHR_materials_pbrSpecularGlossiness") {
-			std::cout << "Required extension: " << extension;
-			metallicRoughnessWorkflow = false;
+		for (auto extension : gltfModel.extensionsUsed) {
+			if (extension == "KHR_materials_pbrSpecularGlossiness") {
+				std::cout << "Required extension: " << extension;
+				metallicRoughnessWorkflow = false;
+			}
 		}
-	}
 
-	size_t vertexBufferSize = vertexBuffer.size() * sizeof(Vertex);
-	size_t indexBufferSize = indexBuffer.size() * sizeof(uint32_t);
-	indices.count = static_cast<uint32_t>(indexBuffer.size());
-	vertices.count = static_cast<uint32_t>(vertexBuffer.size());
+		vertexData = vertexBuffer.data();
+		vertexBufferSize = vertexBuffer.size() * sizeof(Vertex);
+		indexData = indexBuffer.data();
+		indexBufferSize = indexBuffer.size() * sizeof(uint32_t);
+
+		// Convert vertices to the requested vertex layout
+		if (!vertexLayout.attributes.empty()) {
+			const uint32_t stride = vertexLayout.getStride();
+			packedVertexBuffer.resize(vertexBuffer.size() * stride);
+			const uint32_t vertexCount = static_cast<uint32_t>(vertexBuffer.size());
+			const uint32_t chunkSize = 4096;
+			auto packChunk = [&](uint32_t chunk) {
+				const uint32_t end = std::min((chunk + 1) * chunkSize, vertexCount);
+				for (uint32_t i = chunk * chunkSize; i < end; i++) {
+					vertexLayout.pack(vertexBuffer[i], &packedVertexBuffer[static_cast<size_t>(i) * stride]);
+				}
+			};
+			const uint32_t chunkCount = (vertexCount + chunkSize - 1) / chunkSize;
+			if (multiThreaded) {
+				jobSystem.parallelFor(chunkCount, packChunk, 1);
+			} else {
+				for (uint32_t i = 0; i < chunkCount; i++) {
+					packChunk(i);
+				}
+			}
+			vertexData = packedVertexBuffer.data();
+			vertexBufferSize = packedVertexBuffer.size();
+		}
 
-	assert((vertexBufferSize > 0) && (indexBufferSize > 0));
+		if (useMeshCache) {
+			writeMeshCache(cacheFilename, filename, fileLoadingFlags, scale, gltfModel, encodedImages, indexBuffer, vertexData, vertexBufferSize);
+		}
+	}
 
-	struct StagingBuffer {
-		VkBuffer buffer;
-		VkDeviceMemory memory;
-	} vertexStaging, indexStaging;
+	vertices.stride = vertexLayout.getStride();
+	vertices.count = static_cast<uint32_t>(vertexBufferSize / vertices.stride);
+	indices.count = static_cast<uint32_t>(indexBufferSize / sizeof(uint32_t));
 
-	// Create staging buffers
-	// Vertex data
-	VK_CHECK_RESULT(device->createBuffer(
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		vertexBufferSize,
-		&vertexStaging.buffer,
-		&vertexStaging.memory,
-		vertexBuffer.data()));
-	// Index data
-	VK_CHECK_RESULT(device->createBuffer(
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		indexBufferSize,
-		&indexStaging.buffer,
-		&indexStaging.memory,
-		indexBuffer.data()));
+	assert((vertexBufferSize > 0) && (indexBufferSize > 0));
 
 	// Create device local buffers
 	// Vertex buffer
@@ -1311,23 +2274,14 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 		&indices.buffer,
 		&indices.memory));
 
-	// Copy from staging buffers
-	VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-	VkBufferCopy copyRegion = {};
+	// Vertex and index data is uploaded in the same batch as the last group of the model's images
+	// The batch is submitted without waiting for it, work submitted to the graphics queue afterwards sees the uploaded data
+	// Data from the mesh cache is copied into staging memory straight from the mapped file
+	device->stagingUploader.uploadBuffer(vertices.buffer, vertexData, vertexBufferSize);
+	device->stagingUploader.uploadBuffer(indices.buffer, indexData, indexBufferSize);
+	device->stagingUploader.flush();
+	cacheFile.close();
 
-	copyRegion.size = vertexBufferSize;
-	vkCmdCopyBuffer(copyCmd, vertexStaging.buffer, vertices.buffer, 1, &copyRegion);
-
-	copyRegion.size = indexBufferSize;
-	vkCmdCopyBuffer(copyCmd, indexStaging.buffer, indices.buffer, 1, &copyRegion);
-
-	device->flushCommandBuffer(copyCmd, transferQueue, true);
-
-	vkDestroyBuffer(device->logicalDevice, vertexStaging.buffer, nullptr);
-	vkFreeMemory(device->logicalDevice, vertexStaging.memory, nullptr);
-	vkDestroyBuffer(device->logicalDevice, indexStaging.buffer, nullptr);
-	vkFreeMemory(device->logicalDevice, indexStaging.memory, nullptr);
 
 	getSceneDimensions();
 
@@ -1448,9 +2402,255 @@ void vkglTF::Model::draw(VkCommandBuffer commandBuffer, uint32_t renderFlags, Vk
 		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertices.buffer, offsets);
 		vkCmdBindIndexBuffer(commandBuffer, indices.buffer, 0, VK_INDEX_TYPE_UINT32);
 	}
-	for (auto& node : nodes) {
-		drawNode(node, commandBuffer, renderFlags, pipelineLayout, bindImageSet);
+	if (!gpuDriven.enabled) {
+		for (auto& node : nodes) {
+			drawNode(node, commandBuffer, renderFlags, pipelineLayout, bindImageSet);
+		}
+		return;
+	}
+	// GPU driven: One indirect draw per material range, the commands have been written by the culling pass
+	const uint32_t commandStride = sizeof(VkDrawIndexedIndirectCommand);
+	for (uint32_t i = 0; i < static_cast<uint32_t>(gpuDriven.materialRanges.size()); i++) {
+		const GpuDriven::MaterialRange& range = gpuDriven.materialRanges[i];
+		const vkglTF::Material& material = *range.material;
+		bool skip = false;
+		if (renderFlags & RenderFlags::RenderOpaqueNodes) {
+			skip = (material.alphaMode != Material::ALPHAMODE_OPAQUE);
+		}
+		if (renderFlags & RenderFlags::RenderAlphaMaskedNodes) {
+			skip = (material.alphaMode != Material::ALPHAMODE_MASK);
+		}
+		if (renderFlags & RenderFlags::RenderAlphaBlendedNodes) {
+			skip = (material.alphaMode != Material::ALPHAMODE_BLEND);
+		}
+		if (skip) {
+			continue;
+		}
+		if (renderFlags & RenderFlags::BindImages) {
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, bindImageSet, 1, &material.descriptorSet, 0, nullptr);
+		}
+		const VkDeviceSize offset = static_cast<VkDeviceSize>(range.firstCommand) * commandStride;
+		if (gpuDriven.vkCmdDrawIndexedIndirectCountKHR) {
+			gpuDriven.vkCmdDrawIndexedIndirectCountKHR(commandBuffer, gpuDriven.commands.buffer, offset, gpuDriven.counts.buffer, i * sizeof(uint32_t), range.commandCount, commandStride);
+		} else if (device->enabledFeatures.multiDrawIndirect) {
+			// Culled commands at the end of the range have been cleared and result in empty draws
+			vkCmdDrawIndexedIndirect(commandBuffer, gpuDriven.commands.buffer, offset, range.commandCount, commandStride);
+		} else {
+			for (uint32_t j = 0; j < range.commandCount; j++) {
+				vkCmdDrawIndexedIndirect(commandBuffer, gpuDriven.commands.buffer, offset + j * commandStride, 1, commandStride);
+			}
+		}
+	}
+}
+
+/*
+	Prepares GPU driven rendering for the model, shadersPath is the path containing the "base" shader folder (see VulkanExampleBase::getShadersPath)
+	The culling pass needs to be recorded with recordGpuDrivenCulling outside of a render pass before the model is drawn
+	Only models loaded with PreTransformVertices are supported, as the indirect draws can't apply the node matrices
+*/
+void vkglTF::Model::prepareGpuDrivenRendering(const std::string& shadersPath, VkPipelineCache pipelineCache)
+{
+	if (!(fileLoadingFlags & FileLoadingFlags::PreTransformVertices)) {
+		std::cerr << "GPU driven rendering requires a glTF model loaded with PreTransformVertices, the model is drawn per node instead" << std::endl;
+		return;
+	}
+
+	// Must match the layout of the DrawData struct in the culling shader (std430)
+	struct DrawData {
+		glm::vec4 center;
+		float radius;
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		uint32_t firstCommand;
+		uint32_t countIndex;
+		uint32_t pad[3];
+	};
+
+	// Group primitives by material, so all draws of a material range can share the same descriptor set
+	std::vector<std::vector<std::pair<Node*, Primitive*>>> primitivesByMaterial(materials.size());
+	for (Node* node : linearNodes) {
+		if (node->mesh) {
+			for (Primitive* primitive : node->mesh->primitives) {
+				const size_t materialIndex = &primitive->material - materials.data();
+				primitivesByMaterial[materialIndex].push_back({ node, primitive });
+			}
+		}
+	}
+
+	const bool flipY = fileLoadingFlags & FileLoadingFlags::FlipY;
+	std::vector<DrawData> drawData;
+	gpuDriven.materialRanges.clear();
+	for (size_t materialIndex = 0; materialIndex < primitivesByMaterial.size(); materialIndex++) {
+		if (primitivesByMaterial[materialIndex].empty()) {
+			continue;
+		}
+		GpuDriven::MaterialRange range{};
+		range.material = &materials[materialIndex];
+		range.firstCommand = static_cast<uint32_t>(drawData.size());
+		range.commandCount = static_cast<uint32_t>(primitivesByMaterial[materialIndex].size());
+		for (auto& [node, primitive] : primitivesByMaterial[materialIndex]) {
+			// Bounding sphere in the same space as the (pre-transformed) vertex data, primitive dimensions are in mesh space
+			const glm::mat4& matrix = node->worldMatrix;
+			glm::vec3 min = glm::vec3(FLT_MAX);
+			glm::vec3 max = glm::vec3(-FLT_MAX);
+			for (uint32_t corner = 0; corner < 8; corner++) {
+				glm::vec3 pos = glm::vec3(
+					(corner & 1) ? primitive->dimensions.max.x : primitive->dimensions.min.x,
+					(corner & 2) ? primitive->dimensions.max.y : primitive->dimensions.min.y,
+					(corner & 4) ? primitive->dimensions.max.z : primitive->dimensions.min.z);
+				pos = glm::vec3(matrix * glm::vec4(pos, 1.0f));
+				if (flipY) {
+					pos.y *= -1.0f;
+				}
+				min = glm::min(min, pos);
+				max = glm::max(max, pos);
+			}
+			DrawData draw{};
+			draw.center = glm::vec4((min + max) * 0.5f, 1.0f);
+			draw.radius = glm::distance(min, max) * 0.5f;
+			draw.firstIndex = primitive->firstIndex;
+			draw.indexCount = primitive->indexCount;
+			draw.firstCommand = range.firstCommand;
+			draw.countIndex = static_cast<uint32_t>(gpuDriven.materialRanges.size());
+			drawData.push_back(draw);
+		}
+		gpuDriven.materialRanges.push_back(range);
+	}
+	gpuDriven.drawCount = static_cast<uint32_t>(drawData.size());
+	if (gpuDriven.drawCount == 0) {
+		return;
 	}
+
+	// Buffers
+	VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &gpuDriven.drawData, drawData.size() * sizeof(DrawData)));
+	VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &gpuDriven.commands, gpuDriven.drawCount * sizeof(VkDrawIndexedIndirectCommand)));
+	VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &gpuDriven.counts, gpuDriven.materialRanges.size() * sizeof(uint32_t)));
+	VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &gpuDriven.countsReadback, gpuDriven.materialRanges.size() * sizeof(uint32_t)));
+	VK_CHECK_RESULT(gpuDriven.countsReadback.map());
+	memset(gpuDriven.countsReadback.mapped, 0, gpuDriven.countsReadback.size);
+	device->stagingUploader.uploadBuffer(gpuDriven.drawData.buffer, drawData.data(), gpuDriven.drawData.size, 0, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+	device->stagingUploader.flush();
+
+	// Descriptors
+	std::vector<VkDescriptorPoolSize> poolSizes = {
+		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3),
+	};
+	VkDescriptorPoolCreateInfo descriptorPoolCI = vks::initializers::descriptorPoolCreateInfo(poolSizes, 1);
+	VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolCI, nullptr, &gpuDriven.descriptorPool));
+	std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+	};
+	VkDescriptorSetLayoutCreateInfo descriptorLayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorLayoutCI, nullptr, &gpuDriven.descriptorSetLayout));
+	VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(gpuDriven.descriptorPool, &gpuDriven.descriptorSetLayout, 1);
+	VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, &gpuDriven.descriptorSet));
+	std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+		vks::initializers::writeDescriptorSet(gpuDriven.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &gpuDriven.drawData.descriptor),
+		vks::initializers::writeDescriptorSet(gpuDriven.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &gpuDriven.commands.descriptor),
+		vks::initializers::writeDescriptorSet(gpuDriven.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &gpuDriven.counts.descriptor),
+	};
+	vkUpdateDescriptorSets(device->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+
+	// Culling pipeline, frustum planes and draw count are passed as push constants
+	VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(glm::vec4) * 6 + sizeof(uint32_t), 0);
+	VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(&gpuDriven.descriptorSetLayout, 1);
+	pipelineLayoutCI.pushConstantRangeCount = 1;
+	pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+	VK_CHECK_RESULT(vkCreatePipelineLayout(device->logicalDevice, &pipelineLayoutCI, nullptr, &gpuDriven.pipelineLayout));
+	const std::string shaderFile = shadersPath + "base/gpudrivenculling.comp.spv";
+	VkPipelineShaderStageCreateInfo shaderStage{};
+	shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shaderStage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	shaderStage.pName = "main";
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+	shaderStage.module = vks::tools::loadShader(androidApp->activity->assetManager, shaderFile.c_str(), device->logicalDevice);
+#else
+	shaderStage.module = vks::tools::loadShader(shaderFile.c_str(), device->logicalDevice);
+#endif
+	assert(shaderStage.module != VK_NULL_HANDLE);
+	VkComputePipelineCreateInfo computePipelineCI = vks::initializers::computePipelineCreateInfo(gpuDriven.pipelineLayout, 0);
+	computePipelineCI.stage = shaderStage;
+	VK_CHECK_RESULT(vkCreateComputePipelines(device->logicalDevice, pipelineCache, 1, &computePipelineCI, nullptr, &gpuDriven.pipeline));
+	vkDestroyShaderModule(device->logicalDevice, shaderStage.module, nullptr);
+
+	// The function pointer may be returned even if neither the extension nor the core feature have been enabled, so only take it if one of them is
+	gpuDriven.vkCmdDrawIndexedIndirectCountKHR = nullptr;
+	if (device->extensionEnabled(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)) {
+		gpuDriven.vkCmdDrawIndexedIndirectCountKHR = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(vkGetDeviceProcAddr(device->logicalDevice, "vkCmdDrawIndexedIndirectCountKHR"));
+	} else if (device->drawIndirectCount) {
+		gpuDriven.vkCmdDrawIndexedIndirectCountKHR = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(vkGetDeviceProcAddr(device->logicalDevice, "vkCmdDrawIndexedIndirectCount"));
+	}
+	gpuDriven.prepared = true;
+	gpuDriven.enabled = true;
+}
+
+/*
+	Records the compute pass that culls the model's primitives against the frustum of the given view projection matrix and writes the indirect draw commands
+	Must be recorded outside of a render pass and before any draw of the model in the same frame
+*/
+void vkglTF::Model::recordGpuDrivenCulling(VkCommandBuffer commandBuffer, const glm::mat4& viewProjection)
+{
+	if (!gpuDriven.enabled) {
+		return;
+	}
+
+	// Draws and the counts readback of the previous frame need to have consumed the commands before they're reset
+	VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+	memoryBarrier.srcAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	vkCmdFillBuffer(commandBuffer, gpuDriven.counts.buffer, 0, VK_WHOLE_SIZE, 0);
+	if (!gpuDriven.vkCmdDrawIndexedIndirectCountKHR) {
+		// Without a draw count, all commands are drawn, so the ones for culled primitives need to be empty
+		vkCmdFillBuffer(commandBuffer, gpuDriven.commands.buffer, 0, VK_WHOLE_SIZE, 0);
+	}
+	memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+	struct PushConstants {
+		glm::vec4 frustumPlanes[6];
+		uint32_t drawCount;
+	} pushConstants{};
+	vks::Frustum frustum;
+	frustum.update(viewProjection);
+	for (uint32_t i = 0; i < 6; i++) {
+		pushConstants.frustumPlanes[i] = frustum.planes[i];
+	}
+	pushConstants.drawCount = gpuDriven.drawCount;
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, gpuDriven.pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, gpuDriven.pipelineLayout, 0, 1, &gpuDriven.descriptorSet, 0, nullptr);
+	vkCmdPushConstants(commandBuffer, gpuDriven.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(glm::vec4) * 6 + sizeof(uint32_t), &pushConstants);
+	vkCmdDispatch(commandBuffer, (gpuDriven.drawCount + 63) / 64, 1, 1);
+
+	memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+	// Copy the visible draw counts for statistics, they can be read on the host once the command buffer has finished executing
+	VkBufferCopy copyRegion{ 0, 0, gpuDriven.counts.size };
+	vkCmdCopyBuffer(commandBuffer, gpuDriven.counts.buffer, gpuDriven.countsReadback.buffer, 1, &copyRegion);
+	memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+}
+
+/*
+	Returns the number of primitives that passed the culling of the last finished culling pass
+*/
+uint32_t vkglTF::Model::getGpuDrivenVisibleDrawCount()
+{
+	if (!gpuDriven.prepared) {
+		return 0;
+	}
+	const uint32_t* counts = static_cast<const uint32_t*>(gpuDriven.countsReadback.mapped);
+	uint32_t visibleCount = 0;
+	for (size_t i = 0; i < gpuDriven.materialRanges.size(); i++) {
+		visibleCount += counts[i];
+	}
+	return visibleCount;
 }
 
 void vkglTF::Model::getNodeDimensions(Node *node, glm::vec3 &min, glm::vec3 &max)
@@ -1484,6 +2684,84 @@ void vkglTF::Model::getSceneDimensions()
 	dimensions.radius = glm::distance(dimensions.min, dimensions.max) / 2.0f;
 }
 
+/*
+	glTF animation sampler
+*/
+
+bool vkglTF::AnimationSampler::isValid() const
+{
+	const size_t valuesPerKeyframe = (interpolation == CUBICSPLINE) ? 3 : 1;
+	return !inputs.empty() && (outputsVec4.size() >= inputs.size() * valuesPerKeyframe);
+}
+
+/*
+	Returns the keyframe i with inputs[i] <= time < inputs[i + 1]
+	Animations mostly advance by less than a keyframe per update, so the keyframe of the last lookup (cursor) and its successor are checked before falling back to a binary search
+*/
+uint32_t vkglTF::AnimationSampler::findKeyframe(float time, uint32_t& cursor) const
+{
+	const uint32_t lastSegment = static_cast<uint32_t>(inputs.size()) - 2;
+	if ((cursor <= lastSegment) && (inputs[cursor] <= time)) {
+		if (time < inputs[cursor + 1]) {
+			return cursor;
+		}
+		if ((cursor < lastSegment) && (time < inputs[cursor + 2])) {
+			return ++cursor;
+		}
+	}
+	const auto next = std::upper_bound(inputs.begin(), inputs.end(), time);
+	const uint32_t keyframe = static_cast<uint32_t>(std::max<std::ptrdiff_t>(std::distance(inputs.begin(), next) - 1, 0));
+	cursor = std::min(keyframe, lastSegment);
+	return cursor;
+}
+
+/*
+	Returns the sampler's value at the given time, times outside of the keyframe range are clamped to the first or last keyframe
+	Rotations are returned as quaternions (x, y, z, w)
+*/
+glm::vec4 vkglTF::AnimationSampler::evaluate(float time, uint32_t& cursor, bool rotation) const
+{
+	const bool cubic = (interpolation == CUBICSPLINE);
+	auto value = [&](uint32_t keyframe) {
+		return cubic ? outputsVec4[keyframe * 3 + 1] : outputsVec4[keyframe];
+	};
+	const uint32_t keyframeCount = static_cast<uint32_t>(inputs.size());
+	if ((keyframeCount == 1) || (time <= inputs.front())) {
+		return value(0);
+	}
+	if (time >= inputs.back()) {
+		return value(keyframeCount - 1);
+	}
+
+	const uint32_t i = findKeyframe(time, cursor);
+	const float delta = inputs[i + 1] - inputs[i];
+	const float u = (delta > 0.0f) ? (time - inputs[i]) / delta : 0.0f;
+	switch (interpolation) {
+	case STEP:
+		return value(i);
+	case CUBICSPLINE: {
+		// Hermite spline, tangents are scaled by the keyframe delta (see glTF spec appendix C)
+		const float u2 = u * u;
+		const float u3 = u2 * u;
+		const glm::vec4 p0 = outputsVec4[i * 3 + 1];
+		const glm::vec4 m0 = outputsVec4[i * 3 + 2] * delta;
+		const glm::vec4 p1 = outputsVec4[(i + 1) * 3 + 1];
+		const glm::vec4 m1 = outputsVec4[(i + 1) * 3] * delta;
+		const glm::vec4 result = (2.0f * u3 - 3.0f * u2 + 1.0f) * p0 + (u3 - 2.0f * u2 + u) * m0 + (-2.0f * u3 + 3.0f * u2) * p1 + (u3 - u2) * m1;
+		return rotation ? glm::normalize(result) : result;
+	}
+	default: {
+		if (rotation) {
+			const glm::quat q1 = glm::quat(outputsVec4[i].w, outputsVec4[i].x, outputsVec4[i].y, outputsVec4[i].z);
+			const glm::quat q2 = glm::quat(outputsVec4[i + 1].w, outputsVec4[i + 1].x, outputsVec4[i + 1].y, outputsVec4[i + 1].z);
+			const glm::quat q = glm::normalize(glm::slerp(q1, q2, u));
+			return glm::vec4(q.x, q.y, q.z, q.w);
+		}
+		return glm::mix(outputsVec4[i], outputsVec4[i + 1], u);
+	}
+	}
+}
+
 void vkglTF::Model::updateAnimation(uint32_t index, float time)
 {
 	if (index > static_cast<uint32_t>(animations.size()) - 1) {
@@ -1494,49 +2772,95 @@ void vkglTF::Model::updateAnimation(uint32_t index, float time)
 
 	bool updated = false;
 	for (auto& channel : animation.channels) {
-		vkglTF::AnimationSampler &sampler = animation.samplers[channel.samplerIndex];
-		if (sampler.inputs.size() > sampler.outputsVec4.size()) {
+		const vkglTF::AnimationSampler &sampler = animation.samplers[channel.samplerIndex];
+		if (!sampler.isValid()) {
 			continue;
 		}
-
-		for (auto i = 0; i < sampler.inputs.size() - 1; i++) {
-			if ((time >= sampler.inputs[i]) && (time <= sampler.inputs[i + 1])) {
-				float u = std::max(0.0f, time - sampler.inputs[i]) / (sampler.inputs[i + 1] - sampler.inputs[i]);
-				if (u <= 1.0f) {
-					switch (channel.path) {
-					case vkglTF::AnimationChannel::PathType::TRANSLATION: {
-						glm::vec4 trans = glm::mix(sampler.outputsVec4[i], sampler.outputsVec4[i + 1], u);
-						channel.node->translation = glm::vec3(trans);
-						break;
-					}
-					case vkglTF::AnimationChannel::PathType::SCALE: {
-						glm::vec4 trans = glm::mix(sampler.outputsVec4[i], sampler.outputsVec4[i + 1], u);
-						channel.node->scale = glm::vec3(trans);
-						break;
-					}
-					case vkglTF::AnimationChannel::PathType::ROTATION: {
-						glm::quat q1;
-						q1.x = sampler.outputsVec4[i].x;
-						q1.y = sampler.outputsVec4[i].y;
-						q1.z = sampler.outputsVec4[i].z;
-						q1.w = sampler.outputsVec4[i].w;
-						glm::quat q2;
-						q2.x = sampler.outputsVec4[i + 1].x;
-						q2.y = sampler.outputsVec4[i + 1].y;
-						q2.z = sampler.outputsVec4[i + 1].z;
-						q2.w = sampler.outputsVec4[i + 1].w;
-						channel.node->rotation = glm::normalize(glm::slerp(q1, q2, u));
-						break;
-					}
-					}
-					updated = true;
-				}
+		Node* node = channel.node;
+		switch (channel.path) {
+		case vkglTF::AnimationChannel::PathType::TRANSLATION: {
+			const glm::vec3 translation = glm::vec3(sampler.evaluate(time, channel.keyframeCursor, false));
+			if (translation == node->translation) {
+				continue;
 			}
+			node->translation = translation;
+			break;
 		}
+		case vkglTF::AnimationChannel::PathType::SCALE: {
+			const glm::vec3 scale = glm::vec3(sampler.evaluate(time, channel.keyframeCursor, false));
+			if (scale == node->scale) {
+				continue;
+			}
+			node->scale = scale;
+			break;
+		}
+		case vkglTF::AnimationChannel::PathType::ROTATION: {
+			const glm::vec4 q = sampler.evaluate(time, channel.keyframeCursor, true);
+			const glm::quat rotation = glm::quat(q.w, q.x, q.y, q.z);
+			if (rotation == node->rotation) {
+				continue;
+			}
+			node->rotation = rotation;
+			break;
+		}
+		}
+		node->transformDirty = true;
+		updated = true;
 	}
 	if (updated) {
-		for (auto &node : nodes) {
-			node->update();
+		updateTransforms();
+	}
+}
+
+/*
+	Sorts the nodes so that parents come before their children, this allows updating all world matrices in a single pass
+*/
+void vkglTF::Model::buildNodeHierarchy()
+{
+	sortedNodes.clear();
+	sortedParentIndices.clear();
+	sortedNodes.reserve(linearNodes.size());
+	sortedParentIndices.reserve(linearNodes.size());
+	for (Node* node : nodes) {
+		sortedNodes.push_back(node);
+		sortedParentIndices.push_back(-1);
+	}
+	// Breadth first, children are appended after the node that's currently being visited
+	for (size_t i = 0; i < sortedNodes.size(); i++) {
+		for (Node* child : sortedNodes[i]->children) {
+			sortedNodes.push_back(child);
+			sortedParentIndices.push_back(static_cast<int32_t>(i));
+		}
+	}
+	transformsChanged.resize(sortedNodes.size());
+}
+
+/*
+	Recalculates the world matrices of all nodes whose local transform (or that of one of their parents) has changed
+	and updates the uniform buffers of the affected meshes and of all skinned meshes
+*/
+void vkglTF::Model::updateTransforms()
+{
+	bool anyChanged = false;
+	for (size_t i = 0; i < sortedNodes.size(); i++) {
+		Node* node = sortedNodes[i];
+		const int32_t parentIndex = sortedParentIndices[i];
+		const bool changed = node->transformDirty || ((parentIndex > -1) && transformsChanged[parentIndex]);
+		transformsChanged[i] = changed;
+		if (changed) {
+			node->worldMatrix = (parentIndex > -1) ? sortedNodes[parentIndex]->worldMatrix * node->localMatrix() : node->localMatrix();
+			node->transformDirty = false;
+			anyChanged = true;
+		}
+	}
+	if (!anyChanged) {
+		return;
+	}
+	// Joints can be located anywhere in the hierarchy, so skins are updated once all world matrices are up-to-date
+	for (size_t i = 0; i < sortedNodes.size(); i++) {
+		Node* node = sortedNodes[i];
+		if (node->mesh && (transformsChanged[i] || node->skin)) {
+			node->updateUniformBuffer();
 		}
 	}
 }
@@ -1592,3 +2916,212 @@ void vkglTF::Model::prepareNodeDescriptor(vkglTF::Node* node, VkDescriptorSetLay
 		prepareNodeDescriptor(child, descriptorSetLayout);
 	}
 }
+
+/*
+	glTF instanced animation
+*/
+
+vkglTF::AnimationInstances::~AnimationInstances()
+{
+	destroy();
+}
+
+void vkglTF::AnimationInstances::create(vkglTF::Model* model, uint32_t instanceCount, uint32_t frameCount)
+{
+	// Instances may be recreated (e.g. with a different instance count), so resources and per-instance data of a previous call are released first
+	destroy();
+	this->model = model;
+	nodeCount = static_cast<uint32_t>(model->sortedNodes.size());
+	std::unordered_map<const Node*, uint32_t> nodeIndices;
+	for (uint32_t i = 0; i < nodeCount; i++) {
+		nodeIndices[model->sortedNodes[i]] = i;
+	}
+
+	// Resolve the nodes targeted by animation channels and skin joints once, so instances only work with node indices
+	maxChannelCount = 0;
+	channelNodes.assign(model->animations.size(), {});
+	for (size_t i = 0; i < model->animations.size(); i++) {
+		for (const AnimationChannel& channel : model->animations[i].channels) {
+			channelNodes[i].push_back(nodeIndices[channel.node]);
+		}
+		maxChannelCount = std::max(maxChannelCount, static_cast<uint32_t>(channelNodes[i].size()));
+	}
+	skinJointNodes.assign(model->skins.size(), {});
+	for (size_t i = 0; i < model->skins.size(); i++) {
+		for (const Node* joint : model->skins[i]->joints) {
+			skinJointNodes[i].push_back(nodeIndices[joint]);
+		}
+	}
+
+	// Joint matrices are relative to the mesh node using the skin, so every skinned mesh node gets its own range
+	// Ranges start at multiples of the storage buffer offset alignment, so each one can be bound with a dynamic offset
+	const VkDeviceSize alignment = model->device->properties.limits.minStorageBufferOffsetAlignment;
+	const uint32_t jointAlignment = static_cast<uint32_t>(std::max(alignment / sizeof(glm::mat4), static_cast<VkDeviceSize>(1)));
+	uint32_t maxMeshJointCount = 1;
+	instanceJointCount = 0;
+	skinnedMeshes.clear();
+	skinnedMeshNodes.clear();
+	for (uint32_t i = 0; i < nodeCount; i++) {
+		Node* node = model->sortedNodes[i];
+		if (!node->mesh || (node->skinIndex < 0)) {
+			continue;
+		}
+		const uint32_t jointCount = static_cast<uint32_t>(node->skin->joints.size());
+		skinnedMeshes.push_back({ node, node->skin, instanceJointCount });
+		skinnedMeshNodes.push_back(i);
+		maxMeshJointCount = std::max(maxMeshJointCount, jointCount);
+		instanceJointCount += (jointCount + jointAlignment - 1) / jointAlignment * jointAlignment;
+	}
+	meshJointRange = maxMeshJointCount * sizeof(glm::mat4);
+
+	restTranslations.resize(nodeCount);
+	restRotations.resize(nodeCount);
+	restScales.resize(nodeCount);
+	for (uint32_t i = 0; i < nodeCount; i++) {
+		restTranslations[i] = model->sortedNodes[i]->translation;
+		restRotations[i] = model->sortedNodes[i]->rotation;
+		restScales[i] = model->sortedNodes[i]->scale;
+	}
+	instances.assign(instanceCount, Instance());
+	translations.resize(static_cast<size_t>(instanceCount) * nodeCount);
+	rotations.resize(static_cast<size_t>(instanceCount) * nodeCount);
+	scales.resize(static_cast<size_t>(instanceCount) * nodeCount);
+	keyframeCursors.resize(static_cast<size_t>(instanceCount) * maxChannelCount);
+	// Forces a reset to the rest pose on the first update
+	appliedAnimations.assign(instanceCount, UINT32_MAX);
+	meshMatrices.resize(static_cast<size_t>(instanceCount) * skinnedMeshes.size());
+	worldMatrices.assign(1, std::vector<glm::mat4>(nodeCount));
+
+	const VkDeviceSize jointDataSize = std::max(static_cast<VkDeviceSize>(instanceCount) * instanceJointCount * sizeof(glm::mat4), static_cast<VkDeviceSize>(sizeof(glm::mat4)));
+	frameSize = (jointDataSize + alignment - 1) & ~(alignment - 1);
+	// The padding keeps the dynamic range of the last mesh inside the buffer if it has less joints than the largest one
+	VK_CHECK_RESULT(model->device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &jointBuffer, frameSize * frameCount + meshJointRange));
+	VK_CHECK_RESULT(jointBuffer.map());
+	for (uint32_t i = 0; i < frameCount; i++) {
+		update(0.0f, i);
+	}
+}
+
+void vkglTF::AnimationInstances::destroy()
+{
+	jointBuffer.destroy();
+	jointBuffer = {};
+	model = nullptr;
+	// Skinned meshes point into the model, so they're released along with it
+	instances.clear();
+	skinnedMeshes.clear();
+	meshMatrices.clear();
+}
+
+/*
+	Advances the time of all instances and writes their joint matrices to the part of the joint buffer for the given frame
+	If a job system is passed, instances are evaluated in parallel on its threads (must be called from the thread owning the job system)
+*/
+void vkglTF::AnimationInstances::update(float deltaTime, uint32_t frameIndex, vks::JobSystem* jobSystem)
+{
+	glm::mat4* jointMatrices = reinterpret_cast<glm::mat4*>(static_cast<unsigned char*>(jointBuffer.mapped) + frameIndex * frameSize);
+	const uint32_t instanceCount = static_cast<uint32_t>(instances.size());
+	if (jobSystem && (jobSystem->getThreadCount() > 1)) {
+		if (worldMatrices.size() < jobSystem->getThreadCount()) {
+			worldMatrices.resize(jobSystem->getThreadCount(), std::vector<glm::mat4>(nodeCount));
+		}
+		jobSystem->parallelFor(instanceCount, [&](uint32_t i) {
+			updateInstance(i, deltaTime, jointMatrices + static_cast<size_t>(i) * instanceJointCount, worldMatrices[jobSystem->getThreadIndex()]);
+		});
+	} else {
+		for (uint32_t i = 0; i < instanceCount; i++) {
+			updateInstance(i, deltaTime, jointMatrices + static_cast<size_t>(i) * instanceJointCount, worldMatrices[0]);
+		}
+	}
+}
+
+void vkglTF::AnimationInstances::updateInstance(uint32_t index, float deltaTime, glm::mat4* jointMatrices, std::vector<glm::mat4>& nodeMatrices)
+{
+	Instance& instance = instances[index];
+	const size_t firstNode = static_cast<size_t>(index) * nodeCount;
+	uint32_t* cursors = keyframeCursors.data() + static_cast<size_t>(index) * maxChannelCount;
+
+	// Nodes not animated by the new animation return to their rest pose
+	if (appliedAnimations[index] != instance.animation) {
+		std::copy(restTranslations.begin(), restTranslations.end(), translations.begin() + firstNode);
+		std::copy(restRotations.begin(), restRotations.end(), rotations.begin() + firstNode);
+		std::copy(restScales.begin(), restScales.end(), scales.begin() + firstNode);
+		std::fill(cursors, cursors + maxChannelCount, 0);
+		appliedAnimations[index] = instance.animation;
+	}
+
+	if (instance.animation < model->animations.size()) {
+		const Animation& animation = model->animations[instance.animation];
+		const float duration = animation.end - animation.start;
+		instance.time += deltaTime * instance.speed;
+		if ((duration > 0.0f) && ((instance.time > animation.end) || (instance.time < animation.start))) {
+			instance.time = animation.start + fmodf(instance.time - animation.start, duration);
+			if (instance.time < animation.start) {
+				instance.time += duration;
+			}
+		}
+		const std::vector<uint32_t>& targetNodes = channelNodes[instance.animation];
+		for (size_t i = 0; i < animation.channels.size(); i++) {
+			const AnimationChannel& channel = animation.channels[i];
+			const AnimationSampler& sampler = animation.samplers[channel.samplerIndex];
+			if (!sampler.isValid()) {
+				continue;
+			}
+			const size_t node = firstNode + targetNodes[i];
+			switch (channel.path) {
+			case AnimationChannel::PathType::TRANSLATION:
+				translations[node] = glm::vec3(sampler.evaluate(instance.time, cursors[i], false));
+				break;
+			case AnimationChannel::PathType::SCALE:
+				scales[node] = glm::vec3(sampler.evaluate(instance.time, cursors[i], false));
+				break;
+			case AnimationChannel::PathType::ROTATION: {
+				const glm::vec4 q = sampler.evaluate(instance.time, cursors[i], true);
+				rotations[node] = glm::quat(q.w, q.x, q.y, q.z);
+				break;
+			}
+			}
+		}
+	}
+
+	// Single top-down pass over the hierarchy, parents are always stored before their children
+	for (uint32_t i = 0; i < nodeCount; i++) {
+		glm::mat4 local = glm::mat4(rotations[firstNode + i]);
+		local[0] *= scales[firstNode + i].x;
+		local[1] *= scales[firstNode + i].y;
+		local[2] *= scales[firstNode + i].z;
+		local[3] = glm::vec4(translations[firstNode + i], 1.0f);
+		local = local * model->sortedNodes[i]->matrix;
+		const int32_t parentIndex = model->sortedParentIndices[i];
+		nodeMatrices[i] = (parentIndex > -1) ? nodeMatrices[parentIndex] * local : local;
+	}
+
+	glm::mat4* instanceMeshMatrices = meshMatrices.data() + static_cast<size_t>(index) * skinnedMeshes.size();
+	for (size_t i = 0; i < skinnedMeshes.size(); i++) {
+		const SkinnedMesh& skinnedMesh = skinnedMeshes[i];
+		const glm::mat4& meshMatrix = nodeMatrices[skinnedMeshNodes[i]];
+		const glm::mat4 inverseTransform = glm::inverse(meshMatrix);
+		const std::vector<uint32_t>& jointNodes = skinJointNodes[skinnedMesh.node->skinIndex];
+		glm::mat4* meshJointMatrices = jointMatrices + skinnedMesh.jointOffset;
+		for (size_t j = 0; j < jointNodes.size(); j++) {
+			meshJointMatrices[j] = inverseTransform * nodeMatrices[jointNodes[j]] * skinnedMesh.skin->inverseBindMatrices[j];
+		}
+		instanceMeshMatrices[i] = meshMatrix;
+	}
+}
+
+VkDescriptorBufferInfo vkglTF::AnimationInstances::getDescriptor(uint32_t frameIndex) const
+{
+	return { jointBuffer.buffer, frameIndex * frameSize, frameSize };
+}
+
+// Descriptor for binding the joint matrices of a single skinned mesh, to be used with the dynamic offsets from getMeshOffset
+VkDescriptorBufferInfo vkglTF::AnimationInstances::getMeshDescriptor() const
+{
+	return { jointBuffer.buffer, 0, meshJointRange };
+}
+
+uint32_t vkglTF::AnimationInstances::getMeshOffset(uint32_t frameIndex, uint32_t instance, uint32_t skinnedMesh) const
+{
+	return static_cast<uint32_t>(frameIndex * frameSize + (static_cast<VkDeviceSize>(instance) * instanceJointCount + skinnedMeshes[skinnedMesh].jointOffset) * sizeof(glm::mat4));
+}
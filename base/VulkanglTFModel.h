@@ -15,6 +15,7 @@
 
 #include "vulkan/vulkan.h"
 #include "VulkanDevice.h"
+#include "threadpool.hpp"
 
 #include <ktx.h>
 #include <ktxvulkan.h>
@@ -24,6 +25,7 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/packing.hpp>
 
 #define TINYGLTF_NO_STB_IMAGE_WRITE
 #ifdef VK_USE_PLATFORM_ANDROID_KHR
@@ -46,6 +48,8 @@ namespace vkglTF
 	extern VkDescriptorSetLayout descriptorSetLayoutUbo;
 	extern VkMemoryPropertyFlags memoryPropertyFlags;
 	extern uint32_t descriptorBindingFlags;
+	/** @brief Number of threads used for loading glTF files (image decoding and vertex data conversion), 0 = number of hardware threads, 1 = load on the calling thread only */
+	extern uint32_t loadingThreadCount;
 
 	struct Node;
 
@@ -57,6 +61,8 @@ namespace vkglTF
 		VkImage image;
 		VkImageLayout imageLayout;
 		VkDeviceMemory deviceMemory;
+		/** @brief Memory range of the image inside the device memory allocator's block (deviceMemory may be shared with other resources) */
+		vks::Allocation allocation;
 		VkImageView view;
 		uint32_t width, height;
 		uint32_t mipLevels;
@@ -128,6 +134,7 @@ namespace vkglTF
 		struct UniformBuffer {
 			VkBuffer buffer;
 			VkDeviceMemory memory;
+			vks::Allocation allocation;
 			VkDescriptorBufferInfo descriptor;
 			VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
 			void* mapped;
@@ -168,9 +175,14 @@ namespace vkglTF
 		glm::vec3 translation{};
 		glm::vec3 scale{ 1.0f };
 		glm::quat rotation{};
+		// World matrix cached by the last hierarchy update (see Model::updateTransforms)
+		glm::mat4 worldMatrix{ 1.0f };
+		// Needs to be set if the local transform has been changed, so the world matrices of the node and its children are recalculated on the next update
+		bool transformDirty = true;
 		glm::mat4 localMatrix();
 		glm::mat4 getMatrix();
 		void update();
+		void updateUniformBuffer();
 		~Node();
 	};
 
@@ -182,6 +194,8 @@ namespace vkglTF
 		PathType path;
 		Node* node;
 		uint32_t samplerIndex;
+		// Keyframe found by the last update, used as the starting point for the next lookup
+		uint32_t keyframeCursor = 0;
 	};
 
 	/*
@@ -190,8 +204,13 @@ namespace vkglTF
 	struct AnimationSampler {
 		enum InterpolationType { LINEAR, STEP, CUBICSPLINE };
 		InterpolationType interpolation;
+		// Keyframe times and values are stored in separate arrays, so keyframe lookups only touch the times
 		std::vector<float> inputs;
+		// Cubic spline samplers store an in-tangent, the value and an out-tangent for each keyframe
 		std::vector<glm::vec4> outputsVec4;
+		bool isValid() const;
+		uint32_t findKeyframe(float time, uint32_t& cursor) const;
+		glm::vec4 evaluate(float time, uint32_t& cursor, bool rotation) const;
 	};
 
 	/*
@@ -221,19 +240,74 @@ namespace vkglTF
 		static VkVertexInputBindingDescription vertexInputBindingDescription;
 		static std::vector<VkVertexInputAttributeDescription> vertexInputAttributeDescriptions;
 		static VkPipelineVertexInputStateCreateInfo pipelineVertexInputStateCreateInfo;
-		static VkVertexInputBindingDescription inputBindingDescription(uint32_t binding);
+		/** @brief Pass the vertices.stride of the model to be drawn, 0 uses the stride of the current vkglTF::vertexLayout */
+		static VkVertexInputBindingDescription inputBindingDescription(uint32_t binding, uint32_t stride = 0);
 		static VkVertexInputAttributeDescription inputAttributeDescription(uint32_t binding, uint32_t location, VertexComponent component);
 		static std::vector<VkVertexInputAttributeDescription> inputAttributeDescriptions(uint32_t binding, const std::vector<VertexComponent> components);
-		/** @brief Returns the default pipeline vertex input state create info structure for the requested vertex components */
-		static VkPipelineVertexInputStateCreateInfo* getPipelineVertexInputState(const std::vector<VertexComponent> components);
+		/** @brief Returns the default pipeline vertex input state create info structure for the requested vertex components (see inputBindingDescription for stride) */
+		static VkPipelineVertexInputStateCreateInfo* getPipelineVertexInputState(const std::vector<VertexComponent> components, uint32_t stride = 0);
 	};
 
+	/*
+		Storage formats for vertex components, quantized formats reduce vertex buffer size and vertex fetch bandwidth
+		Formats marked with (decode) need to be decoded in the vertex shader, all other formats are read as floats (normalized) by the shader
+	*/
+	enum class VertexComponentFormat {
+		// 32 bit floats (all components)
+		Float,
+		// 16 bit floats (Position, UV, Color)
+		Half,
+		// Normalized signed 16 / 8 bit integers (Normal, Tangent)
+		Snorm16,
+		Snorm8,
+		// Octahedral encoding in two normalized signed 16 bit integers (Normal, decode)
+		Octahedral,
+		// 10-10-10-2 normalized unsigned integers mapped from [-1, 1] to [0, 1], tangent handedness is stored in the 2 bit component (Normal, Tangent, decode)
+		Packed1010102,
+		// Normalized unsigned 16 / 8 bit integers (Color, Weight0)
+		Unorm16,
+		Unorm8,
+		// Unsigned 16 / 8 bit integers, read as uvec4 by the shader (Joint0)
+		Uint16,
+		Uint8
+	};
+
+	/*
+		Layout of the vertex buffers generated by the model loader
+		Only the added components are written to the vertex buffer (interleaved in the order they were added), each one in the requested format
+		If no components are added, the full vkglTF::Vertex structure is used
+	*/
+	struct VertexLayout {
+		struct Attribute {
+			VertexComponent component;
+			VertexComponentFormat format;
+			VkFormat vkFormat;
+			uint32_t offset;
+		};
+		std::vector<Attribute> attributes;
+		uint32_t stride = 0;
+		void add(VertexComponent component, VertexComponentFormat format = VertexComponentFormat::Float);
+		void clear();
+		const Attribute* getAttribute(VertexComponent component) const;
+		/** @brief Returns the size of a single vertex in the vertex buffer */
+		uint32_t getStride() const;
+		/** @brief Returns a hash of the components and formats, used to detect layout changes */
+		uint64_t getHash() const;
+		/** @brief Writes the components of the layout for the given vertex to dst (stride bytes) */
+		void pack(const Vertex& vertex, unsigned char* dst) const;
+	};
+
+	/** @brief Vertex layout for models loaded afterwards and for the pipeline vertex input states returned by vkglTF::Vertex */
+	extern VertexLayout vertexLayout;
+
 	enum FileLoadingFlags {
 		None = 0x00000000,
 		PreTransformVertices = 0x00000001,
 		PreMultiplyVertexColors = 0x00000002,
 		FlipY = 0x00000004,
-		DontLoadImages = 0x00000008
+		DontLoadImages = 0x00000008,
+		// Store the processed scene in a binary cache file next to the glTF file and load from that cache if it's up-to-date (not supported on Android)
+		UseMeshCache = 0x00000010
 	};
 
 	enum RenderFlags {
@@ -251,12 +325,26 @@ namespace vkglTF
 		vkglTF::Texture* getTexture(uint32_t index);
 		vkglTF::Texture emptyTexture;
 		void createEmptyTexture(VkQueue transferQueue);
+		// Vertex and index ranges reserved for a primitive by loadNode, the actual data is converted afterwards (in parallel)
+		struct PrimitiveLoadInfo {
+			const tinygltf::Primitive* primitive;
+			uint32_t firstVertex;
+			uint32_t firstIndex;
+		};
+		std::vector<PrimitiveLoadInfo> primitiveLoads;
+		std::vector<uint8_t> transformsChanged;
+		void buildNodeHierarchy();
+		void loadPrimitiveData(const tinygltf::Model& model, const PrimitiveLoadInfo& loadInfo, std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer);
+		bool loadMeshCache(const unsigned char* data, size_t size, const std::string& filename, uint32_t fileLoadingFlags, float scale, tinygltf::Model& gltfModel, std::vector<std::vector<unsigned char>>& encodedImages, const void** vertexData, size_t* vertexDataSize, const void** indexData, size_t* indexDataSize);
+		void writeMeshCache(const std::string& cacheFilename, const std::string& filename, uint32_t fileLoadingFlags, float scale, const tinygltf::Model& gltfModel, const std::vector<std::vector<unsigned char>>& encodedImages, const std::vector<uint32_t>& indexBuffer, const void* vertexData, size_t vertexDataSize);
 	public:
 		vks::VulkanDevice* device;
 		VkDescriptorPool descriptorPool;
 
 		struct Vertices {
 			int count;
+			// Size of a single vertex, depends on the vertex layout the model was loaded with
+			uint32_t stride;
 			VkBuffer buffer;
 			VkDeviceMemory memory;
 		} vertices;
@@ -268,6 +356,9 @@ namespace vkglTF
 
 		std::vector<Node*> nodes;
 		std::vector<Node*> linearNodes;
+		// Nodes in hierarchy order (parents before their children) with the index of each node's parent in that list, -1 for root nodes
+		std::vector<Node*> sortedNodes;
+		std::vector<int32_t> sortedParentIndices;
 
 		std::vector<Skin*> skins;
 
@@ -286,6 +377,42 @@ namespace vkglTF
 		bool metallicRoughnessWorkflow = true;
 		bool buffersBound = false;
 		std::string path;
+		uint32_t fileLoadingFlags = 0;
+
+		/*
+			GPU driven rendering
+			Primitives are culled against the view frustum in a compute shader that writes compacted indirect draw commands grouped by material.
+			Once enabled, draw() issues one indirect draw per material range instead of one draw per primitive.
+			Indirect draws can't apply per node matrices, so this requires a model loaded with PreTransformVertices (static scenes).
+		*/
+		struct GpuDriven {
+			// Set once prepareGpuDrivenRendering has created the resources, enabled can only be toggled after that
+			bool prepared = false;
+			bool enabled = false;
+			uint32_t drawCount = 0;
+			// Commands of all primitives sharing a material are stored consecutively, the compute shader appends visible draws to the range of their material
+			struct MaterialRange {
+				Material* material;
+				uint32_t firstCommand;
+				uint32_t commandCount;
+			};
+			std::vector<MaterialRange> materialRanges;
+			// Per primitive bounding sphere and draw parameters
+			vks::Buffer drawData;
+			// Indirect draw commands (VkDrawIndexedIndirectCommand)
+			vks::Buffer commands;
+			// Number of visible draws per material range
+			vks::Buffer counts;
+			// Host visible copy of the counts written by the last culling pass that has finished executing
+			vks::Buffer countsReadback;
+			VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+			VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+			VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+			VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+			VkPipeline pipeline = VK_NULL_HANDLE;
+			// Only available if VK_KHR_draw_indirect_count or the Vulkan 1.2 drawIndirectCount feature has been enabled for the device, otherwise all commands of a range are drawn and culled commands are empty
+			PFN_vkCmdDrawIndexedIndirectCountKHR vkCmdDrawIndexedIndirectCountKHR = nullptr;
+		} gpuDriven;
 
 		Model() {};
 		~Model();
@@ -298,11 +425,79 @@ namespace vkglTF
 		void bindBuffers(VkCommandBuffer commandBuffer);
 		void drawNode(Node* node, VkCommandBuffer commandBuffer, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1);
 		void draw(VkCommandBuffer commandBuffer, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1);
+		void prepareGpuDrivenRendering(const std::string& shadersPath, VkPipelineCache pipelineCache = VK_NULL_HANDLE);
+		void recordGpuDrivenCulling(VkCommandBuffer commandBuffer, const glm::mat4& viewProjection);
+		uint32_t getGpuDrivenVisibleDrawCount();
 		void getNodeDimensions(Node* node, glm::vec3& min, glm::vec3& max);
 		void getSceneDimensions();
 		void updateAnimation(uint32_t index, float time);
+		void updateTransforms();
 		Node* findNode(Node* parent, uint32_t index);
 		Node* nodeFromIndex(uint32_t index);
 		void prepareNodeDescriptor(vkglTF::Node* node, VkDescriptorSetLayout descriptorSetLayout);
 	};
+
+	/*
+		Instanced animation
+		Plays animations for many instances of a model that share its skeleton and animation samplers, with each instance having its own animation and time
+		Instances are evaluated in parallel on a job system and the joint matrices of all instances are written to a single storage buffer
+		Joint matrices are stored per skinned mesh node and are relative to that node (like the ones written by Node::updateUniformBuffer),
+		so the shader needs to apply the instance's model matrix multiplied with the mesh node's matrix (see meshMatrices)
+	*/
+	class AnimationInstances {
+	private:
+		vkglTF::Model* model = nullptr;
+		uint32_t nodeCount = 0;
+		uint32_t maxChannelCount = 0;
+		// Index of the animated node for each channel of each animation, of each skinned mesh node and of each skin's joints (indices into the model's sortedNodes)
+		std::vector<std::vector<uint32_t>> channelNodes;
+		std::vector<uint32_t> skinnedMeshNodes;
+		std::vector<std::vector<uint32_t>> skinJointNodes;
+		// Local transforms of the rest pose and of all instances (nodeCount entries per instance)
+		std::vector<glm::vec3> restTranslations;
+		std::vector<glm::quat> restRotations;
+		std::vector<glm::vec3> restScales;
+		std::vector<glm::vec3> translations;
+		std::vector<glm::quat> rotations;
+		std::vector<glm::vec3> scales;
+		// Keyframe cursors of all instances (maxChannelCount entries per instance)
+		std::vector<uint32_t> keyframeCursors;
+		// Animation that last wrote the local transforms of each instance
+		std::vector<uint32_t> appliedAnimations;
+		// Scratch world matrices for each job system thread
+		std::vector<std::vector<glm::mat4>> worldMatrices;
+		uint32_t instanceJointCount = 0;
+		void updateInstance(uint32_t index, float deltaTime, glm::mat4* jointMatrices, std::vector<glm::mat4>& nodeMatrices);
+	public:
+		struct Instance {
+			// Index of the model's animation played by this instance
+			uint32_t animation = 0;
+			float time = 0.0f;
+			float speed = 1.0f;
+		};
+		std::vector<Instance> instances;
+		// Joint matrices of all instances for each frame in flight, persistently mapped
+		vks::Buffer jointBuffer;
+		struct SkinnedMesh {
+			Node* node;
+			Skin* skin;
+			// Offset of the mesh's joint matrices inside an instance's range (in matrices)
+			uint32_t jointOffset;
+		};
+		std::vector<SkinnedMesh> skinnedMeshes;
+		// World matrix of each skinned mesh node for all instances (skinnedMeshes.size() entries per instance), updated along with the joint matrices
+		std::vector<glm::mat4> meshMatrices;
+		// Range of one skinned mesh's joint matrices, for binding the joint buffer as a dynamic storage buffer (see getMeshDescriptor)
+		VkDeviceSize meshJointRange = 0;
+		// Size of the joint matrices for one frame, aligned so it can be used as a dynamic storage buffer offset
+		VkDeviceSize frameSize = 0;
+
+		~AnimationInstances();
+		void create(vkglTF::Model* model, uint32_t instanceCount, uint32_t frameCount = 1);
+		void destroy();
+		void update(float deltaTime, uint32_t frameIndex = 0, vks::JobSystem* jobSystem = nullptr);
+		VkDescriptorBufferInfo getDescriptor(uint32_t frameIndex = 0) const;
+		VkDescriptorBufferInfo getMeshDescriptor() const;
+		uint32_t getMeshOffset(uint32_t frameIndex, uint32_t instance, uint32_t skinnedMesh) const;
+	};
 }
\ No newline at end of file
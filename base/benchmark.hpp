@@ -13,25 +13,346 @@
 #include <functional>
 #include <chrono>
 #include <iomanip>
+#include <numeric>
+#include <cmath>
+#include <utility>
 
 namespace vks
 {
 	class Benchmark {
+	public:
+		// Summary statistics for a set of frame times (in ms)
+		struct Statistics {
+			size_t count = 0;
+			double min = 0.0;
+			double max = 0.0;
+			double mean = 0.0;
+			double stddev = 0.0;
+			double p50 = 0.0;
+			double p90 = 0.0;
+			double p99 = 0.0;
+			double p999 = 0.0;
+			// Frames outside of the Tukey fences (1.5 times the interquartile range below the first or above the third quartile)
+			size_t outliers = 0;
+		};
+
+		// Results for a single benchmark run
+		struct Run {
+			double runtime = 0.0;
+			uint32_t frameCount = 0;
+			Statistics cpu;
+			Statistics gpu;
+		};
+
 	private:
 		FILE *stream;
 		VkPhysicalDeviceProperties deviceProps;
+
+		// GPU frame times are measured with timestamps written by small command buffers submitted at the start (prepareFrame) and the end (submitFrame) of a frame
+		// The start submission waits for the swap chain image to be acquired (and signals the semaphore again for the frame's own submission), so the time doesn't include the acquire or v-sync wait
+		// A ring of query pairs is used, results are read back without waiting once they're available
+		struct GpuTimer {
+			VkDevice device = VK_NULL_HANDLE;
+			VkCommandPool commandPool = VK_NULL_HANDLE;
+			VkQueryPool queryPool = VK_NULL_HANDLE;
+			std::vector<VkCommandBuffer> beginCommandBuffers;
+			std::vector<VkCommandBuffer> endCommandBuffers;
+			std::vector<bool> pending;
+			// Index of the (CPU) frame each query pair was submitted for
+			std::vector<size_t> frameIndices;
+			// Oldest query pair that hasn't been read back yet
+			uint32_t oldest = 0;
+			uint32_t current = 0;
+			bool frameActive = false;
+			double timestampPeriod = 1.0;
+			uint64_t timestampMask = ~0ull;
+		} gpuTimer;
+		bool measuring = false;
+
+		void submit(VkQueue queue, VkCommandBuffer commandBuffer, VkSemaphore semaphore = VK_NULL_HANDLE) {
+			const VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+			VkSubmitInfo submitInfo{};
+			submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+			submitInfo.commandBufferCount = 1;
+			submitInfo.pCommandBuffers = &commandBuffer;
+			if (semaphore != VK_NULL_HANDLE) {
+				submitInfo.waitSemaphoreCount = 1;
+				submitInfo.pWaitSemaphores = &semaphore;
+				submitInfo.pWaitDstStageMask = &waitStageMask;
+				submitInfo.signalSemaphoreCount = 1;
+				submitInfo.pSignalSemaphores = &semaphore;
+			}
+			VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+		}
+
+		// Returns false if the timestamps of the query pair aren't available yet
+		bool readGpuTimestamps(uint32_t index) {
+			uint64_t timestamps[2];
+			VkResult result = vkGetQueryPoolResults(gpuTimer.device, gpuTimer.queryPool, index * 2, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+			if (result == VK_NOT_READY) {
+				return false;
+			}
+			VK_CHECK_RESULT(result);
+			const uint64_t delta = (timestamps[1] - timestamps[0]) & gpuTimer.timestampMask;
+			gpuFrameTimes.push_back((double)delta * gpuTimer.timestampPeriod / 1000000.0);
+			gpuFrameIndices.push_back(gpuTimer.frameIndices[index]);
+			gpuTimer.pending[index] = false;
+			return true;
+		}
+
+		// Read the available results in submission order
+		void pollGpuTimestamps() {
+			const uint32_t count = static_cast<uint32_t>(gpuTimer.pending.size());
+			while (gpuTimer.pending[gpuTimer.oldest] && readGpuTimestamps(gpuTimer.oldest)) {
+				gpuTimer.oldest = (gpuTimer.oldest + 1) % count;
+			}
+		}
+
+		void collectGpuTimestamps() {
+			if (gpuTimer.queryPool == VK_NULL_HANDLE) {
+				return;
+			}
+			// Called after the measured phase, so waiting for the outstanding frames doesn't affect the results
+			VK_CHECK_RESULT(vkDeviceWaitIdle(gpuTimer.device));
+			pollGpuTimestamps();
+		}
+
+		// Two-sided 95% critical values of Student's t-distribution for 1 to 30 degrees of freedom
+		static double tCritical95(size_t degreesOfFreedom) {
+			static const double values[30] = {
+				12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+				2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+				2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+			};
+			if (degreesOfFreedom == 0) {
+				return 0.0;
+			}
+			return (degreesOfFreedom <= 30) ? values[degreesOfFreedom - 1] : 1.960;
+		}
+
+		// Percentile of sorted values with linear interpolation between the closest ranks
+		static double percentile(const std::vector<double>& sorted, double p) {
+			if (sorted.empty()) {
+				return 0.0;
+			}
+			const double rank = p * (double)(sorted.size() - 1);
+			const size_t lower = static_cast<size_t>(std::floor(rank));
+			const size_t upper = std::min(lower + 1, sorted.size() - 1);
+			return sorted[lower] + (sorted[upper] - sorted[lower]) * (rank - (double)lower);
+		}
+
+		void printStatistics(const std::string& name, const Statistics& stats) {
+			std::cout << name << " : avg " << stats.mean << " ms, stddev " << stats.stddev << " ms, min " << stats.min << " ms, max " << stats.max << " ms" << "\n";
+			std::cout << std::string(name.size(), ' ') << "   p50 " << stats.p50 << " ms, p90 " << stats.p90 << " ms, p99 " << stats.p99 << " ms, p99.9 " << stats.p999 << " ms, outliers " << stats.outliers << "\n";
+		}
+
+		static void addNamedTime(std::vector<std::pair<std::string, std::vector<double>>>& namedTimes, const std::string& name, double time) {
+			auto entry = std::find_if(namedTimes.begin(), namedTimes.end(), [&](const std::pair<std::string, std::vector<double>>& namedTime) { return namedTime.first == name; });
+			if (entry == namedTimes.end()) {
+				namedTimes.push_back({ name, {} });
+				entry = namedTimes.end() - 1;
+			}
+			entry->second.push_back(time);
+		}
+
+		// Quotes, backslashes and control characters in strings written to JSON files are escaped
+		static std::string escapeJson(const std::string& value) {
+			std::string escaped;
+			for (const char c : value) {
+				switch (c) {
+				case '"': escaped += "\\\""; break;
+				case '\\': escaped += "\\\\"; break;
+				case '\n': escaped += "\\n"; break;
+				case '\r': escaped += "\\r"; break;
+				case '\t': escaped += "\\t"; break;
+				default:
+					if (static_cast<unsigned char>(c) < 0x20) {
+						char code[7];
+						snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned char>(c));
+						escaped += code;
+					}
+					else {
+						escaped += c;
+					}
+				}
+			}
+			return escaped;
+		}
+
+		// Fields containing separators, quotes or line breaks are quoted, with quotes doubled
+		static std::string escapeCsv(const std::string& value) {
+			if (value.find_first_of(",\"\r\n") == std::string::npos) {
+				return value;
+			}
+			std::string escaped = "\"";
+			for (const char c : value) {
+				escaped += c;
+				if (c == '"') {
+					escaped += '"';
+				}
+			}
+			return escaped + "\"";
+		}
+
+		// GPU time for each CPU frame, frames without a GPU time (e.g. skipped because all query pairs were in use) are NaN
+		std::vector<double> getGpuFrameTimesPerFrame() {
+			std::vector<double> times(frameTimes.size(), std::numeric_limits<double>::quiet_NaN());
+			for (size_t i = 0; i < gpuFrameTimes.size(); i++) {
+				if (gpuFrameIndices[i] < times.size()) {
+					times[gpuFrameIndices[i]] = gpuFrameTimes[i];
+				}
+			}
+			return times;
+		}
+
+		void writeStatisticsJson(std::ofstream& result, const Statistics& stats) {
+			result << "{ \"frames\": " << stats.count << ", \"min\": " << stats.min << ", \"max\": " << stats.max << ", \"avg\": " << stats.mean << ", \"stddev\": " << stats.stddev
+				<< ", \"p50\": " << stats.p50 << ", \"p90\": " << stats.p90 << ", \"p99\": " << stats.p99 << ", \"p99.9\": " << stats.p999 << ", \"outliers\": " << stats.outliers << " }";
+		}
+
 	public:
 		bool active = false;
 		bool outputFrameTimes = false;
 		int outputFrames = -1; // -1 means no frames limit
 		uint32_t warmup = 1;
 		uint32_t duration = 10;
+		// Number of times the benchmark phase is repeated, used to calculate a confidence interval for the average frame time
+		uint32_t runCount = 1;
+		// Measure GPU time per frame with timestamp queries
+		bool gpuTime = false;
 		std::vector<double> frameTimes;
+		std::vector<double> gpuFrameTimes;
+		// Index of the CPU frame (in frameTimes) each GPU frame time belongs to
+		std::vector<size_t> gpuFrameIndices;
+		// GPU times of named passes (e.g. from the GPU profiler), in order of their first appearance
+		std::vector<std::pair<std::string, std::vector<double>>> passTimes;
+		// CPU times of named tasks (e.g. command buffer recording), in order of their first appearance
+		std::vector<std::pair<std::string, std::vector<double>>> taskTimes;
+		std::vector<Run> runs;
 		std::string filename = "";
 
 		double runtime = 0.0;
 		uint32_t frameCount = 0;
 
+		static Statistics calculateStatistics(std::vector<double> values) {
+			Statistics stats;
+			stats.count = values.size();
+			if (values.empty()) {
+				return stats;
+			}
+			std::sort(values.begin(), values.end());
+			stats.min = values.front();
+			stats.max = values.back();
+			stats.mean = std::accumulate(values.begin(), values.end(), 0.0) / (double)values.size();
+			double variance = 0.0;
+			for (auto value : values) {
+				variance += (value - stats.mean) * (value - stats.mean);
+			}
+			stats.stddev = (values.size() > 1) ? std::sqrt(variance / (double)(values.size() - 1)) : 0.0;
+			stats.p50 = percentile(values, 0.5);
+			stats.p90 = percentile(values, 0.9);
+			stats.p99 = percentile(values, 0.99);
+			stats.p999 = percentile(values, 0.999);
+			const double q1 = percentile(values, 0.25);
+			const double q3 = percentile(values, 0.75);
+			const double iqr = q3 - q1;
+			stats.outliers = std::count_if(values.begin(), values.end(), [&](double value) { return (value < q1 - 1.5 * iqr) || (value > q3 + 1.5 * iqr); });
+			return stats;
+		}
+
+		// Sets up the resources for GPU frame times, does nothing if GPU timing hasn't been requested or the queue doesn't support timestamps
+		void prepareGpuTimer(VkDevice device, VkCommandPool commandPool, uint32_t timestampValidBits, const VkPhysicalDeviceProperties& deviceProps) {
+			if (!active || !gpuTime) {
+				return;
+			}
+			if (timestampValidBits == 0 || deviceProps.limits.timestampPeriod == 0.0f) {
+				std::cout << "Timestamp queries are not supported by the graphics queue, GPU frame times won't be recorded" << "\n";
+				gpuTime = false;
+				return;
+			}
+			const uint32_t ringSize = 8;
+			gpuTimer.device = device;
+			gpuTimer.commandPool = commandPool;
+			gpuTimer.timestampPeriod = deviceProps.limits.timestampPeriod;
+			gpuTimer.timestampMask = (timestampValidBits >= 64) ? ~0ull : ((1ull << timestampValidBits) - 1);
+			gpuTimer.pending.resize(ringSize, false);
+			gpuTimer.frameIndices.resize(ringSize, 0);
+
+			VkQueryPoolCreateInfo queryPoolInfo{};
+			queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			queryPoolInfo.queryCount = ringSize * 2;
+			VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &gpuTimer.queryPool));
+
+			// The command buffers only contain the timestamp writes, so they're recorded once and reused
+			gpuTimer.beginCommandBuffers.resize(ringSize);
+			gpuTimer.endCommandBuffers.resize(ringSize);
+			VkCommandBufferAllocateInfo allocateInfo = vks::initializers::commandBufferAllocateInfo(commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, ringSize);
+			VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &allocateInfo, gpuTimer.beginCommandBuffers.data()));
+			VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &allocateInfo, gpuTimer.endCommandBuffers.data()));
+			VkCommandBufferBeginInfo beginInfo = vks::initializers::commandBufferBeginInfo();
+			for (uint32_t i = 0; i < ringSize; i++) {
+				VK_CHECK_RESULT(vkBeginCommandBuffer(gpuTimer.beginCommandBuffers[i], &beginInfo));
+				vkCmdResetQueryPool(gpuTimer.beginCommandBuffers[i], gpuTimer.queryPool, i * 2, 2);
+				vkCmdWriteTimestamp(gpuTimer.beginCommandBuffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, gpuTimer.queryPool, i * 2);
+				VK_CHECK_RESULT(vkEndCommandBuffer(gpuTimer.beginCommandBuffers[i]));
+				VK_CHECK_RESULT(vkBeginCommandBuffer(gpuTimer.endCommandBuffers[i], &beginInfo));
+				vkCmdWriteTimestamp(gpuTimer.endCommandBuffers[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, gpuTimer.queryPool, i * 2 + 1);
+				VK_CHECK_RESULT(vkEndCommandBuffer(gpuTimer.endCommandBuffers[i]));
+			}
+		}
+
+		void destroyGpuTimer() {
+			if (gpuTimer.queryPool == VK_NULL_HANDLE) {
+				return;
+			}
+			vkFreeCommandBuffers(gpuTimer.device, gpuTimer.commandPool, static_cast<uint32_t>(gpuTimer.beginCommandBuffers.size()), gpuTimer.beginCommandBuffers.data());
+			vkFreeCommandBuffers(gpuTimer.device, gpuTimer.commandPool, static_cast<uint32_t>(gpuTimer.endCommandBuffers.size()), gpuTimer.endCommandBuffers.data());
+			vkDestroyQueryPool(gpuTimer.device, gpuTimer.queryPool, nullptr);
+			gpuTimer.queryPool = VK_NULL_HANDLE;
+		}
+
+		// Called at the start of a frame (after the swap chain image has been acquired), the semaphore is the one signaled by the acquire
+		void beginGpuFrame(VkQueue queue, VkSemaphore presentCompleteSemaphore) {
+			if (!measuring || gpuTimer.queryPool == VK_NULL_HANDLE) {
+				return;
+			}
+			pollGpuTimestamps();
+			// Skip the frame if all query pairs are still in use by frames in flight
+			if (gpuTimer.pending[gpuTimer.current]) {
+				return;
+			}
+			submit(queue, gpuTimer.beginCommandBuffers[gpuTimer.current], presentCompleteSemaphore);
+			// The frame's CPU time is added once it has been rendered, so the current frame's index is the number of recorded frames
+			gpuTimer.frameIndices[gpuTimer.current] = frameTimes.size();
+			gpuTimer.frameActive = true;
+		}
+
+		// Called at the end of a frame (after all of the frame's work has been submitted)
+		void endGpuFrame(VkQueue queue) {
+			if (!gpuTimer.frameActive) {
+				return;
+			}
+			submit(queue, gpuTimer.endCommandBuffers[gpuTimer.current]);
+			gpuTimer.pending[gpuTimer.current] = true;
+			gpuTimer.current = (gpuTimer.current + 1) % static_cast<uint32_t>(gpuTimer.pending.size());
+			gpuTimer.frameActive = false;
+		}
+
+		// Adds the GPU time of a named pass for the current frame, only recorded during the benchmark phase
+		void addPassTime(const std::string& name, double time) {
+			if (measuring) {
+				addNamedTime(passTimes, name, time);
+			}
+		}
+
+		// Adds the CPU time of a named task for the current frame, only recorded during the benchmark phase
+		void addTaskTime(const std::string& name, double time) {
+			if (measuring) {
+				addNamedTime(taskTimes, name, time);
+			}
+		}
+
 		void run(std::function<void()> renderFunc, VkPhysicalDeviceProperties deviceProps) {
 			active = true;
 			this->deviceProps = deviceProps;
@@ -53,44 +374,186 @@ namespace vks
 				};
 			}
 
-			// Benchmark phase
-			{
-				while (runtime < (duration * 1000.0)) {
+			// Benchmark phase, repeated runCount times
+			for (uint32_t r = 0; r < std::max(runCount, 1u); r++) {
+				Run run;
+				const size_t firstFrame = frameTimes.size();
+				const size_t firstGpuFrame = gpuFrameTimes.size();
+				measuring = true;
+				while (run.runtime < (duration * 1000.0)) {
 					auto tStart = std::chrono::high_resolution_clock::now();
 					renderFunc();
 					auto tDiff = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
-					runtime += tDiff;
+					run.runtime += tDiff;
 					frameTimes.push_back(tDiff);
-					frameCount++;
-					if (outputFrames != -1 && outputFrames == frameCount) break;
+					run.frameCount++;
+					if (outputFrames != -1 && outputFrames == run.frameCount) break;
 				};
-				std::cout << "Benchmark finished" << "\n";
-				std::cout << "device : " << deviceProps.deviceName << " (driver version: " << deviceProps.driverVersion << ")" << "\n";
-				std::cout << "runtime: " << (runtime / 1000.0) << "\n";
-				std::cout << "frames : " << frameCount << "\n";
-				std::cout << "fps    : " << frameCount / (runtime / 1000.0) << "\n";
+				measuring = false;
+				collectGpuTimestamps();
+				run.cpu = calculateStatistics(std::vector<double>(frameTimes.begin() + firstFrame, frameTimes.end()));
+				run.gpu = calculateStatistics(std::vector<double>(gpuFrameTimes.begin() + firstGpuFrame, gpuFrameTimes.end()));
+				runtime += run.runtime;
+				frameCount += run.frameCount;
+				runs.push_back(run);
+				if (runCount > 1) {
+					std::cout << "run " << (r + 1) << "/" << runCount << ": " << run.frameCount << " frames, avg " << run.cpu.mean << " ms" << "\n";
+				}
 			}
+
+			std::cout << "Benchmark finished" << "\n";
+			std::cout << "device : " << deviceProps.deviceName << " (driver version: " << deviceProps.driverVersion << ")" << "\n";
+			std::cout << "runtime: " << (runtime / 1000.0) << "\n";
+			std::cout << "frames : " << frameCount << "\n";
+			std::cout << "fps    : " << frameCount / (runtime / 1000.0) << "\n";
+			printStatistics("cpu", calculateStatistics(frameTimes));
+			if (!gpuFrameTimes.empty()) {
+				printStatistics("gpu", calculateStatistics(gpuFrameTimes));
+			}
+			for (auto& pass : passTimes) {
+				printStatistics("gpu pass \"" + pass.first + "\"", calculateStatistics(pass.second));
+			}
+			for (auto& task : taskTimes) {
+				printStatistics("cpu task \"" + task.first + "\"", calculateStatistics(task.second));
+			}
+			if (runs.size() > 1) {
+				double ciLow, ciHigh;
+				getConfidenceInterval(ciLow, ciHigh);
+				std::cout << "95% confidence interval of the average frame time over " << runs.size() << " runs: " << ciLow << " - " << ciHigh << " ms" << "\n";
+			}
+		}
+
+		// 95% confidence interval of the average frame time based on the per-run averages
+		void getConfidenceInterval(double& low, double& high) {
+			std::vector<double> means;
+			for (auto& run : runs) {
+				means.push_back(run.cpu.mean);
+			}
+			Statistics stats = calculateStatistics(means);
+			const double halfWidth = (means.size() > 1) ? tCritical95(means.size() - 1) * stats.stddev / std::sqrt((double)means.size()) : 0.0;
+			low = stats.mean - halfWidth;
+			high = stats.mean + halfWidth;
 		}
 
+		// Results are written as JSON if the file name ends with ".json", CSV otherwise
 		void saveResults() {
 			std::ofstream result(filename, std::ios::out);
 			if (result.is_open()) {
 				result << std::fixed << std::setprecision(4);
 
-				result << "device,driverversion,duration (ms),frames,fps" << "\n";
-				result << deviceProps.deviceName << "," << deviceProps.driverVersion << "," << runtime << "," << frameCount << "," << frameCount / (runtime / 1000.0) << "\n";
+				const Statistics cpuStats = calculateStatistics(frameTimes);
+				const Statistics gpuStats = calculateStatistics(gpuFrameTimes);
+				double ciLow, ciHigh;
+				getConfidenceInterval(ciLow, ciHigh);
+				const bool json = (filename.size() >= 5) && (filename.compare(filename.size() - 5, 5, ".json") == 0);
 
-				if (outputFrameTimes) {
-					result << "\n" << "frame,ms" << "\n";
-					for (size_t i = 0; i < frameTimes.size(); i++) {
-						result << i << "," << frameTimes[i] << "\n";
+				if (json) {
+					result << "{" << "\n";
+					result << "  \"device\": \"" << escapeJson(deviceProps.deviceName) << "\"," << "\n";
+					result << "  \"driverversion\": " << deviceProps.driverVersion << "," << "\n";
+					result << "  \"duration\": " << runtime << "," << "\n";
+					result << "  \"frames\": " << frameCount << "," << "\n";
+					result << "  \"fps\": " << frameCount / (runtime / 1000.0) << "," << "\n";
+					result << "  \"cpu\": ";
+					writeStatisticsJson(result, cpuStats);
+					result << "," << "\n";
+					result << "  \"gpu\": ";
+					writeStatisticsJson(result, gpuStats);
+					result << "," << "\n";
+					result << "  \"confidenceinterval95\": [" << ciLow << ", " << ciHigh << "]," << "\n";
+					result << "  \"passes\": {";
+					for (size_t i = 0; i < passTimes.size(); i++) {
+						result << ((i > 0) ? "," : "") << "\n" << "    \"" << escapeJson(passTimes[i].first) << "\": ";
+						writeStatisticsJson(result, calculateStatistics(passTimes[i].second));
+					}
+					result << (passTimes.empty() ? "" : "\n  ") << "}," << "\n";
+					result << "  \"tasks\": {";
+					for (size_t i = 0; i < taskTimes.size(); i++) {
+						result << ((i > 0) ? "," : "") << "\n" << "    \"" << escapeJson(taskTimes[i].first) << "\": ";
+						writeStatisticsJson(result, calculateStatistics(taskTimes[i].second));
+					}
+					result << (taskTimes.empty() ? "" : "\n  ") << "}," << "\n";
+					result << "  \"runs\": [" << "\n";
+					for (size_t i = 0; i < runs.size(); i++) {
+						result << "    { \"duration\": " << runs[i].runtime << ", \"frames\": " << runs[i].frameCount << ", \"cpu\": ";
+						writeStatisticsJson(result, runs[i].cpu);
+						result << ", \"gpu\": ";
+						writeStatisticsJson(result, runs[i].gpu);
+						result << " }" << ((i < runs.size() - 1) ? "," : "") << "\n";
+					}
+					result << "  ]";
+					if (outputFrameTimes) {
+						result << "," << "\n" << "  \"frametimes\": [";
+						for (size_t i = 0; i < frameTimes.size(); i++) {
+							result << ((i > 0) ? ", " : "") << frameTimes[i];
+						}
+						// One entry per frame, null for frames without a GPU time
+						const std::vector<double> gpuTimes = getGpuFrameTimesPerFrame();
+						result << "]," << "\n" << "  \"gpuframetimes\": [";
+						for (size_t i = 0; i < gpuTimes.size(); i++) {
+							result << ((i > 0) ? ", " : "");
+							if (std::isnan(gpuTimes[i])) {
+								result << "null";
+							}
+							else {
+								result << gpuTimes[i];
+							}
+						}
+						result << "]";
 					}
-					double tMin = *std::min_element(frameTimes.begin(), frameTimes.end());
-					double tMax = *std::max_element(frameTimes.begin(), frameTimes.end());
-					double tAvg = std::accumulate(frameTimes.begin(), frameTimes.end(), 0.0) / (double)frameTimes.size();
-					std::cout << "best   : " << (1000.0 / tMin) << " fps (" << tMin << " ms)" << "\n";
-					std::cout << "worst  : " << (1000.0 / tMax) << " fps (" << tMax << " ms)" << "\n";
-					std::cout << "avg    : " << (1000.0 / tAvg) << " fps (" << tAvg << " ms)" << "\n";
+					result << "\n" << "}" << "\n";
+				}
+				else {
+					result << "device,driverversion,duration (ms),frames,fps" << "\n";
+					result << escapeCsv(deviceProps.deviceName) << "," << deviceProps.driverVersion << "," << runtime << "," << frameCount << "," << frameCount / (runtime / 1000.0) << "\n";
+
+					result << "\n" << "timer,frames,min (ms),max (ms),avg (ms),stddev (ms),p50 (ms),p90 (ms),p99 (ms),p99.9 (ms),outliers" << "\n";
+					const Statistics* stats[2] = { &cpuStats, &gpuStats };
+					const char* names[2] = { "cpu", "gpu" };
+					for (uint32_t i = 0; i < 2; i++) {
+						result << names[i] << "," << stats[i]->count << "," << stats[i]->min << "," << stats[i]->max << "," << stats[i]->mean << "," << stats[i]->stddev << ","
+							<< stats[i]->p50 << "," << stats[i]->p90 << "," << stats[i]->p99 << "," << stats[i]->p999 << "," << stats[i]->outliers << "\n";
+					}
+					// GPU times of the profiled passes
+					for (auto& pass : passTimes) {
+						const Statistics passStats = calculateStatistics(pass.second);
+						result << escapeCsv("gpu pass " + pass.first) << "," << passStats.count << "," << passStats.min << "," << passStats.max << "," << passStats.mean << "," << passStats.stddev << ","
+							<< passStats.p50 << "," << passStats.p90 << "," << passStats.p99 << "," << passStats.p999 << "," << passStats.outliers << "\n";
+					}
+					// CPU times of the measured tasks
+					for (auto& task : taskTimes) {
+						const Statistics taskStats = calculateStatistics(task.second);
+						result << escapeCsv("cpu task " + task.first) << "," << taskStats.count << "," << taskStats.min << "," << taskStats.max << "," << taskStats.mean << "," << taskStats.stddev << ","
+							<< taskStats.p50 << "," << taskStats.p90 << "," << taskStats.p99 << "," << taskStats.p999 << "," << taskStats.outliers << "\n";
+					}
+
+					if (runs.size() > 1) {
+						result << "\n" << "run,duration (ms),frames,avg (ms),p99 (ms),gpu avg (ms)" << "\n";
+						for (size_t i = 0; i < runs.size(); i++) {
+							result << i << "," << runs[i].runtime << "," << runs[i].frameCount << "," << runs[i].cpu.mean << "," << runs[i].cpu.p99 << "," << runs[i].gpu.mean << "\n";
+						}
+						result << "\n" << "95% confidence interval low (ms),95% confidence interval high (ms)" << "\n";
+						result << ciLow << "," << ciHigh << "\n";
+					}
+
+					if (outputFrameTimes) {
+						// The GPU cell is left empty for frames without a GPU time
+						const std::vector<double> gpuTimes = getGpuFrameTimesPerFrame();
+						result << "\n" << "frame,ms,gpu ms" << "\n";
+						for (size_t i = 0; i < frameTimes.size(); i++) {
+							result << i << "," << frameTimes[i] << ",";
+							if (!std::isnan(gpuTimes[i])) {
+								result << gpuTimes[i];
+							}
+							result << "\n";
+						}
+					}
+				}
+
+				if (outputFrameTimes) {
+					std::cout << "best   : " << (1000.0 / cpuStats.min) << " fps (" << cpuStats.min << " ms)" << "\n";
+					std::cout << "worst  : " << (1000.0 / cpuStats.max) << " fps (" << cpuStats.max << " ms)" << "\n";
+					std::cout << "avg    : " << (1000.0 / cpuStats.mean) << " fps (" << cpuStats.mean << " ms)" << "\n";
 					std::cout << "\n";
 				}
 
@@ -101,4 +564,4 @@ namespace vks
 			}
 		}
 	};
-}
\ No newline at end of file
+}
@@ -0,0 +1,232 @@
+/*
+* Bounding volume hierarchy for hierarchical view frustum culling
+*
+* Copyright (C) 2016-2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include <float.h>
+#include <math.h>
+#include <glm/glm.hpp>
+
+#include "frustum.hpp"
+
+namespace vks
+{
+	/*
+		Bounding volume hierarchy over object bounding spheres
+
+		Objects are sorted into leaves of up to leafSize spheres by recursive median splits along the longest axis, so every node covers
+		a contiguous range of the sorted objects. Culling walks the tree with a mask of the frustum planes that still need to be tested:
+		- Planes a node is fully inside of are removed from the mask for all of its children
+		- Nodes that are fully inside of all planes are accepted with all of their objects without any further tests
+		- The plane that rejected a node is tested first the next time that node is visited (plane coherency)
+		The spheres of leaves that still need testing are stored as SoA arrays and tested with the frustum's SIMD batch functions
+
+		Moving objects are updated with updateSphere followed by refit, which recalculates the node bounds without rebuilding the tree
+		Culling updates the plane coherency information of the nodes, so it must not be called concurrently on the same BVH
+	*/
+	class BVH
+	{
+	private:
+		struct Node {
+			glm::vec3 min;
+			// First sorted object covered by this node
+			uint32_t first;
+			glm::vec3 max;
+			uint32_t count;
+			// Index of the left child, the right child directly follows it. Zero for leaves, as the root can't be a child
+			uint32_t left;
+			// Frustum plane that rejected this node the last time it was tested
+			uint32_t lastRejectedPlane;
+		};
+		std::vector<Node> nodes;
+		// Maps sorted objects to object indices and vice versa
+		std::vector<uint32_t> objectIndices;
+		std::vector<uint32_t> objectSlots;
+		// Bounding spheres in tree order (SoA)
+		std::vector<float> centerX;
+		std::vector<float> centerY;
+		std::vector<float> centerZ;
+		std::vector<float> radius;
+		// Indices of the visible spheres of the leaf currently being tested
+		std::vector<uint32_t> leafVisible;
+
+		void subdivide(uint32_t nodeIndex, const std::vector<glm::vec4>& spheres)
+		{
+			const uint32_t first = nodes[nodeIndex].first;
+			const uint32_t count = nodes[nodeIndex].count;
+			nodes[nodeIndex].left = 0;
+			nodes[nodeIndex].lastRejectedPlane = 0;
+			if (count <= leafSize) {
+				return;
+			}
+			// Split at the median along the longest axis of the sphere centers
+			glm::vec3 centerMin(FLT_MAX);
+			glm::vec3 centerMax(-FLT_MAX);
+			for (uint32_t i = first; i < first + count; i++) {
+				const glm::vec3 center = glm::vec3(spheres[objectIndices[i]]);
+				centerMin = glm::min(centerMin, center);
+				centerMax = glm::max(centerMax, center);
+			}
+			const glm::vec3 extent = centerMax - centerMin;
+			int axis = 0;
+			if (extent.y > extent.x) {
+				axis = 1;
+			}
+			if (extent.z > extent[axis]) {
+				axis = 2;
+			}
+			const uint32_t half = count / 2;
+			std::nth_element(objectIndices.begin() + first, objectIndices.begin() + first + half, objectIndices.begin() + first + count, [&](uint32_t a, uint32_t b) { return spheres[a][axis] < spheres[b][axis]; });
+			const uint32_t left = static_cast<uint32_t>(nodes.size());
+			nodes[nodeIndex].left = left;
+			Node leftNode{};
+			leftNode.first = first;
+			leftNode.count = half;
+			Node rightNode{};
+			rightNode.first = first + half;
+			rightNode.count = count - half;
+			nodes.push_back(leftNode);
+			nodes.push_back(rightNode);
+			subdivide(left, spheres);
+			subdivide(left + 1, spheres);
+		}
+
+		// Tests the spheres of a leaf against the planes in planeMask and appends the visible objects
+		void testSpheres(uint32_t first, uint32_t count, const Frustum& frustum, uint32_t planeMask, std::vector<uint32_t>& visibleObjects)
+		{
+			const uint32_t visibleCount = frustum.cullSpheres(&centerX[first], &centerY[first], &centerZ[first], &radius[first], count, leafVisible.data(), planeMask);
+			for (uint32_t i = 0; i < visibleCount; i++) {
+				visibleObjects.push_back(objectIndices[first + leafVisible[i]]);
+			}
+		}
+
+		void cullNode(uint32_t nodeIndex, const Frustum& frustum, uint32_t planeMask, std::vector<uint32_t>& visibleObjects)
+		{
+			Node& node = nodes[nodeIndex];
+			const glm::vec3 center = (node.min + node.max) * 0.5f;
+			const glm::vec3 extent = (node.max - node.min) * 0.5f;
+			// Start with the plane that rejected this node the last time
+			for (uint32_t i = 0; i < 6; i++) {
+				const uint32_t p = (node.lastRejectedPlane + i) % 6;
+				if ((planeMask & (1u << p)) == 0) {
+					continue;
+				}
+				const glm::vec4& plane = frustum.planes[p];
+				const float distance = (plane.x * center.x) + (plane.y * center.y) + (plane.z * center.z) + plane.w;
+				const float projectedExtent = (fabsf(plane.x) * extent.x) + (fabsf(plane.y) * extent.y) + (fabsf(plane.z) * extent.z);
+				if (distance <= -projectedExtent) {
+					node.lastRejectedPlane = p;
+					return;
+				}
+				if (distance >= projectedExtent) {
+					// Node is fully inside of this plane, so are its children
+					planeMask &= ~(1u << p);
+				}
+			}
+			if (planeMask == 0) {
+				visibleObjects.insert(visibleObjects.end(), objectIndices.begin() + node.first, objectIndices.begin() + node.first + node.count);
+				return;
+			}
+			if (node.left == 0) {
+				testSpheres(node.first, node.count, frustum, planeMask, visibleObjects);
+				return;
+			}
+			const uint32_t left = node.left;
+			cullNode(left, frustum, planeMask, visibleObjects);
+			cullNode(left + 1, frustum, planeMask, visibleObjects);
+		}
+
+	public:
+		// Max. number of objects per leaf
+		uint32_t leafSize = 16;
+
+		// Builds the hierarchy for the given bounding spheres (xyz = center, w = radius), the index of a sphere is its object index
+		void build(const std::vector<glm::vec4>& spheres)
+		{
+			const uint32_t objectCount = static_cast<uint32_t>(spheres.size());
+			nodes.clear();
+			objectIndices.resize(objectCount);
+			for (uint32_t i = 0; i < objectCount; i++) {
+				objectIndices[i] = i;
+			}
+			if (objectCount > 0) {
+				nodes.reserve(4 * (objectCount / std::max(leafSize, 1u) + 1));
+				Node root{};
+				root.first = 0;
+				root.count = objectCount;
+				nodes.push_back(root);
+				subdivide(0, spheres);
+			}
+			// Store the spheres in tree order, so the spheres of every node are contiguous
+			objectSlots.resize(objectCount);
+			centerX.resize(objectCount);
+			centerY.resize(objectCount);
+			centerZ.resize(objectCount);
+			radius.resize(objectCount);
+			leafVisible.resize(leafSize);
+			for (uint32_t i = 0; i < objectCount; i++) {
+				const glm::vec4& sphere = spheres[objectIndices[i]];
+				objectSlots[objectIndices[i]] = i;
+				centerX[i] = sphere.x;
+				centerY[i] = sphere.y;
+				centerZ[i] = sphere.z;
+				radius[i] = sphere.w;
+			}
+			refit();
+		}
+
+		// Updates the bounding sphere of an object, call refit afterwards to update the node bounds
+		// Different objects can be updated from different threads
+		void updateSphere(uint32_t objectIndex, const glm::vec3& center, float sphereRadius)
+		{
+			const uint32_t slot = objectSlots[objectIndex];
+			centerX[slot] = center.x;
+			centerY[slot] = center.y;
+			centerZ[slot] = center.z;
+			radius[slot] = sphereRadius;
+		}
+
+		// Recalculates the bounds of all nodes bottom-up
+		void refit()
+		{
+			// Children are always stored after their parent
+			for (size_t n = nodes.size(); n-- > 0;) {
+				Node& node = nodes[n];
+				if (node.left == 0) {
+					node.min = glm::vec3(FLT_MAX);
+					node.max = glm::vec3(-FLT_MAX);
+					for (uint32_t i = node.first; i < node.first + node.count; i++) {
+						const glm::vec3 center(centerX[i], centerY[i], centerZ[i]);
+						node.min = glm::min(node.min, center - glm::vec3(radius[i]));
+						node.max = glm::max(node.max, center + glm::vec3(radius[i]));
+					}
+				} else {
+					const Node& left = nodes[node.left];
+					const Node& right = nodes[node.left + 1];
+					node.min = glm::min(left.min, right.min);
+					node.max = glm::max(left.max, right.max);
+				}
+			}
+		}
+
+		// Stores the indices of all objects whose bounding spheres intersect the frustum in visibleObjects
+		void cull(const Frustum& frustum, std::vector<uint32_t>& visibleObjects)
+		{
+			visibleObjects.clear();
+			if (!nodes.empty()) {
+				cullNode(0, frustum, 0x3F, visibleObjects);
+			}
+		}
+
+		uint32_t getNodeCount() const { return static_cast<uint32_t>(nodes.size()); }
+		uint32_t getObjectCount() const { return static_cast<uint32_t>(objectIndices.size()); }
+	};
+}
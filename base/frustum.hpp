@@ -6,18 +6,198 @@
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
+#pragma once
+
 #include <array>
+#include <stdint.h>
 #include <math.h>
 #include <glm/glm.hpp>
 
+// Select the widest SIMD instruction set available to the compiler for the batch culling functions
+#if defined(__AVX2__)
+#define VKS_FRUSTUM_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define VKS_FRUSTUM_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define VKS_FRUSTUM_NEON
+#include <arm_neon.h>
+#endif
+
 namespace vks
 {
 	class Frustum
 	{
+	private:
+		/*
+			Tests objects in batches of batchWidth against the planes selected by planeMask and calls visit(first, laneMask) for every batch
+			Bit n of laneMask is set if object first + n is visible, remaining objects that don't fill a whole batch are tested one at a time
+			Spheres pass their radius in extentX, boxes pass their half extents
+		*/
+		template<bool box, typename Visit>
+		void testBatches(const float* centerX, const float* centerY, const float* centerZ, const float* extentX, const float* extentY, const float* extentZ, uint32_t count, uint32_t planeMask, Visit visit) const
+		{
+			uint32_t i = 0;
+#if defined(VKS_FRUSTUM_AVX2)
+			for (; i + 8 <= count; i += 8) {
+				const __m256 x = _mm256_loadu_ps(centerX + i);
+				const __m256 y = _mm256_loadu_ps(centerY + i);
+				const __m256 z = _mm256_loadu_ps(centerZ + i);
+				const __m256 ex = _mm256_loadu_ps(extentX + i);
+				const __m256 ey = box ? _mm256_loadu_ps(extentY + i) : _mm256_setzero_ps();
+				const __m256 ez = box ? _mm256_loadu_ps(extentZ + i) : _mm256_setzero_ps();
+				__m256 outside = _mm256_setzero_ps();
+				for (uint32_t p = 0; p < 6; p++) {
+					if ((planeMask & (1u << p)) == 0) {
+						continue;
+					}
+					const glm::vec4& plane = planes[p];
+					const __m256 distance = _mm256_add_ps(
+						_mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(plane.x)), _mm256_mul_ps(y, _mm256_set1_ps(plane.y))),
+						_mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(plane.z)), _mm256_set1_ps(plane.w)));
+					// Boxes are projected onto the plane normal
+					const __m256 radius = box ? _mm256_add_ps(
+						_mm256_add_ps(_mm256_mul_ps(ex, _mm256_set1_ps(fabsf(plane.x))), _mm256_mul_ps(ey, _mm256_set1_ps(fabsf(plane.y)))),
+						_mm256_mul_ps(ez, _mm256_set1_ps(fabsf(plane.z)))) : ex;
+					outside = _mm256_or_ps(outside, _mm256_cmp_ps(distance, _mm256_sub_ps(_mm256_setzero_ps(), radius), _CMP_LE_OQ));
+				}
+				visit(i, static_cast<uint32_t>(~_mm256_movemask_ps(outside)) & 0xFFu);
+			}
+#elif defined(VKS_FRUSTUM_SSE2)
+			for (; i + 4 <= count; i += 4) {
+				const __m128 x = _mm_loadu_ps(centerX + i);
+				const __m128 y = _mm_loadu_ps(centerY + i);
+				const __m128 z = _mm_loadu_ps(centerZ + i);
+				const __m128 ex = _mm_loadu_ps(extentX + i);
+				const __m128 ey = box ? _mm_loadu_ps(extentY + i) : _mm_setzero_ps();
+				const __m128 ez = box ? _mm_loadu_ps(extentZ + i) : _mm_setzero_ps();
+				__m128 outside = _mm_setzero_ps();
+				for (uint32_t p = 0; p < 6; p++) {
+					if ((planeMask & (1u << p)) == 0) {
+						continue;
+					}
+					const glm::vec4& plane = planes[p];
+					const __m128 distance = _mm_add_ps(
+						_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+						_mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+					// Boxes are projected onto the plane normal
+					const __m128 radius = box ? _mm_add_ps(
+						_mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(fabsf(plane.x))), _mm_mul_ps(ey, _mm_set1_ps(fabsf(plane.y)))),
+						_mm_mul_ps(ez, _mm_set1_ps(fabsf(plane.z)))) : ex;
+					outside = _mm_or_ps(outside, _mm_cmple_ps(distance, _mm_sub_ps(_mm_setzero_ps(), radius)));
+				}
+				visit(i, static_cast<uint32_t>(~_mm_movemask_ps(outside)) & 0xFu);
+			}
+#elif defined(VKS_FRUSTUM_NEON)
+			const uint32_t laneBits[4] = { 1, 2, 4, 8 };
+			const uint32x4_t laneBitsVec = vld1q_u32(laneBits);
+			for (; i + 4 <= count; i += 4) {
+				const float32x4_t x = vld1q_f32(centerX + i);
+				const float32x4_t y = vld1q_f32(centerY + i);
+				const float32x4_t z = vld1q_f32(centerZ + i);
+				const float32x4_t ex = vld1q_f32(extentX + i);
+				const float32x4_t ey = box ? vld1q_f32(extentY + i) : vdupq_n_f32(0.0f);
+				const float32x4_t ez = box ? vld1q_f32(extentZ + i) : vdupq_n_f32(0.0f);
+				uint32x4_t outside = vdupq_n_u32(0);
+				for (uint32_t p = 0; p < 6; p++) {
+					if ((planeMask & (1u << p)) == 0) {
+						continue;
+					}
+					const glm::vec4& plane = planes[p];
+					const float32x4_t distance = vaddq_f32(
+						vaddq_f32(vmulq_n_f32(x, plane.x), vmulq_n_f32(y, plane.y)),
+						vaddq_f32(vmulq_n_f32(z, plane.z), vdupq_n_f32(plane.w)));
+					// Boxes are projected onto the plane normal
+					const float32x4_t radius = box ? vaddq_f32(
+						vaddq_f32(vmulq_n_f32(ex, fabsf(plane.x)), vmulq_n_f32(ey, fabsf(plane.y))),
+						vmulq_n_f32(ez, fabsf(plane.z))) : ex;
+					outside = vorrq_u32(outside, vcleq_f32(distance, vnegq_f32(radius)));
+				}
+				// Gather one bit per lane
+				const uint32x4_t outsideBits = vandq_u32(outside, laneBitsVec);
+				uint32x2_t sum = vpadd_u32(vget_low_u32(outsideBits), vget_high_u32(outsideBits));
+				sum = vpadd_u32(sum, sum);
+				visit(i, ~vget_lane_u32(sum, 0) & 0xFu);
+			}
+#endif
+			for (; i < count; i++) {
+				bool visible = true;
+				for (uint32_t p = 0; p < 6; p++) {
+					if ((planeMask & (1u << p)) == 0) {
+						continue;
+					}
+					const glm::vec4& plane = planes[p];
+					const float distance = (plane.x * centerX[i]) + (plane.y * centerY[i]) + (plane.z * centerZ[i]) + plane.w;
+					const float radius = box ? (fabsf(plane.x) * extentX[i]) + (fabsf(plane.y) * extentY[i]) + (fabsf(plane.z) * extentZ[i]) : extentX[i];
+					if (distance <= -radius) {
+						visible = false;
+						break;
+					}
+				}
+				visit(i, visible ? 1u : 0u);
+			}
+		}
+
+		// Batch visitor that sets the visibility bits of a batch, batch widths are powers of two so a batch never spans two words
+		struct BitmaskWriter {
+			uint32_t* visibilityMask;
+			void operator()(uint32_t first, uint32_t laneMask) const
+			{
+				visibilityMask[first >> 5] |= laneMask << (first & 31);
+			}
+		};
+
+		// Batch visitor that appends the indices of the visible objects of a batch
+		struct IndexWriter {
+			uint32_t* visibleIndices;
+			uint32_t* visibleCount;
+			void operator()(uint32_t first, uint32_t laneMask) const
+			{
+				for (uint32_t lane = 0; laneMask != 0; lane++, laneMask >>= 1) {
+					if (laneMask & 1u) {
+						visibleIndices[(*visibleCount)++] = first + lane;
+					}
+				}
+			}
+		};
+
+		void clearBitmask(uint32_t count, uint32_t* visibilityMask) const
+		{
+			for (uint32_t i = 0; i < (count + 31) / 32; i++) {
+				visibilityMask[i] = 0;
+			}
+		}
+
 	public:
 		enum side { LEFT = 0, RIGHT = 1, TOP = 2, BOTTOM = 3, BACK = 4, FRONT = 5 };
 		std::array<glm::vec4, 6> planes;
 
+		// Plane mask for the batch functions that selects all planes, bit n selects plane n
+		static const uint32_t allPlanes = 0x3F;
+
+		// Number of objects the batch functions test at once
+#if defined(VKS_FRUSTUM_AVX2)
+		static const uint32_t batchWidth = 8;
+#elif defined(VKS_FRUSTUM_SSE2) || defined(VKS_FRUSTUM_NEON)
+		static const uint32_t batchWidth = 4;
+#else
+		static const uint32_t batchWidth = 1;
+#endif
+
+		static const char* getBatchInstructionSet()
+		{
+#if defined(VKS_FRUSTUM_AVX2)
+			return "AVX2";
+#elif defined(VKS_FRUSTUM_SSE2)
+			return "SSE2";
+#elif defined(VKS_FRUSTUM_NEON)
+			return "NEON";
+#else
+			return "Scalar";
+#endif
+		}
+
 		void update(glm::mat4 matrix)
 		{
 			planes[LEFT].x = matrix[0].w + matrix[0].x;
@@ -57,7 +237,7 @@ namespace vks
 			}
 		}
 		
-		bool checkSphere(glm::vec3 pos, float radius)
+		bool checkSphere(glm::vec3 pos, float radius) const
 		{
 			for (auto i = 0; i < planes.size(); i++)
 			{
@@ -68,5 +248,45 @@ namespace vks
 			}
 			return true;
 		}
+
+		/*
+			Batch functions for testing arrays of spheres and axis aligned boxes stored as structures of arrays
+
+			The objects are tested batchWidth at a time using AVX2, SSE2 or NEON depending on the target (scalar otherwise)
+			Results are either written as a bitmask with one bit per object ((count + 31) / 32 words) or as a compacted list of the visible object indices
+			planeMask selects the planes to test, e.g. to skip planes that a parent node of a hierarchy is known to be inside of
+		*/
+
+		void checkSpheres(const float* centerX, const float* centerY, const float* centerZ, const float* radius, uint32_t count, uint32_t* visibilityMask, uint32_t planeMask = allPlanes) const
+		{
+			clearBitmask(count, visibilityMask);
+			BitmaskWriter writer = { visibilityMask };
+			testBatches<false>(centerX, centerY, centerZ, radius, nullptr, nullptr, count, planeMask, writer);
+		}
+
+		// Returns the number of visible spheres, visibleIndices needs to be able to hold count indices
+		uint32_t cullSpheres(const float* centerX, const float* centerY, const float* centerZ, const float* radius, uint32_t count, uint32_t* visibleIndices, uint32_t planeMask = allPlanes) const
+		{
+			uint32_t visibleCount = 0;
+			IndexWriter writer = { visibleIndices, &visibleCount };
+			testBatches<false>(centerX, centerY, centerZ, radius, nullptr, nullptr, count, planeMask, writer);
+			return visibleCount;
+		}
+
+		void checkBoxes(const float* centerX, const float* centerY, const float* centerZ, const float* extentX, const float* extentY, const float* extentZ, uint32_t count, uint32_t* visibilityMask, uint32_t planeMask = allPlanes) const
+		{
+			clearBitmask(count, visibilityMask);
+			BitmaskWriter writer = { visibilityMask };
+			testBatches<true>(centerX, centerY, centerZ, extentX, extentY, extentZ, count, planeMask, writer);
+		}
+
+		// Returns the number of visible boxes, visibleIndices needs to be able to hold count indices
+		uint32_t cullBoxes(const float* centerX, const float* centerY, const float* centerZ, const float* extentX, const float* extentY, const float* extentZ, uint32_t count, uint32_t* visibleIndices, uint32_t planeMask = allPlanes) const
+		{
+			uint32_t visibleCount = 0;
+			IndexWriter writer = { visibleIndices, &visibleCount };
+			testBatches<true>(centerX, centerY, centerZ, extentX, extentY, extentZ, count, planeMask, writer);
+			return visibleCount;
+		}
 	};
 }
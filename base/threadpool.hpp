@@ -1,120 +1,435 @@
 /*
-* Basic C++11 based thread pool with per-thread job queues
+* Work-stealing job system
 *
-* Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
+* Every worker thread (including the thread that owns the job system) has its own lock-free job deque. Workers pop jobs from
+* the bottom of their own deque and steal from the top of other workers' deques once they run out of work, so uneven per-job
+* cost is balanced automatically instead of depending on a static partitioning of the work.
+*
+* Copyright (C) 2016-2023 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
+#pragma once
+
 #include <vector>
+#include <algorithm>
 #include <thread>
-#include <queue>
+#include <atomic>
 #include <mutex>
 #include <condition_variable>
-#include <functional>
-
-// make_unique is not available in C++11
-// Taken from Herb Sutter's blog (https://herbsutter.com/gotw/_102/)
-template<typename T, typename ...Args>
-std::unique_ptr<T> make_unique(Args&& ...args)
-{
-	return std::unique_ptr<T>(new T(std::forward<Args>(args)...));
-}
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <assert.h>
 
 namespace vks
 {
-	class Thread
+	class JobSystem;
+
+	/*
+		A job stores its callable inline (small buffer), so adding a job usually doesn't allocate
+	*/
+	struct Job
+	{
+		static const size_t storageSize = 96;
+		// Invokes and destroys the stored callable
+		void (*function)(Job*) = nullptr;
+		class JobCounter* counter = nullptr;
+		// Set while the job is queued, waiting for a dependency or running, the job's slot in the worker's pool can't be reused until it's cleared
+		std::atomic<bool> active{ false };
+		// Jobs that didn't fit into the worker's pool are allocated on the heap and deleted once they've finished
+		bool heapAllocated = false;
+		alignas(16) unsigned char storage[storageSize];
+	};
+
+	/*
+		Counts the outstanding jobs that were added with this counter
+		Can be waited on (JobSystem::wait) and used as a dependency for other jobs, which are only queued once the counter reaches zero
+	*/
+	class JobCounter
+	{
+		friend class JobSystem;
+		// Set in value while continuations are attached, so only the job that finishes last has to take the lock
+		static const uint32_t continuationsFlag = 0x80000000u;
+		std::atomic<uint32_t> value{ 0 };
+		std::mutex mutex;
+		std::vector<Job*> continuations;
+	public:
+		bool done() const
+		{
+			return value.load(std::memory_order_acquire) == 0;
+		}
+	};
+
+	/*
+		Fixed size Chase-Lev work-stealing deque
+		Only the owning worker may push and pop (at the bottom), other workers steal from the top
+	*/
+	class JobDeque
 	{
 	private:
-		bool destroying = false;
-		std::thread worker;
-		std::queue<std::function<void()>> jobQueue;
-		std::mutex queueMutex;
-		std::condition_variable condition;
+		static const int64_t capacity = 4096;
+		std::atomic<int64_t> top{ 0 };
+		std::atomic<int64_t> bottom{ 0 };
+		std::atomic<Job*> jobs[capacity];
 
-		// Loop through all remaining jobs
-		void queueLoop()
+	public:
+		JobDeque()
 		{
-			while (true)
-			{
-				std::function<void()> job;
-				{
-					std::unique_lock<std::mutex> lock(queueMutex);
-					condition.wait(lock, [this] { return !jobQueue.empty() || destroying; });
-					if (destroying)
+			for (auto& job : jobs) {
+				job.store(nullptr, std::memory_order_relaxed);
+			}
+		}
+
+		// Returns false if the deque is full
+		bool push(Job* job)
+		{
+			const int64_t b = bottom.load(std::memory_order_relaxed);
+			const int64_t t = top.load(std::memory_order_acquire);
+			if (b - t >= capacity) {
+				return false;
+			}
+			jobs[b & (capacity - 1)].store(job, std::memory_order_relaxed);
+			bottom.store(b + 1, std::memory_order_release);
+			return true;
+		}
+
+		Job* pop()
+		{
+			const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+			bottom.store(b, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			int64_t t = top.load(std::memory_order_relaxed);
+			if (t > b) {
+				// Deque is empty
+				bottom.store(b + 1, std::memory_order_relaxed);
+				return nullptr;
+			}
+			Job* job = jobs[b & (capacity - 1)].load(std::memory_order_relaxed);
+			if (t == b) {
+				// Last job in the deque, this may race with a thief
+				if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+					job = nullptr;
+				}
+				bottom.store(b + 1, std::memory_order_relaxed);
+			}
+			return job;
+		}
+
+		Job* steal()
+		{
+			int64_t t = top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			const int64_t b = bottom.load(std::memory_order_acquire);
+			if (t >= b) {
+				return nullptr;
+			}
+			Job* job = jobs[t & (capacity - 1)].load(std::memory_order_relaxed);
+			if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+				// Lost the race against the owner or another thief
+				return nullptr;
+			}
+			return job;
+		}
+	};
+
+	/*
+		Work-stealing job system
+		The thread calling setThreadCount becomes worker 0 and executes jobs while it waits for them, so count should include that thread
+		Jobs may only be added from threads belonging to the job system (the owning thread or from within jobs)
+	*/
+	class JobSystem
+	{
+	private:
+		// Jobs are taken from a per-worker ring, if the next slot is still in use the job is allocated on the heap instead
+		static const uint32_t jobPoolSize = 4096;
+
+		struct Worker
+		{
+			JobSystem* system = nullptr;
+			uint32_t index = 0;
+			uint32_t randomState = 0;
+			JobDeque deque;
+			std::unique_ptr<Job[]> jobPool;
+			uint32_t nextJob = 0;
+			std::thread thread;
+		};
+
+		std::vector<std::unique_ptr<Worker>> workers;
+		// Worker the owning thread belonged to before this job system was started, so job systems can be nested (e.g. a loader inside a sample)
+		Worker* previousWorker = nullptr;
+		std::atomic<bool> stopping{ false };
+		// Number of jobs in all deques, used to put idle workers to sleep
+		std::atomic<int32_t> queuedJobs{ 0 };
+		std::atomic<uint32_t> sleepingWorkers{ 0 };
+		std::mutex sleepMutex;
+		std::condition_variable sleepCondition;
+
+		static Worker*& localWorker()
+		{
+			static thread_local Worker* worker = nullptr;
+			return worker;
+		}
+
+		Worker* currentWorker()
+		{
+			Worker* worker = localWorker();
+			return (worker && worker->system == this) ? worker : nullptr;
+		}
+
+		template<typename F>
+		Job* allocateJob(F&& function, JobCounter* counter)
+		{
+			typedef typename std::decay<F>::type Function;
+			static_assert(sizeof(Function) <= Job::storageSize, "Job function exceeds the inline job storage, capture less data by value");
+			static_assert(alignof(Function) <= 16, "Job function alignment exceeds the inline job storage alignment");
+			Worker* worker = currentWorker();
+			assert(worker && "Jobs can only be added from threads of the job system");
+			Job* job = &worker->jobPool[worker->nextJob++ & (jobPoolSize - 1)];
+			if (job->active.load(std::memory_order_acquire)) {
+				// The slot belongs to a job that hasn't finished yet (e.g. a continuation or a long running stolen job)
+				job = new Job();
+				job->heapAllocated = true;
+			}
+			job->active.store(true, std::memory_order_relaxed);
+			new (job->storage) Function(std::forward<F>(function));
+			job->function = [](Job* job) {
+				Function* function = reinterpret_cast<Function*>(job->storage);
+				(*function)();
+				function->~Function();
+			};
+			job->counter = counter;
+			return job;
+		}
+
+		void execute(Job* job)
+		{
+			JobCounter* counter = job->counter;
+			job->function(job);
+			// The callable has been destroyed, so the job's slot can be reused
+			if (job->heapAllocated) {
+				delete job;
+			}
+			else {
+				job->active.store(false, std::memory_order_release);
+			}
+			if (counter) {
+				// Without continuations the decrement is the last access to the counter, so a waiting thread may destroy it right after (see wait)
+				const uint32_t previous = counter->value.fetch_sub(1, std::memory_order_acq_rel);
+				if (previous == (JobCounter::continuationsFlag | 1)) {
+					// Counter reached zero, queue all jobs that depend on it
+					// The counter only reads as done once the flag has been cleared, and waiting threads take the lock before they return
+					std::vector<Job*> continuations;
 					{
-						break;
+						std::lock_guard<std::mutex> lock(counter->mutex);
+						continuations.swap(counter->continuations);
+						counter->value.fetch_and(~JobCounter::continuationsFlag, std::memory_order_release);
+					}
+					for (auto continuation : continuations) {
+						submit(continuation);
 					}
-					job = jobQueue.front();
 				}
+			}
+		}
 
-				job();
+		void submit(Job* job)
+		{
+			Worker* worker = currentWorker();
+			queuedJobs.fetch_add(1, std::memory_order_seq_cst);
+			if (!worker->deque.push(job)) {
+				// Deque is full, run the job right away
+				queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+				execute(job);
+				return;
+			}
+			if (sleepingWorkers.load(std::memory_order_seq_cst) > 0) {
+				std::lock_guard<std::mutex> lock(sleepMutex);
+				sleepCondition.notify_one();
+			}
+		}
 
-				{
-					std::lock_guard<std::mutex> lock(queueMutex);
-					jobQueue.pop();
-					condition.notify_one();
+		// Pops a job from the worker's own deque or steals one from another worker and executes it
+		bool runPendingJob(Worker* worker)
+		{
+			Job* job = worker->deque.pop();
+			if (!job) {
+				// Start with a random victim so thieves don't all contend on the same deque
+				const uint32_t count = static_cast<uint32_t>(workers.size());
+				worker->randomState ^= worker->randomState << 13;
+				worker->randomState ^= worker->randomState >> 17;
+				worker->randomState ^= worker->randomState << 5;
+				const uint32_t start = worker->randomState % count;
+				for (uint32_t i = 0; i < count && !job; i++) {
+					const uint32_t victim = (start + i) % count;
+					if (victim != worker->index) {
+						job = workers[victim]->deque.steal();
+					}
 				}
 			}
+			if (!job) {
+				return false;
+			}
+			queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+			execute(job);
+			return true;
 		}
 
-	public:
-		Thread()
+		void workerLoop(Worker* worker)
 		{
-			worker = std::thread(&Thread::queueLoop, this);
+			localWorker() = worker;
+			uint32_t idleCount = 0;
+			while (!stopping.load(std::memory_order_relaxed)) {
+				if (runPendingJob(worker)) {
+					idleCount = 0;
+					continue;
+				}
+				// Spin for a short while before going to sleep, as new jobs are usually added in bursts
+				if (++idleCount < 64) {
+					std::this_thread::yield();
+					continue;
+				}
+				std::unique_lock<std::mutex> lock(sleepMutex);
+				sleepingWorkers.fetch_add(1, std::memory_order_seq_cst);
+				sleepCondition.wait(lock, [this] { return queuedJobs.load(std::memory_order_seq_cst) > 0 || stopping.load(); });
+				sleepingWorkers.fetch_sub(1, std::memory_order_relaxed);
+				idleCount = 0;
+			}
+			localWorker() = nullptr;
 		}
 
-		~Thread()
+		void shutdown()
 		{
-			if (worker.joinable())
+			stopping = true;
 			{
-				wait();
-				queueMutex.lock();
-				destroying = true;
-				condition.notify_one();
-				queueMutex.unlock();
-				worker.join();
+				std::lock_guard<std::mutex> lock(sleepMutex);
+				sleepCondition.notify_all();
+			}
+			for (auto& worker : workers) {
+				if (worker->thread.joinable()) {
+					worker->thread.join();
+				}
+			}
+			if (currentWorker()) {
+				localWorker() = previousWorker;
+				previousWorker = nullptr;
 			}
+			workers.clear();
+			stopping = false;
 		}
 
-		// Add a new job to the thread's queue
-		void addJob(std::function<void()> function)
+	public:
+		~JobSystem()
 		{
-			std::lock_guard<std::mutex> lock(queueMutex);
-			jobQueue.push(std::move(function));
-			condition.notify_one();
+			shutdown();
 		}
 
-		// Wait until all work items have been finished
-		void wait()
+		// Sets the number of workers, the calling thread is worker 0 and count - 1 additional threads are started
+		void setThreadCount(uint32_t count)
 		{
-			std::unique_lock<std::mutex> lock(queueMutex);
-			condition.wait(lock, [this]() { return jobQueue.empty(); });
+			shutdown();
+			count = std::max(count, 1u);
+			for (uint32_t i = 0; i < count; i++) {
+				std::unique_ptr<Worker> worker(new Worker());
+				worker->system = this;
+				worker->index = i;
+				worker->randomState = 0x9E3779B9u * (i + 1);
+				worker->jobPool.reset(new Job[jobPoolSize]);
+				workers.push_back(std::move(worker));
+			}
+			previousWorker = localWorker();
+			localWorker() = workers[0].get();
+			for (uint32_t i = 1; i < count; i++) {
+				workers[i]->thread = std::thread(&JobSystem::workerLoop, this, workers[i].get());
+			}
 		}
-	};
-	
-	class ThreadPool
-	{
-	public:
-		std::vector<std::unique_ptr<Thread>> threads;
 
-		// Sets the number of threads to be allocated in this pool
-		void setThreadCount(uint32_t count)
+		uint32_t getThreadCount() const
 		{
-			threads.clear();
-			for (auto i = 0; i < count; i++)
-			{
-				threads.push_back(make_unique<Thread>());
+			return static_cast<uint32_t>(workers.size());
+		}
+
+		// Index of the worker running the calling thread (0 for the owning thread), can be used to access per-thread data from within jobs
+		uint32_t getThreadIndex()
+		{
+			Worker* worker = currentWorker();
+			assert(worker);
+			return worker->index;
+		}
+
+		// Adds a job, counter (if set) is incremented and decremented once the job has finished
+		// If a dependency is passed, the job is only queued once that counter has reached zero
+		template<typename F>
+		void addJob(F&& function, JobCounter* counter = nullptr, JobCounter* dependency = nullptr)
+		{
+			if (counter) {
+				counter->value.fetch_add(1, std::memory_order_relaxed);
+			}
+			Job* job = allocateJob(std::forward<F>(function), counter);
+			if (dependency) {
+				std::lock_guard<std::mutex> lock(dependency->mutex);
+				// Flag the counter while it hasn't reached zero, so the job that finishes last picks up the continuation
+				uint32_t value = dependency->value.load(std::memory_order_acquire);
+				while ((value & ~JobCounter::continuationsFlag) != 0) {
+					if (dependency->value.compare_exchange_weak(value, value | JobCounter::continuationsFlag, std::memory_order_acq_rel, std::memory_order_acquire)) {
+						dependency->continuations.push_back(job);
+						return;
+					}
+				}
 			}
+			submit(job);
 		}
 
-		// Wait until all threads have finished their work items
-		void wait()
+		// Executes pending jobs on the calling thread until the counter reaches zero
+		void wait(JobCounter& counter)
 		{
-			for (auto &thread : threads)
-			{
-				thread->wait();
+			Worker* worker = currentWorker();
+			assert(worker);
+			while (!counter.done()) {
+				if (!runPendingJob(worker)) {
+					std::this_thread::yield();
+				}
+			}
+			// Wait for the thread that finished the last job to release the counter (only locked if there were continuations)
+			std::lock_guard<std::mutex> lock(counter.mutex);
+		}
+
+		/*
+			Calls function(index) for every index in [0, count) and returns once all calls have finished
+			The range is split recursively into halves until it's below the grain size, so idle workers can steal large parts of the range
+			If no grain size is passed, the range is split into roughly four chunks per worker
+		*/
+		template<typename F>
+		void parallelFor(uint32_t count, const F& function, uint32_t grainSize = 0)
+		{
+			if (count == 0) {
+				return;
+			}
+			if (grainSize == 0) {
+				grainSize = std::max(count / (getThreadCount() * 4), 1u);
 			}
+			JobCounter counter;
+			addRangeJob(&function, 0, count, grainSize, &counter);
+			wait(counter);
+		}
+
+	private:
+		template<typename F>
+		void addRangeJob(const F* function, uint32_t begin, uint32_t end, uint32_t grainSize, JobCounter* counter)
+		{
+			addJob([this, function, begin, end, grainSize, counter]() {
+				uint32_t rangeEnd = end;
+				// Keep the lower half and hand the upper half to other workers until the range is small enough
+				while (rangeEnd - begin > grainSize) {
+					const uint32_t split = begin + (rangeEnd - begin) / 2;
+					addRangeJob(function, split, rangeEnd, grainSize, counter);
+					rangeEnd = split;
+				}
+				for (uint32_t i = begin; i < rangeEnd; i++) {
+					(*function)(i);
+				}
+			}, counter);
 		}
 	};
 
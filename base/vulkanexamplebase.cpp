@@ -77,6 +77,13 @@ VkResult VulkanExampleBase::createInstance(bool enableValidation)
 	}
 #endif
 
+	// VK_KHR_timeline_semaphore, which the device enables whenever it's supported (see VulkanDevice::createLogicalDevice), depends on VK_KHR_get_physical_device_properties2
+	if ((std::find(supportedInstanceExtensions.begin(), supportedInstanceExtensions.end(), VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) != supportedInstanceExtensions.end()) &&
+		(std::find(enabledInstanceExtensions.begin(), enabledInstanceExtensions.end(), VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) == enabledInstanceExtensions.end()))
+	{
+		enabledInstanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+	}
+
 	// Enabled requested instance extensions
 	if (enabledInstanceExtensions.size() > 0) 
 	{
@@ -152,10 +159,12 @@ VkResult VulkanExampleBase::createInstance(bool enableValidation)
 
 void VulkanExampleBase::renderFrame()
 {
-	VulkanExampleBase::prepareFrame();
+	if (!VulkanExampleBase::prepareFrame()) {
+		return;
+	}
 	submitInfo.commandBufferCount = 1;
 	submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
-	VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+	VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, multipleFramesInFlight ? frames[currentFrame].fence : VK_NULL_HANDLE));
 	VulkanExampleBase::submitFrame();
 }
 
@@ -189,16 +198,117 @@ void VulkanExampleBase::destroyCommandBuffers()
 	vkFreeCommandBuffers(device, cmdPool, static_cast<uint32_t>(drawCmdBuffers.size()), drawCmdBuffers.data());
 }
 
+void VulkanExampleBase::createFrameResources()
+{
+	// One fence, image acquisition semaphore and primary command buffer per frame in flight
+	frames.resize(maxFramesInFlight);
+	VkFenceCreateInfo fenceCreateInfo = vks::initializers::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
+	VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
+	VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(cmdPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+	for (auto& frame : frames) {
+		VK_CHECK_RESULT(vkCreateFence(device, &fenceCreateInfo, nullptr, &frame.fence));
+		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &frame.presentComplete));
+		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &frame.commandBuffer));
+	}
+	createRenderCompleteSemaphores();
+	currentFrame = 0;
+}
+
+void VulkanExampleBase::destroyFrameResources()
+{
+	for (auto& frame : frames) {
+		vkDestroyFence(device, frame.fence, nullptr);
+		vkDestroySemaphore(device, frame.presentComplete, nullptr);
+		vkFreeCommandBuffers(device, cmdPool, 1, &frame.commandBuffer);
+	}
+	frames.clear();
+	destroyRenderCompleteSemaphores();
+}
+
+void VulkanExampleBase::createRenderCompleteSemaphores()
+{
+	// A render complete semaphore may only be reused once the presentation of its swap chain image has finished, so these are per image and not per frame
+	VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
+	renderCompleteSemaphores.resize(swapChain.imageCount);
+	for (auto& semaphore : renderCompleteSemaphores) {
+		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &semaphore));
+	}
+}
+
+void VulkanExampleBase::destroyRenderCompleteSemaphores()
+{
+	for (auto& semaphore : renderCompleteSemaphores) {
+		vkDestroySemaphore(device, semaphore, nullptr);
+	}
+	renderCompleteSemaphores.clear();
+}
+
 std::string VulkanExampleBase::getShadersPath() const
 {
 	return getShaderBasePath() + shaderDir + "/";
 }
 
+std::string VulkanExampleBase::getPipelineCacheFileName()
+{
+	if (!settings.pipelineCacheFile.empty()) {
+		return settings.pipelineCacheFile;
+	}
+	// Each sample gets its own cache file named after the executable
+	std::string fileName = name;
+	if (!args.empty() && (args[0] != nullptr)) {
+		fileName = args[0];
+		const size_t slash = fileName.find_last_of("/\\");
+		if (slash != std::string::npos) {
+			fileName = fileName.substr(slash + 1);
+		}
+		const size_t dot = fileName.find_last_of('.');
+		if ((dot != std::string::npos) && (dot > 0)) {
+			fileName = fileName.substr(0, dot);
+		}
+	}
+	fileName += "_pipelinecache.bin";
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+	// The working directory isn't writable on Android, so use the app's internal storage instead
+	fileName = std::string(androidApp->activity->internalDataPath) + "/" + fileName;
+#endif
+	return fileName;
+}
+
 void VulkanExampleBase::createPipelineCache()
 {
 	VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
 	pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-	VK_CHECK_RESULT(vkCreatePipelineCache(device, &pipelineCacheCreateInfo, nullptr, &pipelineCache));
+	// Seed the cache with data from a previous run, falls back to an empty cache if there is no (valid) data for this device and driver
+	std::vector<char> cacheData;
+	if (settings.pipelineCache) {
+		const std::string fileName = getPipelineCacheFileName();
+		cacheData = vks::tools::loadPipelineCacheData(fileName, deviceProperties);
+		if (!cacheData.empty()) {
+			std::cout << "Loaded pipeline cache from \"" << fileName << "\" (" << cacheData.size() << " bytes)\n";
+			pipelineCacheCreateInfo.initialDataSize = cacheData.size();
+			pipelineCacheCreateInfo.pInitialData = cacheData.data();
+		}
+	}
+	VkResult result = vkCreatePipelineCache(device, &pipelineCacheCreateInfo, nullptr, &pipelineCache);
+	if ((result != VK_SUCCESS) && !cacheData.empty()) {
+		// Implementations may still refuse the data, in that case start with an empty cache
+		std::cout << "Pipeline cache data was rejected by the implementation, starting with an empty cache\n";
+		pipelineCacheCreateInfo.initialDataSize = 0;
+		pipelineCacheCreateInfo.pInitialData = nullptr;
+		result = vkCreatePipelineCache(device, &pipelineCacheCreateInfo, nullptr, &pipelineCache);
+	}
+	VK_CHECK_RESULT(result);
+}
+
+void VulkanExampleBase::savePipelineCache()
+{
+	if (!settings.pipelineCache || (pipelineCache == VK_NULL_HANDLE)) {
+		return;
+	}
+	const std::string fileName = getPipelineCacheFileName();
+	if (!vks::tools::savePipelineCacheData(fileName, device, pipelineCache, deviceProperties)) {
+		std::cerr << "Could not write pipeline cache to \"" << fileName << "\"\n";
+	}
 }
 
 void VulkanExampleBase::prepare()
@@ -208,14 +318,24 @@ void VulkanExampleBase::prepare()
 	setupSwapChain();
 	createCommandBuffers();
 	createSynchronizationPrimitives();
+	if (multipleFramesInFlight) {
+		createFrameResources();
+	}
 	setupDepthStencil();
 	setupRenderPass();
 	createPipelineCache();
 	setupFrameBuffer();
 	settings.overlay = settings.overlay && (!benchmark.active);
+	const uint32_t timestampValidBits = vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.graphics].timestampValidBits;
+	if (benchmark.active && benchmark.gpuTime) {
+		benchmark.prepareGpuTimer(device, cmdPool, timestampValidBits, vulkanDevice->properties);
+	}
+	// One profiler slot per frame in flight or per pre-recorded command buffer
+	gpuProfiler.create(device, vulkanDevice->properties, timestampValidBits, multipleFramesInFlight ? maxFramesInFlight : static_cast<uint32_t>(drawCmdBuffers.size()));
 	if (settings.overlay) {
 		UIOverlay.device = vulkanDevice;
 		UIOverlay.queue = queue;
+		UIOverlay.buffers.resize(multipleFramesInFlight ? maxFramesInFlight : 1);
 		UIOverlay.shaders = {
 			loadShader(getShadersPath() + "base/uioverlay.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
 			loadShader(getShadersPath() + "base/uioverlay.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT),
@@ -703,6 +823,14 @@ void VulkanExampleBase::updateOverlay()
 #endif
 	ImGui::PushItemWidth(110.0f * UIOverlay.scale);
 	OnUpdateUIOverlay(&UIOverlay);
+	// Per-pass breakdown of the GPU time for samples that record profiler scopes
+	if (!gpuProfiler.getScopes().empty()) {
+		if (UIOverlay.header("GPU timings")) {
+			for (auto& scope : gpuProfiler.getScopes()) {
+				UIOverlay.text("%s: %.3f ms", scope.name.c_str(), scope.averageTime);
+			}
+		}
+	}
 	ImGui::PopItemWidth();
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
 	ImGui::PopStyleVar();
@@ -712,7 +840,13 @@ void VulkanExampleBase::updateOverlay()
 	ImGui::PopStyleVar();
 	ImGui::Render();
 
-	if (UIOverlay.update() || UIOverlay.updated) {
+	// With multiple frames in flight, the overlay's buffers for a frame are updated in prepareFrame once that frame's fence has been signaled
+	if (multipleFramesInFlight) {
+		if (UIOverlay.updated) {
+			buildCommandBuffers();
+			UIOverlay.updated = false;
+		}
+	} else if (UIOverlay.update() || UIOverlay.updated) {
 		buildCommandBuffers();
 		UIOverlay.updated = false;
 	}
@@ -732,30 +866,61 @@ void VulkanExampleBase::drawUI(const VkCommandBuffer commandBuffer)
 		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-		UIOverlay.draw(commandBuffer);
+		UIOverlay.draw(commandBuffer, multipleFramesInFlight ? currentFrame : 0);
 	}
 }
 
-void VulkanExampleBase::prepareFrame()
+bool VulkanExampleBase::prepareFrame()
 {
+	VkSemaphore presentCompleteSemaphore = semaphores.presentComplete;
+	if (multipleFramesInFlight) {
+		// Wait until the GPU has finished the last submission that used this frame's resources
+		VK_CHECK_RESULT(vkWaitForFences(device, 1, &frames[currentFrame].fence, VK_TRUE, UINT64_MAX));
+		presentCompleteSemaphore = frames[currentFrame].presentComplete;
+	}
 	// Acquire the next image from the swap chain
-	VkResult result = swapChain.acquireNextImage(semaphores.presentComplete, &currentBuffer);
+	VkResult result = swapChain.acquireNextImage(presentCompleteSemaphore, &currentBuffer);
 	// Recreate the swapchain if it's no longer compatible with the surface (OUT_OF_DATE)
 	// SRS - If no longer optimal (VK_SUBOPTIMAL_KHR), wait until submitFrame() in case number of swapchain images will change on resize
-	if ((result == VK_ERROR_OUT_OF_DATE_KHR) || (result == VK_SUBOPTIMAL_KHR)) {
-		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-			windowResize();
-		}
-		return;
+	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+		windowResize();
+		return false;
 	}
-	else {
+	else if (result != VK_SUBOPTIMAL_KHR) {
 		VK_CHECK_RESULT(result);
 	}
+	if (multipleFramesInFlight) {
+		// Only reset the fence once we know that work will be submitted for this frame
+		VK_CHECK_RESULT(vkResetFences(device, 1, &frames[currentFrame].fence));
+		submitInfo.pWaitSemaphores = &frames[currentFrame].presentComplete;
+		submitInfo.pSignalSemaphores = &renderCompleteSemaphores[currentBuffer];
+		if (settings.overlay) {
+			UIOverlay.update(currentFrame);
+		}
+	}
+	// The last submission that used this frame's profiler slot has finished, so its timestamps can be read without waiting
+	if (gpuProfiler.resolve(getProfilerSlot()) && benchmark.active) {
+		for (auto& scope : gpuProfiler.getScopes()) {
+			if (scope.updated) {
+				benchmark.addPassTime(scope.name, scope.time);
+			}
+		}
+	}
+	// Resources loaded since the last frame may still have their uploads queued
+	vulkanDevice->stagingUploader.flush();
+	benchmark.beginGpuFrame(queue, presentCompleteSemaphore);
+	return true;
 }
 
 void VulkanExampleBase::submitFrame()
 {
-	VkResult result = swapChain.queuePresent(queue, currentBuffer, semaphores.renderComplete);
+	benchmark.endGpuFrame(queue);
+	gpuProfiler.markSubmitted(getProfilerSlot());
+	VkSemaphore renderCompleteSemaphore = multipleFramesInFlight ? renderCompleteSemaphores[currentBuffer] : semaphores.renderComplete;
+	if (multipleFramesInFlight) {
+		currentFrame = (currentFrame + 1) % maxFramesInFlight;
+	}
+	VkResult result = swapChain.queuePresent(queue, currentBuffer, renderCompleteSemaphore);
 	// Recreate the swapchain if it's no longer compatible with the surface (OUT_OF_DATE) or no longer optimal for presentation (SUBOPTIMAL)
 	if ((result == VK_ERROR_OUT_OF_DATE_KHR) || (result == VK_SUBOPTIMAL_KHR)) {
 		windowResize();
@@ -766,7 +931,10 @@ void VulkanExampleBase::submitFrame()
 	else {
 		VK_CHECK_RESULT(result);
 	}
-	VK_CHECK_RESULT(vkQueueWaitIdle(queue));
+	// Frames in flight are throttled by their fences in prepareFrame instead
+	if (!multipleFramesInFlight) {
+		VK_CHECK_RESULT(vkQueueWaitIdle(queue));
+	}
 }
 
 VulkanExampleBase::VulkanExampleBase(bool enableValidation)
@@ -804,6 +972,11 @@ VulkanExampleBase::VulkanExampleBase(bool enableValidation)
 	commandLineParser.add("benchmarkresultfile", { "-bf", "--benchfilename" }, 1, "Set file name for benchmark results");
 	commandLineParser.add("benchmarkresultframes", { "-bt", "--benchframetimes" }, 0, "Save frame times to benchmark results file");
 	commandLineParser.add("benchmarkframes", { "-bfs", "--benchmarkframes" }, 1, "Only render the given number of frames");
+	commandLineParser.add("benchmarkruns", { "-brs", "--benchruns" }, 1, "Repeat the benchmark the given number of times (reports a confidence interval)");
+	commandLineParser.add("benchmarkgpu", { "-bg", "--benchgpu" }, 0, "Measure GPU frame times with timestamp queries in benchmark mode");
+	commandLineParser.add("framesinflight", { "-fif", "--framesinflight" }, 1, "Set the number of frames in flight (for samples that support it)");
+	commandLineParser.add("pipelinecache", { "-pc", "--pipelinecache" }, 0, "Load the pipeline cache from disk at startup and store it at shutdown");
+	commandLineParser.add("pipelinecachefile", { "-pcf", "--pipelinecachefile" }, 1, "Set file name for the persistent pipeline cache (implies --pipelinecache)");
 
 	commandLineParser.parse(args);
 	if (commandLineParser.isSet("help")) {
@@ -857,6 +1030,22 @@ VulkanExampleBase::VulkanExampleBase(bool enableValidation)
 	if (commandLineParser.isSet("benchmarkframes")) {
 		benchmark.outputFrames = commandLineParser.getValueAsInt("benchmarkframes", benchmark.outputFrames);
 	}
+	if (commandLineParser.isSet("benchmarkruns")) {
+		benchmark.runCount = commandLineParser.getValueAsInt("benchmarkruns", benchmark.runCount);
+	}
+	if (commandLineParser.isSet("benchmarkgpu")) {
+		benchmark.gpuTime = true;
+	}
+	if (commandLineParser.isSet("framesinflight")) {
+		maxFramesInFlight = std::max(commandLineParser.getValueAsInt("framesinflight", maxFramesInFlight), 1);
+	}
+	if (commandLineParser.isSet("pipelinecache")) {
+		settings.pipelineCache = true;
+	}
+	if (commandLineParser.isSet("pipelinecachefile")) {
+		settings.pipelineCache = true;
+		settings.pipelineCacheFile = commandLineParser.getValueAsString("pipelinecachefile", "");
+	}
 
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
 	// Vulkan library is loaded dynamically on Android
@@ -906,8 +1095,15 @@ VulkanExampleBase::~VulkanExampleBase()
 	vkDestroyImage(device, depthStencil.image, nullptr);
 	vkFreeMemory(device, depthStencil.mem, nullptr);
 
+	savePipelineCache();
 	vkDestroyPipelineCache(device, pipelineCache, nullptr);
 
+	if (multipleFramesInFlight) {
+		destroyFrameResources();
+	}
+
+	benchmark.destroyGpuTimer();
+	gpuProfiler.destroy();
 	vkDestroyCommandPool(device, cmdPool, nullptr);
 
 	vkDestroySemaphore(device, semaphores.presentComplete, nullptr);
@@ -2883,6 +3079,12 @@ void VulkanExampleBase::windowResize()
 	}
 	createSynchronizationPrimitives();
 
+	// Number of swap chain images may also have changed for the per-image render complete semaphores
+	if (multipleFramesInFlight) {
+		destroyRenderCompleteSemaphores();
+		createRenderCompleteSemaphores();
+	}
+
 	vkDeviceWaitIdle(device);
 
 	if ((width > 0.0f) && (height > 0.0f)) {
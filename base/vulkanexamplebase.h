@@ -68,6 +68,7 @@
 #include "VulkanBuffer.h"
 #include "VulkanDevice.h"
 #include "VulkanTexture.h"
+#include "VulkanProfiler.h"
 
 #include "VulkanInitializers.hpp"
 #include "camera.hpp"
@@ -85,12 +86,18 @@ private:
 	void nextFrame();
 	void updateOverlay();
 	void createPipelineCache();
+	void savePipelineCache();
+	std::string getPipelineCacheFileName();
 	void createCommandPool();
 	void createSynchronizationPrimitives();
 	void initSwapchain();
 	void setupSwapChain();
 	void createCommandBuffers();
 	void destroyCommandBuffers();
+	void createFrameResources();
+	void destroyFrameResources();
+	void createRenderCompleteSemaphores();
+	void destroyRenderCompleteSemaphores();
 	std::string shaderDir = "glsl";
 protected:
 	// Returns the path to the root of the glsl or hlsl shader directory.
@@ -143,7 +150,7 @@ protected:
 	// List of shader modules created (stored for cleanup)
 	std::vector<VkShaderModule> shaderModules;
 	// Pipeline cache object
-	VkPipelineCache pipelineCache;
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;
 	// Wraps the swap chain to present images (framebuffers) to the windowing system
 	VulkanSwapChain swapChain;
 	// Synchronization semaphores
@@ -154,6 +161,24 @@ protected:
 		VkSemaphore renderComplete;
 	} semaphores;
 	std::vector<VkFence> waitFences;
+	/** @brief Set by samples that keep per-frame resources, so prepareFrame/submitFrame let multiple frames be processed concurrently instead of waiting for the queue to become idle after each frame */
+	bool multipleFramesInFlight = false;
+	/** @brief Number of frames that can be in flight at the same time if multipleFramesInFlight is enabled (can be changed via command line) */
+	uint32_t maxFramesInFlight = 2;
+	/** @brief Index of the frame in flight that is currently recorded (0..maxFramesInFlight-1) */
+	uint32_t currentFrame = 0;
+	// Synchronization primitives and command buffer for a single frame in flight
+	struct FrameResources {
+		// Signaled once the GPU has finished the work submitted for this frame
+		VkFence fence;
+		// Swap chain image acquisition
+		VkSemaphore presentComplete;
+		// Primary command buffer to be (re)recorded by samples for this frame
+		VkCommandBuffer commandBuffer;
+	};
+	std::vector<FrameResources> frames;
+	// Render complete semaphores are indexed by swap chain image, as they are consumed by the presentation engine
+	std::vector<VkSemaphore> renderCompleteSemaphores;
 	bool requiresStencil{ false };
 public:
 	bool prepared = false;
@@ -170,6 +195,11 @@ public:
 
 	vks::Benchmark benchmark;
 
+	/** @brief Measures the GPU time of named command buffer regions, samples record scopes into their command buffers (see getProfilerSlot) */
+	vks::GpuProfiler gpuProfiler;
+	/** @brief Returns the profiler slot of the command buffer that is submitted for the current frame */
+	uint32_t getProfilerSlot() const { return multipleFramesInFlight ? currentFrame : currentBuffer; }
+
 	/** @brief Encapsulated physical and logical vulkan device */
 	vks::VulkanDevice *vulkanDevice;
 
@@ -183,6 +213,10 @@ public:
 		bool vsync = false;
 		/** @brief Enable UI overlay */
 		bool overlay = true;
+		/** @brief Load the pipeline cache from disk at startup and store it at shutdown */
+		bool pipelineCache = false;
+		/** @brief File used for the persistent pipeline cache, derived from the executable name if empty */
+		std::string pipelineCacheFile;
 	} settings;
 
 	VkClearColorValue defaultClearColor = { { 0.025f, 0.025f, 0.025f, 1.0f } };
@@ -383,8 +417,8 @@ public:
 	/** @brief Adds the drawing commands for the ImGui overlay to the given command buffer */
 	void drawUI(const VkCommandBuffer commandBuffer);
 
-	/** Prepare the next frame for workload submission by acquiring the next swap chain image */
-	void prepareFrame();
+	/** Prepare the next frame for workload submission by acquiring the next swap chain image, returns false if the frame has to be skipped (e.g. due to a swap chain recreation) */
+	bool prepareFrame();
 	/** @brief Presents the current image to the swap chain */
 	void submitFrame();
 	/** @brief (Virtual) Default image acquire + submission and command buffer submission function */
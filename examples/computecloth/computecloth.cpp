@@ -8,6 +8,7 @@
 
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "VulkanAsyncCompute.h"
 
 #define ENABLE_VALIDATION false
 
@@ -15,10 +16,13 @@ class VulkanExample : public VulkanExampleBase
 {
 public:
 	uint32_t sceneSetup = 0;
-	uint32_t readSet = 0;
 	uint32_t indexCount;
 	bool simulateWind = false;
-	bool specializedComputeQueue = false;
+	// Let compute steps execute while the previous step's cloth is still being rendered (requires timeline semaphores)
+	bool overlapCompute = true;
+
+	// Schedules the simulation steps on the (dedicated) compute queue and synchronizes them with the frames rendering their results
+	vks::AsyncCompute asyncCompute;
 
 	vks::Texture2D textureCloth;
 	vkglTF::Model modelSphere;
@@ -26,14 +30,15 @@ public:
 	// Resources for the graphics part of the example
 	struct {
 		VkDescriptorSetLayout descriptorSetLayout;
-		VkDescriptorSet descriptorSet;
+		// One per frame in flight
+		std::vector<VkDescriptorSet> descriptorSets;
 		VkPipelineLayout pipelineLayout;
 		struct Pipelines {
 			VkPipeline cloth;
 			VkPipeline sphere;
 		} pipelines;
 		vks::Buffer indices;
-		vks::Buffer uniformBuffer;
+		std::vector<vks::Buffer> uniformBuffers;
 		struct graphicsUBO {
 			glm::mat4 projection;
 			glm::mat4 view;
@@ -44,19 +49,16 @@ public:
 	// Resources for the compute part of the example
 	struct {
 		struct StorageBuffers {
-			vks::Buffer input;
-			vks::Buffer output;
+			// Final results of the steps, alternately written by the steps and rendered as vertex buffers
+			vks::Buffer display[vks::AsyncCompute::slotCount];
+			// Intermediate results of a step's iterations, only accessed by the compute queue
+			vks::Buffer scratch[2];
 		} storageBuffers;
-		struct Semaphores {
-			VkSemaphore ready{ 0L };
-			VkSemaphore complete{ 0L };
-		} semaphores;
-		vks::Buffer uniformBuffer;
-		VkQueue queue;
-		VkCommandPool commandPool;
-		std::array<VkCommandBuffer,2> commandBuffers;
+		// One per step in flight
+		vks::Buffer uniformBuffers[vks::AsyncCompute::slotCount];
 		VkDescriptorSetLayout descriptorSetLayout;
-		std::array<VkDescriptorSet,2> descriptorSets;
+		// Per slot: previous display -> scratch 0, scratch 0 -> scratch 1, scratch 1 -> scratch 0, scratch 0 -> display of the slot
+		std::array<std::array<VkDescriptorSet, 4>, vks::AsyncCompute::slotCount> descriptorSets;
 		VkPipelineLayout pipelineLayout;
 		VkPipeline pipeline;
 		struct computeUBO {
@@ -96,13 +98,23 @@ public:
 		camera.setPerspective(60.0f, (float)width / (float)height, 0.1f, 512.0f);
 		camera.setRotation(glm::vec3(-30.0f, -45.0f, 0.0f));
 		camera.setTranslation(glm::vec3(0.0f, 0.0f, -5.0f));
+		// Per frame command buffers bind the cloth vertices written by the frame's compute step
+		multipleFramesInFlight = true;
+		// Compare async compute against compute steps that wait for the previous frame (e.g. in benchmark mode)
+		commandLineParser.add("serializecompute", { "--serializecompute" }, 0, "Don't overlap compute steps with rendering");
+		commandLineParser.parse(args);
+		if (commandLineParser.isSet("serializecompute")) {
+			overlapCompute = false;
+		}
 	}
 
 	~VulkanExample()
 	{
 		// Graphics
 		graphics.indices.destroy();
-		graphics.uniformBuffer.destroy();
+		for (auto& uniformBuffer : graphics.uniformBuffers) {
+			uniformBuffer.destroy();
+		}
 		vkDestroyPipeline(device, graphics.pipelines.cloth, nullptr);
 		vkDestroyPipeline(device, graphics.pipelines.sphere, nullptr);
 		vkDestroyPipelineLayout(device, graphics.pipelineLayout, nullptr);
@@ -110,15 +122,17 @@ public:
 		textureCloth.destroy();
 
 		// Compute
-		compute.storageBuffers.input.destroy();
-		compute.storageBuffers.output.destroy();
-		compute.uniformBuffer.destroy();
+		asyncCompute.destroy();
+		for (uint32_t i = 0; i < vks::AsyncCompute::slotCount; i++) {
+			compute.storageBuffers.display[i].destroy();
+			compute.uniformBuffers[i].destroy();
+		}
+		for (auto& buffer : compute.storageBuffers.scratch) {
+			buffer.destroy();
+		}
 		vkDestroyPipelineLayout(device, compute.pipelineLayout, nullptr);
 		vkDestroyDescriptorSetLayout(device, compute.descriptorSetLayout, nullptr);
 		vkDestroyPipeline(device, compute.pipeline, nullptr);
-		vkDestroySemaphore(device, compute.semaphores.ready, nullptr);
-		vkDestroySemaphore(device, compute.semaphores.complete, nullptr);
-		vkDestroyCommandPool(device, compute.commandPool, nullptr);
 	}
 
 	// Enable physical device features required for this example
@@ -136,80 +150,8 @@ public:
 		textureCloth.loadFromFile(getAssetPath() + "textures/vulkan_cloth_rgba.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
 	}
 
-	void addGraphicsToComputeBarriers(VkCommandBuffer commandBuffer, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask, VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask)
-	{
-		if (specializedComputeQueue) {
-			VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
-			bufferBarrier.srcAccessMask = srcAccessMask;
-			bufferBarrier.dstAccessMask = dstAccessMask;
-			bufferBarrier.srcQueueFamilyIndex = vulkanDevice->queueFamilyIndices.graphics;
-			bufferBarrier.dstQueueFamilyIndex = vulkanDevice->queueFamilyIndices.compute;
-			bufferBarrier.size = VK_WHOLE_SIZE;
-
-			std::vector<VkBufferMemoryBarrier> bufferBarriers;
-			bufferBarrier.buffer = compute.storageBuffers.input.buffer;
-			bufferBarriers.push_back(bufferBarrier);
-			bufferBarrier.buffer = compute.storageBuffers.output.buffer;
-			bufferBarriers.push_back(bufferBarrier);
-			vkCmdPipelineBarrier(commandBuffer,
-				srcStageMask,
-				dstStageMask,
-				VK_FLAGS_NONE,
-				0, nullptr,
-				static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
-				0, nullptr);
-		}
-	}
-
-	void addComputeToComputeBarriers(VkCommandBuffer commandBuffer)
-	{
-		VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
-		bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-		bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-		bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		bufferBarrier.size = VK_WHOLE_SIZE;
-		std::vector<VkBufferMemoryBarrier> bufferBarriers;
-		bufferBarrier.buffer = compute.storageBuffers.input.buffer;
-		bufferBarriers.push_back(bufferBarrier);
-		bufferBarrier.buffer = compute.storageBuffers.output.buffer;
-		bufferBarriers.push_back(bufferBarrier);
-		vkCmdPipelineBarrier(
-			commandBuffer,
-			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-			VK_FLAGS_NONE,
-			0, nullptr,
-			static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
-			0, nullptr);
-	}
-
-	void addComputeToGraphicsBarriers(VkCommandBuffer commandBuffer, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask, VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask)
-	{
-		if (specializedComputeQueue) {
-			VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
-			bufferBarrier.srcAccessMask = srcAccessMask;
-			bufferBarrier.dstAccessMask = dstAccessMask;
-			bufferBarrier.srcQueueFamilyIndex = vulkanDevice->queueFamilyIndices.compute;
-			bufferBarrier.dstQueueFamilyIndex = vulkanDevice->queueFamilyIndices.graphics;
-			bufferBarrier.size = VK_WHOLE_SIZE;
-			std::vector<VkBufferMemoryBarrier> bufferBarriers;
-			bufferBarrier.buffer = compute.storageBuffers.input.buffer;
-			bufferBarriers.push_back(bufferBarrier);
-			bufferBarrier.buffer = compute.storageBuffers.output.buffer;
-			bufferBarriers.push_back(bufferBarrier);
-			vkCmdPipelineBarrier(
-				commandBuffer,
-				srcStageMask,
-				dstStageMask,
-				VK_FLAGS_NONE,
-				0, nullptr,
-				static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
-				0, nullptr);
-		}
-	}
-
-	void buildCommandBuffers()
+	// Record the rendering of the cloth written by the compute step in the given slot
+	void recordCommandBuffer(uint32_t slot)
 	{
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
@@ -225,96 +167,78 @@ public:
 		renderPassBeginInfo.renderArea.extent.height = height;
 		renderPassBeginInfo.clearValueCount = 2;
 		renderPassBeginInfo.pClearValues = clearValues;
+		renderPassBeginInfo.framebuffer = frameBuffers[currentBuffer];
 
-		for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
-		{
-			// Set target frame buffer
-			renderPassBeginInfo.framebuffer = frameBuffers[i];
-
-			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
-
-			// Acquire storage buffers from compute queue
-			addComputeToGraphicsBarriers(drawCmdBuffers[i], 0, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
-
-			// Draw the particle system using the update vertex buffer
+		const VkCommandBuffer commandBuffer = frames[currentFrame].commandBuffer;
 
-			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufInfo));
 
-			VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
-			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
+		// The display buffers are shared concurrently by the graphics and compute queue families, so no ownership transfer is required
+		// The semaphore wait for the compute step makes its writes visible to the vertex input stage
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-			VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
-			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+		VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
-			VkDeviceSize offsets[1] = { 0 };
+		VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-			// Render sphere
-			if (sceneSetup == 0) {
-				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelines.sphere);
-				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelineLayout, 0, 1, &graphics.descriptorSet, 0, NULL);
-				modelSphere.draw(drawCmdBuffers[i]);
-			}
-
-			// Render cloth
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelines.cloth);
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelineLayout, 0, 1, &graphics.descriptorSet, 0, NULL);
-			vkCmdBindIndexBuffer(drawCmdBuffers[i], graphics.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], 0, 1, &compute.storageBuffers.output.buffer, offsets);
-			vkCmdDrawIndexed(drawCmdBuffers[i], indexCount, 1, 0, 0, 0);
+		VkDeviceSize offsets[1] = { 0 };
 
-			drawUI(drawCmdBuffers[i]);
+		// Render sphere
+		if (sceneSetup == 0) {
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelines.sphere);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelineLayout, 0, 1, &graphics.descriptorSets[currentFrame], 0, NULL);
+			modelSphere.draw(commandBuffer);
+		}
 
-			vkCmdEndRenderPass(drawCmdBuffers[i]);
+		// Render cloth
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelines.cloth);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelineLayout, 0, 1, &graphics.descriptorSets[currentFrame], 0, NULL);
+		vkCmdBindIndexBuffer(commandBuffer, graphics.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &compute.storageBuffers.display[slot].buffer, offsets);
+		vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, 0);
 
-			// release the storage buffers to the compute queue
-			addGraphicsToComputeBarriers(drawCmdBuffers[i], VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, 0, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+		drawUI(commandBuffer);
 
-			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
-		}
+		vkCmdEndRenderPass(commandBuffer);
 
+		VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
 	}
 
-	// todo: check barriers (validation, separate compute queue)
-	void buildComputeCommandBuffer()
+	// Record a simulation step reading the cloth of the previous step and writing it to the given slot
+	void recordComputeCommandBuffer(VkCommandBuffer commandBuffer, uint32_t slot)
 	{
-		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
-		cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-
-		for (uint32_t i = 0; i < 2; i++) {
-
-			VK_CHECK_RESULT(vkBeginCommandBuffer(compute.commandBuffers[i], &cmdBufInfo));
-
-			// Acquire the storage buffers from the graphics queue
-			addGraphicsToComputeBarriers(compute.commandBuffers[i], 0, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-
-			vkCmdBindPipeline(compute.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipeline);
-
-			uint32_t calculateNormals = 0;
-			vkCmdPushConstants(compute.commandBuffers[i], compute.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &calculateNormals);
-
-			// Dispatch the compute job
-			const uint32_t iterations = 64;
-			for (uint32_t j = 0; j < iterations; j++) {
-				readSet = 1 - readSet;
-				vkCmdBindDescriptorSets(compute.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSets[readSet], 0, 0);
-
-				if (j == iterations - 1) {
-					calculateNormals = 1;
-					vkCmdPushConstants(compute.commandBuffers[i], compute.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &calculateNormals);
-				}
-
-				vkCmdDispatch(compute.commandBuffers[i], cloth.gridsize.x / 10, cloth.gridsize.y / 10, 1);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipeline);
+
+		uint32_t calculateNormals = 0;
+		vkCmdPushConstants(commandBuffer, compute.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &calculateNormals);
+
+		// Dispatch the compute job
+		// The first iteration reads the previous step's display buffer, the iterations in between ping-pong between the scratch buffers
+		// and the last one (which also calculates the normals) writes the display buffer of the slot
+		const uint32_t iterations = 64;
+		for (uint32_t j = 0; j < iterations; j++) {
+			uint32_t set = (j % 2 == 1) ? 1 : 2;
+			if (j == 0) {
+				set = 0;
+			}
+			if (j == iterations - 1) {
+				set = 3;
+				calculateNormals = 1;
+				vkCmdPushConstants(commandBuffer, compute.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &calculateNormals);
+			}
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSets[slot][set], 0, 0);
 
-				// Don't add a barrier on the last iteration of the loop, since we'll have an explicit release to the graphics queue
-				if (j != iterations - 1) {
-					addComputeToComputeBarriers(compute.commandBuffers[i]);
-				}
+			vkCmdDispatch(commandBuffer, cloth.gridsize.x / 10, cloth.gridsize.y / 10, 1);
 
+			// Don't add a barrier on the last iteration of the loop, the graphics queue waits for the step's semaphore
+			if (j != iterations - 1) {
+				VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+				memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+				memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_FLAGS_NONE, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
 			}
-
-			// release the storage buffers back to the graphics queue
-			addComputeToGraphicsBarriers(compute.commandBuffers[i], VK_ACCESS_SHADER_WRITE_BIT, 0, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
-			vkEndCommandBuffer(compute.commandBuffers[i]);
 		}
 	}
 
@@ -363,43 +287,14 @@ public:
 
 		VkDeviceSize storageBufferSize = particleBuffer.size() * sizeof(Particle);
 
-		// Staging
-		// SSBO won't be changed on the host after upload so copy to device local memory
+		// SSBOs won't be changed on the host after upload so they're created in device local memory
+		// The display buffers will be used as storage buffers for the compute pipeline and as vertex buffers in the graphics pipeline
+		asyncCompute.createDoubleBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, storageBufferSize, compute.storageBuffers.display, particleBuffer.data());
+		// The scratch buffers also need the initial data, as the shader doesn't write the uv coordinates and pinned state and keeps the positions of pinned particles
+		asyncCompute.createDoubleBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, storageBufferSize, compute.storageBuffers.scratch, particleBuffer.data());
 
 		vks::Buffer stagingBuffer;
 
-		vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&stagingBuffer,
-			storageBufferSize,
-			particleBuffer.data());
-
-		vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			&compute.storageBuffers.input,
-			storageBufferSize);
-
-		vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			&compute.storageBuffers.output,
-			storageBufferSize);
-
-		// Copy from staging buffer
-		VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-		VkBufferCopy copyRegion = {};
-		copyRegion.size = storageBufferSize;
-		vkCmdCopyBuffer(copyCmd, stagingBuffer.buffer, compute.storageBuffers.output.buffer, 1, &copyRegion);
-		// Add an initial release barrier to the graphics queue,
-		// so that when the compute command buffer executes for the first time
-		// it doesn't complain about a lack of a corresponding "release" to its "acquire"
-		addGraphicsToComputeBarriers(copyCmd, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, 0, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
-		vulkanDevice->flushCommandBuffer(copyCmd, queue, true);
-
-		stagingBuffer.destroy();
-
 		// Indices
 		std::vector<uint32_t> indices;
 		for (uint32_t y = 0; y <  cloth.gridsize.y - 1; y++) {
@@ -427,8 +322,8 @@ public:
 			indexBufferSize);
 
 		// Copy from staging buffer
-		copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-		copyRegion = {};
+		VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		VkBufferCopy copyRegion = {};
 		copyRegion.size = indexBufferSize;
 		vkCmdCopyBuffer(copyCmd, stagingBuffer.buffer, graphics.indices.buffer, 1, &copyRegion);
 		vulkanDevice->flushCommandBuffer(copyCmd, queue, true);
@@ -439,13 +334,13 @@ public:
 	void setupDescriptorPool()
 	{
 		std::vector<VkDescriptorPoolSize> poolSizes = {
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2)
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, maxFramesInFlight + 4 * vks::AsyncCompute::slotCount),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 8 * vks::AsyncCompute::slotCount),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, maxFramesInFlight)
 		};
 
 		VkDescriptorPoolCreateInfo descriptorPoolInfo =
-			vks::initializers::descriptorPoolCreateInfo(poolSizes, 3);
+			vks::initializers::descriptorPoolCreateInfo(poolSizes, maxFramesInFlight + 4 * vks::AsyncCompute::slotCount);
 
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
 	}
@@ -465,16 +360,19 @@ public:
 			vks::initializers::pipelineLayoutCreateInfo(&graphics.descriptorSetLayout, 1);
 		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &graphics.pipelineLayout));
 
-		// Set
-		VkDescriptorSetAllocateInfo allocInfo =
-			vks::initializers::descriptorSetAllocateInfo(descriptorPool, &graphics.descriptorSetLayout, 1);
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &graphics.descriptorSet));
-
-		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
-			vks::initializers::writeDescriptorSet(graphics.descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &graphics.uniformBuffer.descriptor),
-			vks::initializers::writeDescriptorSet(graphics.descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &textureCloth.descriptor)
-		};
-		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+		// Sets (one per frame in flight)
+		graphics.descriptorSets.resize(maxFramesInFlight);
+		for (uint32_t i = 0; i < maxFramesInFlight; i++) {
+			VkDescriptorSetAllocateInfo allocInfo =
+				vks::initializers::descriptorSetAllocateInfo(descriptorPool, &graphics.descriptorSetLayout, 1);
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &graphics.descriptorSets[i]));
+
+			std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+				vks::initializers::writeDescriptorSet(graphics.descriptorSets[i], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &graphics.uniformBuffers[i].descriptor),
+				vks::initializers::writeDescriptorSet(graphics.descriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &textureCloth.descriptor)
+			};
+			vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+		}
 	}
 
 	void preparePipelines()
@@ -562,9 +460,6 @@ public:
 
 	void prepareCompute()
 	{
-		// Create a compute capable device queue
-		vkGetDeviceQueue(device, vulkanDevice->queueFamilyIndices.compute, 0, &compute.queue);
-
 		// Create compute pipeline
 		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
@@ -591,59 +486,40 @@ public:
 		VkDescriptorSetAllocateInfo allocInfo =
 			vks::initializers::descriptorSetAllocateInfo(descriptorPool, &compute.descriptorSetLayout, 1);
 
-		// Create two descriptor sets with input and output buffers switched
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &compute.descriptorSets[0]));
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &compute.descriptorSets[1]));
-
-		std::vector<VkWriteDescriptorSet> computeWriteDescriptorSets = {
-			vks::initializers::writeDescriptorSet(compute.descriptorSets[0], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &compute.storageBuffers.input.descriptor),
-			vks::initializers::writeDescriptorSet(compute.descriptorSets[0], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &compute.storageBuffers.output.descriptor),
-			vks::initializers::writeDescriptorSet(compute.descriptorSets[0], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &compute.uniformBuffer.descriptor),
-
-			vks::initializers::writeDescriptorSet(compute.descriptorSets[1], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &compute.storageBuffers.output.descriptor),
-			vks::initializers::writeDescriptorSet(compute.descriptorSets[1], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &compute.storageBuffers.input.descriptor),
-			vks::initializers::writeDescriptorSet(compute.descriptorSets[1], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &compute.uniformBuffer.descriptor)
-		};
-
-		vkUpdateDescriptorSets(device, static_cast<uint32_t>(computeWriteDescriptorSets.size()), computeWriteDescriptorSets.data(), 0, NULL);
+		// Create the descriptor sets for the iterations of a step writing each slot, see recordComputeCommandBuffer
+		for (uint32_t i = 0; i < vks::AsyncCompute::slotCount; i++) {
+			const uint32_t previousSlot = (i + vks::AsyncCompute::slotCount - 1) % vks::AsyncCompute::slotCount;
+			vks::Buffer* inputs[4] = { &compute.storageBuffers.display[previousSlot], &compute.storageBuffers.scratch[0], &compute.storageBuffers.scratch[1], &compute.storageBuffers.scratch[0] };
+			vks::Buffer* outputs[4] = { &compute.storageBuffers.scratch[0], &compute.storageBuffers.scratch[1], &compute.storageBuffers.scratch[0], &compute.storageBuffers.display[i] };
+			for (uint32_t j = 0; j < 4; j++) {
+				VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &compute.descriptorSets[i][j]));
+				std::vector<VkWriteDescriptorSet> computeWriteDescriptorSets = {
+					vks::initializers::writeDescriptorSet(compute.descriptorSets[i][j], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &inputs[j]->descriptor),
+					vks::initializers::writeDescriptorSet(compute.descriptorSets[i][j], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &outputs[j]->descriptor),
+					vks::initializers::writeDescriptorSet(compute.descriptorSets[i][j], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &compute.uniformBuffers[i].descriptor)
+				};
+				vkUpdateDescriptorSets(device, static_cast<uint32_t>(computeWriteDescriptorSets.size()), computeWriteDescriptorSets.data(), 0, NULL);
+			}
+		}
 
 		// Create pipeline
 		VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(compute.pipelineLayout, 0);
 		computePipelineCreateInfo.stage = loadShader(getShadersPath() + "computecloth/cloth.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
 		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.pipeline));
-
-		// Separate command pool as queue family for compute may be different than graphics
-		VkCommandPoolCreateInfo cmdPoolInfo = {};
-		cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-		cmdPoolInfo.queueFamilyIndex = vulkanDevice->queueFamilyIndices.compute;
-		cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-		VK_CHECK_RESULT(vkCreateCommandPool(device, &cmdPoolInfo, nullptr, &compute.commandPool));
-
-		// Create a command buffer for compute operations
-		VkCommandBufferAllocateInfo cmdBufAllocateInfo =
-			vks::initializers::commandBufferAllocateInfo(compute.commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 2);
-
-		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &compute.commandBuffers[0]));
-
-		// Semaphores for graphics / compute synchronization
-		VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
-		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &compute.semaphores.ready));
-		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &compute.semaphores.complete));
-
-		// Build a single command buffer containing the compute dispatch commands
-		buildComputeCommandBuffer();
 	}
 
 	// Prepare and initialize uniform buffer containing shader uniforms
 	void prepareUniformBuffers()
 	{
-		// Compute shader uniform buffer block
-		vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&compute.uniformBuffer,
-			sizeof(compute.ubo));
-		VK_CHECK_RESULT(compute.uniformBuffer.map());
+		// Compute shader uniform buffer blocks, the block of a slot is updated once its last step has finished executing
+		for (auto& uniformBuffer : compute.uniformBuffers) {
+			vulkanDevice->createBuffer(
+				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&uniformBuffer,
+				sizeof(compute.ubo));
+			VK_CHECK_RESULT(uniformBuffer.map());
+		}
 
 		// Initial values
 		float dx = cloth.size.x / (cloth.gridsize.x - 1);
@@ -654,20 +530,19 @@ public:
 		compute.ubo.restDistD = sqrtf(dx * dx + dy * dy);
 		compute.ubo.particleCount = cloth.gridsize;
 
-		updateComputeUBO();
-
-		// Vertex shader uniform buffer block
-		vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&graphics.uniformBuffer,
-			sizeof(graphics.ubo));
-		VK_CHECK_RESULT(graphics.uniformBuffer.map());
-
-		updateGraphicsUBO();
+		// Vertex shader uniform buffer blocks (one per frame in flight)
+		graphics.uniformBuffers.resize(maxFramesInFlight);
+		for (auto& uniformBuffer : graphics.uniformBuffers) {
+			vulkanDevice->createBuffer(
+				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&uniformBuffer,
+				sizeof(graphics.ubo));
+			VK_CHECK_RESULT(uniformBuffer.map());
+		}
 	}
 
-	void updateComputeUBO()
+	void updateComputeUBO(uint32_t slot)
 	{
 		if (!paused) {
 			//compute.ubo.deltaT = 0.000005f;
@@ -689,57 +564,38 @@ public:
 		else {
 			compute.ubo.deltaT = 0.0f;
 		}
-		memcpy(compute.uniformBuffer.mapped, &compute.ubo, sizeof(compute.ubo));
+		memcpy(compute.uniformBuffers[slot].mapped, &compute.ubo, sizeof(compute.ubo));
 	}
 
 	void updateGraphicsUBO()
 	{
 		graphics.ubo.projection = camera.matrices.perspective;
 		graphics.ubo.view = camera.matrices.view;
-		memcpy(graphics.uniformBuffer.mapped, &graphics.ubo, sizeof(graphics.ubo));
+		memcpy(graphics.uniformBuffers[currentFrame].mapped, &graphics.ubo, sizeof(graphics.ubo));
 	}
 
 	void draw()
 	{
-		static bool firstDraw = true;
-		VkSubmitInfo computeSubmitInfo = vks::initializers::submitInfo();
-		// FIXME find a better way to do this (without using fences, which is much slower)
-		VkPipelineStageFlags computeWaitDstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
-		if (!firstDraw) {
-			computeSubmitInfo.waitSemaphoreCount = 1;
-			computeSubmitInfo.pWaitSemaphores = &compute.semaphores.ready;
-			computeSubmitInfo.pWaitDstStageMask = &computeWaitDstStageMask;
-		} else {
-			firstDraw = false;
+		// Waits until the GPU has finished with the resources of the current frame in flight
+		if (!VulkanExampleBase::prepareFrame()) {
+			return;
 		}
-		computeSubmitInfo.signalSemaphoreCount = 1;
-		computeSubmitInfo.pSignalSemaphores = &compute.semaphores.complete;
-		computeSubmitInfo.commandBufferCount = 1;
-		computeSubmitInfo.pCommandBuffers = &compute.commandBuffers[readSet];
-
-		VK_CHECK_RESULT( vkQueueSubmit( compute.queue, 1, &computeSubmitInfo, VK_NULL_HANDLE) );
-
-		// Submit graphics commands
-		VulkanExampleBase::prepareFrame();
+		updateGraphicsUBO();
 
-		VkPipelineStageFlags waitDstStageMask[2] = {
-			submitPipelineStages, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
-		};
-		VkSemaphore waitSemaphores[2] = {
-			semaphores.presentComplete, compute.semaphores.complete
-		};
-		VkSemaphore signalSemaphores[2] = {
-			semaphores.renderComplete, compute.semaphores.ready
-		};
+		// Submit the simulation step for this frame, it may execute while the previous frame still renders the other slot's cloth
+		asyncCompute.serialize = !overlapCompute;
+		VkCommandBuffer computeCommandBuffer = asyncCompute.beginStep();
+		const uint32_t slot = asyncCompute.getSlot();
+		updateComputeUBO(slot);
+		recordComputeCommandBuffer(computeCommandBuffer, slot);
+		asyncCompute.submit();
 
-		submitInfo.waitSemaphoreCount = 2;
-		submitInfo.pWaitDstStageMask = waitDstStageMask;
-		submitInfo.pWaitSemaphores = waitSemaphores;
-		submitInfo.signalSemaphoreCount = 2;
-		submitInfo.pSignalSemaphores = signalSemaphores;
+		// Submit graphics commands, these wait for the step at the vertex input stage
+		recordCommandBuffer(slot);
 		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+		submitInfo.pCommandBuffers = &frames[currentFrame].commandBuffer;
+		VkSubmitInfo graphicsSubmitInfo = asyncCompute.getGraphicsSubmitInfo(submitInfo);
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &graphicsSubmitInfo, frames[currentFrame].fence));
 
 		VulkanExampleBase::submitFrame();
 	}
@@ -751,8 +607,8 @@ public:
 #ifdef DEBUG_FORCE_SHARED_GRAPHICS_COMPUTE_QUEUE
 		vulkanDevice->queueFamilyIndices.compute = vulkanDevice->queueFamilyIndices.graphics;
 #endif
-		// Check whether the compute queue family is distinct from the graphics queue family
-		specializedComputeQueue = vulkanDevice->queueFamilyIndices.graphics != vulkanDevice->queueFamilyIndices.compute;
+		// Compute steps are submitted to a queue of the device's compute queue family, which may differ from the graphics queue family
+		asyncCompute.create(vulkanDevice, queue);
 		loadAssets();
 		prepareStorageBuffers();
 		prepareUniformBuffers();
@@ -760,7 +616,6 @@ public:
 		setupLayoutsAndDescriptors();
 		preparePipelines();
 		prepareCompute();
-		buildCommandBuffers();
 		prepared = true;
 	}
 
@@ -769,13 +624,6 @@ public:
 		if (!prepared)
 			return;
 		draw();
-
-		updateComputeUBO();
-	}
-
-	virtual void viewChanged()
-	{
-		updateGraphicsUBO();
 	}
 
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
@@ -783,6 +631,15 @@ public:
 		if (overlay->header("Settings")) {
 			overlay->checkBox("Simulate wind", &simulateWind);
 		}
+		if (overlay->header("Async compute")) {
+			overlay->text("Compute queue family: %d (%s)", asyncCompute.getQueueFamilyIndex(), asyncCompute.hasDedicatedQueue() ? "dedicated" : "shared with graphics");
+			if (asyncCompute.usesTimelineSemaphores()) {
+				overlay->checkBox("Overlap compute and graphics", &overlapCompute);
+			}
+			else {
+				overlay->text("No timeline semaphores, steps are serialized");
+			}
+		}
 	}
 };
 
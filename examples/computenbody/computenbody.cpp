@@ -1,12 +1,15 @@
 /*
 * Vulkan Example - Compute shader N-body simulation using two passes and shared compute shader memory
 *
+* Forces are either summed up for all particle pairs with a tiled kernel or approximated with a Barnes-Hut octree built on the GPU
+*
 * Copyright (C) by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
 #include "vulkanexamplebase.h"
+#include "VulkanAsyncCompute.h"
 
 #define VERTEX_BUFFER_BIND_ID 0
 #define ENABLE_VALIDATION false
@@ -16,11 +19,32 @@
 #else
 #define PARTICLES_PER_ATTRACTOR 4 * 1024
 #endif
+// Upper limit for the particle count that can be selected in the UI (about 1.5 million particles in total)
+#define MAX_PARTICLES_PER_ATTRACTOR 256 * 1024
 
 class VulkanExample : public VulkanExampleBase
 {
 public:
 	uint32_t numParticles;
+	// Particle count is changed in multiples of 1024 per attractor, so it's always a multiple of the integration workgroup size
+	uint32_t particlesPerAttractor = PARTICLES_PER_ATTRACTOR;
+	int32_t particlesPerAttractorK = PARTICLES_PER_ATTRACTOR / 1024;
+
+	// Tiled mode sums up the forces of all particle pairs using shared memory tiles, which is O(n^2)
+	// Barnes-Hut mode approximates groups of distant particles by the center of mass of their octree cell, which is O(n log n)
+	enum ForceMode { ForceModeTiled = 0, ForceModeBarnesHut = 1 };
+	int32_t forceMode = ForceModeTiled;
+
+	// Workgroup sizes of the force calculation supported by the device, set via specialization constant
+	std::vector<uint32_t> workgroupSizes;
+	int32_t workgroupSizeIndex = 0;
+	uint32_t requestedWorkgroupSize = 256;
+
+	// Let compute steps execute while the previous step's particles are still being rendered (requires timeline semaphores)
+	bool overlapCompute = true;
+
+	// Schedules the simulation steps on the (dedicated) compute queue and synchronizes them with the frames rendering their results
+	vks::AsyncCompute asyncCompute;
 
 	struct {
 		vks::Texture2D particle;
@@ -35,13 +59,11 @@ public:
 
 	// Resources for the graphics part of the example
 	struct {
-		uint32_t queueFamilyIndex;					// Used to check if compute and graphics queue families differ and require additional barriers
-		vks::Buffer uniformBuffer;					// Contains scene matrices
+		std::vector<vks::Buffer> uniformBuffers;	// Contains scene matrices (one per frame in flight)
 		VkDescriptorSetLayout descriptorSetLayout;	// Particle system rendering shader binding layout
-		VkDescriptorSet descriptorSet;				// Particle system rendering shader bindings
+		std::vector<VkDescriptorSet> descriptorSets;	// Particle system rendering shader bindings (one per frame in flight)
 		VkPipelineLayout pipelineLayout;			// Layout of the graphics pipeline
 		VkPipeline pipeline;						// Particle rendering pipeline
-		VkSemaphore semaphore;                      // Execution dependency between compute & graphic submission
 		struct {
 			glm::mat4 projection;
 			glm::mat4 view;
@@ -51,18 +73,19 @@ public:
 
 	// Resources for the compute part of the example
 	struct {
-		uint32_t queueFamilyIndex;					// Used to check if compute and graphics queue families differ and require additional barriers
-		vks::Buffer storageBuffer;					// (Shader) storage buffer object containing the particles
-		vks::Buffer uniformBuffer;					// Uniform buffer object containing particle system parameters
-		VkQueue queue;								// Separate queue for compute commands (queue family may differ from the one used for graphics)
-		VkCommandPool commandPool;					// Use a separate command pool (queue family may differ from the one used for graphics)
-		VkCommandBuffer commandBuffer;				// Command buffer storing the dispatch commands and barriers
-		VkSemaphore semaphore;                      // Execution dependency between compute & graphic submission
+		vks::Buffer storageBuffers[vks::AsyncCompute::slotCount];	// (Shader) storage buffer objects containing the particles, alternately written by the simulation steps
+		vks::Buffer uniformBuffers[vks::AsyncCompute::slotCount];	// Uniform buffer objects containing particle system parameters (one per step in flight)
 		VkDescriptorSetLayout descriptorSetLayout;	// Compute shader binding layout
-		VkDescriptorSet descriptorSet;				// Compute shader bindings
+		VkDescriptorSet descriptorSets[vks::AsyncCompute::slotCount];	// Compute shader bindings, each one writes one slot's particles and reads the other's
+		vks::Buffer tree;							// Octree nodes and bounds of the particles (Barnes-Hut mode only)
+		vks::Buffer cells;							// Leaf cell of each particle (Barnes-Hut mode only)
+		vks::Buffer sortedIndices;					// Particle indices sorted by leaf cell (Barnes-Hut mode only)
 		VkPipelineLayout pipelineLayout;			// Layout of the compute pipeline
 		VkPipeline pipelineCalculate;				// Compute pipeline for N-Body velocity calculation (1st pass)
+		VkPipeline pipelineCalculateBarnesHut;		// Compute pipeline for the velocity calculation with the octree (1st pass, Barnes-Hut mode)
+		VkPipeline pipelineBuild;					// Compute pipeline for building the octree (Barnes-Hut mode)
 		VkPipeline pipelineIntegrate;				// Compute pipeline for euler integration (2nd pass)
+		vks::GpuProfiler profiler;					// Timings of the simulation steps on the compute queue
 		VkPipeline blur;
 		VkPipelineLayout pipelineLayoutBlur;
 		VkDescriptorSetLayout descriptorSetLayoutBlur;
@@ -70,9 +93,26 @@ public:
 		struct computeUBO {							// Compute shader uniform block object
 			float deltaT;							//		Frame delta time
 			int32_t particleCount;
+			uint32_t treeDepth;						//		Level of the octree's leaf cells
+			float theta = 0.5f;						//		Barnes-Hut opening angle, smaller values are more accurate
 		} ubo;
 	} compute;
 
+	// Passes of the octree build, selected via push constant (see barneshut_build.comp)
+	enum TreeBuildPass { TreeBuildPassBounds = 0, TreeBuildPassInsert, TreeBuildPassCount, TreeBuildPassOffsets, TreeBuildPassScatter, TreeBuildPassSummarize };
+	struct TreeBuildPushConstants {
+		uint32_t pass;
+		uint32_t level;
+	};
+
+	// Octree node declaration, the nodes follow the bounds of the particle positions (two uvec4s) in the tree buffer
+	struct TreeNode {
+		glm::vec4 centerOfMass;						// xyz = center of mass, w = mass of all particles in the node's cell
+		uint32_t count;								// Number of particles in the node's cell
+		uint32_t offset;							// Position of the cell's first particle in the sorted particle indices
+		uint32_t _pad[2];
+	};
+
 	// SSBO particle declaration
 	struct Particle {
 		glm::vec4 pos;								// xyz = position, w = mass
@@ -87,26 +127,55 @@ public:
 		camera.setRotation(glm::vec3(-26.0f, 75.0f, 0.0f));
 		camera.setTranslation(glm::vec3(0.0f, 0.0f, -14.0f));
 		camera.movementSpeed = 2.5f;
+		// Per frame command buffers bind the particle buffer written by the frame's compute step
+		multipleFramesInFlight = true;
+		// Compare async compute against compute steps that wait for the previous frame (e.g. in benchmark mode)
+		commandLineParser.add("serializecompute", { "--serializecompute" }, 0, "Don't overlap compute steps with rendering");
+		commandLineParser.add("particles", { "--particles" }, 1, "Set the number of particles per attractor (in multiples of 1024)");
+		commandLineParser.add("barneshut", { "--barneshut" }, 0, "Approximate the forces with a Barnes-Hut octree");
+		commandLineParser.add("workgroupsize", { "--workgroupsize" }, 1, "Set the workgroup size of the force calculation (GLSL shaders only)");
+		commandLineParser.parse(args);
+		if (commandLineParser.isSet("serializecompute")) {
+			overlapCompute = false;
+		}
+		if (commandLineParser.isSet("particles")) {
+			particlesPerAttractorK = std::min(std::max(commandLineParser.getValueAsInt("particles", PARTICLES_PER_ATTRACTOR) / 1024, 1), MAX_PARTICLES_PER_ATTRACTOR / 1024);
+			particlesPerAttractor = particlesPerAttractorK * 1024;
+		}
+		if (commandLineParser.isSet("barneshut")) {
+			forceMode = ForceModeBarnesHut;
+		}
+		if (commandLineParser.isSet("workgroupsize")) {
+			requestedWorkgroupSize = commandLineParser.getValueAsInt("workgroupsize", requestedWorkgroupSize);
+		}
 	}
 
 	~VulkanExample()
 	{
 		// Graphics
-		graphics.uniformBuffer.destroy();
+		for (auto& uniformBuffer : graphics.uniformBuffers) {
+			uniformBuffer.destroy();
+		}
 		vkDestroyPipeline(device, graphics.pipeline, nullptr);
 		vkDestroyPipelineLayout(device, graphics.pipelineLayout, nullptr);
 		vkDestroyDescriptorSetLayout(device, graphics.descriptorSetLayout, nullptr);
-		vkDestroySemaphore(device, graphics.semaphore, nullptr);
 
 		// Compute
-		compute.storageBuffer.destroy();
-		compute.uniformBuffer.destroy();
+		asyncCompute.destroy();
+		for (uint32_t i = 0; i < vks::AsyncCompute::slotCount; i++) {
+			compute.storageBuffers[i].destroy();
+			compute.uniformBuffers[i].destroy();
+		}
+		compute.tree.destroy();
+		compute.cells.destroy();
+		compute.sortedIndices.destroy();
+		compute.profiler.destroy();
 		vkDestroyPipelineLayout(device, compute.pipelineLayout, nullptr);
 		vkDestroyDescriptorSetLayout(device, compute.descriptorSetLayout, nullptr);
 		vkDestroyPipeline(device, compute.pipelineCalculate, nullptr);
+		vkDestroyPipeline(device, compute.pipelineCalculateBarnesHut, nullptr);
+		vkDestroyPipeline(device, compute.pipelineBuild, nullptr);
 		vkDestroyPipeline(device, compute.pipelineIntegrate, nullptr);
-		vkDestroySemaphore(device, compute.semaphore, nullptr);
-		vkDestroyCommandPool(device, compute.commandPool, nullptr);
 
 		textures.particle.destroy();
 		textures.gradient.destroy();
@@ -118,7 +187,8 @@ public:
 		textures.gradient.loadFromFile(getAssetPath() + "textures/particle_gradient_rgba.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
 	}
 
-	void buildCommandBuffers()
+	// Record the rendering of the particles written by the compute step in the given slot
+	void recordCommandBuffer(uint32_t slot)
 	{
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
@@ -134,141 +204,113 @@ public:
 		renderPassBeginInfo.renderArea.extent.height = height;
 		renderPassBeginInfo.clearValueCount = 2;
 		renderPassBeginInfo.pClearValues = clearValues;
+		renderPassBeginInfo.framebuffer = frameBuffers[currentBuffer];
 
-		for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
-		{
-			// Set target frame buffer
-			renderPassBeginInfo.framebuffer = frameBuffers[i];
-
-			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
-
-			// Acquire barrier
-			if (graphics.queueFamilyIndex != compute.queueFamilyIndex)
-			{
-				VkBufferMemoryBarrier buffer_barrier =
-				{
-					VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-					nullptr,
-					0,
-					VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-					compute.queueFamilyIndex,
-					graphics.queueFamilyIndex,
-					compute.storageBuffer.buffer,
-					0,
-					compute.storageBuffer.size
-				};
+		const VkCommandBuffer commandBuffer = frames[currentFrame].commandBuffer;
 
-				vkCmdPipelineBarrier(
-					drawCmdBuffers[i],
-					VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-					VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
-					0,
-					0, nullptr,
-					1, &buffer_barrier,
-					0, nullptr);
-			}
+		VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufInfo));
 
-			// Draw the particle system using the update vertex buffer
-			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		// The storage buffers are shared concurrently by the graphics and compute queue families, so no ownership transfer is required
+		// The semaphore wait for the compute step makes its writes visible to the vertex input stage
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-			VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
-			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
+		VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
-			VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
-			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+		VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipeline);
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelineLayout, 0, 1, &graphics.descriptorSet, 0, nullptr);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelineLayout, 0, 1, &graphics.descriptorSets[currentFrame], 0, nullptr);
 
-			VkDeviceSize offsets[1] = { 0 };
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &compute.storageBuffer.buffer, offsets);
-			vkCmdDraw(drawCmdBuffers[i], numParticles, 1, 0, 0);
+		VkDeviceSize offsets[1] = { 0 };
+		vkCmdBindVertexBuffers(commandBuffer, VERTEX_BUFFER_BIND_ID, 1, &compute.storageBuffers[slot].buffer, offsets);
+		vkCmdDraw(commandBuffer, numParticles, 1, 0, 0);
 
-			drawUI(drawCmdBuffers[i]);
+		drawUI(commandBuffer);
 
-			vkCmdEndRenderPass(drawCmdBuffers[i]);
+		vkCmdEndRenderPass(commandBuffer);
 
-			// Release barrier
-			if (graphics.queueFamilyIndex != compute.queueFamilyIndex)
-			{
-				VkBufferMemoryBarrier buffer_barrier =
-				{
-					VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-					nullptr,
-					VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-					0,
-					graphics.queueFamilyIndex,
-					compute.queueFamilyIndex,
-					compute.storageBuffer.buffer,
-					0,
-					compute.storageBuffer.size
-				};
+		VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+	}
 
-				vkCmdPipelineBarrier(
-					drawCmdBuffers[i],
-					VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
-					VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-					0,
-					0, nullptr,
-					1, &buffer_barrier,
-					0, nullptr);
-			}
+	// Record the build of the octree from the particles of the previous step, the tree is rebuilt from scratch for every step
+	void recordTreeBuild(VkCommandBuffer commandBuffer)
+	{
+		// Bounds and particle counts are accumulated with atomics, so the tree is cleared once the previous step has finished reading it
+		VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+		// Write-after-read hazard, the execution dependency is sufficient (reads have nothing to make available)
+		memoryBarrier.srcAccessMask = 0;
+		memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_FLAGS_NONE, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		vkCmdFillBuffer(commandBuffer, compute.tree.buffer, 0, VK_WHOLE_SIZE, 0);
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_FLAGS_NONE, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineBuild);
+
+		// Each pass depends on the results of the previous one
+		auto dispatchPass = [&](TreeBuildPass pass, uint32_t level, uint32_t itemCount) {
+			TreeBuildPushConstants pushConstants = { static_cast<uint32_t>(pass), level };
+			vkCmdPushConstants(commandBuffer, compute.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(TreeBuildPushConstants), &pushConstants);
+			vkCmdDispatch(commandBuffer, (itemCount + 255) / 256, 1, 1);
+			VkMemoryBarrier passBarrier = vks::initializers::memoryBarrier();
+			passBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			passBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_FLAGS_NONE, 1, &passBarrier, 0, nullptr, 0, nullptr);
+		};
 
-			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
+		// Level n of the tree has 8^n nodes
+		const int32_t depth = static_cast<int32_t>(compute.ubo.treeDepth);
+		dispatchPass(TreeBuildPassBounds, 0, numParticles);
+		dispatchPass(TreeBuildPassInsert, 0, numParticles);
+		for (int32_t level = depth - 1; level >= 0; level--) {
+			dispatchPass(TreeBuildPassCount, level, 1u << (3 * level));
+		}
+		for (int32_t level = 0; level < depth; level++) {
+			dispatchPass(TreeBuildPassOffsets, level, 1u << (3 * level));
+		}
+		dispatchPass(TreeBuildPassScatter, 0, numParticles);
+		for (int32_t level = depth; level >= 0; level--) {
+			dispatchPass(TreeBuildPassSummarize, level, 1u << (3 * level));
 		}
-
 	}
 
-	void buildComputeCommandBuffer()
+	// Record a simulation step reading the particles of the previous step and writing them to the given slot
+	void recordComputeCommandBuffer(VkCommandBuffer commandBuffer, uint32_t slot)
 	{
-		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
-
-		VK_CHECK_RESULT(vkBeginCommandBuffer(compute.commandBuffer, &cmdBufInfo));
-
-		// Acquire barrier
-		if (graphics.queueFamilyIndex != compute.queueFamilyIndex)
-		{
-			VkBufferMemoryBarrier buffer_barrier =
-			{
-				VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-				nullptr,
-				0,
-				VK_ACCESS_SHADER_WRITE_BIT,
-				graphics.queueFamilyIndex,
-				compute.queueFamilyIndex,
-				compute.storageBuffer.buffer,
-				0,
-				compute.storageBuffer.size
-			};
-
-			vkCmdPipelineBarrier(
-				compute.commandBuffer,
-				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-				0,
-				0, nullptr,
-				1, &buffer_barrier,
-				0, nullptr);
-		}
+		compute.profiler.beginFrame(commandBuffer, slot);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSets[slot], 0, 0);
 
 		// First pass: Calculate particle movement
 		// -------------------------------------------------------------------------------------------------------
-		vkCmdBindPipeline(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineCalculate);
-		vkCmdBindDescriptorSets(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSet, 0, 0);
-		vkCmdDispatch(compute.commandBuffer, numParticles / 256, 1, 1);
+		if (forceMode == ForceModeBarnesHut) {
+			compute.profiler.beginScope(commandBuffer, slot, "Tree build");
+			recordTreeBuild(commandBuffer);
+			compute.profiler.endScope(commandBuffer, slot);
+			compute.profiler.beginScope(commandBuffer, slot, "Force (Barnes-Hut)");
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineCalculateBarnesHut);
+		}
+		else {
+			compute.profiler.beginScope(commandBuffer, slot, "Force (tiled)");
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineCalculate);
+		}
+		const uint32_t workgroupSize = workgroupSizes[workgroupSizeIndex];
+		vkCmdDispatch(commandBuffer, (numParticles + workgroupSize - 1) / workgroupSize, 1, 1);
+		compute.profiler.endScope(commandBuffer, slot);
 
 		// Add memory barrier to ensure that the computer shader has finished writing to the buffer
 		VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
-		bufferBarrier.buffer = compute.storageBuffer.buffer;
-		bufferBarrier.size = compute.storageBuffer.descriptor.range;
+		bufferBarrier.buffer = compute.storageBuffers[slot].buffer;
+		bufferBarrier.size = compute.storageBuffers[slot].descriptor.range;
 		bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
 		bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-		// Transfer ownership if compute and graphics queue family indices differ
 		bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 		bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 
 		vkCmdPipelineBarrier(
-			compute.commandBuffer,
+			commandBuffer,
 			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
 			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
 			VK_FLAGS_NONE,
@@ -278,36 +320,10 @@ public:
 
 		// Second pass: Integrate particles
 		// -------------------------------------------------------------------------------------------------------
-		vkCmdBindPipeline(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineIntegrate);
-		vkCmdDispatch(compute.commandBuffer, numParticles / 256, 1, 1);
-
-		// Release barrier
-		if (graphics.queueFamilyIndex != compute.queueFamilyIndex)
-		{
-			VkBufferMemoryBarrier buffer_barrier =
-			{
-				VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-				nullptr,
-				VK_ACCESS_SHADER_WRITE_BIT,
-				0,
-				compute.queueFamilyIndex,
-				graphics.queueFamilyIndex,
-				compute.storageBuffer.buffer,
-				0,
-				compute.storageBuffer.size
-			};
-
-			vkCmdPipelineBarrier(
-				compute.commandBuffer,
-				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-				VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-				0,
-				0, nullptr,
-				1, &buffer_barrier,
-				0, nullptr);
-		}
-
-		vkEndCommandBuffer(compute.commandBuffer);
+		compute.profiler.beginScope(commandBuffer, slot, "Integrate");
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineIntegrate);
+		vkCmdDispatch(commandBuffer, numParticles / 256, 1, 1);
+		compute.profiler.endScope(commandBuffer, slot);
 	}
 
 	// Setup and fill the compute shader storage buffers containing the particles
@@ -329,7 +345,7 @@ public:
 		};
 #endif
 
-		numParticles = static_cast<uint32_t>(attractors.size()) * PARTICLES_PER_ATTRACTOR;
+		numParticles = static_cast<uint32_t>(attractors.size()) * particlesPerAttractor;
 
 		// Initial particle positions
 		std::vector<Particle> particleBuffer(numParticles);
@@ -339,9 +355,9 @@ public:
 
 		for (uint32_t i = 0; i < static_cast<uint32_t>(attractors.size()); i++)
 		{
-			for (uint32_t j = 0; j < PARTICLES_PER_ATTRACTOR; j++)
+			for (uint32_t j = 0; j < particlesPerAttractor; j++)
 			{
-				Particle &particle = particleBuffer[i * PARTICLES_PER_ATTRACTOR + j];
+				Particle &particle = particleBuffer[i * particlesPerAttractor + j];
 
 				// First particle in group as heavy center of gravity
 				if (j == 0)
@@ -374,58 +390,9 @@ public:
 
 		VkDeviceSize storageBufferSize = particleBuffer.size() * sizeof(Particle);
 
-		// Staging
-		// SSBO won't be changed on the host after upload so copy to device local memory
-
-		vks::Buffer stagingBuffer;
-
-		vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&stagingBuffer,
-			storageBufferSize,
-			particleBuffer.data());
-
-		vulkanDevice->createBuffer(
-			// The SSBO will be used as a storage buffer for the compute pipeline and as a vertex buffer in the graphics pipeline
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			&compute.storageBuffer,
-			storageBufferSize);
-
-		// Copy from staging buffer to storage buffer
-		VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-		VkBufferCopy copyRegion = {};
-		copyRegion.size = storageBufferSize;
-		vkCmdCopyBuffer(copyCmd, stagingBuffer.buffer, compute.storageBuffer.buffer, 1, &copyRegion);
-		// Execute a transfer barrier to the compute queue, if necessary
-		if (graphics.queueFamilyIndex != compute.queueFamilyIndex)
-		{
-			VkBufferMemoryBarrier buffer_barrier =
-			{
-				VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-				nullptr,
-				VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-				0,
-				graphics.queueFamilyIndex,
-				compute.queueFamilyIndex,
-				compute.storageBuffer.buffer,
-				0,
-				compute.storageBuffer.size
-			};
-
-			vkCmdPipelineBarrier(
-				copyCmd,
-				VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
-				VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-				0,
-				0, nullptr,
-				1, &buffer_barrier,
-				0, nullptr);
-		}
-		vulkanDevice->flushCommandBuffer(copyCmd, queue, true);
-
-		stagingBuffer.destroy();
+		// SSBOs won't be changed on the host after upload so they're created in device local memory
+		// The SSBOs will be used as storage buffers for the compute pipeline and as vertex buffers in the graphics pipeline
+		asyncCompute.createDoubleBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, storageBufferSize, compute.storageBuffers, particleBuffer.data());
 
 		// Binding description
 		vertices.bindingDescriptions.resize(1);
@@ -461,20 +428,66 @@ public:
 		vertices.inputState.pVertexAttributeDescriptions = vertices.attributeDescriptions.data();
 	}
 
+	// Setup the buffers for building the octree of the Barnes-Hut mode, which are only accessed by the compute queue
+	void prepareTreeBuffers()
+	{
+		// The tree is complete down to the leaf level, which is chosen to have about 8 particles per leaf cell on average
+		uint32_t depth = 2;
+		while ((depth < 7) && ((1u << (3 * depth)) * 8 < numParticles)) {
+			depth++;
+		}
+		compute.ubo.treeDepth = depth;
+		const VkDeviceSize nodeCount = ((1ull << (3 * (depth + 1))) - 1) / 7;
+
+		// The tree buffer is cleared with vkCmdFillBuffer before each build
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&compute.tree,
+			2 * sizeof(glm::uvec4) + nodeCount * sizeof(TreeNode)));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&compute.cells,
+			numParticles * sizeof(glm::uvec2)));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&compute.sortedIndices,
+			numParticles * sizeof(uint32_t)));
+	}
+
+	// Changes the number of particles, called from the UI
+	void setParticleCount(uint32_t count)
+	{
+		// The particle buffers may still be in use by steps and frames in flight
+		vkDeviceWaitIdle(device);
+		particlesPerAttractor = count;
+		for (uint32_t i = 0; i < vks::AsyncCompute::slotCount; i++) {
+			compute.storageBuffers[i].destroy();
+		}
+		compute.tree.destroy();
+		compute.cells.destroy();
+		compute.sortedIndices.destroy();
+		prepareStorageBuffers();
+		prepareTreeBuffers();
+		updateComputeDescriptorSets();
+	}
+
 	void setupDescriptorPool()
 	{
 		std::vector<VkDescriptorPoolSize> poolSizes =
 		{
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2)
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, maxFramesInFlight + vks::AsyncCompute::slotCount),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5 * vks::AsyncCompute::slotCount),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2 * maxFramesInFlight)
 		};
 
 		VkDescriptorPoolCreateInfo descriptorPoolInfo =
 			vks::initializers::descriptorPoolCreateInfo(
 				static_cast<uint32_t>(poolSizes.size()),
 				poolSizes.data(),
-				2);
+				maxFramesInFlight + vks::AsyncCompute::slotCount);
 
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
 	}
@@ -511,15 +524,18 @@ public:
 				&graphics.descriptorSetLayout,
 				1);
 
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &graphics.descriptorSet));
+		graphics.descriptorSets.resize(maxFramesInFlight);
+		for (uint32_t i = 0; i < maxFramesInFlight; i++) {
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &graphics.descriptorSets[i]));
 
-		std::vector<VkWriteDescriptorSet> writeDescriptorSets;
-		writeDescriptorSets = {
-			vks::initializers::writeDescriptorSet(graphics.descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &textures.particle.descriptor),
-			vks::initializers::writeDescriptorSet(graphics.descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &textures.gradient.descriptor),
-			vks::initializers::writeDescriptorSet(graphics.descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &graphics.uniformBuffer.descriptor),
-		};
-		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+			std::vector<VkWriteDescriptorSet> writeDescriptorSets;
+			writeDescriptorSets = {
+				vks::initializers::writeDescriptorSet(graphics.descriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &textures.particle.descriptor),
+				vks::initializers::writeDescriptorSet(graphics.descriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &textures.gradient.descriptor),
+				vks::initializers::writeDescriptorSet(graphics.descriptorSets[i], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &graphics.uniformBuffers[i].descriptor),
+			};
+			vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+		}
 	}
 
 	void preparePipelines()
@@ -612,36 +628,20 @@ public:
 	void prepareGraphics()
 	{
 		prepareStorageBuffers();
+		prepareTreeBuffers();
 		prepareUniformBuffers();
 		setupDescriptorSetLayout();
 		preparePipelines();
 		setupDescriptorSet();
-
-		// Semaphore for compute & graphics sync
-		VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
-		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &graphics.semaphore));
-
-		// Signal the semaphore
-		VkSubmitInfo submitInfo = vks::initializers::submitInfo();
-		submitInfo.signalSemaphoreCount = 1;
-		submitInfo.pSignalSemaphores = &graphics.semaphore;
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
-		VK_CHECK_RESULT(vkQueueWaitIdle(queue));
 	}
 
 	void prepareCompute()
 	{
-		// Create a compute capable device queue
-		// The VulkanDevice::createLogicalDevice functions finds a compute capable queue and prefers queue families that only support compute
-		// Depending on the implementation this may result in different queue family indices for graphics and computes,
-		// requiring proper synchronization (see the memory barriers in buildComputeCommandBuffer)
-		vkGetDeviceQueue(device, compute.queueFamilyIndex, 0, &compute.queue);
-
 		// Create compute pipeline
 		// Compute pipelines are created separate from graphics pipelines even if they use the same queue (family index)
 
 		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
-			// Binding 0 : Particle position storage buffer
+			// Binding 0 : Particle storage buffer written by the step
 			vks::initializers::descriptorSetLayoutBinding(
 				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
 				VK_SHADER_STAGE_COMPUTE_BIT,
@@ -651,6 +651,26 @@ public:
 				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
 				VK_SHADER_STAGE_COMPUTE_BIT,
 				1),
+			// Binding 2 : Particle storage buffer of the previous step
+			vks::initializers::descriptorSetLayoutBinding(
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				VK_SHADER_STAGE_COMPUTE_BIT,
+				2),
+			// Binding 3 : Octree storage buffer
+			vks::initializers::descriptorSetLayoutBinding(
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				VK_SHADER_STAGE_COMPUTE_BIT,
+				3),
+			// Binding 4 : Leaf cells of the particles
+			vks::initializers::descriptorSetLayoutBinding(
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				VK_SHADER_STAGE_COMPUTE_BIT,
+				4),
+			// Binding 5 : Particle indices sorted by leaf cell
+			vks::initializers::descriptorSetLayoutBinding(
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				VK_SHADER_STAGE_COMPUTE_BIT,
+				5),
 		};
 
 		VkDescriptorSetLayoutCreateInfo descriptorLayout =
@@ -665,55 +685,109 @@ public:
 				&compute.descriptorSetLayout,
 				1);
 
-		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pPipelineLayoutCreateInfo, nullptr,	&compute.pipelineLayout));
+		// The octree build passes are selected via push constants
+		VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(TreeBuildPushConstants), 0);
+		pPipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pPipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
 
-		VkDescriptorSetAllocateInfo allocInfo =
-			vks::initializers::descriptorSetAllocateInfo(
-				descriptorPool,
-				&compute.descriptorSetLayout,
-				1);
-
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &compute.descriptorSet));
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pPipelineLayoutCreateInfo, nullptr,	&compute.pipelineLayout));
 
-		std::vector<VkWriteDescriptorSet> computeWriteDescriptorSets =
+		for (uint32_t i = 0; i < vks::AsyncCompute::slotCount; i++)
 		{
-			// Binding 0 : Particle position storage buffer
-			vks::initializers::writeDescriptorSet(
-				compute.descriptorSet,
-				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-				0,
-				&compute.storageBuffer.descriptor),
-			// Binding 1 : Uniform buffer
-			vks::initializers::writeDescriptorSet(
-				compute.descriptorSet,
-				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-				1,
-				&compute.uniformBuffer.descriptor)
-		};
+			VkDescriptorSetAllocateInfo allocInfo =
+				vks::initializers::descriptorSetAllocateInfo(
+					descriptorPool,
+					&compute.descriptorSetLayout,
+					1);
 
-		vkUpdateDescriptorSets(device, static_cast<uint32_t>(computeWriteDescriptorSets.size()), computeWriteDescriptorSets.data(), 0, nullptr);
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &compute.descriptorSets[i]));
+		}
+		updateComputeDescriptorSets();
 
 		// Create pipelines
 		VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(compute.pipelineLayout, 0);
 
 		// 1st pass
-		computePipelineCreateInfo.stage = loadShader(getShadersPath() + "computenbody/particle_calculate.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		prepareForcePipelines();
+
+		// Octree build for the 1st pass in Barnes-Hut mode
+		computePipelineCreateInfo.stage = loadShader(getShadersPath() + "computenbody/barneshut_build.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.pipelineBuild));
 
+		// 2nd pass
+		computePipelineCreateInfo.stage = loadShader(getShadersPath() + "computenbody/particle_integrate.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.pipelineIntegrate));
+	}
+
+	// (Re)write the compute descriptor sets, e.g. after the particle buffers have been recreated for a new particle count
+	void updateComputeDescriptorSets()
+	{
+		for (uint32_t i = 0; i < vks::AsyncCompute::slotCount; i++)
+		{
+			const uint32_t previousSlot = (i + vks::AsyncCompute::slotCount - 1) % vks::AsyncCompute::slotCount;
+			std::vector<VkWriteDescriptorSet> computeWriteDescriptorSets =
+			{
+				// Binding 0 : Particle storage buffer written by the step
+				vks::initializers::writeDescriptorSet(
+					compute.descriptorSets[i],
+					VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+					0,
+					&compute.storageBuffers[i].descriptor),
+				// Binding 1 : Uniform buffer
+				vks::initializers::writeDescriptorSet(
+					compute.descriptorSets[i],
+					VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+					1,
+					&compute.uniformBuffers[i].descriptor),
+				// Binding 2 : Particle storage buffer of the previous step
+				vks::initializers::writeDescriptorSet(
+					compute.descriptorSets[i],
+					VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+					2,
+					&compute.storageBuffers[previousSlot].descriptor),
+				// Binding 3 : Octree storage buffer
+				vks::initializers::writeDescriptorSet(
+					compute.descriptorSets[i],
+					VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+					3,
+					&compute.tree.descriptor),
+				// Binding 4 : Leaf cells of the particles
+				vks::initializers::writeDescriptorSet(
+					compute.descriptorSets[i],
+					VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+					4,
+					&compute.cells.descriptor),
+				// Binding 5 : Particle indices sorted by leaf cell
+				vks::initializers::writeDescriptorSet(
+					compute.descriptorSets[i],
+					VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+					5,
+					&compute.sortedIndices.descriptor)
+			};
+
+			vkUpdateDescriptorSets(device, static_cast<uint32_t>(computeWriteDescriptorSets.size()), computeWriteDescriptorSets.data(), 0, nullptr);
+		}
+	}
+
+	// Create the pipelines of the force calculation, which depend on the selected workgroup size
+	void prepareForcePipelines()
+	{
 		// Set shader parameters via specialization constants
 		struct SpecializationData {
-			uint32_t sharedDataSize;
+			uint32_t workgroupSize;
 			float gravity;
 			float power;
 			float soften;
 		} specializationData;
 
 		std::vector<VkSpecializationMapEntry> specializationMapEntries;
-		specializationMapEntries.push_back(vks::initializers::specializationMapEntry(0, offsetof(SpecializationData, sharedDataSize), sizeof(uint32_t)));
+		specializationMapEntries.push_back(vks::initializers::specializationMapEntry(0, offsetof(SpecializationData, workgroupSize), sizeof(uint32_t)));
 		specializationMapEntries.push_back(vks::initializers::specializationMapEntry(1, offsetof(SpecializationData, gravity), sizeof(float)));
 		specializationMapEntries.push_back(vks::initializers::specializationMapEntry(2, offsetof(SpecializationData, power), sizeof(float)));
 		specializationMapEntries.push_back(vks::initializers::specializationMapEntry(3, offsetof(SpecializationData, soften), sizeof(float)));
 
-		specializationData.sharedDataSize = std::min((uint32_t)1024, (uint32_t)(vulkanDevice->properties.limits.maxComputeSharedMemorySize / sizeof(glm::vec4)));
+		// The tiled kernel loads one particle position per invocation into shared memory
+		specializationData.workgroupSize = workgroupSizes[workgroupSizeIndex];
 
 		specializationData.gravity = 0.002f;
 		specializationData.power = 0.75f;
@@ -721,117 +795,83 @@ public:
 
 		VkSpecializationInfo specializationInfo =
 			vks::initializers::specializationInfo(static_cast<uint32_t>(specializationMapEntries.size()), specializationMapEntries.data(), sizeof(specializationData), &specializationData);
-		computePipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
-
-		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.pipelineCalculate));
-
-		// 2nd pass
-		computePipelineCreateInfo.stage = loadShader(getShadersPath() + "computenbody/particle_integrate.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
-		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.pipelineIntegrate));
-
-		// Separate command pool as queue family for compute may be different than graphics
-		VkCommandPoolCreateInfo cmdPoolInfo = {};
-		cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-		cmdPoolInfo.queueFamilyIndex = compute.queueFamilyIndex;
-		cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-		VK_CHECK_RESULT(vkCreateCommandPool(device, &cmdPoolInfo, nullptr, &compute.commandPool));
-
-		// Create a command buffer for compute operations
-		compute.commandBuffer = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, compute.commandPool);
 
-		// Semaphore for compute & graphics sync
-		VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
-		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &compute.semaphore));
-
-		// Build a single command buffer containing the compute dispatch commands
-		buildComputeCommandBuffer();
+		VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(compute.pipelineLayout, 0);
 
-		// SRS - By reordering compute and graphics within draw(), the following code is no longer needed:
-		// If graphics and compute queue family indices differ, acquire and immediately release the storage buffer, so that the initial acquire from the graphics command buffers are matched up properly
-		/*
-		if (graphics.queueFamilyIndex != compute.queueFamilyIndex)
-		{
-			// Create a transient command buffer for setting up the initial buffer transfer state
-			VkCommandBuffer transferCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, compute.commandPool, true);
+		computePipelineCreateInfo.stage = loadShader(getShadersPath() + "computenbody/particle_calculate.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		computePipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.pipelineCalculate));
 
-			VkBufferMemoryBarrier acquire_buffer_barrier =
-			{
-				VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-				nullptr,
-				0,
-				VK_ACCESS_SHADER_WRITE_BIT,
-				graphics.queueFamilyIndex,
-				compute.queueFamilyIndex,
-				compute.storageBuffer.buffer,
-				0,
-				compute.storageBuffer.size
-			};
-			vkCmdPipelineBarrier(
-				transferCmd,
-				VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
-				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-				0,
-				0, nullptr,
-				1, &acquire_buffer_barrier,
-				0, nullptr);
+		computePipelineCreateInfo.stage = loadShader(getShadersPath() + "computenbody/barneshut_calculate.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		computePipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.pipelineCalculateBarnesHut));
+	}
 
-			VkBufferMemoryBarrier release_buffer_barrier =
-			{
-				VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-				nullptr,
-				VK_ACCESS_SHADER_WRITE_BIT,
-				0,
-				compute.queueFamilyIndex,
-				graphics.queueFamilyIndex,
-				compute.storageBuffer.buffer,
-				0,
-				compute.storageBuffer.size
-			};
-			vkCmdPipelineBarrier(
-				transferCmd,
-				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-				VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
-				0,
-				0, nullptr,
-				1, &release_buffer_barrier,
-				0, nullptr);
+	// Changes the workgroup size of the force calculation, called from the UI
+	void setWorkgroupSize(int32_t index)
+	{
+		// The pipelines may still be in use by steps in flight
+		vkDeviceWaitIdle(device);
+		workgroupSizeIndex = index;
+		vkDestroyPipeline(device, compute.pipelineCalculate, nullptr);
+		vkDestroyPipeline(device, compute.pipelineCalculateBarnesHut, nullptr);
+		prepareForcePipelines();
+	}
 
-			vulkanDevice->flushCommandBuffer(transferCmd, compute.queue, compute.commandPool);
+	// Collect the workgroup sizes for the force calculation that are supported by the device
+	void getWorkgroupSizes()
+	{
+		// HLSL can't set numthreads from a specialization constant, so the HLSL shaders are fixed to 256 invocations
+		if (getShadersPath() == getShaderBasePath() + "hlsl/") {
+			workgroupSizes = { 256 };
+			workgroupSizeIndex = 0;
+			return;
+		}
+		const VkPhysicalDeviceLimits& limits = vulkanDevice->properties.limits;
+		for (uint32_t size = 64; size <= 1024; size *= 2) {
+			// The tiled kernel needs one vec4 of shared memory per invocation
+			if ((size <= limits.maxComputeWorkGroupSize[0]) && (size <= limits.maxComputeWorkGroupInvocations) && (size * sizeof(glm::vec4) <= limits.maxComputeSharedMemorySize)) {
+				workgroupSizes.push_back(size);
+				if (size <= requestedWorkgroupSize) {
+					workgroupSizeIndex = static_cast<int32_t>(workgroupSizes.size()) - 1;
+				}
+			}
 		}
-		*/
 	}
 
 	// Prepare and initialize uniform buffer containing shader uniforms
 	void prepareUniformBuffers()
 	{
-		// Compute shader uniform buffer block
-		vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&compute.uniformBuffer,
-			sizeof(compute.ubo));
-
-		// Map for host access
-		VK_CHECK_RESULT(compute.uniformBuffer.map());
-
-		// Vertex shader uniform buffer block
-		vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&graphics.uniformBuffer,
-			sizeof(graphics.ubo));
-
-		// Map for host access
-		VK_CHECK_RESULT(graphics.uniformBuffer.map());
-
-		updateComputeUniformBuffers();
-		updateGraphicsUniformBuffers();
+		// Compute shader uniform buffer blocks, the block of a slot is updated once its last step has finished executing
+		for (auto& uniformBuffer : compute.uniformBuffers) {
+			vulkanDevice->createBuffer(
+				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&uniformBuffer,
+				sizeof(compute.ubo));
+
+			// Map for host access
+			VK_CHECK_RESULT(uniformBuffer.map());
+		}
+
+		// Vertex shader uniform buffer blocks, one per frame in flight
+		graphics.uniformBuffers.resize(maxFramesInFlight);
+		for (auto& uniformBuffer : graphics.uniformBuffers) {
+			vulkanDevice->createBuffer(
+				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&uniformBuffer,
+				sizeof(graphics.ubo));
+
+			// Map for host access
+			VK_CHECK_RESULT(uniformBuffer.map());
+		}
 	}
 
-	void updateComputeUniformBuffers()
+	void updateComputeUniformBuffers(uint32_t slot)
 	{
 		compute.ubo.deltaT = paused ? 0.0f : frameTimer * 0.05f;
-		memcpy(compute.uniformBuffer.mapped, &compute.ubo, sizeof(compute.ubo));
+		memcpy(compute.uniformBuffers[slot].mapped, &compute.ubo, sizeof(compute.ubo));
 	}
 
 	void updateGraphicsUniformBuffers()
@@ -839,40 +879,40 @@ public:
 		graphics.ubo.projection = camera.matrices.perspective;
 		graphics.ubo.view = camera.matrices.view;
 		graphics.ubo.screenDim = glm::vec2((float)width, (float)height);
-		memcpy(graphics.uniformBuffer.mapped, &graphics.ubo, sizeof(graphics.ubo));
+		memcpy(graphics.uniformBuffers[currentFrame].mapped, &graphics.ubo, sizeof(graphics.ubo));
 	}
 
 	void draw()
 	{
-		// Wait for rendering finished
-		VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
-
-		// Submit compute commands
-		VkSubmitInfo computeSubmitInfo = vks::initializers::submitInfo();
-		computeSubmitInfo.commandBufferCount = 1;
-		computeSubmitInfo.pCommandBuffers = &compute.commandBuffer;
-		computeSubmitInfo.waitSemaphoreCount = 1;
-		computeSubmitInfo.pWaitSemaphores = &graphics.semaphore;
-		computeSubmitInfo.pWaitDstStageMask = &waitStageMask;
-		computeSubmitInfo.signalSemaphoreCount = 1;
-		computeSubmitInfo.pSignalSemaphores = &compute.semaphore;
-		VK_CHECK_RESULT(vkQueueSubmit(compute.queue, 1, &computeSubmitInfo, VK_NULL_HANDLE));
-
-		VulkanExampleBase::prepareFrame();
-
-		VkPipelineStageFlags graphicsWaitStageMasks[] = { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-		VkSemaphore graphicsWaitSemaphores[] = { compute.semaphore, semaphores.presentComplete };
-		VkSemaphore graphicsSignalSemaphores[] = { graphics.semaphore, semaphores.renderComplete };
-
-		// Submit graphics commands
+		// Waits until the GPU has finished with the resources of the current frame in flight
+		if (!VulkanExampleBase::prepareFrame()) {
+			return;
+		}
+		updateGraphicsUniformBuffers();
+
+		// Submit the simulation step for this frame, it may execute while the previous frame still renders the other slot's particles
+		asyncCompute.serialize = !overlapCompute;
+		VkCommandBuffer computeCommandBuffer = asyncCompute.beginStep();
+		const uint32_t slot = asyncCompute.getSlot();
+		// The slot's last step has finished executing, so its timestamps can be read without waiting
+		if (compute.profiler.resolve(slot) && benchmark.active) {
+			for (auto& scope : compute.profiler.getScopes()) {
+				if (scope.updated) {
+					benchmark.addPassTime(scope.name, scope.time);
+				}
+			}
+		}
+		updateComputeUniformBuffers(slot);
+		recordComputeCommandBuffer(computeCommandBuffer, slot);
+		asyncCompute.submit();
+		compute.profiler.markSubmitted(slot);
+
+		// Submit graphics commands, these wait for the step at the vertex input stage
+		recordCommandBuffer(slot);
 		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
-		submitInfo.waitSemaphoreCount = 2;
-		submitInfo.pWaitSemaphores = graphicsWaitSemaphores;
-		submitInfo.pWaitDstStageMask = graphicsWaitStageMasks;
-		submitInfo.signalSemaphoreCount = 2;
-		submitInfo.pSignalSemaphores = graphicsSignalSemaphores;
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+		submitInfo.pCommandBuffers = &frames[currentFrame].commandBuffer;
+		VkSubmitInfo graphicsSubmitInfo = asyncCompute.getGraphicsSubmitInfo(submitInfo);
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &graphicsSubmitInfo, frames[currentFrame].fence));
 
 		VulkanExampleBase::submitFrame();
 	}
@@ -880,15 +920,15 @@ public:
 	void prepare()
 	{
 		VulkanExampleBase::prepare();
-		// We will be using the queue family indices to check if graphics and compute queue families differ
-		// If that's the case, we need additional barriers for acquiring and releasing resources
-		graphics.queueFamilyIndex = vulkanDevice->queueFamilyIndices.graphics;
-		compute.queueFamilyIndex = vulkanDevice->queueFamilyIndices.compute;
+		// Compute steps are submitted to a queue of the device's compute queue family, which may differ from the graphics queue family
+		asyncCompute.create(vulkanDevice, queue);
+		// The simulation steps are timed on the compute queue, with one profiler slot per step in flight
+		compute.profiler.create(device, vulkanDevice->properties, vulkanDevice->queueFamilyProperties[asyncCompute.getQueueFamilyIndex()].timestampValidBits, vks::AsyncCompute::slotCount);
+		getWorkgroupSizes();
 		loadAssets();
 		setupDescriptorPool();
 		prepareGraphics();
 		prepareCompute();
-		buildCommandBuffers();
 		prepared = true;
 	}
 
@@ -897,15 +937,48 @@ public:
 		if (!prepared)
 			return;
 		draw();
-		updateComputeUniformBuffers();
-		if (camera.updated) {
-			updateGraphicsUniformBuffers();
-		}
 	}
 
-	virtual void viewChanged()
+	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
 	{
-		updateGraphicsUniformBuffers();
+		if (overlay->header("Simulation")) {
+			if (overlay->sliderInt("Particles per attractor (K)", &particlesPerAttractorK, 1, MAX_PARTICLES_PER_ATTRACTOR / 1024)) {
+				setParticleCount(particlesPerAttractorK * 1024);
+			}
+			overlay->text("%d particles", numParticles);
+			overlay->comboBox("Force calculation", &forceMode, { "Tiled", "Barnes-Hut" });
+			if (workgroupSizes.size() > 1) {
+				std::vector<std::string> workgroupSizeNames;
+				for (auto size : workgroupSizes) {
+					workgroupSizeNames.push_back(std::to_string(size));
+				}
+				int32_t index = workgroupSizeIndex;
+				if (overlay->comboBox("Workgroup size", &index, workgroupSizeNames)) {
+					setWorkgroupSize(index);
+				}
+			}
+			if (forceMode == ForceModeBarnesHut) {
+				overlay->sliderFloat("Opening angle", &compute.ubo.theta, 0.0f, 1.5f);
+				overlay->text("Octree depth: %d", compute.ubo.treeDepth);
+			}
+		}
+		// Compare the step timings of both modes to find the particle count at which Barnes-Hut becomes faster
+		if (!compute.profiler.getScopes().empty()) {
+			if (overlay->header("Compute timings")) {
+				for (auto& scope : compute.profiler.getScopes()) {
+					overlay->text("%s: %.3f ms", scope.name.c_str(), scope.averageTime);
+				}
+			}
+		}
+		if (overlay->header("Async compute")) {
+			overlay->text("Compute queue family: %d (%s)", asyncCompute.getQueueFamilyIndex(), asyncCompute.hasDedicatedQueue() ? "dedicated" : "shared with graphics");
+			if (asyncCompute.usesTimelineSemaphores()) {
+				overlay->checkBox("Overlap compute and graphics", &overlapCompute);
+			}
+			else {
+				overlay->text("No timeline semaphores, steps are serialized");
+			}
+		}
 	}
 };
 
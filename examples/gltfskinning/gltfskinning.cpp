@@ -44,17 +44,18 @@ VulkanglTFModel::~VulkanglTFModel()
 	vkFreeMemory(vulkanDevice->logicalDevice, vertices.memory, nullptr);
 	vkDestroyBuffer(vulkanDevice->logicalDevice, indices.buffer, nullptr);
 	vkFreeMemory(vulkanDevice->logicalDevice, indices.memory, nullptr);
-	for (Image image : images)
+	for (Image& image : images)
 	{
-		vkDestroyImageView(vulkanDevice->logicalDevice, image.texture.view, nullptr);
-		vkDestroyImage(vulkanDevice->logicalDevice, image.texture.image, nullptr);
-		vkDestroySampler(vulkanDevice->logicalDevice, image.texture.sampler, nullptr);
-		vkFreeMemory(vulkanDevice->logicalDevice, image.texture.deviceMemory, nullptr);
+		image.texture.destroy();
 	}
-	for (Skin skin : skins)
+	for (Skin &skin : skins)
 	{
-		skin.ssbo.destroy();
+		for (vks::Buffer &ssbo : skin.ssbo)
+		{
+			ssbo.destroy();
+		}
 	}
+	skinnedVertices.destroy();
 }
 
 /*
@@ -201,13 +202,18 @@ void VulkanglTFModel::loadSkins(tinygltf::Model &input)
 
 			// Store inverse bind matrices for this skin in a shader storage buffer object
 			// To keep this sample simple, we create a host visible shader storage buffer
-			VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-			    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			    &skins[i].ssbo,
-			    sizeof(glm::mat4) * skins[i].inverseBindMatrices.size(),
-			    skins[i].inverseBindMatrices.data()));
-			VK_CHECK_RESULT(skins[i].ssbo.map());
+			// As the joint matrices are updated while previous frames may still be in flight, there is one buffer per frame
+			skins[i].ssbo.resize(frameCount);
+			for (vks::Buffer &ssbo : skins[i].ssbo)
+			{
+				VK_CHECK_RESULT(vulkanDevice->createBuffer(
+				    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				    &ssbo,
+				    sizeof(glm::mat4) * skins[i].inverseBindMatrices.size(),
+				    skins[i].inverseBindMatrices.data()));
+				VK_CHECK_RESULT(ssbo.map());
+			}
 		}
 	}
 }
@@ -458,6 +464,8 @@ void VulkanglTFModel::loadNode(const tinygltf::Node &inputNode, const tinygltf::
 			primitive.firstIndex    = firstIndex;
 			primitive.indexCount    = indexCount;
 			primitive.materialIndex = glTFPrimitive.material;
+			primitive.firstVertex   = vertexStart;
+			primitive.vertexCount   = static_cast<uint32_t>(vertexBuffer.size()) - vertexStart;
 			node->mesh.primitives.push_back(primitive);
 		}
 	}
@@ -490,13 +498,13 @@ glm::mat4 VulkanglTFModel::getNodeMatrix(VulkanglTFModel::Node *node)
 }
 
 // POI: Update the joint matrices from the current animation frame and pass them to the GPU
-void VulkanglTFModel::updateJoints(VulkanglTFModel::Node *node)
+void VulkanglTFModel::updateJoints(VulkanglTFModel::Node *node, uint32_t frameIndex)
 {
 	if (node->skin > -1)
 	{
 		// Update the joint matrices
 		glm::mat4              inverseTransform = glm::inverse(getNodeMatrix(node));
-		Skin                   skin             = skins[node->skin];
+		Skin &                 skin             = skins[node->skin];
 		size_t                 numJoints        = (uint32_t) skin.joints.size();
 		std::vector<glm::mat4> jointMatrices(numJoints);
 		for (size_t i = 0; i < numJoints; i++)
@@ -504,18 +512,18 @@ void VulkanglTFModel::updateJoints(VulkanglTFModel::Node *node)
 			jointMatrices[i] = getNodeMatrix(skin.joints[i]) * skin.inverseBindMatrices[i];
 			jointMatrices[i] = inverseTransform * jointMatrices[i];
 		}
-		// Update ssbo
-		skin.ssbo.copyTo(jointMatrices.data(), jointMatrices.size() * sizeof(glm::mat4));
+		// Update the ssbo of the current frame
+		skin.ssbo[frameIndex].copyTo(jointMatrices.data(), jointMatrices.size() * sizeof(glm::mat4));
 	}
 
 	for (auto &child : node->children)
 	{
-		updateJoints(child);
+		updateJoints(child, frameIndex);
 	}
 }
 
 // POI: Update the current animation
-void VulkanglTFModel::updateAnimation(float deltaTime)
+void VulkanglTFModel::updateAnimation(float deltaTime, uint32_t frameIndex)
 {
 	if (activeAnimation > static_cast<uint32_t>(animations.size()) - 1)
 	{
@@ -573,7 +581,43 @@ void VulkanglTFModel::updateAnimation(float deltaTime)
 	}
 	for (auto &node : nodes)
 	{
-		updateJoints(node);
+		updateJoints(node, frameIndex);
+	}
+}
+
+/*
+	glTF compute skinning functions
+*/
+
+// POI: Skin the vertices of all primitives of a node using the joint matrices of the node's skin
+void VulkanglTFModel::skinNode(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, VulkanglTFModel::Node *node, uint32_t frameIndex)
+{
+	if ((node->skin > -1) && (node->mesh.primitives.size() > 0))
+	{
+		// Bind SSBO with skin data of the current frame for this node to set 1
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 1, 1, &skins[node->skin].descriptorSets[frameIndex], 0, nullptr);
+		for (VulkanglTFModel::Primitive &primitive : node->mesh.primitives)
+		{
+			// Pass the primitive's vertex range to the compute shader
+			const uint32_t vertexRange[2] = {primitive.firstVertex, primitive.vertexCount};
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(vertexRange), vertexRange);
+			vkCmdDispatch(commandBuffer, (primitive.vertexCount + 63) / 64, 1, 1);
+		}
+	}
+	for (auto &child : node->children)
+	{
+		skinNode(commandBuffer, pipelineLayout, child, frameIndex);
+	}
+}
+
+// Record the compute skinning pass for all skinned nodes, the compute skinning pipeline needs to be bound
+void VulkanglTFModel::skinVertices(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t frameIndex)
+{
+	// Input and output vertex buffers are bound to set 0
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &skinningDescriptorSet, 0, nullptr);
+	for (auto &node : nodes)
+	{
+		skinNode(commandBuffer, pipelineLayout, node, frameIndex);
 	}
 }
 
@@ -582,7 +626,7 @@ void VulkanglTFModel::updateAnimation(float deltaTime)
 */
 
 // Draw a single node including child nodes (if present)
-void VulkanglTFModel::drawNode(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, VulkanglTFModel::Node node)
+void VulkanglTFModel::drawNode(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, VulkanglTFModel::Node node, uint32_t frameIndex, bool preSkinned)
 {
 	if (node.mesh.primitives.size() > 0)
 	{
@@ -597,8 +641,11 @@ void VulkanglTFModel::drawNode(VkCommandBuffer commandBuffer, VkPipelineLayout p
 		}
 		// Pass the final matrix to the vertex shader using push constants
 		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &nodeMatrix);
-		// Bind SSBO with skin data for this node to set 1
-		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &skins[node.skin].descriptorSet, 0, nullptr);
+		// Bind SSBO with skin data of the current frame for this node to set 1 (not required if the vertices have already been skinned)
+		if (!preSkinned)
+		{
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &skins[node.skin].descriptorSets[frameIndex], 0, nullptr);
+		}
 		for (VulkanglTFModel::Primitive &primitive : node.mesh.primitives)
 		{
 			if (primitive.indexCount > 0)
@@ -613,21 +660,21 @@ void VulkanglTFModel::drawNode(VkCommandBuffer commandBuffer, VkPipelineLayout p
 	}
 	for (auto &child : node.children)
 	{
-		drawNode(commandBuffer, pipelineLayout, *child);
+		drawNode(commandBuffer, pipelineLayout, *child, frameIndex, preSkinned);
 	}
 }
 
 // Draw the glTF scene starting at the top-level-nodes
-void VulkanglTFModel::draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout)
+void VulkanglTFModel::draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t frameIndex, bool preSkinned)
 {
 	// All vertices and indices are stored in single buffers, so we only need to bind once
 	VkDeviceSize offsets[1] = {0};
-	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertices.buffer, offsets);
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, preSkinned ? &skinnedVertices.buffer : &vertices.buffer, offsets);
 	vkCmdBindIndexBuffer(commandBuffer, indices.buffer, 0, VK_INDEX_TYPE_UINT32);
 	// Render all nodes at top-level
 	for (auto &node : nodes)
 	{
-		drawNode(commandBuffer, pipelineLayout, *node);
+		drawNode(commandBuffer, pipelineLayout, *node, frameIndex, preSkinned);
 	}
 }
 
@@ -646,22 +693,36 @@ VulkanExample::VulkanExample() :
 	camera.setPosition(glm::vec3(0.0f, 0.75f, -2.0f));
 	camera.setRotation(glm::vec3(0.0f, 0.0f, 0.0f));
 	camera.setPerspective(60.0f, (float) width / (float) height, 0.1f, 256.0f);
+	// Uniform data and joint matrices are kept per frame, so the CPU can prepare the next frame while the GPU is still rendering
+	multipleFramesInFlight = true;
 }
 
 VulkanExample::~VulkanExample()
 {
 	vkDestroyPipeline(device, pipelines.solid, nullptr);
+	vkDestroyPipeline(device, pipelines.solidPreSkinned, nullptr);
 	if (pipelines.wireframe != VK_NULL_HANDLE)
 	{
 		vkDestroyPipeline(device, pipelines.wireframe, nullptr);
+		vkDestroyPipeline(device, pipelines.wireframePreSkinned, nullptr);
 	}
+	vkDestroyPipeline(device, skinningPass.pipeline, nullptr);
+	vkDestroyPipelineLayout(device, skinningPass.pipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(device, skinningPass.descriptorSetLayout, nullptr);
+
+	vkDestroyPipeline(device, instanced.pipeline, nullptr);
+	vkDestroyPipelineLayout(device, instanced.pipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(device, instanced.descriptorSetLayout, nullptr);
 
 	vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 	vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.matrices, nullptr);
 	vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.textures, nullptr);
 	vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.jointMatrices, nullptr);
 
-	shaderData.buffer.destroy();
+	for (vks::Buffer &buffer : shaderData.buffers)
+	{
+		buffer.destroy();
+	}
 }
 
 void VulkanExample::getEnabledFeatures()
@@ -673,13 +734,12 @@ void VulkanExample::getEnabledFeatures()
 	};
 }
 
-void VulkanExample::buildCommandBuffers()
+void VulkanExample::recordCommandBuffer()
 {
 	VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
 	VkClearValue clearValues[2];
-	clearValues[0].color = {{0.25f, 0.25f, 0.25f, 1.0f}};
-	;
+	clearValues[0].color        = {{0.25f, 0.25f, 0.25f, 1.0f}};
 	clearValues[1].depthStencil = {1.0f, 0};
 
 	VkRenderPassBeginInfo renderPassBeginInfo    = vks::initializers::renderPassBeginInfo();
@@ -690,24 +750,83 @@ void VulkanExample::buildCommandBuffers()
 	renderPassBeginInfo.renderArea.extent.height = height;
 	renderPassBeginInfo.clearValueCount          = 2;
 	renderPassBeginInfo.pClearValues             = clearValues;
+	renderPassBeginInfo.framebuffer              = frameBuffers[currentBuffer];
 
 	const VkViewport viewport = vks::initializers::viewport((float) width, (float) height, 0.0f, 1.0f);
 	const VkRect2D   scissor  = vks::initializers::rect2D(width, height, 0, 0);
 
-	for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
-	{
-		renderPassBeginInfo.framebuffer = frameBuffers[i];
-		VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
-		vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-		vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-		vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
-		// Bind scene matrices descriptor to set 0
-		vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
-		vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, wireframe ? pipelines.wireframe : pipelines.solid);
-		glTFModel.draw(drawCmdBuffers[i], pipelineLayout);
-		drawUI(drawCmdBuffers[i]);
-		vkCmdEndRenderPass(drawCmdBuffers[i]);
-		VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
+	// The command buffer of the current frame in flight is re-recorded every frame, as it references that frame's descriptor sets
+	VkCommandBuffer commandBuffer = frames[currentFrame].commandBuffer;
+	VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufInfo));
+
+	// POI: Skin all vertices once in a compute pass, all following passes draw the skinned vertices
+	if (computeSkinning)
+	{
+		VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
+		bufferBarrier.srcQueueFamilyIndex   = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.dstQueueFamilyIndex   = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.buffer                = glTFModel.skinnedVertices.buffer;
+		bufferBarrier.size                  = VK_WHOLE_SIZE;
+		// The previous frame needs to have finished reading the skinned vertices before they are overwritten
+		bufferBarrier.srcAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, skinningPass.pipeline);
+		glTFModel.skinVertices(commandBuffer, skinningPass.pipelineLayout, currentFrame);
+		// Make the skinned vertices visible to the vertex input stage
+		bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+	}
+
+	vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+	// Bind scene matrices descriptor to set 0
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &shaderData.descriptorSets[currentFrame], 0, nullptr);
+	if (computeSkinning)
+	{
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, wireframe ? pipelines.wireframePreSkinned : pipelines.solidPreSkinned);
+	}
+	else
+	{
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, wireframe ? pipelines.wireframe : pipelines.solid);
+	}
+	if (instancedAnimation)
+	{
+		drawInstances(commandBuffer);
+	}
+	else
+	{
+		glTFModel.draw(commandBuffer, pipelineLayout, currentFrame, computeSkinning);
+	}
+	drawUI(commandBuffer);
+	vkCmdEndRenderPass(commandBuffer);
+	VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+}
+
+// POI: Draws all instances of the instanced animation, each skinned mesh of an instance reads its joint matrices from its own range of the shared joint buffer
+void VulkanExample::drawInstances(VkCommandBuffer commandBuffer)
+{
+	const vkglTF::AnimationInstances &animationInstances = instanced.animationInstances;
+	const uint32_t                    meshCount          = static_cast<uint32_t>(animationInstances.skinnedMeshes.size());
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, instanced.pipeline);
+	instanced.model.bindBuffers(commandBuffer);
+	for (uint32_t i = 0; i < static_cast<uint32_t>(animationInstances.instances.size()); i++)
+	{
+		for (uint32_t j = 0; j < meshCount; j++)
+		{
+			// Joint matrices are relative to the mesh node, so the mesh node's matrix is applied on top of the instance's matrix
+			const glm::mat4 modelMatrix = instanced.instanceMatrices[i] * animationInstances.meshMatrices[i * meshCount + j];
+			vkCmdPushConstants(commandBuffer, instanced.pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &modelMatrix);
+			const uint32_t dynamicOffset = animationInstances.getMeshOffset(currentFrame, i, j);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, instanced.pipelineLayout, 1, 1, &instanced.descriptorSet, 1, &dynamicOffset);
+			for (const vkglTF::Primitive *primitive : animationInstances.skinnedMeshes[j].node->mesh->primitives)
+			{
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, instanced.pipelineLayout, 2, 1, &primitive->material.descriptorSet, 0, nullptr);
+				vkCmdDrawIndexed(commandBuffer, primitive->indexCount, 1, primitive->firstIndex, 0, 0);
+			}
+		}
 	}
 }
 
@@ -729,6 +848,7 @@ void VulkanExample::loadglTFFile(std::string filename)
 	// Pass some Vulkan resources required for setup and rendering to the glTF model loading class
 	glTFModel.vulkanDevice = vulkanDevice;
 	glTFModel.copyQueue    = queue;
+	glTFModel.frameCount   = maxFramesInFlight;
 
 	std::vector<uint32_t>                indexBuffer;
 	std::vector<VulkanglTFModel::Vertex> vertexBuffer;
@@ -747,9 +867,12 @@ void VulkanExample::loadglTFFile(std::string filename)
 		glTFModel.loadSkins(glTFInput);
 		glTFModel.loadAnimations(glTFInput);
 		// Calculate initial pose
-		for (auto node : glTFModel.nodes)
+		for (uint32_t i = 0; i < maxFramesInFlight; i++)
 		{
-			glTFModel.updateJoints(node);
+			for (auto node : glTFModel.nodes)
+			{
+				glTFModel.updateJoints(node, i);
+			}
 		}
 	}
 	else
@@ -762,6 +885,7 @@ void VulkanExample::loadglTFFile(std::string filename)
 	size_t vertexBufferSize = vertexBuffer.size() * sizeof(VulkanglTFModel::Vertex);
 	size_t indexBufferSize  = indexBuffer.size() * sizeof(uint32_t);
 	glTFModel.indices.count = static_cast<uint32_t>(indexBuffer.size());
+	glTFModel.vertexCount   = static_cast<uint32_t>(vertexBuffer.size());
 
 	struct StagingBuffer
 	{
@@ -787,8 +911,9 @@ void VulkanExample::loadglTFFile(std::string filename)
 	    indexBuffer.data()));
 
 	// Create device local buffers (target)
+	// The vertex buffer is also read as a storage buffer by the compute skinning pass
 	VK_CHECK_RESULT(vulkanDevice->createBuffer(
-	    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+	    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 	    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 	    vertexBufferSize,
 	    &glTFModel.vertices.buffer,
@@ -814,6 +939,31 @@ void VulkanExample::loadglTFFile(std::string filename)
 	vkFreeMemory(device, vertexStaging.memory, nullptr);
 	vkDestroyBuffer(device, indexStaging.buffer, nullptr);
 	vkFreeMemory(device, indexStaging.memory, nullptr);
+
+	// POI: Output buffer of the compute skinning pass
+	// It's initialized with the unskinned vertices, so nodes without a skin can be drawn from the same buffer
+	static_assert(sizeof(VulkanglTFModel::Vertex) == 19 * sizeof(float), "Vertex layout must match the input stride of the skinning compute shader");
+	static_assert(sizeof(VulkanglTFModel::SkinnedVertex) == 11 * sizeof(float), "Skinned vertex layout must match the output stride of the skinning compute shader");
+	std::vector<VulkanglTFModel::SkinnedVertex> skinnedVertexBuffer(vertexBuffer.size());
+	for (size_t i = 0; i < vertexBuffer.size(); i++)
+	{
+		skinnedVertexBuffer[i] = {vertexBuffer[i].pos, vertexBuffer[i].normal, vertexBuffer[i].uv, vertexBuffer[i].color};
+	}
+	const VkDeviceSize skinnedVertexBufferSize = skinnedVertexBuffer.size() * sizeof(VulkanglTFModel::SkinnedVertex);
+	vks::Buffer        skinnedVertexStaging;
+	VK_CHECK_RESULT(vulkanDevice->createBuffer(
+	    VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+	    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	    &skinnedVertexStaging,
+	    skinnedVertexBufferSize,
+	    skinnedVertexBuffer.data()));
+	VK_CHECK_RESULT(vulkanDevice->createBuffer(
+	    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+	    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+	    &glTFModel.skinnedVertices,
+	    skinnedVertexBufferSize));
+	vulkanDevice->copyBuffer(&skinnedVertexStaging, &glTFModel.skinnedVertices, queue);
+	skinnedVertexStaging.destroy();
 }
 
 void VulkanExample::setupDescriptors()
@@ -823,14 +973,17 @@ void VulkanExample::setupDescriptors()
 	*/
 
 	std::vector<VkDescriptorPoolSize> poolSizes = {
-	    vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1),
+	    // One scene ubo per frame in flight
+	    vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, maxFramesInFlight),
 	    // One combined image sampler per material image/texture
 	    vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, static_cast<uint32_t>(glTFModel.images.size())),
-	    // One ssbo per skin
-	    vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, static_cast<uint32_t>(glTFModel.skins.size())),
+	    // One ssbo per skin and frame in flight + input and output vertices of the compute skinning pass
+	    vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, static_cast<uint32_t>(glTFModel.skins.size()) * maxFramesInFlight + 2),
+	    // One dynamic ssbo for the joint matrices of all animation instances
+	    vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1),
 	};
-	// Number of descriptor sets = One for the scene ubo + one per image + one per skin
-	const uint32_t             maxSetCount        = static_cast<uint32_t>(glTFModel.images.size()) + static_cast<uint32_t>(glTFModel.skins.size()) + 1;
+	// Number of descriptor sets = One for the scene ubo + one per image + one per skin (scene ubo and skins are per frame in flight) + one for the compute skinning pass + one for the animation instances
+	const uint32_t             maxSetCount        = static_cast<uint32_t>(glTFModel.images.size()) + (static_cast<uint32_t>(glTFModel.skins.size()) + 1) * maxFramesInFlight + 2;
 	VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, maxSetCount);
 	VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
 
@@ -846,8 +999,8 @@ void VulkanExample::setupDescriptors()
 	setLayoutBinding = vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 0);
 	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &descriptorSetLayouts.textures));
 
-	// Descriptor set layout for passing skin joint matrices
-	setLayoutBinding = vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0);
+	// Descriptor set layout for passing skin joint matrices (also used by the compute skinning pass)
+	setLayoutBinding = vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT, 0);
 	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &descriptorSetLayouts.jointMatrices));
 
 	// The pipeline layout uses three sets:
@@ -867,19 +1020,54 @@ void VulkanExample::setupDescriptors()
 	pipelineLayoutCI.pPushConstantRanges    = &pushConstantRange;
 	VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &pipelineLayout));
 
-	// Descriptor set for scene matrices
-	VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayouts.matrices, 1);
-	VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet));
-	VkWriteDescriptorSet writeDescriptorSet = vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &shaderData.buffer.descriptor);
-	vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
+	// Descriptor sets for scene matrices
+	shaderData.descriptorSets.resize(maxFramesInFlight);
+	for (uint32_t i = 0; i < maxFramesInFlight; i++)
+	{
+		const VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayouts.matrices, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &shaderData.descriptorSets[i]));
+		VkWriteDescriptorSet writeDescriptorSet = vks::initializers::writeDescriptorSet(shaderData.descriptorSets[i], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &shaderData.buffers[i].descriptor);
+		vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
+	}
 
-	// Descriptor set for glTF model skin joint matrices
+	// Descriptor sets for glTF model skin joint matrices
 	for (auto &skin : glTFModel.skins)
 	{
-		const VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayouts.jointMatrices, 1);
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &skin.descriptorSet));
-		VkWriteDescriptorSet writeDescriptorSet = vks::initializers::writeDescriptorSet(skin.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &skin.ssbo.descriptor);
-		vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
+		skin.descriptorSets.resize(maxFramesInFlight);
+		for (uint32_t i = 0; i < maxFramesInFlight; i++)
+		{
+			const VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayouts.jointMatrices, 1);
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &skin.descriptorSets[i]));
+			VkWriteDescriptorSet writeDescriptorSet = vks::initializers::writeDescriptorSet(skin.descriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &skin.ssbo[i].descriptor);
+			vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
+		}
+	}
+
+	// POI: Compute skinning pass
+	// Set 0 = Input and output vertices (CS)
+	// Set 1 = Joint matrices (CS)
+	const std::vector<VkDescriptorSetLayoutBinding> skinningSetLayoutBindings = {
+	    vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+	    vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+	};
+	VkDescriptorSetLayoutCreateInfo skinningSetLayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(skinningSetLayoutBindings);
+	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &skinningSetLayoutCI, nullptr, &skinningPass.descriptorSetLayout));
+	const std::array<VkDescriptorSetLayout, 2> skinningSetLayouts = {skinningPass.descriptorSetLayout, descriptorSetLayouts.jointMatrices};
+	VkPipelineLayoutCreateInfo                 skinningPipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(skinningSetLayouts.data(), static_cast<uint32_t>(skinningSetLayouts.size()));
+	// The vertex range of the primitive to skin is passed via push constants
+	VkPushConstantRange skinningPushConstantRange     = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, 2 * sizeof(uint32_t), 0);
+	skinningPipelineLayoutCI.pushConstantRangeCount = 1;
+	skinningPipelineLayoutCI.pPushConstantRanges    = &skinningPushConstantRange;
+	VK_CHECK_RESULT(vkCreatePipelineLayout(device, &skinningPipelineLayoutCI, nullptr, &skinningPass.pipelineLayout));
+	{
+		const VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &skinningPass.descriptorSetLayout, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &glTFModel.skinningDescriptorSet));
+		VkDescriptorBufferInfo                  inputVertices     = {glTFModel.vertices.buffer, 0, VK_WHOLE_SIZE};
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+		    vks::initializers::writeDescriptorSet(glTFModel.skinningDescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &inputVertices),
+		    vks::initializers::writeDescriptorSet(glTFModel.skinningDescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &glTFModel.skinnedVertices.descriptor),
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 	}
 
 	// Descriptor sets for glTF model materials
@@ -890,6 +1078,28 @@ void VulkanExample::setupDescriptors()
 		VkWriteDescriptorSet writeDescriptorSet = vks::initializers::writeDescriptorSet(image.descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &image.texture.descriptor);
 		vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
 	}
+
+	// POI: Instanced animation
+	// Set 0 = Scene matrices (VS)
+	// Set 1 = Joint matrices of all instances, the range of the skinned mesh to draw is selected with a dynamic offset (VS)
+	// Set 2 = Material texture, allocated by the glTF loader (FS)
+	setLayoutBinding = vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT, 0);
+	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &instanced.descriptorSetLayout));
+	const std::array<VkDescriptorSetLayout, 3> instancedSetLayouts = {
+	    descriptorSetLayouts.matrices,
+	    instanced.descriptorSetLayout,
+	    vkglTF::descriptorSetLayoutImage};
+	VkPipelineLayoutCreateInfo instancedPipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(instancedSetLayouts.data(), static_cast<uint32_t>(instancedSetLayouts.size()));
+	instancedPipelineLayoutCI.pushConstantRangeCount     = 1;
+	instancedPipelineLayoutCI.pPushConstantRanges        = &pushConstantRange;
+	VK_CHECK_RESULT(vkCreatePipelineLayout(device, &instancedPipelineLayoutCI, nullptr, &instanced.pipelineLayout));
+	{
+		const VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &instanced.descriptorSetLayout, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &instanced.descriptorSet));
+		const VkDescriptorBufferInfo jointMatrices      = instanced.animationInstances.getMeshDescriptor();
+		VkWriteDescriptorSet         writeDescriptorSet = vks::initializers::writeDescriptorSet(instanced.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 0, &jointMatrices);
+		vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
+	}
 }
 
 void VulkanExample::preparePipelines()
@@ -949,25 +1159,89 @@ void VulkanExample::preparePipelines()
 		rasterizationStateCI.lineWidth   = 1.0f;
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.wireframe));
 	}
+
+	// POI: Pipelines for drawing the vertices skinned by the compute pass, these only read position, normal, uv and color
+	const std::vector<VkVertexInputBindingDescription> preSkinnedVertexInputBindings = {
+	    vks::initializers::vertexInputBindingDescription(0, sizeof(VulkanglTFModel::SkinnedVertex), VK_VERTEX_INPUT_RATE_VERTEX),
+	};
+	const std::vector<VkVertexInputAttributeDescription> preSkinnedVertexInputAttributes = {
+	    {0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(VulkanglTFModel::SkinnedVertex, pos)},
+	    {1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(VulkanglTFModel::SkinnedVertex, normal)},
+	    {2, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(VulkanglTFModel::SkinnedVertex, uv)},
+	    {3, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(VulkanglTFModel::SkinnedVertex, color)},
+	};
+	vertexInputStateCI.vertexBindingDescriptionCount   = static_cast<uint32_t>(preSkinnedVertexInputBindings.size());
+	vertexInputStateCI.pVertexBindingDescriptions      = preSkinnedVertexInputBindings.data();
+	vertexInputStateCI.vertexAttributeDescriptionCount = static_cast<uint32_t>(preSkinnedVertexInputAttributes.size());
+	vertexInputStateCI.pVertexAttributeDescriptions    = preSkinnedVertexInputAttributes.data();
+	const std::array<VkPipelineShaderStageCreateInfo, 2> preSkinnedShaderStages = {
+	    loadShader(getShadersPath() + "gltfskinning/preskinnedmodel.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
+	    loadShader(getShadersPath() + "gltfskinning/skinnedmodel.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT)};
+	pipelineCI.pStages = preSkinnedShaderStages.data();
+	rasterizationStateCI.polygonMode = VK_POLYGON_MODE_FILL;
+	VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.solidPreSkinned));
+	if (deviceFeatures.fillModeNonSolid)
+	{
+		rasterizationStateCI.polygonMode = VK_POLYGON_MODE_LINE;
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.wireframePreSkinned));
+	}
+
+	// POI: Pipeline for the animation instances, uses the same shaders with the vertex layout of the glTF loader
+	pipelineCI.layout                = instanced.pipelineLayout;
+	pipelineCI.pVertexInputState     = vkglTF::Vertex::getPipelineVertexInputState({vkglTF::VertexComponent::Position, vkglTF::VertexComponent::Normal, vkglTF::VertexComponent::UV, vkglTF::VertexComponent::Color, vkglTF::VertexComponent::Joint0, vkglTF::VertexComponent::Weight0});
+	pipelineCI.pStages               = shaderStages.data();
+	rasterizationStateCI.polygonMode = VK_POLYGON_MODE_FILL;
+	VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &instanced.pipeline));
+
+	// POI: Compute skinning pipeline
+	VkComputePipelineCreateInfo computePipelineCI = vks::initializers::computePipelineCreateInfo(skinningPass.pipelineLayout, 0);
+	computePipelineCI.stage                       = loadShader(getShadersPath() + "gltfskinning/skinning.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+	VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCI, nullptr, &skinningPass.pipeline));
 }
 
 void VulkanExample::prepareUniformBuffers()
 {
-	VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &shaderData.buffer, sizeof(shaderData.values)));
-	VK_CHECK_RESULT(shaderData.buffer.map());
-	updateUniformBuffers();
+	shaderData.buffers.resize(maxFramesInFlight);
+	for (vks::Buffer &buffer : shaderData.buffers)
+	{
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &buffer, sizeof(shaderData.values)));
+		VK_CHECK_RESULT(buffer.map());
+	}
 }
 
 void VulkanExample::updateUniformBuffers()
 {
 	shaderData.values.projection = camera.matrices.perspective;
 	shaderData.values.model      = camera.matrices.view;
-	memcpy(shaderData.buffer.mapped, &shaderData.values, sizeof(shaderData.values));
+	memcpy(shaderData.buffers[currentFrame].mapped, &shaderData.values, sizeof(shaderData.values));
 }
 
 void VulkanExample::loadAssets()
 {
 	loadglTFFile(getAssetPath() + "models/CesiumMan/glTF/CesiumMan.gltf");
+
+	// POI: Instanced animation
+	// Instances are placed on a grid and play the model's animation with different start times and speeds
+	instanced.model.loadFromFile(getAssetPath() + "models/CesiumMan/glTF/CesiumMan.gltf", vulkanDevice, queue);
+	const uint32_t instanceCount = InstancedAnimation::gridSize * InstancedAnimation::gridSize;
+	// The joint matrices are kept per frame in flight, so instances can be updated while the GPU still reads the previous frames
+	instanced.animationInstances.create(&instanced.model, instanceCount, maxFramesInFlight);
+	instanced.instanceMatrices.resize(instanceCount);
+	for (uint32_t i = 0; i < instanceCount; i++)
+	{
+		const float x = (static_cast<float>(i % InstancedAnimation::gridSize) - static_cast<float>(InstancedAnimation::gridSize - 1) * 0.5f) * 0.75f;
+		const float z = static_cast<float>(i / InstancedAnimation::gridSize) * 0.75f;
+		instanced.instanceMatrices[i] = glm::translate(glm::mat4(1.0f), glm::vec3(x, 0.0f, z));
+		vkglTF::AnimationInstances::Instance &instance = instanced.animationInstances.instances[i];
+		if (!instanced.model.animations.empty())
+		{
+			const vkglTF::Animation &animation = instanced.model.animations[instance.animation];
+			instance.time                      = animation.start + fmodf(static_cast<float>(i) * 0.37f, animation.end - animation.start);
+		}
+		instance.speed = 0.75f + static_cast<float>(i % 5) * 0.125f;
+	}
+	// Instances are updated in parallel, the render thread is one of the workers
+	instanced.jobSystem.setThreadCount(std::thread::hardware_concurrency());
 }
 
 void VulkanExample::prepare()
@@ -977,36 +1251,50 @@ void VulkanExample::prepare()
 	prepareUniformBuffers();
 	setupDescriptors();
 	preparePipelines();
-	buildCommandBuffers();
 	prepared = true;
 }
 
 void VulkanExample::render()
 {
-	renderFrame();
-	if (camera.updated)
+	if (!prepared)
 	{
-		updateUniformBuffers();
+		return;
 	}
-	// POI: Advance animation
-	if (!paused)
+	// Waits until the GPU has finished with the resources of the current frame in flight
+	if (!prepareFrame())
 	{
-		glTFModel.updateAnimation(frameTimer);
+		return;
 	}
-}
-
-void VulkanExample::viewChanged()
-{
+	// The current frame's buffers are no longer in use by the GPU and can be updated
 	updateUniformBuffers();
+	// POI: Advance animation
+	if (instancedAnimation)
+	{
+		instanced.animationInstances.update(paused ? 0.0f : frameTimer, currentFrame, &instanced.jobSystem);
+	}
+	else
+	{
+		glTFModel.updateAnimation(paused ? 0.0f : frameTimer, currentFrame);
+	}
+	recordCommandBuffer();
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers    = &frames[currentFrame].commandBuffer;
+	VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, frames[currentFrame].fence));
+	submitFrame();
 }
 
 void VulkanExample::OnUpdateUIOverlay(vks::UIOverlay *overlay)
 {
 	if (overlay->header("Settings"))
 	{
-		if (overlay->checkBox("Wireframe", &wireframe))
+		overlay->checkBox("Wireframe", &wireframe);
+		// Compare the cost of skinning in the vertex shader with skinning once in a compute pass
+		overlay->checkBox("Compute skinning", &computeSkinning);
+		// Draws a crowd of instances animated in parallel, compute skinning and wireframe only apply to the single model
+		overlay->checkBox("Instanced animation", &instancedAnimation);
+		if (instancedAnimation)
 		{
-			buildCommandBuffers();
+			overlay->text("%d instances", static_cast<int>(instanced.animationInstances.instances.size()));
 		}
 	}
 }
@@ -27,13 +27,9 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
-#define TINYGLTF_IMPLEMENTATION
-#define STB_IMAGE_IMPLEMENTATION
-#define TINYGLTF_NO_STB_IMAGE_WRITE
-#ifdef VK_USE_PLATFORM_ANDROID_KHR
-#	define TINYGLTF_ANDROID_LOAD_FROM_ASSETS
-#endif
-#include "tiny_gltf.h"
+// tinygltf is implemented by the base library's glTF loader, which is also used for the instanced animation
+#include "VulkanglTFModel.h"
+#include "threadpool.hpp"
 
 #include "vulkanexamplebase.h"
 #include <vulkan/vulkan.h>
@@ -89,6 +85,9 @@ class VulkanglTFModel
 		uint32_t firstIndex;
 		uint32_t indexCount;
 		int32_t  materialIndex;
+		// Vertex range of the primitive, used by the compute skinning pass
+		uint32_t firstVertex;
+		uint32_t vertexCount;
 	};
 
 	struct Mesh
@@ -120,6 +119,15 @@ class VulkanglTFModel
 		glm::vec4 jointWeights;
 	};
 
+	// Vertex written by the compute skinning pass, joint data is no longer required
+	struct SkinnedVertex
+	{
+		glm::vec3 pos;
+		glm::vec3 normal;
+		glm::vec2 uv;
+		glm::vec3 color;
+	};
+
 	/*
 		Skin structure
 	*/
@@ -130,8 +138,9 @@ class VulkanglTFModel
 		Node *                 skeletonRoot = nullptr;
 		std::vector<glm::mat4> inverseBindMatrices;
 		std::vector<Node *>    joints;
-		vks::Buffer            ssbo;
-		VkDescriptorSet        descriptorSet;
+		// Joint matrices are updated every frame, so each frame in flight gets its own buffer and descriptor set
+		std::vector<vks::Buffer>     ssbo;
+		std::vector<VkDescriptorSet> descriptorSets;
 	};
 
 	/*
@@ -170,6 +179,12 @@ class VulkanglTFModel
 	std::vector<Animation> animations;
 
 	uint32_t activeAnimation = 0;
+	uint32_t frameCount      = 1;
+	uint32_t vertexCount     = 0;
+
+	// POI: Output of the compute skinning pass, used by all passes drawing the model instead of skinning in the vertex shader
+	vks::Buffer     skinnedVertices;
+	VkDescriptorSet skinningDescriptorSet = VK_NULL_HANDLE;
 
 	~VulkanglTFModel();
 	void      loadImages(tinygltf::Model &input);
@@ -181,20 +196,28 @@ class VulkanglTFModel
 	void      loadAnimations(tinygltf::Model &input);
 	void      loadNode(const tinygltf::Node &inputNode, const tinygltf::Model &input, VulkanglTFModel::Node *parent, uint32_t nodeIndex, std::vector<uint32_t> &indexBuffer, std::vector<VulkanglTFModel::Vertex> &vertexBuffer);
 	glm::mat4 getNodeMatrix(VulkanglTFModel::Node *node);
-	void      updateJoints(VulkanglTFModel::Node *node);
-	void      updateAnimation(float deltaTime);
-	void      drawNode(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, VulkanglTFModel::Node node);
-	void      draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout);
+	void      updateJoints(VulkanglTFModel::Node *node, uint32_t frameIndex);
+	void      updateAnimation(float deltaTime, uint32_t frameIndex);
+	void      skinNode(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, VulkanglTFModel::Node *node, uint32_t frameIndex);
+	void      skinVertices(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t frameIndex);
+	void      drawNode(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, VulkanglTFModel::Node node, uint32_t frameIndex, bool preSkinned);
+	void      draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t frameIndex, bool preSkinned = false);
 };
 
 class VulkanExample : public VulkanExampleBase
 {
   public:
 	bool wireframe = false;
+	// POI: If enabled, vertices are skinned once per frame in a compute pass instead of in the vertex shader
+	bool computeSkinning = false;
+	// POI: If enabled, a crowd of model instances is drawn, each playing the animation at its own time and speed
+	bool instancedAnimation = false;
 
 	struct ShaderData
 	{
-		vks::Buffer buffer;
+		// One uniform buffer (and descriptor set) per frame in flight
+		std::vector<vks::Buffer>     buffers;
+		std::vector<VkDescriptorSet> descriptorSets;
 		struct Values
 		{
 			glm::mat4 projection;
@@ -208,23 +231,48 @@ class VulkanExample : public VulkanExampleBase
 	{
 		VkPipeline solid;
 		VkPipeline wireframe = VK_NULL_HANDLE;
+		// Pipelines for drawing vertices skinned by the compute pass
+		VkPipeline solidPreSkinned;
+		VkPipeline wireframePreSkinned = VK_NULL_HANDLE;
 	} pipelines;
 
+	struct SkinningPass
+	{
+		VkDescriptorSetLayout descriptorSetLayout;
+		VkPipelineLayout      pipelineLayout;
+		VkPipeline            pipeline;
+	} skinningPass;
+
 	struct DescriptorSetLayouts
 	{
 		VkDescriptorSetLayout matrices;
 		VkDescriptorSetLayout textures;
 		VkDescriptorSetLayout jointMatrices;
 	} descriptorSetLayouts;
-	VkDescriptorSet descriptorSet;
 
 	VulkanglTFModel glTFModel;
 
+	// POI: The instanced animation uses the base library's glTF loader and animates all instances in parallel
+	// The joint matrices of all instances are stored in a single buffer, each skinned mesh of an instance is selected with a dynamic offset
+	struct InstancedAnimation
+	{
+		static const uint32_t gridSize = 8;
+		vkglTF::Model              model;
+		vkglTF::AnimationInstances animationInstances;
+		vks::JobSystem             jobSystem;
+		std::vector<glm::mat4>     instanceMatrices;
+		VkDescriptorSetLayout      descriptorSetLayout;
+		VkDescriptorSet            descriptorSet;
+		VkPipelineLayout           pipelineLayout;
+		VkPipeline                 pipeline;
+	} instanced;
+
 	VulkanExample();
 	~VulkanExample();
 	void         loadglTFFile(std::string filename);
 	virtual void getEnabledFeatures();
-	void         buildCommandBuffers();
+	void         recordCommandBuffer();
+	void         drawInstances(VkCommandBuffer commandBuffer);
 	void         loadAssets();
 	void         setupDescriptors();
 	void         preparePipelines();
@@ -232,6 +280,5 @@ class VulkanExample : public VulkanExampleBase
 	void         updateUniformBuffers();
 	void         prepare();
 	virtual void render();
-	virtual void viewChanged();
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay);
 };
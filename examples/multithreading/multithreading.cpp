@@ -10,6 +10,7 @@
 
 #include "threadpool.hpp"
 #include "frustum.hpp"
+#include "bvh.hpp"
 
 #include "VulkanglTFModel.h"
 
@@ -33,22 +34,32 @@ public:
 
 	struct {
 		VkPipeline phong;
+		VkPipeline phongInstanced;
 		VkPipeline starsphere;
 	} pipelines;
 
 	VkPipelineLayout pipelineLayout;
 
-	VkCommandBuffer primaryCommandBuffer;
-
 	// Secondary scene command buffers used to store backdrop and user interface
+	// These are kept per frame in flight, as they are re-recorded every frame
 	struct SecondaryCommandBuffers {
 		VkCommandBuffer background;
 		VkCommandBuffer ui;
-	} secondaryCommandBuffers;
+	};
+	std::vector<SecondaryCommandBuffers> secondaryCommandBuffers;
 
-	// Number of animated objects to be renderer
+	// Number of animated objects to be rendered
 	// by using threads and secondary command buffers
-	uint32_t numObjectsPerThread;
+	uint32_t numObjects = 512;
+	// Shared by the command line argument and the UI slider
+	const uint32_t minObjects = 1;
+	const uint32_t maxObjects = 500000;
+	int32_t objectCount = 512;
+
+	// Per object mode records one secondary command buffer per visible object and passes the object's data as push constants
+	// Instanced mode streams the object data into a per-frame instance buffer and records one instanced draw per batch of visible objects
+	enum RenderMode { RenderModePerObject = 0, RenderModeInstanced = 1 };
+	int32_t renderMode = RenderModePerObject;
 
 	// Multi threaded stuff
 	// Max. number of concurrent threads
@@ -61,6 +72,14 @@ public:
 		glm::vec3 color;
 	};
 
+	// Secondary command buffer that is kept across frames, along with the state it has been recorded with
+	struct CachedCommandBuffer {
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		ThreadPushConstantBlock pushConstBlock;
+		uint32_t width = 0;
+		uint32_t height = 0;
+	};
+
 	struct ObjectData {
 		glm::mat4 model;
 		glm::vec3 pos;
@@ -70,29 +89,71 @@ public:
 		float scale;
 		float deltaT;
 		float stateT = 0;
-		bool visible = true;
+		bool visible = false;
+		// Secondary command buffer recorded for this object in the current frame
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		// Cached secondary command buffers, one per frame in flight as a command buffer can't be pending in multiple frames at once
+		std::vector<CachedCommandBuffer> cachedCommandBuffers;
 	};
-
+	// Per object information (position, rotation, etc.)
+	std::vector<ObjectData> objectData;
+	// One push constant block per render object
+	std::vector<ThreadPushConstantBlock> pushConstBlocks;
+
+	// Instanced mode uses the push constant block layout as per-instance vertex data
+	// One persistently mapped instance buffer per frame in flight, so the CPU can write a frame's data while the GPU reads the previous ones
+	std::vector<vks::Buffer> instanceBuffers;
+	// Number of visible objects that are written and recorded by a single job
+	uint32_t instanceBatchSize = 1024;
+	// Secondary command buffers recorded for the instance batches in the current frame
+	std::vector<VkCommandBuffer> batchCommandBuffers;
+
+	// Objects are distributed dynamically by the job system, so there is no fixed object to thread mapping
+	// Command pools must not be used by multiple threads at once, so every thread records into command buffers from its own pools
+	// Each thread has one pool per frame in flight that is reset as a whole at the start of the frame instead of resetting single command buffers
 	struct ThreadData {
-		VkCommandPool commandPool;
-		// One command buffer per render object
-		std::vector<VkCommandBuffer> commandBuffer;
-		// One push constant block per render object
-		std::vector<ThreadPushConstantBlock> pushConstBlock;
-		// Per object information (position, rotation, etc.)
-		std::vector<ObjectData> objectData;
+		std::vector<VkCommandPool> commandPools;
+		// Command buffers of this thread for each frame in flight, allocated on demand and reused after the pool has been reset
+		std::vector<std::vector<VkCommandBuffer>> commandBuffers;
+		// Number of command buffers used in the current frame
+		uint32_t usedCommandBuffers = 0;
+		// Time spent recording command buffers on this thread in the current frame in ms
+		float recordingTime = 0.0f;
+		// Number of command buffers recorded on this thread in the current frame
+		uint32_t recordedCommandBuffers = 0;
 	};
 	std::vector<ThreadData> threadData;
 
-	vks::ThreadPool threadPool;
+	// Per object mode can keep the objects' secondary command buffers and only re-record those whose content has changed
+	// Cached command buffers are allocated from pools that each serve a fixed chunk of objects, and a chunk is processed by a single job,
+	// so no pool is ever used by multiple threads at once even though the job system has no fixed object to thread mapping
+	bool reuseCommandBuffers = true;
+	const uint32_t objectsPerCachePool = 256;
+	std::vector<VkCommandPool> cachePools;
 
-	// Fence to wait for all command buffers to finish before
-	// presenting to the swap chain
-	VkFence renderFence = {};
+	vks::JobSystem jobSystem;
 
 	// View frustum for culling invisible objects
 	vks::Frustum frustum;
 
+	// Hierarchical culling walks a bounding volume hierarchy over the object's bounding spheres instead of testing each object
+	bool hierarchicalCulling = true;
+	vks::BVH bvh;
+	// Indices of the objects that passed the frustum test in the current frame
+	std::vector<uint32_t> visibleObjects;
+	// CPU times of the frame's update steps in ms
+	float updateTime = 0.0f;
+	float cullingTime = 0.0f;
+	float recordingTime = 0.0f;
+
+	// Throughput of the culling micro-benchmark in million objects per second
+	struct {
+		bool done = false;
+		float scalarSpheres = 0.0f;
+		float batchSpheres = 0.0f;
+		float batchBoxes = 0.0f;
+	} cullingBenchmark;
+
 	std::default_random_engine rndEngine;
 
 	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
@@ -103,6 +164,8 @@ public:
 		camera.setRotation(glm::vec3(0.0f));
 		camera.setRotationSpeed(0.5f);
 		camera.setPerspective(60.0f, (float)width / (float)height, 0.1f, 256.0f);
+		// Command buffers are recorded every frame, so the CPU can work on the next frame while the GPU is still busy with previous ones
+		multipleFramesInFlight = true;
 		// Get number of max. concurrent threads
 		numThreads = std::thread::hardware_concurrency();
 		assert(numThreads > 0);
@@ -111,9 +174,19 @@ public:
 #else
 		std::cout << "numThreads = " << numThreads << std::endl;
 #endif
-		threadPool.setThreadCount(numThreads);
-		numObjectsPerThread = 512 / numThreads;
+		jobSystem.setThreadCount(numThreads);
 		rndEngine.seed(benchmark.active ? 0 : (unsigned)time(nullptr));
+		// Sample specific arguments to measure how command buffer recording scales with the object count (e.g. in benchmark mode)
+		commandLineParser.add("objectcount", { "-oc", "--objectcount" }, 1, "Set the number of objects");
+		commandLineParser.add("instanced", { "--instanced" }, 0, "Render the objects with instanced draws from a streamed instance buffer");
+		commandLineParser.parse(args);
+		if (commandLineParser.isSet("objectcount")) {
+			numObjects = std::min(std::max(commandLineParser.getValueAsInt("objectcount", numObjects), (int32_t)minObjects), (int32_t)maxObjects);
+			objectCount = numObjects;
+		}
+		if (commandLineParser.isSet("instanced")) {
+			renderMode = RenderModeInstanced;
+		}
 	}
 
 	~VulkanExample()
@@ -121,16 +194,24 @@ public:
 		// Clean up used Vulkan resources
 		// Note : Inherited destructor cleans up resources stored in base class
 		vkDestroyPipeline(device, pipelines.phong, nullptr);
+		vkDestroyPipeline(device, pipelines.phongInstanced, nullptr);
 		vkDestroyPipeline(device, pipelines.starsphere, nullptr);
 
+		for (auto& instanceBuffer : instanceBuffers) {
+			instanceBuffer.destroy();
+		}
+
 		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 
 		for (auto& thread : threadData) {
-			vkFreeCommandBuffers(device, thread.commandPool, thread.commandBuffer.size(), thread.commandBuffer.data());
-			vkDestroyCommandPool(device, thread.commandPool, nullptr);
+			for (size_t i = 0; i < thread.commandPools.size(); i++) {
+				if (!thread.commandBuffers[i].empty()) {
+					vkFreeCommandBuffers(device, thread.commandPools[i], static_cast<uint32_t>(thread.commandBuffers[i].size()), thread.commandBuffers[i].data());
+				}
+				vkDestroyCommandPool(device, thread.commandPools[i], nullptr);
+			}
 		}
-
-		vkDestroyFence(device, renderFence, nullptr);
+		destroyCommandBufferCache();
 	}
 
 	float rnd(float range)
@@ -144,95 +225,184 @@ public:
 	{
 		// Since this demo updates the command buffers on each frame
 		// we don't use the per-framebuffer command buffers from the
-		// base class, and create a single primary command buffer instead
+		// base class, but the per-frame primary command buffers instead
+
+		// Create additional secondary CBs for background and ui
 		VkCommandBufferAllocateInfo cmdBufAllocateInfo =
 			vks::initializers::commandBufferAllocateInfo(
 				cmdPool,
-				VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+				VK_COMMAND_BUFFER_LEVEL_SECONDARY,
 				1);
-		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &primaryCommandBuffer));
-
-		// Create additional secondary CBs for background and ui
-		cmdBufAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
-		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &secondaryCommandBuffers.background));
-		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &secondaryCommandBuffers.ui));
+		secondaryCommandBuffers.resize(maxFramesInFlight);
+		for (auto& secondaryCommandBuffer : secondaryCommandBuffers) {
+			VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &secondaryCommandBuffer.background));
+			VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &secondaryCommandBuffer.ui));
+		}
 
 		threadData.resize(numThreads);
-
-		float maxX = std::floor(std::sqrt(numThreads * numObjectsPerThread));
-		uint32_t posX = 0;
-		uint32_t posZ = 0;
-
-		for (uint32_t i = 0; i < numThreads; i++) {
-			ThreadData *thread = &threadData[i];
-
-			// Create one command pool for each thread
+		for (auto& thread : threadData) {
+			// Create one command pool for each thread and frame in flight
+			// The command buffers are only reset by resetting the whole pool, so the pools don't need to support resetting single command buffers
 			VkCommandPoolCreateInfo cmdPoolInfo = vks::initializers::commandPoolCreateInfo();
 			cmdPoolInfo.queueFamilyIndex = swapChain.queueNodeIndex;
-			cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-			VK_CHECK_RESULT(vkCreateCommandPool(device, &cmdPoolInfo, nullptr, &thread->commandPool));
-
-			// One secondary command buffer per object that is updated by this thread
-			thread->commandBuffer.resize(numObjectsPerThread);
-			// Generate secondary command buffers for each thread
-			VkCommandBufferAllocateInfo secondaryCmdBufAllocateInfo =
-				vks::initializers::commandBufferAllocateInfo(
-					thread->commandPool,
-					VK_COMMAND_BUFFER_LEVEL_SECONDARY,
-					thread->commandBuffer.size());
-			VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &secondaryCmdBufAllocateInfo, thread->commandBuffer.data()));
-
-			thread->pushConstBlock.resize(numObjectsPerThread);
-			thread->objectData.resize(numObjectsPerThread);
-
-			for (uint32_t j = 0; j < numObjectsPerThread; j++) {
-				float theta = 2.0f * float(M_PI) * rnd(1.0f);
-				float phi = acos(1.0f - 2.0f * rnd(1.0f));
-				thread->objectData[j].pos = glm::vec3(sin(phi) * cos(theta), 0.0f, cos(phi)) * 35.0f;
-
-				thread->objectData[j].rotation = glm::vec3(0.0f, rnd(360.0f), 0.0f);
-				thread->objectData[j].deltaT = rnd(1.0f);
-				thread->objectData[j].rotationDir = (rnd(100.0f) < 50.0f) ? 1.0f : -1.0f;
-				thread->objectData[j].rotationSpeed = (2.0f + rnd(4.0f)) * thread->objectData[j].rotationDir;
-				thread->objectData[j].scale = 0.75f + rnd(0.5f);
-
-				thread->pushConstBlock[j].color = glm::vec3(rnd(1.0f), rnd(1.0f), rnd(1.0f));
+			cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+			thread.commandPools.resize(maxFramesInFlight);
+			for (auto& commandPool : thread.commandPools) {
+				VK_CHECK_RESULT(vkCreateCommandPool(device, &cmdPoolInfo, nullptr, &commandPool));
 			}
+			thread.commandBuffers.resize(maxFramesInFlight);
 		}
 
+		prepareObjects();
 	}
 
-	// Builds the secondary command buffer for each thread
-	void threadRenderCode(uint32_t threadIndex, uint32_t cmdBufferIndex, VkCommandBufferInheritanceInfo inheritanceInfo)
+	// Generates the randomly placed objects and their culling hierarchy
+	void prepareObjects()
 	{
-		ThreadData *thread = &threadData[threadIndex];
-		ObjectData *objectData = &thread->objectData[cmdBufferIndex];
+		destroyCommandBufferCache();
+		objectData.resize(numObjects);
+		pushConstBlocks.resize(numObjects);
+		// Spread larger object counts over a larger area to keep the object density constant
+		const float areaRadius = 35.0f * sqrtf((float)numObjects / 512.0f);
+		for (uint32_t i = 0; i < numObjects; i++) {
+			float theta = 2.0f * float(M_PI) * rnd(1.0f);
+			float phi = acos(1.0f - 2.0f * rnd(1.0f));
+			objectData[i].pos = glm::vec3(sin(phi) * cos(theta), 0.0f, cos(phi)) * areaRadius;
+
+			objectData[i].rotation = glm::vec3(0.0f, rnd(360.0f), 0.0f);
+			objectData[i].deltaT = rnd(1.0f);
+			objectData[i].rotationDir = (rnd(100.0f) < 50.0f) ? 1.0f : -1.0f;
+			objectData[i].rotationSpeed = (2.0f + rnd(4.0f)) * objectData[i].rotationDir;
+			objectData[i].scale = 0.75f + rnd(0.5f);
+
+			pushConstBlocks[i].color = glm::vec3(rnd(1.0f), rnd(1.0f), rnd(1.0f));
+		}
 
-		// Check visibility against view frustum using a simple sphere check based on the radius of the mesh
-		objectData->visible = frustum.checkSphere(objectData->pos, models.ufo.dimensions.radius * 0.5f);
+		// Build the culling hierarchy once, objects only move slightly so the node bounds are refit every frame instead of rebuilding the tree
+		std::vector<glm::vec4> boundingSpheres(numObjects);
+		for (uint32_t i = 0; i < numObjects; i++) {
+			boundingSpheres[i] = glm::vec4(objectData[i].pos, getObjectRadius());
+		}
+		bvh.build(boundingSpheres);
+		visibleObjects.reserve(numObjects);
 
-		if (!objectData->visible)
-		{
-			return;
+		prepareCommandBufferCache();
+	}
+
+	// Creates the command pools for the cached per-object command buffers, the command buffers are allocated on first use
+	void prepareCommandBufferCache()
+	{
+		VkCommandPoolCreateInfo cmdPoolInfo = vks::initializers::commandPoolCreateInfo();
+		cmdPoolInfo.queueFamilyIndex = swapChain.queueNodeIndex;
+		// Cached command buffers are re-recorded individually
+		cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		cachePools.resize((numObjects + objectsPerCachePool - 1) / objectsPerCachePool);
+		for (auto& cachePool : cachePools) {
+			VK_CHECK_RESULT(vkCreateCommandPool(device, &cmdPoolInfo, nullptr, &cachePool));
+		}
+		for (auto& object : objectData) {
+			object.cachedCommandBuffers.assign(maxFramesInFlight, CachedCommandBuffer());
 		}
+	}
 
-		VkCommandBufferBeginInfo commandBufferBeginInfo = vks::initializers::commandBufferBeginInfo();
-		commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
-		commandBufferBeginInfo.pInheritanceInfo = &inheritanceInfo;
+	// Destroying the pools also frees all cached command buffers
+	void destroyCommandBufferCache()
+	{
+		for (auto& cachePool : cachePools) {
+			vkDestroyCommandPool(device, cachePool, nullptr);
+		}
+		cachePools.clear();
+	}
 
-		VkCommandBuffer cmdBuffer = thread->commandBuffer[cmdBufferIndex];
+	// Creates the per-frame instance buffers, these are host visible and stay mapped for the lifetime of the buffer
+	void prepareInstanceBuffers()
+	{
+		instanceBuffers.resize(maxFramesInFlight);
+		for (auto& instanceBuffer : instanceBuffers) {
+			instanceBuffer.destroy();
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(
+				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&instanceBuffer,
+				numObjects * sizeof(ThreadPushConstantBlock)));
+			VK_CHECK_RESULT(instanceBuffer.map());
+		}
+	}
 
-		VK_CHECK_RESULT(vkBeginCommandBuffer(cmdBuffer, &commandBufferBeginInfo));
+	// Changes the number of objects, called from the UI
+	void setObjectCount(uint32_t count)
+	{
+		// The instance buffers may still be in use by frames in flight
+		vkDeviceWaitIdle(device);
+		numObjects = count;
+		prepareObjects();
+		prepareInstanceBuffers();
+	}
 
-		VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
-		vkCmdSetViewport(cmdBuffer, 0, 1, &viewport);
+	// Radius of the bounding sphere used for culling
+	float getObjectRadius()
+	{
+		return models.ufo.dimensions.radius * 0.5f;
+	}
 
-		VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
-		vkCmdSetScissor(cmdBuffer, 0, 1, &scissor);
+	// Compares the throughput of the per-object sphere test with the SIMD batch tests of the frustum class on a large set of random objects
+	void runCullingBenchmark()
+	{
+		const uint32_t objectCount = 100000;
+		const uint32_t iterations = 20;
+		std::vector<glm::vec4> spheres(objectCount);
+		std::vector<float> centerX(objectCount), centerY(objectCount), centerZ(objectCount);
+		std::vector<float> extentX(objectCount), extentY(objectCount), extentZ(objectCount);
+		for (uint32_t i = 0; i < objectCount; i++) {
+			spheres[i] = glm::vec4(rnd(200.0f) - 100.0f, rnd(200.0f) - 100.0f, rnd(200.0f) - 100.0f, 0.5f + rnd(1.0f));
+			centerX[i] = spheres[i].x;
+			centerY[i] = spheres[i].y;
+			centerZ[i] = spheres[i].z;
+			extentX[i] = extentY[i] = extentZ[i] = spheres[i].w;
+		}
+		std::vector<uint32_t> visibleIndices(objectCount);
+		uint32_t visibleScalar = 0, visibleSpheres = 0, visibleBoxes = 0;
+
+		auto throughput = [&](std::chrono::high_resolution_clock::time_point tStart) {
+			const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - tStart).count();
+			return (float)((double)objectCount * iterations / seconds / 1000000.0);
+		};
+
+		auto tStart = std::chrono::high_resolution_clock::now();
+		for (uint32_t n = 0; n < iterations; n++) {
+			visibleScalar = 0;
+			for (uint32_t i = 0; i < objectCount; i++) {
+				if (frustum.checkSphere(glm::vec3(spheres[i]), spheres[i].w)) {
+					visibleIndices[visibleScalar++] = i;
+				}
+			}
+		}
+		cullingBenchmark.scalarSpheres = throughput(tStart);
 
-		vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.phong);
+		tStart = std::chrono::high_resolution_clock::now();
+		for (uint32_t n = 0; n < iterations; n++) {
+			visibleSpheres = frustum.cullSpheres(centerX.data(), centerY.data(), centerZ.data(), extentX.data(), objectCount, visibleIndices.data());
+		}
+		cullingBenchmark.batchSpheres = throughput(tStart);
 
-		// Update
+		tStart = std::chrono::high_resolution_clock::now();
+		for (uint32_t n = 0; n < iterations; n++) {
+			visibleBoxes = frustum.cullBoxes(centerX.data(), centerY.data(), centerZ.data(), extentX.data(), extentY.data(), extentZ.data(), objectCount, visibleIndices.data());
+		}
+		cullingBenchmark.batchBoxes = throughput(tStart);
+		cullingBenchmark.done = true;
+
+		std::cout << "Culling benchmark (" << objectCount << " objects, " << vks::Frustum::getBatchInstructionSet() << "):" << std::endl;
+		std::cout << "  Scalar spheres: " << cullingBenchmark.scalarSpheres << " M objects/s (" << visibleScalar << " visible)" << std::endl;
+		std::cout << "  Batch spheres: " << cullingBenchmark.batchSpheres << " M objects/s (" << visibleSpheres << " visible)" << std::endl;
+		std::cout << "  Batch boxes: " << cullingBenchmark.batchBoxes << " M objects/s (" << visibleBoxes << " visible)" << std::endl;
+	}
+
+	// Animates a single object, called from the job system's threads
+	void updateObject(uint32_t objectIndex)
+	{
+		ObjectData *objectData = &this->objectData[objectIndex];
+		objectData->visible = false;
 		if (!paused) {
 			objectData->rotation.y += 2.5f * objectData->rotationSpeed * frameTimer;
 			if (objectData->rotation.y > 360.0f) {
@@ -243,14 +413,168 @@ public:
 				objectData->deltaT -= 1.0f;
 			objectData->pos.y = sin(glm::radians(objectData->deltaT * 360.0f)) * 2.5f;
 		}
+		bvh.updateSphere(objectIndex, objectData->pos, getObjectRadius());
+	}
 
+	// Determines the objects that are within the current view frustum
+	void cullObjects()
+	{
+		auto tStart = std::chrono::high_resolution_clock::now();
+		if (hierarchicalCulling) {
+			bvh.refit();
+			bvh.cull(frustum, visibleObjects);
+		} else {
+			// Check visibility against view frustum using a simple sphere check based on the radius of the mesh
+			visibleObjects.clear();
+			for (uint32_t i = 0; i < numObjects; i++) {
+				if (frustum.checkSphere(objectData[i].pos, getObjectRadius())) {
+					visibleObjects.push_back(i);
+				}
+			}
+		}
+		auto tEnd = std::chrono::high_resolution_clock::now();
+		cullingTime = std::chrono::duration<float, std::milli>(tEnd - tStart).count();
+	}
+
+	// Returns an unused secondary command buffer from the calling thread's pool, allocating a new one if all are in use
+	VkCommandBuffer getThreadCommandBuffer(uint32_t threadIndex)
+	{
+		ThreadData *thread = &threadData[threadIndex];
+		std::vector<VkCommandBuffer>& commandBuffers = thread->commandBuffers[currentFrame];
+		if (thread->usedCommandBuffers == commandBuffers.size()) {
+			VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(thread->commandPools[currentFrame], VK_COMMAND_BUFFER_LEVEL_SECONDARY, 1);
+			VkCommandBuffer commandBuffer;
+			VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &commandBuffer));
+			commandBuffers.push_back(commandBuffer);
+		}
+		return commandBuffers[thread->usedCommandBuffers++];
+	}
+
+	// Updates the model matrix and the push constant block of a visible object
+	void updateObjectTransform(uint32_t objectIndex)
+	{
+		ObjectData *objectData = &this->objectData[objectIndex];
 		objectData->model = glm::translate(glm::mat4(1.0f), objectData->pos);
 		objectData->model = glm::rotate(objectData->model, -sinf(glm::radians(objectData->deltaT * 360.0f)) * 0.25f, glm::vec3(objectData->rotationDir, 0.0f, 0.0f));
 		objectData->model = glm::rotate(objectData->model, glm::radians(objectData->rotation.y), glm::vec3(0.0f, objectData->rotationDir, 0.0f));
 		objectData->model = glm::rotate(objectData->model, glm::radians(objectData->deltaT * 360.0f), glm::vec3(0.0f, objectData->rotationDir, 0.0f));
 		objectData->model = glm::scale(objectData->model, glm::vec3(objectData->scale));
 
-		thread->pushConstBlock[cmdBufferIndex].mvp = matrices.projection * matrices.view * objectData->model;
+		pushConstBlocks[objectIndex].mvp = matrices.projection * matrices.view * objectData->model;
+	}
+
+	// Writes the instance data for a batch of visible objects into the current frame's instance buffer and
+	// builds a secondary command buffer that draws the whole batch with a single instanced draw, called from the job system's threads
+	void threadRenderBatch(uint32_t batchIndex, const VkCommandBufferInheritanceInfo& inheritanceInfo)
+	{
+		auto tStart = std::chrono::high_resolution_clock::now();
+		const uint32_t firstInstance = batchIndex * instanceBatchSize;
+		const uint32_t instanceCount = std::min(instanceBatchSize, static_cast<uint32_t>(visibleObjects.size()) - firstInstance);
+
+		// Batches write disjoint ranges of the mapped buffer, so no synchronization between the threads is required
+		ThreadPushConstantBlock* instanceData = static_cast<ThreadPushConstantBlock*>(instanceBuffers[currentFrame].mapped);
+		for (uint32_t i = 0; i < instanceCount; i++) {
+			const uint32_t objectIndex = visibleObjects[firstInstance + i];
+			updateObjectTransform(objectIndex);
+			instanceData[firstInstance + i] = pushConstBlocks[objectIndex];
+		}
+
+		VkCommandBufferBeginInfo commandBufferBeginInfo = vks::initializers::commandBufferBeginInfo();
+		commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		commandBufferBeginInfo.pInheritanceInfo = &inheritanceInfo;
+
+		VkCommandBuffer cmdBuffer = getThreadCommandBuffer(jobSystem.getThreadIndex());
+		batchCommandBuffers[batchIndex] = cmdBuffer;
+
+		VK_CHECK_RESULT(vkBeginCommandBuffer(cmdBuffer, &commandBufferBeginInfo));
+
+		VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+		vkCmdSetViewport(cmdBuffer, 0, 1, &viewport);
+
+		VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
+		vkCmdSetScissor(cmdBuffer, 0, 1, &scissor);
+
+		vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.phongInstanced);
+
+		VkDeviceSize offsets[1] = { 0 };
+		vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &models.ufo.vertices.buffer, offsets);
+		vkCmdBindVertexBuffers(cmdBuffer, 1, 1, &instanceBuffers[currentFrame].buffer, offsets);
+		vkCmdBindIndexBuffer(cmdBuffer, models.ufo.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+		vkCmdDrawIndexed(cmdBuffer, models.ufo.indices.count, instanceCount, 0, 0, firstInstance);
+
+		VK_CHECK_RESULT(vkEndCommandBuffer(cmdBuffer));
+
+		ThreadData& thread = threadData[jobSystem.getThreadIndex()];
+		thread.recordedCommandBuffers++;
+		thread.recordingTime += std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+	}
+
+	// Builds the secondary command buffer for a single object, called from the job system's threads
+	void threadRenderCode(uint32_t objectIndex, const VkCommandBufferInheritanceInfo& inheritanceInfo)
+	{
+		auto tStart = std::chrono::high_resolution_clock::now();
+		const uint32_t threadIndex = jobSystem.getThreadIndex();
+
+		VkCommandBuffer cmdBuffer = getThreadCommandBuffer(threadIndex);
+		objectData[objectIndex].commandBuffer = cmdBuffer;
+
+		updateObjectTransform(objectIndex);
+		recordObjectCommandBuffer(cmdBuffer, objectIndex, inheritanceInfo);
+
+		ThreadData& thread = threadData[threadIndex];
+		thread.recordedCommandBuffers++;
+		thread.recordingTime += std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+	}
+
+	// Updates the visible objects of a chunk of objects that share a cache pool, called from the job system's threads
+	// The command buffer recorded for the current frame in flight during an earlier frame is executed again if its content would be unchanged
+	void threadRenderCachedChunk(uint32_t chunkIndex, const VkCommandBufferInheritanceInfo& inheritanceInfo)
+	{
+		auto tStart = std::chrono::high_resolution_clock::now();
+		ThreadData& thread = threadData[jobSystem.getThreadIndex()];
+		const uint32_t firstObject = chunkIndex * objectsPerCachePool;
+		const uint32_t lastObject = std::min(firstObject + objectsPerCachePool, numObjects);
+		for (uint32_t objectIndex = firstObject; objectIndex < lastObject; objectIndex++) {
+			ObjectData& object = objectData[objectIndex];
+			if (!object.visible) {
+				continue;
+			}
+			updateObjectTransform(objectIndex);
+			CachedCommandBuffer& cached = object.cachedCommandBuffers[currentFrame];
+			if (cached.commandBuffer == VK_NULL_HANDLE) {
+				VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(cachePools[chunkIndex], VK_COMMAND_BUFFER_LEVEL_SECONDARY, 1);
+				VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &cached.commandBuffer));
+			} else if ((cached.width == width) && (cached.height == height) && (memcmp(&cached.pushConstBlock, &pushConstBlocks[objectIndex], sizeof(ThreadPushConstantBlock)) == 0)) {
+				object.commandBuffer = cached.commandBuffer;
+				continue;
+			}
+			// The command buffer was last submitted with this frame in flight, whose fence has been waited on, so it can be re-recorded
+			recordObjectCommandBuffer(cached.commandBuffer, objectIndex, inheritanceInfo);
+			cached.pushConstBlock = pushConstBlocks[objectIndex];
+			cached.width = width;
+			cached.height = height;
+			object.commandBuffer = cached.commandBuffer;
+			thread.recordedCommandBuffers++;
+		}
+		thread.recordingTime += std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+	}
+
+	// Records the draw commands for a single object into a secondary command buffer
+	void recordObjectCommandBuffer(VkCommandBuffer cmdBuffer, uint32_t objectIndex, const VkCommandBufferInheritanceInfo& inheritanceInfo)
+	{
+		VkCommandBufferBeginInfo commandBufferBeginInfo = vks::initializers::commandBufferBeginInfo();
+		commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		commandBufferBeginInfo.pInheritanceInfo = &inheritanceInfo;
+
+		VK_CHECK_RESULT(vkBeginCommandBuffer(cmdBuffer, &commandBufferBeginInfo));
+
+		VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+		vkCmdSetViewport(cmdBuffer, 0, 1, &viewport);
+
+		VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
+		vkCmdSetScissor(cmdBuffer, 0, 1, &scissor);
+
+		vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.phong);
 
 		// Update shader push constant block
 		// Contains model view matrix
@@ -260,7 +584,7 @@ public:
 			VK_SHADER_STAGE_VERTEX_BIT,
 			0,
 			sizeof(ThreadPushConstantBlock),
-			&thread->pushConstBlock[cmdBufferIndex]);
+			&pushConstBlocks[objectIndex]);
 
 		VkDeviceSize offsets[1] = { 0 };
 		vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &models.ufo.vertices.buffer, offsets);
@@ -272,6 +596,8 @@ public:
 
 	void updateSecondaryCommandBuffers(VkCommandBufferInheritanceInfo inheritanceInfo)
 	{
+		const SecondaryCommandBuffers& secondaryCommandBuffers = this->secondaryCommandBuffers[currentFrame];
+
 		// Secondary command buffer for the sky sphere
 		VkCommandBufferBeginInfo commandBufferBeginInfo = vks::initializers::commandBufferBeginInfo();
 		commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
@@ -326,11 +652,13 @@ public:
 		VK_CHECK_RESULT(vkEndCommandBuffer(secondaryCommandBuffers.ui));
 	}
 
-	// Updates the secondary command buffers using a thread pool
+	// Updates the secondary command buffers using the job system
 	// and puts them into the primary command buffer that's
 	// lat submitted to the queue for rendering
 	void updateCommandBuffers(VkFramebuffer frameBuffer)
 	{
+		VkCommandBuffer primaryCommandBuffer = frames[currentFrame].commandBuffer;
+
 		// Contains the list of secondary command buffers to be submitted
 		std::vector<VkCommandBuffer> commandBuffers;
 
@@ -368,35 +696,67 @@ public:
 		updateSecondaryCommandBuffers(inheritanceInfo);
 
 		if (displayStarSphere) {
-			commandBuffers.push_back(secondaryCommandBuffers.background);
+			commandBuffers.push_back(secondaryCommandBuffers[currentFrame].background);
 		}
 
-		// Add a job to the thread's queue for each object to be rendered
-		for (uint32_t t = 0; t < numThreads; t++)
-		{
-			for (uint32_t i = 0; i < numObjectsPerThread; i++)
-			{
-				threadPool.threads[t]->addJob([=] { threadRenderCode(t, i, inheritanceInfo); });
-			}
+		// The command buffers of this frame in flight are no longer in use by the GPU (prepareFrame waited on its fence)
+		// Resetting the pools as a whole is cheaper than resetting every command buffer on its own when it's recorded again
+		for (auto& thread : threadData) {
+			VK_CHECK_RESULT(vkResetCommandPool(device, thread.commandPools[currentFrame], 0));
+			thread.usedCommandBuffers = 0;
+			thread.recordingTime = 0.0f;
+			thread.recordedCommandBuffers = 0;
 		}
 
-		threadPool.wait();
+		// Animate all objects (including invisible ones) before culling, so culling uses this frame's positions
+		auto tStart = std::chrono::high_resolution_clock::now();
+		jobSystem.parallelFor(numObjects, [&](uint32_t i) { updateObject(i); });
+		updateTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+
+		cullObjects();
+
+		tStart = std::chrono::high_resolution_clock::now();
+		if (renderMode == RenderModeInstanced) {
+			// Write and record the batches of visible objects in parallel
+			const uint32_t batchCount = (static_cast<uint32_t>(visibleObjects.size()) + instanceBatchSize - 1) / instanceBatchSize;
+			batchCommandBuffers.resize(batchCount);
+			jobSystem.parallelFor(batchCount, [&](uint32_t i) { threadRenderBatch(i, inheritanceInfo); });
+			commandBuffers.insert(commandBuffers.end(), batchCommandBuffers.begin(), batchCommandBuffers.end());
+		} else if (reuseCommandBuffers) {
+			// Cached command buffers are executed with different framebuffers (swap chain images), so they can't inherit a specific one
+			VkCommandBufferInheritanceInfo cachedInheritanceInfo = inheritanceInfo;
+			cachedInheritanceInfo.framebuffer = VK_NULL_HANDLE;
+			for (uint32_t objectIndex : visibleObjects) {
+				objectData[objectIndex].visible = true;
+			}
+			jobSystem.parallelFor(static_cast<uint32_t>(cachePools.size()), [&](uint32_t i) { threadRenderCachedChunk(i, cachedInheritanceInfo); });
+			for (uint32_t objectIndex : visibleObjects) {
+				commandBuffers.push_back(objectData[objectIndex].commandBuffer);
+			}
+		} else {
+			// Record the visible objects in parallel, the job system splits the range into chunks that idle threads can steal
+			jobSystem.parallelFor(static_cast<uint32_t>(visibleObjects.size()), [&](uint32_t i) { threadRenderCode(visibleObjects[i], inheritanceInfo); });
 
-		// Only submit if object is within the current view frustum
-		for (uint32_t t = 0; t < numThreads; t++)
-		{
-			for (uint32_t i = 0; i < numObjectsPerThread; i++)
+			// Only objects within the current view frustum have been recorded
+			for (uint32_t objectIndex : visibleObjects)
 			{
-				if (threadData[t].objectData[i].visible)
-				{
-					commandBuffers.push_back(threadData[t].commandBuffer[i]);
-				}
+				commandBuffers.push_back(objectData[objectIndex].commandBuffer);
+			}
+		}
+		recordingTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+
+		benchmark.addTaskTime("update", updateTime);
+		benchmark.addTaskTime("culling", cullingTime);
+		benchmark.addTaskTime("recording", recordingTime);
+		if (benchmark.active) {
+			for (size_t i = 0; i < threadData.size(); i++) {
+				benchmark.addTaskTime("recording thread " + std::to_string(i), threadData[i].recordingTime);
 			}
 		}
 
 		// Render ui last
 		if (UIOverlay.visible) {
-			commandBuffers.push_back(secondaryCommandBuffers.ui);
+			commandBuffers.push_back(secondaryCommandBuffers[currentFrame].ui);
 		}
 
 		// Execute render commands from the secondary command buffer
@@ -463,6 +823,25 @@ public:
 		shaderStages[1] = loadShader(getShadersPath() + "multithreading/phong.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.phong));
 
+		// Instanced object rendering pipeline
+		// Binding 0 contains the per-vertex data of the model, binding 1 the per-instance data streamed into the instance buffer
+		std::vector<VkVertexInputBindingDescription> bindingDescriptions = {
+			vkglTF::Vertex::inputBindingDescription(0, models.ufo.vertices.stride),
+			vks::initializers::vertexInputBindingDescription(1, sizeof(ThreadPushConstantBlock), VK_VERTEX_INPUT_RATE_INSTANCE)
+		};
+		std::vector<VkVertexInputAttributeDescription> attributeDescriptions = vkglTF::Vertex::inputAttributeDescriptions(0, { vkglTF::VertexComponent::Position, vkglTF::VertexComponent::Normal, vkglTF::VertexComponent::Color });
+		// Locations 4 - 7: Model view projection matrix (one location per column)
+		for (uint32_t i = 0; i < 4; i++) {
+			attributeDescriptions.push_back(vks::initializers::vertexInputAttributeDescription(1, 4 + i, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(ThreadPushConstantBlock, mvp) + sizeof(glm::vec4) * i));
+		}
+		// Location 8: Color
+		attributeDescriptions.push_back(vks::initializers::vertexInputAttributeDescription(1, 8, VK_FORMAT_R32G32B32_SFLOAT, offsetof(ThreadPushConstantBlock, color)));
+		VkPipelineVertexInputStateCreateInfo instancedInputState = vks::initializers::pipelineVertexInputStateCreateInfo(bindingDescriptions, attributeDescriptions);
+		pipelineCI.pVertexInputState = &instancedInputState;
+		shaderStages[0] = loadShader(getShadersPath() + "multithreading/phong_instanced.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.phongInstanced));
+		pipelineCI.pVertexInputState = vkglTF::Vertex::getPipelineVertexInputState({vkglTF::VertexComponent::Position, vkglTF::VertexComponent::Normal, vkglTF::VertexComponent::Color});
+
 		// Star sphere rendering pipeline
 		rasterizationState.cullMode = VK_CULL_MODE_FRONT_BIT;
 		depthStencilState.depthWriteEnable = VK_FALSE;
@@ -480,22 +859,17 @@ public:
 
 	void draw()
 	{
-		// Wait for fence to signal that all command buffers are ready
-		VkResult fenceRes;
-		do {
-			fenceRes = vkWaitForFences(device, 1, &renderFence, VK_TRUE, 100000000);
-		} while (fenceRes == VK_TIMEOUT);
-		VK_CHECK_RESULT(fenceRes);
-		vkResetFences(device, 1, &renderFence);
-
-		VulkanExampleBase::prepareFrame();
+		// Waits for the fence of the current frame in flight, so its command buffers can be safely re-recorded
+		if (!VulkanExampleBase::prepareFrame()) {
+			return;
+		}
 
 		updateCommandBuffers(frameBuffers[currentBuffer]);
 
 		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &primaryCommandBuffer;
+		submitInfo.pCommandBuffers = &frames[currentFrame].commandBuffer;
 
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, renderFence));
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, frames[currentFrame].fence));
 
 		VulkanExampleBase::submitFrame();
 	}
@@ -503,14 +877,15 @@ public:
 	void prepare()
 	{
 		VulkanExampleBase::prepare();
-		// Create a fence for synchronization
-		VkFenceCreateInfo fenceCreateInfo = vks::initializers::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
-		vkCreateFence(device, &fenceCreateInfo, nullptr, &renderFence);
 		loadAssets();
 		setupPipelineLayout();
 		preparePipelines();
 		prepareMultiThreadedRenderer();
+		prepareInstanceBuffers();
 		updateMatrices();
+		if (benchmark.active) {
+			runCullingBenchmark();
+		}
 		prepared = true;
 	}
 
@@ -534,9 +909,39 @@ public:
 	{
 		if (overlay->header("Statistics")) {
 			overlay->text("Active threads: %d", numThreads);
+			overlay->text("Visible objects: %d / %d", static_cast<uint32_t>(visibleObjects.size()), numObjects);
+			overlay->text("Update: %.3f ms", updateTime);
+			overlay->text("Culling: %.3f ms", cullingTime);
+			overlay->text("Recording: %.3f ms", recordingTime);
+		}
+		if (overlay->header("Threads")) {
+			uint32_t recordedCommandBuffers = 0;
+			for (size_t i = 0; i < threadData.size(); i++) {
+				overlay->text("Thread %d: %.3f ms, %d recorded", static_cast<uint32_t>(i), threadData[i].recordingTime, threadData[i].recordedCommandBuffers);
+				recordedCommandBuffers += threadData[i].recordedCommandBuffers;
+			}
+			overlay->text("Recorded command buffers: %d", recordedCommandBuffers);
 		}
 		if (overlay->header("Settings")) {
 			overlay->checkBox("Stars", &displayStarSphere);
+			overlay->checkBox("Hierarchical culling", &hierarchicalCulling);
+			overlay->comboBox("Render mode", &renderMode, { "Per object", "Instanced" });
+			if (renderMode == RenderModePerObject) {
+				overlay->checkBox("Reuse command buffers", &reuseCommandBuffers);
+			}
+			if (overlay->sliderInt("Object count", &objectCount, minObjects, maxObjects)) {
+				setObjectCount(objectCount);
+			}
+		}
+		if (overlay->header("Culling benchmark")) {
+			if (overlay->button("Run")) {
+				runCullingBenchmark();
+			}
+			if (cullingBenchmark.done) {
+				overlay->text("Scalar spheres: %.1f M/s", cullingBenchmark.scalarSpheres);
+				overlay->text("%s spheres: %.1f M/s", vks::Frustum::getBatchInstructionSet(), cullingBenchmark.batchSpheres);
+				overlay->text("%s boxes: %.1f M/s", vks::Frustum::getBatchInstructionSet(), cullingBenchmark.batchBoxes);
+			}
 		}
 
 	}
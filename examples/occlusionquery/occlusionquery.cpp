@@ -8,6 +8,7 @@
 
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "VulkanQueryRing.h"
 
 #define VERTEX_BUFFER_BIND_ID 0
 #define ENABLE_VALIDATION false
@@ -22,11 +23,13 @@ public:
 		vkglTF::Model sphere;
 	} models;
 
-	struct {
+	// Uniform buffers and descriptor sets are per frame in flight, as they change every frame depending on the query results
+	struct UniformBuffers {
 		vks::Buffer occluder;
 		vks::Buffer teapot;
 		vks::Buffer sphere;
-	} uniformBuffers;
+	};
+	std::vector<UniformBuffers> uniformBuffers;
 
 	struct UBOVS {
 		glm::mat4 projection;
@@ -44,21 +47,26 @@ public:
 		VkPipeline simple;
 	} pipelines;
 
-	struct {
+	struct DescriptorSets {
+		VkDescriptorSet occluder;
 		VkDescriptorSet teapot;
 		VkDescriptorSet sphere;
-	} descriptorSets;
+	};
+	std::vector<DescriptorSets> descriptorSets;
 
 	VkPipelineLayout pipelineLayout;
-	VkDescriptorSet descriptorSet;
 	VkDescriptorSetLayout descriptorSetLayout;
 
-	// Pool that stores all occlusion queries
-	VkQueryPool queryPool;
+	// Ring of query pools (one per frame in flight) that stores all occlusion queries
+	vks::QueryRing occlusionQueries;
 
 	// Passed query samples
 	uint64_t passedSamples[2] = { 1,1 };
 
+	// Query pools can be reset on the host if VK_EXT_host_query_reset is supported
+	bool hostQueryReset = false;
+	VkPhysicalDeviceHostQueryResetFeaturesEXT hostQueryResetFeatures{};
+
 	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
 	{
 		title = "Occlusion queries";
@@ -67,6 +75,9 @@ public:
 		camera.setRotation(glm::vec3(0.0f, -123.75f, 0.0f));
 		camera.setRotationSpeed(0.5f);
 		camera.setPerspective(60.0f, (float)width / (float)height, 1.0f, 256.0f);
+		// Query results are read back once a frame's resources are reused, so the CPU never waits for them
+		multipleFramesInFlight = true;
+		enabledInstanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
 	}
 
 	~VulkanExample()
@@ -80,42 +91,46 @@ public:
 		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 
-		vkDestroyQueryPool(device, queryPool, nullptr);
+		occlusionQueries.destroy();
 
-		uniformBuffers.occluder.destroy();
-		uniformBuffers.sphere.destroy();
-		uniformBuffers.teapot.destroy();
+		for (auto& buffers : uniformBuffers) {
+			buffers.occluder.destroy();
+			buffers.sphere.destroy();
+			buffers.teapot.destroy();
+		}
 	}
 
-	// Create a query pool for storing the occlusion query result
+	virtual void getEnabledExtensions()
+	{
+		// Resetting query pools on the host avoids having to record the reset into the command buffer
+		if (vulkanDevice->extensionSupported(VK_EXT_HOST_QUERY_RESET_EXTENSION_NAME)) {
+			enabledDeviceExtensions.push_back(VK_EXT_HOST_QUERY_RESET_EXTENSION_NAME);
+			hostQueryResetFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_QUERY_RESET_FEATURES_EXT;
+			hostQueryResetFeatures.hostQueryReset = VK_TRUE;
+			deviceCreatepNextChain = &hostQueryResetFeatures;
+			hostQueryReset = true;
+		}
+	}
+
+	// Create the query pools for storing the occlusion query results
 	void setupQueryPool()
 	{
-		VkQueryPoolCreateInfo queryPoolInfo = {};
-		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
-		queryPoolInfo.queryType = VK_QUERY_TYPE_OCCLUSION;
-		queryPoolInfo.queryCount = 2;
-		VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, NULL, &queryPool));
+		occlusionQueries.create(device, VK_QUERY_TYPE_OCCLUSION, 2, maxFramesInFlight, 0, hostQueryReset);
 	}
 
-	// Retrieves the results of the occlusion queries submitted to the command buffer
+	// Retrieves the results of the occlusion queries submitted with the last use of the current frame's resources
 	void getQueryResults()
 	{
-		// We use vkGetQueryResults to copy the results into a host visible buffer
-		vkGetQueryPoolResults(
-			device,
-			queryPool,
-			0,
-			2,
-			sizeof(passedSamples),
-			passedSamples,
-			sizeof(uint64_t),
-			// Store results a 64 bit values and wait until the results have been finished
-			// If you don't want to wait, you can use VK_QUERY_RESULT_WITH_AVAILABILITY_BIT
-			// which also returns the state of the result (ready) in the result
-			VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+		// The frame's fence has been waited on, so the results are either available or the queries were not executed
+		// Instead of waiting for results with VK_QUERY_RESULT_WAIT_BIT, the query ring uses VK_QUERY_RESULT_WITH_AVAILABILITY_BIT and keeps the last known values
+		if (occlusionQueries.readResults(currentFrame)) {
+			passedSamples[0] = occlusionQueries.getResult(0);
+			passedSamples[1] = occlusionQueries.getResult(1);
+		}
 	}
 
-	void buildCommandBuffers()
+	// The command buffer of the current frame in flight is recorded every frame, as it references that frame's descriptor sets and query pool
+	void recordCommandBuffer()
 	{
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
@@ -132,111 +147,114 @@ public:
 		renderPassBeginInfo.clearValueCount = 2;
 		renderPassBeginInfo.pClearValues = clearValues;
 
-		for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
-		{
-			// Set target frame buffer
-			renderPassBeginInfo.framebuffer = frameBuffers[i];
+		// Set target frame buffer
+		renderPassBeginInfo.framebuffer = frameBuffers[currentBuffer];
 
-			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
+		const VkCommandBuffer commandBuffer = frames[currentFrame].commandBuffer;
 
-			// Reset query pool
-			// Must be done outside of render pass
-			vkCmdResetQueryPool(drawCmdBuffers[i], queryPool, 0, 2);
+		VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufInfo));
 
-			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		// Reset query pool (if not done on the host)
+		// Must be done outside of render pass
+		occlusionQueries.cmdReset(commandBuffer, currentFrame);
 
-			VkViewport viewport = vks::initializers::viewport(
-				(float)width,
-				(float)height,
-				0.0f,
-				1.0f);
-			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-			VkRect2D scissor = vks::initializers::rect2D(
-				width,
-				height,
-				0,
-				0);
-			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+		VkViewport viewport = vks::initializers::viewport(
+			(float)width,
+			(float)height,
+			0.0f,
+			1.0f);
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
-			glm::mat4 modelMatrix = glm::mat4(1.0f);
+		VkRect2D scissor = vks::initializers::rect2D(
+			width,
+			height,
+			0,
+			0);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-			// Occlusion pass
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.simple);
+		glm::mat4 modelMatrix = glm::mat4(1.0f);
 
-			// Occluder first
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
-			models.plane.draw(drawCmdBuffers[i]);
+		// Occlusion pass
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.simple);
 
-			// Teapot
-			vkCmdBeginQuery(drawCmdBuffers[i], queryPool, 0, VK_FLAGS_NONE);
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.teapot, 0, NULL);
-			models.teapot.draw(drawCmdBuffers[i]);
-			vkCmdEndQuery(drawCmdBuffers[i], queryPool, 0);
+		// Occluder first
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame].occluder, 0, NULL);
+		models.plane.draw(commandBuffer);
 
-			// Sphere
-			vkCmdBeginQuery(drawCmdBuffers[i], queryPool, 1, VK_FLAGS_NONE);
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.sphere, 0, NULL);
-			models.sphere.draw(drawCmdBuffers[i]);
-			vkCmdEndQuery(drawCmdBuffers[i], queryPool, 1);
+		// Teapot
+		occlusionQueries.cmdBeginQuery(commandBuffer, currentFrame, 0);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame].teapot, 0, NULL);
+		models.teapot.draw(commandBuffer);
+		occlusionQueries.cmdEndQuery(commandBuffer, currentFrame, 0);
 
-			// Visible pass
-			// Clear color and depth attachments
-			VkClearAttachment clearAttachments[2] = {};
+		// Sphere
+		occlusionQueries.cmdBeginQuery(commandBuffer, currentFrame, 1);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame].sphere, 0, NULL);
+		models.sphere.draw(commandBuffer);
+		occlusionQueries.cmdEndQuery(commandBuffer, currentFrame, 1);
 
-			clearAttachments[0].aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			clearAttachments[0].clearValue.color = defaultClearColor;
-			clearAttachments[0].colorAttachment = 0;
+		// Visible pass
+		// Clear color and depth attachments
+		VkClearAttachment clearAttachments[2] = {};
 
-			clearAttachments[1].aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-			clearAttachments[1].clearValue.depthStencil = { 1.0f, 0 };
+		clearAttachments[0].aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		clearAttachments[0].clearValue.color = defaultClearColor;
+		clearAttachments[0].colorAttachment = 0;
 
-			VkClearRect clearRect = {};
-			clearRect.layerCount = 1;
-			clearRect.rect.offset = { 0, 0 };
-			clearRect.rect.extent = { width, height };
+		clearAttachments[1].aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+		clearAttachments[1].clearValue.depthStencil = { 1.0f, 0 };
 
-			vkCmdClearAttachments(
-				drawCmdBuffers[i],
-				2,
-				clearAttachments,
-				1,
-				&clearRect);
+		VkClearRect clearRect = {};
+		clearRect.layerCount = 1;
+		clearRect.rect.offset = { 0, 0 };
+		clearRect.rect.extent = { width, height };
 
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.solid);
+		vkCmdClearAttachments(
+			commandBuffer,
+			2,
+			clearAttachments,
+			1,
+			&clearRect);
 
-			// Teapot
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.teapot, 0, NULL);
-			models.teapot.draw(drawCmdBuffers[i]);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.solid);
 
-			// Sphere
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.sphere, 0, NULL);
-			models.sphere.draw(drawCmdBuffers[i]);
+		// Teapot
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame].teapot, 0, NULL);
+		models.teapot.draw(commandBuffer);
+
+		// Sphere
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame].sphere, 0, NULL);
+		models.sphere.draw(commandBuffer);
 
-			// Occluder
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.occluder);
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
-			models.plane.draw(drawCmdBuffers[i]);
+		// Occluder
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.occluder);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame].occluder, 0, NULL);
+		models.plane.draw(commandBuffer);
 
-			drawUI(drawCmdBuffers[i]);
+		drawUI(commandBuffer);
 
-			vkCmdEndRenderPass(drawCmdBuffers[i]);
+		vkCmdEndRenderPass(commandBuffer);
 
-			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
-		}
+		VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
 	}
 
 	void draw()
 	{
+		// Waits until the GPU has finished with the resources of the current frame in flight
+		if (!VulkanExampleBase::prepareFrame()) {
+			return;
+		}
+
+		// Read the query results of the last submission of this frame for displaying them and coloring the objects
+		getQueryResults();
 		updateUniformBuffers();
-		VulkanExampleBase::prepareFrame();
+		recordCommandBuffer();
 
 		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
-
-		// Read query results for displaying in next frame
-		getQueryResults();
+		submitInfo.pCommandBuffers = &frames[currentFrame].commandBuffer;
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, frames[currentFrame].fence));
 
 		VulkanExampleBase::submitFrame();
 	}
@@ -253,15 +271,15 @@ public:
 	{
 		std::vector<VkDescriptorPoolSize> poolSizes =
 		{
-			// One uniform buffer block for each mesh
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3)
+			// One uniform buffer block for each mesh and frame in flight
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3 * maxFramesInFlight)
 		};
 
 		VkDescriptorPoolCreateInfo descriptorPoolInfo =
 			vks::initializers::descriptorPoolCreateInfo(
 				poolSizes.size(),
 				poolSizes.data(),
-				3);
+				3 * maxFramesInFlight);
 
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
 	}
@@ -300,32 +318,35 @@ public:
 				&descriptorSetLayout,
 				1);
 
-		// Occluder (plane)
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet));
+		descriptorSets.resize(maxFramesInFlight);
+		for (uint32_t i = 0; i < maxFramesInFlight; i++) {
+			// Occluder (plane)
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets[i].occluder));
 
-		std::vector<VkWriteDescriptorSet> writeDescriptorSets =
-		{
-			// Binding 0 : Vertex shader uniform buffer
-			vks::initializers::writeDescriptorSet(
-				descriptorSet,
-				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-				0,
-				&uniformBuffers.occluder.descriptor)
-		};
+			std::vector<VkWriteDescriptorSet> writeDescriptorSets =
+			{
+				// Binding 0 : Vertex shader uniform buffer
+				vks::initializers::writeDescriptorSet(
+					descriptorSets[i].occluder,
+					VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+					0,
+					&uniformBuffers[i].occluder.descriptor)
+			};
 
-		vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
+			vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
 
-		// Teapot
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets.teapot));
-		writeDescriptorSets[0].dstSet = descriptorSets.teapot;
-		writeDescriptorSets[0].pBufferInfo = &uniformBuffers.teapot.descriptor;
-		vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
+			// Teapot
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets[i].teapot));
+			writeDescriptorSets[0].dstSet = descriptorSets[i].teapot;
+			writeDescriptorSets[0].pBufferInfo = &uniformBuffers[i].teapot.descriptor;
+			vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
 
-		// Sphere
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets.sphere));
-		writeDescriptorSets[0].dstSet = descriptorSets.sphere;
-		writeDescriptorSets[0].pBufferInfo = &uniformBuffers.sphere.descriptor;
-		vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
+			// Sphere
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets[i].sphere));
+			writeDescriptorSets[0].dstSet = descriptorSets[i].sphere;
+			writeDescriptorSets[0].pBufferInfo = &uniformBuffers[i].sphere.descriptor;
+			vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
+		}
 	}
 
 	void preparePipelines()
@@ -378,33 +399,34 @@ public:
 	// Prepare and initialize uniform buffer containing shader uniforms
 	void prepareUniformBuffers()
 	{
-		// Vertex shader uniform buffer block
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&uniformBuffers.occluder,
-			sizeof(uboVS)));
-
-		// Teapot
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&uniformBuffers.teapot,
-			sizeof(uboVS)));
-
-		// Sphere
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&uniformBuffers.sphere,
-			sizeof(uboVS)));
+		uniformBuffers.resize(maxFramesInFlight);
+		for (auto& buffers : uniformBuffers) {
+			// Vertex shader uniform buffer block
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(
+				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&buffers.occluder,
+				sizeof(uboVS)));
 
-		// Map persistent
-		VK_CHECK_RESULT(uniformBuffers.occluder.map());
-		VK_CHECK_RESULT(uniformBuffers.teapot.map());
-		VK_CHECK_RESULT(uniformBuffers.sphere.map());
+			// Teapot
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(
+				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&buffers.teapot,
+				sizeof(uboVS)));
 
-		updateUniformBuffers();
+			// Sphere
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(
+				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&buffers.sphere,
+				sizeof(uboVS)));
+
+			// Map persistent
+			VK_CHECK_RESULT(buffers.occluder.map());
+			VK_CHECK_RESULT(buffers.teapot.map());
+			VK_CHECK_RESULT(buffers.sphere.map());
+		}
 	}
 
 	void updateUniformBuffers()
@@ -412,26 +434,28 @@ public:
 		uboVS.projection = camera.matrices.perspective;
 		uboVS.view = camera.matrices.view;
 
-		uint8_t *pData;
+		// Only the buffers of the current frame in flight are updated, the other frames may still be in use by the GPU
+		UniformBuffers& buffers = uniformBuffers[currentFrame];
+
 		// Occluder
 		uboVS.visible = 1.0f;
 		uboVS.model = glm::scale(glm::mat4(1.0f), glm::vec3(6.0f));
 		uboVS.color = glm::vec4(0.0f, 0.0f, 1.0f, 0.5f);
-		memcpy(uniformBuffers.occluder.mapped, &uboVS, sizeof(uboVS));
+		memcpy(buffers.occluder.mapped, &uboVS, sizeof(uboVS));
 
 		// Teapot
 		// Toggle color depending on visibility
 		uboVS.visible = (passedSamples[0] > 0) ? 1.0f : 0.0f;
 		uboVS.model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -3.0f));
 		uboVS.color = glm::vec4(1.0f, 0.0f, 0.0f, 1.0f);
-		memcpy(uniformBuffers.teapot.mapped, &uboVS, sizeof(uboVS));
+		memcpy(buffers.teapot.mapped, &uboVS, sizeof(uboVS));
 
 		// Sphere
 		// Toggle color depending on visibility
 		uboVS.visible = (passedSamples[1] > 0) ? 1.0f : 0.0f;
 		uboVS.model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 3.0f));
 		uboVS.color = glm::vec4(0.0f, 1.0f, 0.0f, 1.0f);
-		memcpy(uniformBuffers.sphere.mapped, &uboVS, sizeof(uboVS));
+		memcpy(buffers.sphere.mapped, &uboVS, sizeof(uboVS));
 	}
 
 	void prepare()
@@ -444,7 +468,6 @@ public:
 		preparePipelines();
 		setupDescriptorPool();
 		setupDescriptorSets();
-		buildCommandBuffers();
 		prepared = true;
 	}
 
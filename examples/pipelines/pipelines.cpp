@@ -147,6 +147,11 @@ public:
 
 	void loadAssets()
 	{
+		// Only store the vertex components used by the shaders, with quantized normals and colors (20 instead of 100 bytes per vertex)
+		vkglTF::vertexLayout.clear();
+		vkglTF::vertexLayout.add(vkglTF::VertexComponent::Position);
+		vkglTF::vertexLayout.add(vkglTF::VertexComponent::Normal, vkglTF::VertexComponentFormat::Snorm8);
+		vkglTF::vertexLayout.add(vkglTF::VertexComponent::Color, vkglTF::VertexComponentFormat::Unorm8);
 		const uint32_t glTFLoadingFlags = vkglTF::FileLoadingFlags::PreTransformVertices | vkglTF::FileLoadingFlags::PreMultiplyVertexColors | vkglTF::FileLoadingFlags::FlipY;
 		scene.loadFromFile(getAssetPath() + "models/treasure_smooth.gltf", vulkanDevice, queue, glTFLoadingFlags);
 	}
@@ -239,7 +244,8 @@ public:
 		pipelineCI.pDynamicState = &dynamicState;
 		pipelineCI.stageCount = shaderStages.size();
 		pipelineCI.pStages = shaderStages.data();
-		pipelineCI.pVertexInputState  = vkglTF::Vertex::getPipelineVertexInputState({vkglTF::VertexComponent::Position, vkglTF::VertexComponent::Normal, vkglTF::VertexComponent::Color});
+		// The scene uses a quantized vertex layout, so the stride is taken from the model
+		pipelineCI.pVertexInputState  = vkglTF::Vertex::getPipelineVertexInputState({vkglTF::VertexComponent::Position, vkglTF::VertexComponent::Normal, vkglTF::VertexComponent::Color}, scene.vertices.stride);
 
 		// Create the graphics pipeline state objects
 
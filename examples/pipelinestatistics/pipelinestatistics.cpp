@@ -8,6 +8,7 @@
 
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "VulkanQueryRing.h"
 
 #define ENABLE_VALIDATION false
 #define OBJ_DIM 0.05f
@@ -21,9 +22,11 @@ public:
 		std::vector<std::string> names;
 	} models;
 
+	// One uniform buffer and descriptor set per frame in flight
 	struct UniformBuffers {
 		vks::Buffer VS;
-	} uniformBuffers;
+	};
+	std::vector<UniformBuffers> uniformBuffers;
 
 	struct UBOVS {
 		glm::mat4 projection;
@@ -40,15 +43,20 @@ public:
 	bool tessellation = false;
 
 	VkPipelineLayout pipelineLayout;
-	VkDescriptorSet descriptorSet;
+	std::vector<VkDescriptorSet> descriptorSets;
 	VkDescriptorSetLayout descriptorSetLayout;
 
-	VkQueryPool queryPool;
+	// Ring of query pools (one per frame in flight) for the pipeline statistics query
+	vks::QueryRing pipelineStatisticsQueries;
 
 	// Vector for storing pipeline statistics results
 	std::vector<uint64_t> pipelineStats;
 	std::vector<std::string> pipelineStatNames;
 
+	// Query pools can be reset on the host if VK_EXT_host_query_reset is supported
+	bool hostQueryReset = false;
+	VkPhysicalDeviceHostQueryResetFeaturesEXT hostQueryResetFeatures{};
+
 	int32_t gridSize = 3;
 
 	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
@@ -60,6 +68,9 @@ public:
 		camera.movementSpeed = 4.0f;
 		camera.setPerspective(60.0f, (float)width / (float)height, 0.1f, 256.0f);
 		camera.rotationSpeed = 0.25f;
+		// Query results are read back once a frame's resources are reused, so the CPU never waits for them
+		multipleFramesInFlight = true;
+		enabledInstanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
 	}
 
 	~VulkanExample()
@@ -67,8 +78,10 @@ public:
 		vkDestroyPipeline(device, pipeline, nullptr);
 		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
-		vkDestroyQueryPool(device, queryPool, nullptr);
-		uniformBuffers.VS.destroy();
+		pipelineStatisticsQueries.destroy();
+		for (auto& buffers : uniformBuffers) {
+			buffers.VS.destroy();
+		}
 	}
 
 	virtual void getEnabledFeatures()
@@ -88,7 +101,19 @@ public:
 		}
 	}
 
-	// Setup a query pool for storing pipeline statistics
+	virtual void getEnabledExtensions()
+	{
+		// Resetting query pools on the host avoids having to record the reset into the command buffer
+		if (vulkanDevice->extensionSupported(VK_EXT_HOST_QUERY_RESET_EXTENSION_NAME)) {
+			enabledDeviceExtensions.push_back(VK_EXT_HOST_QUERY_RESET_EXTENSION_NAME);
+			hostQueryResetFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_QUERY_RESET_FEATURES_EXT;
+			hostQueryResetFeatures.hostQueryReset = VK_TRUE;
+			deviceCreatepNextChain = &hostQueryResetFeatures;
+			hostQueryReset = true;
+		}
+	}
+
+	// Setup the query pools for storing pipeline statistics
 	void setupQueryPool()
 	{
 		pipelineStatNames = {
@@ -105,12 +130,8 @@ public:
 		}
 		pipelineStats.resize(pipelineStatNames.size());
 
-		VkQueryPoolCreateInfo queryPoolInfo = {};
-		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
-		// This query pool will store pipeline statistics
-		queryPoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
 		// Pipeline counters to be returned for this pool
-		queryPoolInfo.pipelineStatistics =
+		VkQueryPipelineStatisticFlags pipelineStatistics =
 			VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
 			VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
 			VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
@@ -118,30 +139,25 @@ public:
 			VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
 			VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
 		if (deviceFeatures.tessellationShader) {
-			queryPoolInfo.pipelineStatistics |=
+			pipelineStatistics |=
 				VK_QUERY_PIPELINE_STATISTIC_TESSELLATION_CONTROL_SHADER_PATCHES_BIT |
 				VK_QUERY_PIPELINE_STATISTIC_TESSELLATION_EVALUATION_SHADER_INVOCATIONS_BIT;
 		}
-		queryPoolInfo.queryCount = deviceFeatures.tessellationShader ? 8 : 6;
-		VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, NULL, &queryPool));
+		// A single query returns all enabled counters
+		pipelineStatisticsQueries.create(device, VK_QUERY_TYPE_PIPELINE_STATISTICS, 1, maxFramesInFlight, pipelineStatistics, hostQueryReset);
 	}
 
-	// Retrieves the results of the pipeline statistics query submitted to the command buffer
+	// Retrieves the results of the pipeline statistics query submitted with the last use of the current frame's resources
 	void getQueryResults()
 	{
-		uint32_t count = static_cast<uint32_t>(pipelineStats.size());
-		vkGetQueryPoolResults(
-			device,
-			queryPool,
-			0,
-			1,
-			count * sizeof(uint64_t),
-			pipelineStats.data(),
-			sizeof(uint64_t),
-			VK_QUERY_RESULT_64_BIT);
+		// The frame's fence has been waited on, so this doesn't stall, results that are not available keep their last values
+		if (pipelineStatisticsQueries.readResults(currentFrame)) {
+			pipelineStats = pipelineStatisticsQueries.getResults();
+		}
 	}
 
-	void buildCommandBuffers()
+	// The command buffer of the current frame in flight is recorded every frame, as it references that frame's descriptor set and query pool
+	void recordCommandBuffer()
 	{
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
@@ -158,61 +174,66 @@ public:
 		renderPassBeginInfo.clearValueCount = 2;
 		renderPassBeginInfo.pClearValues = clearValues;
 
-		for (int32_t i = 0; i < drawCmdBuffers.size(); ++i) {
-			renderPassBeginInfo.framebuffer = frameBuffers[i];
+		renderPassBeginInfo.framebuffer = frameBuffers[currentBuffer];
 
-			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
+		const VkCommandBuffer commandBuffer = frames[currentFrame].commandBuffer;
 
-			// Reset timestamp query pool
-			vkCmdResetQueryPool(drawCmdBuffers[i], queryPool, 0, static_cast<uint32_t>(pipelineStats.size()));
+		VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufInfo));
 
-			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		// Reset the pipeline statistics query pool (if not done on the host)
+		pipelineStatisticsQueries.cmdReset(commandBuffer, currentFrame);
 
-			VkViewport viewport = vks::initializers::viewport((float)width,	(float)height, 0.0f, 1.0f);
-			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-			VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
-			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+		VkViewport viewport = vks::initializers::viewport((float)width,	(float)height, 0.0f, 1.0f);
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
-			VkDeviceSize offsets[1] = { 0 };
+		VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-			// Start capture of pipeline statistics
-			vkCmdBeginQuery(drawCmdBuffers[i], queryPool, 0, 0);
+		VkDeviceSize offsets[1] = { 0 };
 
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], 0, 1, &models.objects[models.objectIndex].vertices.buffer, offsets);
-			vkCmdBindIndexBuffer(drawCmdBuffers[i], models.objects[models.objectIndex].indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+		// Start capture of pipeline statistics
+		pipelineStatisticsQueries.cmdBeginQuery(commandBuffer, currentFrame, 0);
 
-			for (int32_t y = 0; y < gridSize; y++) {
-				for (int32_t x = 0; x < gridSize; x++) {
-					glm::vec3 pos = glm::vec3(float(x - (gridSize / 2.0f)) * 2.5f, 0.0f, float(y - (gridSize / 2.0f)) * 2.5f);
-					vkCmdPushConstants(drawCmdBuffers[i], pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::vec3), &pos);
-					models.objects[models.objectIndex].draw(drawCmdBuffers[i]);
-				}
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame], 0, NULL);
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &models.objects[models.objectIndex].vertices.buffer, offsets);
+		vkCmdBindIndexBuffer(commandBuffer, models.objects[models.objectIndex].indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+
+		for (int32_t y = 0; y < gridSize; y++) {
+			for (int32_t x = 0; x < gridSize; x++) {
+				glm::vec3 pos = glm::vec3(float(x - (gridSize / 2.0f)) * 2.5f, 0.0f, float(y - (gridSize / 2.0f)) * 2.5f);
+				vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::vec3), &pos);
+				models.objects[models.objectIndex].draw(commandBuffer);
 			}
+		}
 
-			// End capture of pipeline statistics
-			vkCmdEndQuery(drawCmdBuffers[i], queryPool, 0);
+		// End capture of pipeline statistics
+		pipelineStatisticsQueries.cmdEndQuery(commandBuffer, currentFrame, 0);
 
-			drawUI(drawCmdBuffers[i]);
+		drawUI(commandBuffer);
 
-			vkCmdEndRenderPass(drawCmdBuffers[i]);
+		vkCmdEndRenderPass(commandBuffer);
 
-			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
-		}
+		VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
 	}
 
 	void draw()
 	{
-		VulkanExampleBase::prepareFrame();
-
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+		// Waits until the GPU has finished with the resources of the current frame in flight
+		if (!VulkanExampleBase::prepareFrame()) {
+			return;
+		}
 
-		// Read query results for displaying in next frame
+		// Read the query results of the last submission of this frame for displaying them
 		getQueryResults();
+		updateUniformBuffers();
+		recordCommandBuffer();
+
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &frames[currentFrame].commandBuffer;
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, frames[currentFrame].fence));
 
 		VulkanExampleBase::submitFrame();
 	}
@@ -231,10 +252,10 @@ public:
 	void setupDescriptorPool()
 	{
 		std::vector<VkDescriptorPoolSize> poolSizes = {
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3)
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, maxFramesInFlight)
 		};
 		VkDescriptorPoolCreateInfo descriptorPoolInfo =
-			vks::initializers::descriptorPoolCreateInfo(poolSizes, 3);
+			vks::initializers::descriptorPoolCreateInfo(poolSizes, maxFramesInFlight);
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
 	}
 
@@ -259,16 +280,21 @@ public:
 	{
 		VkDescriptorSetAllocateInfo allocInfo =
 			vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet));
-		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
-			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.VS.descriptor)
-		};
-		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+		descriptorSets.resize(maxFramesInFlight);
+		for (uint32_t i = 0; i < maxFramesInFlight; i++) {
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets[i]));
+			std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+				vks::initializers::writeDescriptorSet(descriptorSets[i], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers[i].VS.descriptor)
+			};
+			vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+		}
 	}
 
 	void preparePipelines()
 	{
 		if (pipeline != VK_NULL_HANDLE) {
+			// The pipeline may still be used by frames in flight
+			VK_CHECK_RESULT(vkDeviceWaitIdle(device));
 			vkDestroyPipeline(device, pipeline, nullptr);
 		}
 
@@ -333,23 +359,25 @@ public:
 	// Prepare and initialize uniform buffer containing shader uniforms
 	void prepareUniformBuffers()
 	{
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&uniformBuffers.VS,
-			sizeof(uboVS)));
-
-		// Map persistent
-		VK_CHECK_RESULT(uniformBuffers.VS.map());
-
-		updateUniformBuffers();
+		uniformBuffers.resize(maxFramesInFlight);
+		for (auto& buffers : uniformBuffers) {
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(
+				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&buffers.VS,
+				sizeof(uboVS)));
+
+			// Map persistent
+			VK_CHECK_RESULT(buffers.VS.map());
+		}
 	}
 
+	// Updates the uniform buffer of the current frame in flight, the other frames may still be in use by the GPU
 	void updateUniformBuffers()
 	{
 		uboVS.projection = camera.matrices.perspective;
 		uboVS.modelview = camera.matrices.view;
-		memcpy(uniformBuffers.VS.mapped, &uboVS, sizeof(uboVS));
+		memcpy(uniformBuffers[currentFrame].VS.mapped, &uboVS, sizeof(uboVS));
 	}
 
 	void prepare()
@@ -362,7 +390,6 @@ public:
 		preparePipelines();
 		setupDescriptorPool();
 		setupDescriptorSets();
-		buildCommandBuffers();
 		prepared = true;
 	}
 
@@ -373,45 +400,30 @@ public:
 		draw();
 	}
 
-	virtual void viewChanged()
-	{
-		updateUniformBuffers();
-	}
-
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
 	{
 		if (overlay->header("Settings")) {
-			if (overlay->comboBox("Object type", &models.objectIndex, models.names)) {
-				updateUniformBuffers();
-				buildCommandBuffers();
-			}
-			if (overlay->sliderInt("Grid size", &gridSize, 1, 10)) {
-				buildCommandBuffers();
-			}
+			overlay->comboBox("Object type", &models.objectIndex, models.names);
+			overlay->sliderInt("Grid size", &gridSize, 1, 10);
 			std::vector<std::string> cullModeNames = { "None", "Front", "Back", "Back and front" };
 			if (overlay->comboBox("Cull mode", &cullMode, cullModeNames)) {
 				preparePipelines();
-				buildCommandBuffers();
 			}
 			if (overlay->checkBox("Blending", &blending)) {
 				preparePipelines();
-				buildCommandBuffers();
 			}
 			if (deviceFeatures.fillModeNonSolid) {
 				if (overlay->checkBox("Wireframe", &wireframe)) {
 					preparePipelines();
-					buildCommandBuffers();
 				}
 			}
 			if (deviceFeatures.tessellationShader) {
 				if (overlay->checkBox("Tessellation", &tessellation)) {
 					preparePipelines();
-					buildCommandBuffers();
 				}
 			}
 			if (overlay->checkBox("Discard", &discard)) {
 				preparePipelines();
-				buildCommandBuffers();
 			}
 		}
 		if (!pipelineStats.empty()) {
@@ -75,6 +75,9 @@ public:
 	VkDevice device;
 	uint32_t queueFamilyIndex;
 	VkPipelineCache pipelineCache;
+	VkPhysicalDeviceProperties deviceProperties;
+	// Pipeline cache file used if the persistent pipeline cache has been enabled via command line
+	std::string pipelineCacheFile = "renderheadless_pipelinecache.bin";
 	VkQueue queue;
 	VkCommandPool commandPool;
 	VkCommandBuffer commandBuffer;
@@ -263,7 +266,6 @@ public:
 		VK_CHECK_RESULT(vkEnumeratePhysicalDevices(instance, &deviceCount, physicalDevices.data()));
 		physicalDevice = physicalDevices[0];
 
-		VkPhysicalDeviceProperties deviceProperties;
 		vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
 		LOG("GPU: %s\n", deviceProperties.deviceName);
 
@@ -577,7 +579,19 @@ public:
 
 			VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
 			pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-			VK_CHECK_RESULT(vkCreatePipelineCache(device, &pipelineCacheCreateInfo, nullptr, &pipelineCache));
+			// Seed the pipeline cache with data from a previous run (if enabled and valid for this device and driver)
+			std::vector<char> pipelineCacheData;
+			if (commandLineParser.isSet("pipelinecache")) {
+				pipelineCacheData = vks::tools::loadPipelineCacheData(pipelineCacheFile, deviceProperties);
+				pipelineCacheCreateInfo.initialDataSize = pipelineCacheData.size();
+				pipelineCacheCreateInfo.pInitialData = pipelineCacheData.empty() ? nullptr : pipelineCacheData.data();
+			}
+			if (vkCreatePipelineCache(device, &pipelineCacheCreateInfo, nullptr, &pipelineCache) != VK_SUCCESS) {
+				// Fall back to an empty cache if the implementation rejects the data
+				pipelineCacheCreateInfo.initialDataSize = 0;
+				pipelineCacheCreateInfo.pInitialData = nullptr;
+				VK_CHECK_RESULT(vkCreatePipelineCache(device, &pipelineCacheCreateInfo, nullptr, &pipelineCache));
+			}
 
 			// Create pipeline
 			VkPipelineInputAssemblyStateCreateInfo inputAssemblyState =
@@ -897,6 +911,9 @@ public:
 		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 		vkDestroyPipeline(device, pipeline, nullptr);
+		if (commandLineParser.isSet("pipelinecache")) {
+			vks::tools::savePipelineCacheData(pipelineCacheFile, device, pipelineCache, deviceProperties);
+		}
 		vkDestroyPipelineCache(device, pipelineCache, nullptr);
 		vkDestroyCommandPool(device, commandPool, nullptr);
 		for (auto shadermodule : shaderModules) {
@@ -943,6 +960,7 @@ void android_main(android_app* state) {
 int main(int argc, char* argv[]) {
 	commandLineParser.add("help", { "--help" }, 0, "Show help");
 	commandLineParser.add("shaders", { "-s", "--shaders" }, 1, "Select shader type to use (glsl or hlsl)");
+	commandLineParser.add("pipelinecache", { "-pc", "--pipelinecache" }, 0, "Load the pipeline cache from disk at startup and store it at shutdown");
 	commandLineParser.parse(argc, argv);
 	if (commandLineParser.isSet("help")) {
 		commandLineParser.printHelp();
@@ -9,6 +9,7 @@
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
 #include "frustum.hpp"
+#include "VulkanQueryRing.h"
 #include <ktx.h>
 #include <ktxvulkan.h>
 
@@ -43,10 +44,12 @@ public:
 		vkglTF::Model skysphere;
 	} models;
 
-	struct {
+	// Uniform buffers and descriptor sets are per frame in flight
+	struct UniformBuffers {
 		vks::Buffer terrainTessellation;
 		vks::Buffer skysphereVertex;
-	} uniformBuffers;
+	};
+	std::vector<UniformBuffers> uniformBuffers;
 
 	// Shared values for tessellation control and evaluation stages
 	struct {
@@ -82,19 +85,20 @@ public:
 		VkPipelineLayout skysphere;
 	} pipelineLayouts;
 
-	struct {
+	struct DescriptorSets {
 		VkDescriptorSet terrain;
 		VkDescriptorSet skysphere;
-	} descriptorSets;
+	};
+	std::vector<DescriptorSets> descriptorSets;
 
-	// Pipeline statistics
-	struct {
-		VkBuffer buffer;
-		VkDeviceMemory memory;
-	} queryResult;
-	VkQueryPool queryPool = VK_NULL_HANDLE;
+	// Pipeline statistics, read back from a ring of query pools (one per frame in flight)
+	vks::QueryRing pipelineStatisticsQueries;
 	uint64_t pipelineStats[2] = { 0 };
 
+	// Query pools can be reset on the host if VK_EXT_host_query_reset is supported
+	bool hostQueryReset = false;
+	VkPhysicalDeviceHostQueryResetFeaturesEXT hostQueryResetFeatures{};
+
 	// View frustum passed to tessellation control shader for culling
 	vks::Frustum frustum;
 
@@ -106,6 +110,9 @@ public:
 		camera.setRotation(glm::vec3(-12.0f, 159.0f, 0.0f));
 		camera.setTranslation(glm::vec3(18.0f, 22.5f, 57.5f));
 		camera.movementSpeed = 10.0f;
+		// Query results are read back once a frame's resources are reused, so the CPU never waits for them
+		multipleFramesInFlight = true;
+		enabledInstanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
 	}
 
 	~VulkanExample()
@@ -124,8 +131,10 @@ public:
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.terrain, nullptr);
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.skysphere, nullptr);
 
-		uniformBuffers.skysphereVertex.destroy();
-		uniformBuffers.terrainTessellation.destroy();
+		for (auto& buffers : uniformBuffers) {
+			buffers.skysphereVertex.destroy();
+			buffers.terrainTessellation.destroy();
+		}
 
 		textures.heightMap.destroy();
 		textures.skySphere.destroy();
@@ -136,11 +145,7 @@ public:
 		vkDestroyBuffer(device, terrain.indices.buffer, nullptr);
 		vkFreeMemory(device, terrain.indices.memory, nullptr);
 
-		if (queryPool != VK_NULL_HANDLE) {
-			vkDestroyQueryPool(device, queryPool, nullptr);
-			vkDestroyBuffer(device, queryResult.buffer, nullptr);
-			vkFreeMemory(device, queryResult.memory, nullptr);
-		}
+		pipelineStatisticsQueries.destroy();
 	}
 
 	// Enable physical device features required for this example
@@ -177,52 +182,35 @@ public:
 		}
 	}
 
-	// Setup pool and buffer for storing pipeline statistics results
-	void setupQueryResultBuffer()
+	virtual void getEnabledExtensions()
 	{
-		uint32_t bufSize = 2 * sizeof(uint64_t);
-
-		VkMemoryRequirements memReqs;
-		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
-		VkBufferCreateInfo bufferCreateInfo =
-			vks::initializers::bufferCreateInfo(
-				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-				bufSize);
-
-		// Results are saved in a host visible buffer for easy access by the application
-		VK_CHECK_RESULT(vkCreateBuffer(device, &bufferCreateInfo, nullptr, &queryResult.buffer));
-		vkGetBufferMemoryRequirements(device, queryResult.buffer, &memReqs);
-		memAlloc.allocationSize = memReqs.size;
-		memAlloc.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device, &memAlloc, nullptr, &queryResult.memory));
-		VK_CHECK_RESULT(vkBindBufferMemory(device, queryResult.buffer, queryResult.memory, 0));
-
-		// Create query pool
-		if (deviceFeatures.pipelineStatisticsQuery) {
-			VkQueryPoolCreateInfo queryPoolInfo = {};
-			queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
-			queryPoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
-			queryPoolInfo.pipelineStatistics =
-				VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
-				VK_QUERY_PIPELINE_STATISTIC_TESSELLATION_EVALUATION_SHADER_INVOCATIONS_BIT;
-			queryPoolInfo.queryCount = 2;
-			VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, NULL, &queryPool));
+		// Resetting query pools on the host avoids having to record the reset into the command buffer
+		if (vulkanDevice->extensionSupported(VK_EXT_HOST_QUERY_RESET_EXTENSION_NAME)) {
+			enabledDeviceExtensions.push_back(VK_EXT_HOST_QUERY_RESET_EXTENSION_NAME);
+			hostQueryResetFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_QUERY_RESET_FEATURES_EXT;
+			hostQueryResetFeatures.hostQueryReset = VK_TRUE;
+			deviceCreatepNextChain = &hostQueryResetFeatures;
+			hostQueryReset = true;
 		}
 	}
 
-	// Retrieves the results of the pipeline statistics query submitted to the command buffer
+	// Setup the query pools for storing pipeline statistics results
+	void setupQueryPool()
+	{
+		const VkQueryPipelineStatisticFlags pipelineStatistics =
+			VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+			VK_QUERY_PIPELINE_STATISTIC_TESSELLATION_EVALUATION_SHADER_INVOCATIONS_BIT;
+		pipelineStatisticsQueries.create(device, VK_QUERY_TYPE_PIPELINE_STATISTICS, 1, maxFramesInFlight, pipelineStatistics, hostQueryReset);
+	}
+
+	// Retrieves the results of the pipeline statistics query submitted with the last use of the current frame's resources
 	void getQueryResults()
 	{
-		// We use vkGetQueryResults to copy the results into a host visible buffer
-		vkGetQueryPoolResults(
-			device,
-			queryPool,
-			0,
-			1,
-			sizeof(pipelineStats),
-			pipelineStats,
-			sizeof(uint64_t),
-			VK_QUERY_RESULT_64_BIT);
+		// The frame's fence has been waited on, so this doesn't stall, results that are not available keep their last values
+		if (pipelineStatisticsQueries.readResults(currentFrame)) {
+			pipelineStats[0] = pipelineStatisticsQueries.getResult(0, 0);
+			pipelineStats[1] = pipelineStatisticsQueries.getResult(0, 1);
+		}
 	}
 
 	void loadAssets()
@@ -276,7 +264,8 @@ public:
 		textures.terrainArray.descriptor.sampler = textures.terrainArray.sampler;
 	}
 
-	void buildCommandBuffers()
+	// The command buffer of the current frame in flight is recorded every frame, as it references that frame's descriptor sets and query pool
+	void recordCommandBuffer()
 	{
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
@@ -293,55 +282,55 @@ public:
 		renderPassBeginInfo.clearValueCount = 2;
 		renderPassBeginInfo.pClearValues = clearValues;
 
-		for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
-		{
-			renderPassBeginInfo.framebuffer = frameBuffers[i];
+		renderPassBeginInfo.framebuffer = frameBuffers[currentBuffer];
 
-			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
+		const VkCommandBuffer commandBuffer = frames[currentFrame].commandBuffer;
 
-			if (deviceFeatures.pipelineStatisticsQuery) {
-				vkCmdResetQueryPool(drawCmdBuffers[i], queryPool, 0, 2);
-			}
+		VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufInfo));
 
-			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		if (deviceFeatures.pipelineStatisticsQuery) {
+			// Reset the query pool of this frame (if not done on the host)
+			pipelineStatisticsQueries.cmdReset(commandBuffer, currentFrame);
+		}
 
-			VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
-			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-			VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
-			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+		VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
-			vkCmdSetLineWidth(drawCmdBuffers[i], 1.0f);
+		VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-			VkDeviceSize offsets[1] = { 0 };
+		vkCmdSetLineWidth(commandBuffer, 1.0f);
 
-			// Skysphere
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.skysphere);
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.skysphere, 0, 1, &descriptorSets.skysphere, 0, nullptr);
-			models.skysphere.draw(drawCmdBuffers[i]);
-
-			// Tessellated terrain
-			if (deviceFeatures.pipelineStatisticsQuery) {
-				// Begin pipeline statistics query
-				vkCmdBeginQuery(drawCmdBuffers[i], queryPool, 0, 0);
-			}
-			// Render
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, wireframe ? pipelines.wireframe : pipelines.terrain);
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.terrain, 0, 1, &descriptorSets.terrain, 0, nullptr);
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], 0, 1, &terrain.vertices.buffer, offsets);
-			vkCmdBindIndexBuffer(drawCmdBuffers[i], terrain.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdDrawIndexed(drawCmdBuffers[i], terrain.indices.count, 1, 0, 0, 0);
-			if (deviceFeatures.pipelineStatisticsQuery) {
-				// End pipeline statistics query
-				vkCmdEndQuery(drawCmdBuffers[i], queryPool, 0);
-			}
-
-			drawUI(drawCmdBuffers[i]);
+		VkDeviceSize offsets[1] = { 0 };
 
-			vkCmdEndRenderPass(drawCmdBuffers[i]);
+		// Skysphere
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.skysphere);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.skysphere, 0, 1, &descriptorSets[currentFrame].skysphere, 0, nullptr);
+		models.skysphere.draw(commandBuffer);
 
-			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
+		// Tessellated terrain
+		if (deviceFeatures.pipelineStatisticsQuery) {
+			// Begin pipeline statistics query
+			pipelineStatisticsQueries.cmdBeginQuery(commandBuffer, currentFrame, 0);
 		}
+		// Render
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, wireframe ? pipelines.wireframe : pipelines.terrain);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.terrain, 0, 1, &descriptorSets[currentFrame].terrain, 0, nullptr);
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &terrain.vertices.buffer, offsets);
+		vkCmdBindIndexBuffer(commandBuffer, terrain.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+		vkCmdDrawIndexed(commandBuffer, terrain.indices.count, 1, 0, 0, 0);
+		if (deviceFeatures.pipelineStatisticsQuery) {
+			// End pipeline statistics query
+			pipelineStatisticsQueries.cmdEndQuery(commandBuffer, currentFrame, 0);
+		}
+
+		drawUI(commandBuffer);
+
+		vkCmdEndRenderPass(commandBuffer);
+
+		VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
 	}
 
 	// Encapsulate height map data for easy sampling
@@ -551,15 +540,15 @@ public:
 	{
 		std::vector<VkDescriptorPoolSize> poolSizes =
 		{
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3)
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2 * maxFramesInFlight),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3 * maxFramesInFlight)
 		};
 
 		VkDescriptorPoolCreateInfo descriptorPoolInfo =
 			vks::initializers::descriptorPoolCreateInfo(
 				static_cast<uint32_t>(poolSizes.size()),
 				poolSizes.data(),
-				2);
+				2 * maxFramesInFlight);
 
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
 	}
@@ -621,53 +610,56 @@ public:
 		VkDescriptorSetAllocateInfo allocInfo;
 		std::vector<VkWriteDescriptorSet> writeDescriptorSets;
 
-		// Terrain
-		allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayouts.terrain, 1);
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets.terrain));
+		descriptorSets.resize(maxFramesInFlight);
+		for (uint32_t i = 0; i < maxFramesInFlight; i++) {
+			// Terrain
+			allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayouts.terrain, 1);
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets[i].terrain));
 
-		writeDescriptorSets =
-		{
-			// Binding 0 : Shared tessellation shader ubo
-			vks::initializers::writeDescriptorSet(
-				descriptorSets.terrain,
-				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-				0,
-				&uniformBuffers.terrainTessellation.descriptor),
-			// Binding 1 : Displacement map
-			vks::initializers::writeDescriptorSet(
-				descriptorSets.terrain,
-				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-				1,
-				&textures.heightMap.descriptor),
-			// Binding 2 : Color map (alpha channel)
-			vks::initializers::writeDescriptorSet(
-				descriptorSets.terrain,
-				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-				2,
-				&textures.terrainArray.descriptor),
-		};
-		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+			writeDescriptorSets =
+			{
+				// Binding 0 : Shared tessellation shader ubo
+				vks::initializers::writeDescriptorSet(
+					descriptorSets[i].terrain,
+					VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+					0,
+					&uniformBuffers[i].terrainTessellation.descriptor),
+				// Binding 1 : Displacement map
+				vks::initializers::writeDescriptorSet(
+					descriptorSets[i].terrain,
+					VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+					1,
+					&textures.heightMap.descriptor),
+				// Binding 2 : Color map (alpha channel)
+				vks::initializers::writeDescriptorSet(
+					descriptorSets[i].terrain,
+					VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+					2,
+					&textures.terrainArray.descriptor),
+			};
+			vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
 
-		// Skysphere
-		allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayouts.skysphere, 1);
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets.skysphere));
+			// Skysphere
+			allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayouts.skysphere, 1);
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets[i].skysphere));
 
-		writeDescriptorSets =
-		{
-			// Binding 0 : Vertex shader ubo
-			vks::initializers::writeDescriptorSet(
-				descriptorSets.skysphere,
-				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-				0,
-				&uniformBuffers.skysphereVertex.descriptor),
-			// Binding 1 : Fragment shader color map
-			vks::initializers::writeDescriptorSet(
-				descriptorSets.skysphere,
-				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-				1,
-				&textures.skySphere.descriptor),
-		};
-		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+			writeDescriptorSets =
+			{
+				// Binding 0 : Vertex shader ubo
+				vks::initializers::writeDescriptorSet(
+					descriptorSets[i].skysphere,
+					VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+					0,
+					&uniformBuffers[i].skysphereVertex.descriptor),
+				// Binding 1 : Fragment shader color map
+				vks::initializers::writeDescriptorSet(
+					descriptorSets[i].skysphere,
+					VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+					1,
+					&textures.skySphere.descriptor),
+			};
+			vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+		}
 	}
 
 	void preparePipelines()
@@ -730,27 +722,29 @@ public:
 	// Prepare and initialize uniform buffer containing shader uniforms
 	void prepareUniformBuffers()
 	{
-		// Shared tessellation shader stages uniform buffer
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&uniformBuffers.terrainTessellation,
-			sizeof(uboTess)));
-
-		// Skysphere vertex shader uniform buffer
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&uniformBuffers.skysphereVertex,
-			sizeof(uboVS)));
-
-		// Map persistent
-		VK_CHECK_RESULT(uniformBuffers.terrainTessellation.map());
-		VK_CHECK_RESULT(uniformBuffers.skysphereVertex.map());
-
-		updateUniformBuffers();
+		uniformBuffers.resize(maxFramesInFlight);
+		for (auto& buffers : uniformBuffers) {
+			// Shared tessellation shader stages uniform buffer
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(
+				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&buffers.terrainTessellation,
+				sizeof(uboTess)));
+
+			// Skysphere vertex shader uniform buffer
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(
+				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&buffers.skysphereVertex,
+				sizeof(uboVS)));
+
+			// Map persistent
+			VK_CHECK_RESULT(buffers.terrainTessellation.map());
+			VK_CHECK_RESULT(buffers.skysphereVertex.map());
+		}
 	}
 
+	// Updates the uniform buffers of the current frame in flight, the other frames may still be in use by the GPU
 	void updateUniformBuffers()
 	{
 		// Tessellation
@@ -770,7 +764,7 @@ public:
 			uboTess.tessellationFactor = 0.0f;
 		}
 
-		memcpy(uniformBuffers.terrainTessellation.mapped, &uboTess, sizeof(uboTess));
+		memcpy(uniformBuffers[currentFrame].terrainTessellation.mapped, &uboTess, sizeof(uboTess));
 
 		if (!tessellation)
 		{
@@ -779,24 +773,30 @@ public:
 
 		// Skysphere vertex shader
 		uboVS.mvp = camera.matrices.perspective * glm::mat4(glm::mat3(camera.matrices.view));
-		memcpy(uniformBuffers.skysphereVertex.mapped, &uboVS, sizeof(uboVS));
+		memcpy(uniformBuffers[currentFrame].skysphereVertex.mapped, &uboVS, sizeof(uboVS));
 	}
 
 	void draw()
 	{
-		VulkanExampleBase::prepareFrame();
+		// Waits until the GPU has finished with the resources of the current frame in flight
+		if (!VulkanExampleBase::prepareFrame()) {
+			return;
+		}
+
+		if (deviceFeatures.pipelineStatisticsQuery) {
+			// Read the query results of the last submission of this frame for displaying them
+			getQueryResults();
+		}
+
+		updateUniformBuffers();
+		recordCommandBuffer();
 
 		// Command buffer to be submitted to the queue
 		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
+		submitInfo.pCommandBuffers = &frames[currentFrame].commandBuffer;
 
 		// Submit to queue
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
-
-		if (deviceFeatures.pipelineStatisticsQuery) {
-			// Read query results for displaying in next frame
-			getQueryResults();
-		}
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, frames[currentFrame].fence));
 
 		VulkanExampleBase::submitFrame();
 	}
@@ -807,14 +807,13 @@ public:
 		loadAssets();
 		generateTerrain();
 		if (deviceFeatures.pipelineStatisticsQuery) {
-			setupQueryResultBuffer();
+			setupQueryPool();
 		}
 		prepareUniformBuffers();
 		setupDescriptorSetLayouts();
 		preparePipelines();
 		setupDescriptorPool();
 		setupDescriptorSets();
-		buildCommandBuffers();
 		prepared = true;
 	}
 
@@ -823,30 +822,16 @@ public:
 		if (!prepared)
 			return;
 		draw();
-		if (camera.updated) {
-			updateUniformBuffers();
-		}
-	}
-
-	virtual void viewChanged()
-	{
-		updateUniformBuffers();
 	}
 
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
 	{
 		if (overlay->header("Settings")) {
 
-			if (overlay->checkBox("Tessellation", &tessellation)) {
-				updateUniformBuffers();
-			}
-			if (overlay->inputFloat("Factor", &uboTess.tessellationFactor, 0.05f, 2)) {
-				updateUniformBuffers();
-			}
+			overlay->checkBox("Tessellation", &tessellation);
+			overlay->inputFloat("Factor", &uboTess.tessellationFactor, 0.05f, 2);
 			if (deviceFeatures.fillModeNonSolid) {
-				if (overlay->checkBox("Wireframe", &wireframe)) {
-					buildCommandBuffers();
-				}
+				overlay->checkBox("Wireframe", &wireframe);
 			}
 		}
 		if (deviceFeatures.pipelineStatisticsQuery) {
@@ -7,6 +7,8 @@
 */
 
 #include "vulkanexamplebase.h"
+#include "VulkanQueryRing.h"
+#include "threadpool.hpp"
 
 #define VERTEX_BUFFER_BIND_ID 0
 #define ENABLE_VALIDATION false
@@ -18,12 +20,155 @@ struct Vertex {
 	float normal[3];
 };
 
+// Select the widest SIMD instruction set available to the compiler for the vectorized noise kernel
+#if defined(__AVX2__)
+#define NOISE_SIMD_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define NOISE_SIMD_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define NOISE_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+// Thin wrappers around the SIMD operations used by the vectorized noise kernel, each lane evaluates the noise for one voxel
+namespace simd
+{
+#if defined(NOISE_SIMD_AVX2)
+	typedef __m256 Float;
+	typedef __m256i Int;
+	const uint32_t width = 8;
+	inline const char* instructionSet() { return "AVX2"; }
+	inline Float set(float value) { return _mm256_set1_ps(value); }
+	inline Int set(int32_t value) { return _mm256_set1_epi32(value); }
+	inline Float load(const float* values) { return _mm256_loadu_ps(values); }
+	inline void store(int32_t* values, Int a) { _mm256_storeu_si256((__m256i*)values, a); }
+	inline Float add(Float a, Float b) { return _mm256_add_ps(a, b); }
+	inline Float sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+	inline Float mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+	inline Float floor(Float a) { return _mm256_floor_ps(a); }
+	inline Int toInt(Float a) { return _mm256_cvttps_epi32(a); }
+	inline Int add(Int a, Int b) { return _mm256_add_epi32(a, b); }
+	inline Int bitAnd(Int a, Int b) { return _mm256_and_si256(a, b); }
+	inline Int bitOr(Int a, Int b) { return _mm256_or_si256(a, b); }
+	inline Int less(Int a, Int b) { return _mm256_cmpgt_epi32(b, a); }
+	inline Int equal(Int a, Int b) { return _mm256_cmpeq_epi32(a, b); }
+	template<int bits> inline Int shiftLeft(Int a) { return _mm256_slli_epi32(a, bits); }
+	inline Float select(Int mask, Float a, Float b) { return _mm256_blendv_ps(b, a, _mm256_castsi256_ps(mask)); }
+	inline Float flipSign(Float a, Int sign) { return _mm256_xor_ps(a, _mm256_castsi256_ps(sign)); }
+	inline Int gather(const int32_t* table, Int index) { return _mm256_i32gather_epi32(table, index, 4); }
+#elif defined(NOISE_SIMD_SSE2)
+	typedef __m128 Float;
+	typedef __m128i Int;
+	const uint32_t width = 4;
+	inline const char* instructionSet() { return "SSE2"; }
+	inline Float set(float value) { return _mm_set1_ps(value); }
+	inline Int set(int32_t value) { return _mm_set1_epi32(value); }
+	inline Float load(const float* values) { return _mm_loadu_ps(values); }
+	inline void store(int32_t* values, Int a) { _mm_storeu_si128((__m128i*)values, a); }
+	inline Float add(Float a, Float b) { return _mm_add_ps(a, b); }
+	inline Float sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+	inline Float mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+	inline Float floor(Float a)
+	{
+		// SSE2 has no rounding instruction, truncate and correct the lanes that were rounded up
+		const Float truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+		return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, a), _mm_set1_ps(1.0f)));
+	}
+	inline Int toInt(Float a) { return _mm_cvttps_epi32(a); }
+	inline Int add(Int a, Int b) { return _mm_add_epi32(a, b); }
+	inline Int bitAnd(Int a, Int b) { return _mm_and_si128(a, b); }
+	inline Int bitOr(Int a, Int b) { return _mm_or_si128(a, b); }
+	inline Int less(Int a, Int b) { return _mm_cmplt_epi32(a, b); }
+	inline Int equal(Int a, Int b) { return _mm_cmpeq_epi32(a, b); }
+	template<int bits> inline Int shiftLeft(Int a) { return _mm_slli_epi32(a, bits); }
+	inline Float select(Int mask, Float a, Float b)
+	{
+		const Float m = _mm_castsi128_ps(mask);
+		return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+	}
+	inline Float flipSign(Float a, Int sign) { return _mm_xor_ps(a, _mm_castsi128_ps(sign)); }
+	inline Int gather(const int32_t* table, Int index)
+	{
+		int32_t i[4];
+		_mm_storeu_si128((__m128i*)i, index);
+		return _mm_setr_epi32(table[i[0]], table[i[1]], table[i[2]], table[i[3]]);
+	}
+#elif defined(NOISE_SIMD_NEON)
+	typedef float32x4_t Float;
+	typedef int32x4_t Int;
+	const uint32_t width = 4;
+	inline const char* instructionSet() { return "NEON"; }
+	inline Float set(float value) { return vdupq_n_f32(value); }
+	inline Int set(int32_t value) { return vdupq_n_s32(value); }
+	inline Float load(const float* values) { return vld1q_f32(values); }
+	inline void store(int32_t* values, Int a) { vst1q_s32(values, a); }
+	inline Float add(Float a, Float b) { return vaddq_f32(a, b); }
+	inline Float sub(Float a, Float b) { return vsubq_f32(a, b); }
+	inline Float mul(Float a, Float b) { return vmulq_f32(a, b); }
+	inline Float floor(Float a)
+	{
+		// Rounding instructions are not available on ARMv7, truncate and correct the lanes that were rounded up
+		const Float truncated = vcvtq_f32_s32(vcvtq_s32_f32(a));
+		const uint32x4_t roundedUp = vcgtq_f32(truncated, a);
+		return vsubq_f32(truncated, vreinterpretq_f32_u32(vandq_u32(roundedUp, vreinterpretq_u32_f32(vdupq_n_f32(1.0f)))));
+	}
+	inline Int toInt(Float a) { return vcvtq_s32_f32(a); }
+	inline Int add(Int a, Int b) { return vaddq_s32(a, b); }
+	inline Int bitAnd(Int a, Int b) { return vandq_s32(a, b); }
+	inline Int bitOr(Int a, Int b) { return vorrq_s32(a, b); }
+	inline Int less(Int a, Int b) { return vreinterpretq_s32_u32(vcltq_s32(a, b)); }
+	inline Int equal(Int a, Int b) { return vreinterpretq_s32_u32(vceqq_s32(a, b)); }
+	template<int bits> inline Int shiftLeft(Int a) { return vshlq_n_s32(a, bits); }
+	inline Float select(Int mask, Float a, Float b) { return vbslq_f32(vreinterpretq_u32_s32(mask), a, b); }
+	inline Float flipSign(Float a, Int sign) { return vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_s32(sign))); }
+	inline Int gather(const int32_t* table, Int index)
+	{
+		int32_t i[4];
+		vst1q_s32(i, index);
+		const int32_t values[4] = { table[i[0]], table[i[1]], table[i[2]], table[i[3]] };
+		return vld1q_s32(values);
+	}
+#else
+	typedef float Float;
+	typedef int32_t Int;
+	const uint32_t width = 1;
+	inline const char* instructionSet() { return "Scalar"; }
+	inline Float set(float value) { return value; }
+	inline Int set(int32_t value) { return value; }
+	inline Float load(const float* values) { return values[0]; }
+	inline void store(int32_t* values, Int a) { values[0] = a; }
+	inline Float add(Float a, Float b) { return a + b; }
+	inline Float sub(Float a, Float b) { return a - b; }
+	inline Float mul(Float a, Float b) { return a * b; }
+	inline Float floor(Float a) { return floorf(a); }
+	inline Int toInt(Float a) { return static_cast<int32_t>(a); }
+	inline Int add(Int a, Int b) { return a + b; }
+	inline Int bitAnd(Int a, Int b) { return a & b; }
+	inline Int bitOr(Int a, Int b) { return a | b; }
+	inline Int less(Int a, Int b) { return (a < b) ? -1 : 0; }
+	inline Int equal(Int a, Int b) { return (a == b) ? -1 : 0; }
+	template<int bits> inline Int shiftLeft(Int a) { return static_cast<int32_t>(static_cast<uint32_t>(a) << bits); }
+	inline Float select(Int mask, Float a, Float b) { return (mask != 0) ? a : b; }
+	inline Float flipSign(Float a, Int sign)
+	{
+		uint32_t bits;
+		memcpy(&bits, &a, sizeof(bits));
+		bits ^= static_cast<uint32_t>(sign);
+		memcpy(&a, &bits, sizeof(a));
+		return a;
+	}
+	inline Int gather(const int32_t* table, Int index) { return table[index]; }
+#endif
+}
+
 // Translation of Ken Perlin's JAVA implementation (http://mrl.nyu.edu/~perlin/noise/)
 template <typename T>
 class PerlinNoise
 {
 private:
-	uint32_t permutations[512];
+	int32_t permutations[512];
 	T fade(T t)
 	{
 		return t * t * t * (t * (t * (T)6 - (T)15) + (T)10);
@@ -40,6 +185,27 @@ private:
 		T v = h < 4 ? y : h == 12 || h == 14 ? x : z;
 		return ((h & 1) == 0 ? u : -u) + ((h & 2) == 0 ? v : -v);
 	}
+	// Vectorized versions of the above, the gradient is selected per lane with masks instead of branches
+	simd::Float fadeSimd(simd::Float t) const
+	{
+		const simd::Float inner = simd::add(simd::mul(t, simd::sub(simd::mul(t, simd::set(6.0f)), simd::set(15.0f))), simd::set(10.0f));
+		return simd::mul(simd::mul(simd::mul(t, t), t), inner);
+	}
+	simd::Float lerpSimd(simd::Float t, simd::Float a, simd::Float b) const
+	{
+		return simd::add(a, simd::mul(t, simd::sub(b, a)));
+	}
+	simd::Float gradSimd(simd::Int hash, simd::Float x, simd::Float y, simd::Float z) const
+	{
+		const simd::Int h = simd::bitAnd(hash, simd::set(15));
+		const simd::Float u = simd::select(simd::less(h, simd::set(8)), x, y);
+		const simd::Int useX = simd::bitOr(simd::equal(h, simd::set(12)), simd::equal(h, simd::set(14)));
+		const simd::Float v = simd::select(simd::less(h, simd::set(4)), y, simd::select(useX, x, z));
+		// Bits 0 and 1 of the hash negate u and v, they are moved into the sign bit
+		const simd::Int signU = simd::shiftLeft<31>(h);
+		const simd::Int signV = simd::shiftLeft<30>(simd::bitAnd(h, simd::set(2)));
+		return simd::add(simd::flipSign(u, signU), simd::flipSign(v, signV));
+	}
 public:
 	PerlinNoise()
 	{
@@ -85,6 +251,49 @@ public:
 			lerp(v, lerp(u, grad(permutations[AA + 1], x, y, z - 1), grad(permutations[BA + 1], x - 1, y, z - 1)), lerp(u, grad(permutations[AB + 1], x, y - 1, z - 1), grad(permutations[BB + 1], x - 1, y - 1, z - 1))));
 		return res;
 	}
+	// Evaluates the noise for simd::width points at once, same results as noise
+	simd::Float noiseSimd(simd::Float x, simd::Float y, simd::Float z) const
+	{
+		// Find unit cubes that contain the points
+		const simd::Float cellX = simd::floor(x);
+		const simd::Float cellY = simd::floor(y);
+		const simd::Float cellZ = simd::floor(z);
+		const simd::Int X = simd::bitAnd(simd::toInt(cellX), simd::set(255));
+		const simd::Int Y = simd::bitAnd(simd::toInt(cellY), simd::set(255));
+		const simd::Int Z = simd::bitAnd(simd::toInt(cellZ), simd::set(255));
+		// Relative positions in the cubes
+		x = simd::sub(x, cellX);
+		y = simd::sub(y, cellY);
+		z = simd::sub(z, cellZ);
+		const simd::Float x1 = simd::sub(x, simd::set(1.0f));
+		const simd::Float y1 = simd::sub(y, simd::set(1.0f));
+		const simd::Float z1 = simd::sub(z, simd::set(1.0f));
+
+		const simd::Float u = fadeSimd(x);
+		const simd::Float v = fadeSimd(y);
+		const simd::Float w = fadeSimd(z);
+
+		// Hash coordinates of the 8 cube corners, the permutation lookups are gathered per lane
+		const simd::Int one = simd::set(1);
+		const simd::Int A = simd::add(simd::gather(permutations, X), Y);
+		const simd::Int AA = simd::add(simd::gather(permutations, A), Z);
+		const simd::Int AB = simd::add(simd::gather(permutations, simd::add(A, one)), Z);
+		const simd::Int B = simd::add(simd::gather(permutations, simd::add(X, one)), Y);
+		const simd::Int BA = simd::add(simd::gather(permutations, B), Z);
+		const simd::Int BB = simd::add(simd::gather(permutations, simd::add(B, one)), Z);
+
+		return lerpSimd(w, lerpSimd(v,
+			lerpSimd(u, gradSimd(simd::gather(permutations, AA), x, y, z), gradSimd(simd::gather(permutations, BA), x1, y, z)),
+			lerpSimd(u, gradSimd(simd::gather(permutations, AB), x, y1, z), gradSimd(simd::gather(permutations, BB), x1, y1, z))),
+			lerpSimd(v,
+			lerpSimd(u, gradSimd(simd::gather(permutations, simd::add(AA, one)), x, y, z1), gradSimd(simd::gather(permutations, simd::add(BA, one)), x1, y, z1)),
+			lerpSimd(u, gradSimd(simd::gather(permutations, simd::add(AB, one)), x, y1, z1), gradSimd(simd::gather(permutations, simd::add(BB, one)), x1, y1, z1))));
+	}
+	// Permutation table (512 entries), also used by the compute shader
+	const int32_t* getPermutations() const
+	{
+		return permutations;
+	}
 };
 
 // Fractal noise generator based on perlin noise above
@@ -123,6 +332,26 @@ public:
 		sum = sum / max;
 		return (sum + (T)1.0) / (T)2.0;
 	}
+
+	simd::Float noiseSimd(simd::Float x, simd::Float y, simd::Float z) const
+	{
+		simd::Float sum = simd::set(0.0f);
+		T frequency = (T)1;
+		T amplitude = (T)1;
+		T max = (T)0;
+		for (uint32_t i = 0; i < octaves; i++)
+		{
+			const simd::Float f = simd::set(frequency);
+			sum = simd::add(sum, simd::mul(perlinNoise.noiseSimd(simd::mul(x, f), simd::mul(y, f), simd::mul(z, f)), simd::set(amplitude)));
+			max += amplitude;
+			amplitude *= persistence;
+			frequency *= (T)2;
+		}
+
+		// Not all instruction sets have a vector division, so multiply with the reciprocal instead (may differ in the last bit from noise)
+		sum = simd::mul(sum, simd::set((T)1 / max));
+		return simd::mul(simd::add(sum, simd::set((T)1.0)), simd::set((T)0.5));
+	}
 };
 
 class VulkanExample : public VulkanExampleBase
@@ -168,6 +397,70 @@ public:
 	VkDescriptorSet descriptorSet;
 	VkDescriptorSetLayout descriptorSetLayout;
 
+	// The noise can either be generated on the CPU (vectorized and in parallel) or with a compute shader
+	enum NoisePath { NoisePathCPU = 0, NoisePathCompute = 1 };
+	int32_t noisePath = NoisePathCPU;
+	const std::vector<uint32_t> textureSizes = { 64, 128, 256 };
+	int32_t textureSizeIndex = 1;
+	// Spreads the generation and upload of a new volume over multiple frames
+	bool incrementalRegeneration = false;
+	int32_t slicesPerFrame = 16;
+	// Starts a new regeneration as soon as the previous one has finished
+	bool continuousRegeneration = false;
+
+	PerlinNoise<float> perlinNoise;
+	FractalNoise<float> fractalNoise{ perlinNoise };
+	float noiseScale = 8.0f;
+	// Noise space x coordinates of the voxels in a row, the same for all rows
+	std::vector<float> noiseCoordsX;
+	// Next slice of the volume to generate, the regeneration is complete once this reaches the texture's depth
+	uint32_t nextSlice = 0;
+
+	vks::JobSystem jobSystem;
+	uint32_t numThreads;
+
+	// Persistently mapped staging buffer the CPU writes the generated slices to
+	vks::Buffer stagingBuffer;
+
+	struct {
+		// Permutation table of the current noise (persistently mapped)
+		vks::Buffer permutations;
+		// The compute shader writes the packed voxels to this buffer, which is copied to the image like the staging buffer
+		vks::Buffer voxels;
+		VkDescriptorSetLayout descriptorSetLayout;
+		VkDescriptorSet descriptorSet;
+		VkPipelineLayout pipelineLayout;
+		VkPipeline pipeline;
+		bool supported = false;
+	} compute;
+
+	struct NoisePushConstants {
+		uint32_t width;
+		uint32_t height;
+		uint32_t depth;
+		float noiseScale;
+		uint32_t firstSlice;
+	};
+
+	// Generation (compute path) and upload of the slices of a frame, submitted along with that frame's command buffer
+	VkCommandBuffer updateCmdBuffer = VK_NULL_HANDLE;
+	bool updatePending = false;
+	// Timestamps at the start of the update, after the compute generation and after the upload
+	vks::QueryRing timestampQueries;
+	bool timestampsSupported = false;
+	uint64_t timestampMask = ~0ull;
+
+	struct NoiseTimings {
+		// CPU generation (wall clock), compute shader generation and upload (copy to the image) in ms, accumulated over all slices of a volume
+		double cpuGeneration = 0.0;
+		double gpuGeneration = 0.0;
+		double upload = 0.0;
+		uint32_t frames = 0;
+	};
+	// Timings of the regeneration in progress and of the last complete one
+	NoiseTimings noiseTimings;
+	NoiseTimings lastNoiseTimings;
+
 	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
 	{
 		title = "3D textures";
@@ -176,6 +469,25 @@ public:
 		camera.setRotation(glm::vec3(0.0f, 15.0f, 0.0f));
 		camera.setPerspective(60.0f, (float)width / (float)height, 0.1f, 256.0f);
 		srand((unsigned int)time(NULL));
+		numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+		jobSystem.setThreadCount(numThreads);
+		// Sample specific arguments to measure the noise generation (e.g. in benchmark mode)
+		commandLineParser.add("noisesize", { "-ns", "--noisesize" }, 1, "Set the size of the noise volume (64, 128 or 256)");
+		commandLineParser.add("computenoise", { "--computenoise" }, 0, "Generate the noise with a compute shader");
+		commandLineParser.add("regenerate", { "--regenerate" }, 0, "Continuously regenerate the noise");
+		commandLineParser.parse(args);
+		if (commandLineParser.isSet("noisesize")) {
+			const uint32_t size = static_cast<uint32_t>(commandLineParser.getValueAsInt("noisesize", 128));
+			for (size_t i = 0; i < textureSizes.size(); i++) {
+				if (textureSizes[i] == size) {
+					textureSizeIndex = static_cast<int32_t>(i);
+				}
+			}
+		}
+		if (commandLineParser.isSet("computenoise")) {
+			noisePath = NoisePathCompute;
+		}
+		continuousRegeneration = commandLineParser.isSet("regenerate");
 	}
 
 	~VulkanExample()
@@ -184,12 +496,24 @@ public:
 		// Note : Inherited destructor cleans up resources stored in base class
 
 		destroyTextureImage(texture);
+		stagingBuffer.destroy();
 
 		vkDestroyPipeline(device, pipelines.solid, nullptr);
 
 		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 
+		vkDestroyPipeline(device, compute.pipeline, nullptr);
+		vkDestroyPipelineLayout(device, compute.pipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(device, compute.descriptorSetLayout, nullptr);
+		compute.permutations.destroy();
+		compute.voxels.destroy();
+
+		if (timestampsSupported) {
+			timestampQueries.destroy();
+		}
+		vkFreeCommandBuffers(device, cmdPool, 1, &updateCmdBuffer);
+
 		vertexBuffer.destroy();
 		indexBuffer.destroy();
 		uniformBufferVS.destroy();
@@ -205,6 +529,7 @@ public:
 		texture.depth = depth;
 		texture.mipLevels = 1;
 		texture.format = VK_FORMAT_R8_UNORM;
+		texture.imageLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
 		// Format support check
 		// 3D texture support in Vulkan is mandatory (in contrast to OpenGL) so no need to check if it's supported
@@ -284,82 +609,152 @@ public:
 		texture.descriptor.imageView = texture.view;
 		texture.descriptor.sampler = texture.sampler;
 
-		updateNoiseTexture();
-	}
-
-	// Generate randomized noise and upload it to the 3D texture using staging
-	void updateNoiseTexture()
-	{
-		const uint32_t texMemSize = texture.width * texture.height * texture.depth;
-
-		uint8_t *data = new uint8_t[texMemSize];
-		memset(data, 0, texMemSize);
+		// The generated voxels are written to a persistently mapped staging buffer that has room for the whole volume, so incremental
+		// regenerations can write new slices while older ones are still being uploaded
+		const VkDeviceSize texMemSize = (VkDeviceSize)width * height * depth;
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&stagingBuffer,
+			texMemSize));
+		VK_CHECK_RESULT(stagingBuffer.map());
 
-		// Generate perlin based noise
-		std::cout << "Generating " << texture.width << " x " << texture.height << " x " << texture.depth << " noise texture..." << std::endl;
+		// Target of the compute shader, four voxels are packed into each uint
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&compute.voxels,
+			texMemSize));
 
-		auto tStart = std::chrono::high_resolution_clock::now();
+		noiseCoordsX.resize(width);
 
-		PerlinNoise<float> perlinNoise;
-		FractalNoise<float> fractalNoise(perlinNoise);
+		regenerateNoise();
+	}
 
-		const float noiseScale = static_cast<float>(rand() % 10) + 4.0f;
+	// Recreates the texture with a new size, the descriptors refer to the new image and buffers
+	void setTextureSize(uint32_t size)
+	{
+		vkDeviceWaitIdle(device);
+		destroyTextureImage(texture);
+		stagingBuffer.destroy();
+		compute.voxels.destroy();
+		prepareNoiseTexture(size, size, size);
+		updateDescriptorSets();
+		buildCommandBuffers();
+	}
 
-#pragma omp parallel for
-		for (int32_t z = 0; z < texture.depth; z++)
-		{
-			for (int32_t y = 0; y < texture.height; y++)
-			{
-				for (int32_t x = 0; x < texture.width; x++)
-				{
-					float nx = (float)x / (float)texture.width;
-					float ny = (float)y / (float)texture.height;
-					float nz = (float)z / (float)texture.depth;
-#define FRACTAL
-#ifdef FRACTAL
-					float n = fractalNoise.noise(nx * noiseScale, ny * noiseScale, nz * noiseScale);
-#else
-					float n = 20.0 * perlinNoise.noise(nx, ny, nz);
-#endif
-					n = n - floor(n);
+	// Starts the generation of a new randomized noise volume, the slices are generated and uploaded by updateNoiseTexture
+	void regenerateNoise()
+	{
+		perlinNoise = PerlinNoise<float>();
+		fractalNoise = FractalNoise<float>(perlinNoise);
+		noiseScale = static_cast<float>(rand() % 10) + 4.0f;
+		for (uint32_t x = 0; x < texture.width; x++) {
+			noiseCoordsX[x] = (float)x / (float)texture.width * noiseScale;
+		}
+		memcpy(compute.permutations.mapped, perlinNoise.getPermutations(), 512 * sizeof(int32_t));
+		nextSlice = 0;
+		noiseTimings = NoiseTimings();
+	}
 
-					data[x + y * texture.width + z * texture.width * texture.height] = static_cast<uint8_t>(floor(n * 255));
-				}
+	// Generates the noise for a row of voxels, the vectorized kernel evaluates simd::width voxels per call
+	void generateNoiseRow(uint8_t* dst, float ny, float nz)
+	{
+		const simd::Float y = simd::set(ny);
+		const simd::Float z = simd::set(nz);
+		uint32_t x = 0;
+		for (; x + simd::width <= texture.width; x += simd::width) {
+			simd::Float n = fractalNoise.noiseSimd(simd::load(&noiseCoordsX[x]), y, z);
+			n = simd::sub(n, simd::floor(n));
+			int32_t values[simd::width];
+			simd::store(values, simd::toInt(simd::floor(simd::mul(n, simd::set(255.0f)))));
+			// Staging memory is usually write-combined, so the voxels are written with a single store instead of byte by byte
+			uint8_t voxels[simd::width];
+			for (uint32_t i = 0; i < simd::width; i++) {
+				voxels[i] = static_cast<uint8_t>(values[i]);
 			}
+			memcpy(dst + x, voxels, simd::width);
 		}
+		// Remaining voxels if the width is not a multiple of the SIMD width
+		for (; x < texture.width; x++) {
+			float n = fractalNoise.noise(noiseCoordsX[x], ny, nz);
+			n = n - floor(n);
+			dst[x] = static_cast<uint8_t>(floor(n * 255));
+		}
+	}
 
-		auto tEnd = std::chrono::high_resolution_clock::now();
-		auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
-
-		std::cout << "Done in " << tDiff << "ms" << std::endl;
+	// Generates a range of slices straight into the staging buffer, slices are distributed across the job system's threads
+	void generateNoiseSlices(uint32_t firstSlice, uint32_t sliceCount)
+	{
+		uint8_t* data = static_cast<uint8_t*>(stagingBuffer.mapped);
+		const size_t sliceSize = (size_t)texture.width * texture.height;
+		jobSystem.parallelFor(sliceCount, [&](uint32_t i) {
+			const uint32_t z = firstSlice + i;
+			const float nz = (float)z / (float)texture.depth * noiseScale;
+			for (uint32_t y = 0; y < texture.height; y++) {
+				const float ny = (float)y / (float)texture.height * noiseScale;
+				generateNoiseRow(data + z * sliceSize + (size_t)y * texture.width, ny, nz);
+			}
+		});
+	}
 
-		// Create a host-visible staging buffer that contains the raw image data
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingMemory;
+	// Generates the next slices of a pending regeneration and records their upload to the 3D texture into the update command buffer
+	void updateNoiseTexture()
+	{
+		updatePending = false;
+		if (nextSlice >= texture.depth) {
+			return;
+		}
+		// All slices are generated at once unless the regeneration is incremental
+		// The first upload to a new image always contains the whole volume, as slices that haven't been uploaded yet would be undefined
+		uint32_t sliceCount = texture.depth - nextSlice;
+		if (incrementalRegeneration && (texture.imageLayout != VK_IMAGE_LAYOUT_UNDEFINED)) {
+			sliceCount = std::min(sliceCount, static_cast<uint32_t>(slicesPerFrame));
+		}
+		const uint32_t firstSlice = nextSlice;
+		nextSlice += sliceCount;
+		const bool useCompute = (noisePath == NoisePathCompute) && compute.supported;
+
+		if (!useCompute) {
+			auto tStart = std::chrono::high_resolution_clock::now();
+			generateNoiseSlices(firstSlice, sliceCount);
+			auto tEnd = std::chrono::high_resolution_clock::now();
+			const double tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+			noiseTimings.cpuGeneration += tDiff;
+			benchmark.addTaskTime("noise generation", tDiff);
+		}
 
-		// Buffer object
-		VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo();
-		bufferCreateInfo.size = texMemSize;
-		bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		VK_CHECK_RESULT(vkCreateBuffer(device, &bufferCreateInfo, nullptr, &stagingBuffer));
+		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+		VK_CHECK_RESULT(vkBeginCommandBuffer(updateCmdBuffer, &cmdBufInfo));
 
-		// Allocate host visible memory for data upload
-		VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
-		VkMemoryRequirements memReqs = {};
-		vkGetBufferMemoryRequirements(device, stagingBuffer, &memReqs);
-		memAllocInfo.allocationSize = memReqs.size;
-		memAllocInfo.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device, &memAllocInfo, nullptr, &stagingMemory));
-		VK_CHECK_RESULT(vkBindBufferMemory(device, stagingBuffer, stagingMemory, 0));
+		if (timestampsSupported) {
+			timestampQueries.cmdReset(updateCmdBuffer, 0);
+			timestampQueries.cmdWriteTimestamp(updateCmdBuffer, 0, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0);
+		}
 
-		// Copy texture data into staging buffer
-		uint8_t *mapped;
-		VK_CHECK_RESULT(vkMapMemory(device, stagingMemory, 0, memReqs.size, 0, (void **)&mapped));
-		memcpy(mapped, data, texMemSize);
-		vkUnmapMemory(device, stagingMemory);
+		VkBuffer srcBuffer = stagingBuffer.buffer;
+		if (useCompute) {
+			NoisePushConstants pushConstants = { texture.width, texture.height, texture.depth, noiseScale, firstSlice };
+			vkCmdBindPipeline(updateCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipeline);
+			vkCmdBindDescriptorSets(updateCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSet, 0, nullptr);
+			vkCmdPushConstants(updateCmdBuffer, compute.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(NoisePushConstants), &pushConstants);
+			// Each invocation generates four voxels of a row, work groups are 8 x 8
+			vkCmdDispatch(updateCmdBuffer, (texture.width / 4 + 7) / 8, (texture.height + 7) / 8, sliceCount);
+			// Make the shader writes visible to the copy
+			VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
+			bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			bufferBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferBarrier.buffer = compute.voxels.buffer;
+			bufferBarrier.size = VK_WHOLE_SIZE;
+			vkCmdPipelineBarrier(updateCmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+			srcBuffer = compute.voxels.buffer;
+		}
 
-		VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		if (timestampsSupported) {
+			timestampQueries.cmdWriteTimestamp(updateCmdBuffer, 0, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 1);
+		}
 
 		// The sub resource range describes the regions of the image we will be transitioned
 		VkImageSubresourceRange subresourceRange = {};
@@ -368,50 +763,85 @@ public:
 		subresourceRange.levelCount = 1;
 		subresourceRange.layerCount = 1;
 
-		// Optimal image will be used as destination for the copy, so we must transfer from our
-		// initial undefined image layout to the transfer destination layout
+		// Optimal image will be used as destination for the copy, so we must transfer from the current image layout to the transfer destination layout
+		// Slices that are not part of this upload keep their contents (unless the image is still undefined)
 		vks::tools::setImageLayout(
-			copyCmd,
+			updateCmdBuffer,
 			texture.image,
-			VK_IMAGE_LAYOUT_UNDEFINED,
+			texture.imageLayout,
 			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 			subresourceRange);
 
-		// Copy 3D noise data to texture
-
-		// Setup buffer copy regions
+		// Copy the generated slices to the 3D texture
 		VkBufferImageCopy bufferCopyRegion{};
+		bufferCopyRegion.bufferOffset = (VkDeviceSize)firstSlice * texture.width * texture.height;
 		bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 		bufferCopyRegion.imageSubresource.mipLevel = 0;
 		bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
 		bufferCopyRegion.imageSubresource.layerCount = 1;
+		bufferCopyRegion.imageOffset.z = firstSlice;
 		bufferCopyRegion.imageExtent.width = texture.width;
 		bufferCopyRegion.imageExtent.height = texture.height;
-		bufferCopyRegion.imageExtent.depth = texture.depth;
+		bufferCopyRegion.imageExtent.depth = sliceCount;
 
 		vkCmdCopyBufferToImage(
-			copyCmd,
-			stagingBuffer,
+			updateCmdBuffer,
+			srcBuffer,
 			texture.image,
 			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 			1,
 			&bufferCopyRegion);
 
-		// Change texture image layout to shader read after all mip levels have been copied
+		// Change texture image layout to shader read after the slices have been copied
 		texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 		vks::tools::setImageLayout(
-			copyCmd,
+			updateCmdBuffer,
 			texture.image,
 			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 			texture.imageLayout,
 			subresourceRange);
 
-		vulkanDevice->flushCommandBuffer(copyCmd, queue, true);
+		if (timestampsSupported) {
+			timestampQueries.cmdWriteTimestamp(updateCmdBuffer, 0, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 2);
+		}
 
-		// Clean up staging resources
-		delete[] data;
-		vkFreeMemory(device, stagingMemory, nullptr);
-		vkDestroyBuffer(device, stagingBuffer, nullptr);
+		VK_CHECK_RESULT(vkEndCommandBuffer(updateCmdBuffer));
+		updatePending = true;
+	}
+
+	// Reads the GPU timings of the last update once it has been executed and finishes the regeneration after its last slices
+	void finishNoiseUpdate()
+	{
+		noiseTimings.frames++;
+		if (timestampsSupported && timestampQueries.readResults(0) && timestampQueries.isAvailable(0) && timestampQueries.isAvailable(1) && timestampQueries.isAvailable(2)) {
+			const double timestampPeriod = vulkanDevice->properties.limits.timestampPeriod;
+			const uint64_t generation = (timestampQueries.getResult(1) - timestampQueries.getResult(0)) & timestampMask;
+			const uint64_t upload = (timestampQueries.getResult(2) - timestampQueries.getResult(1)) & timestampMask;
+			if ((noisePath == NoisePathCompute) && compute.supported) {
+				noiseTimings.gpuGeneration += (double)generation * timestampPeriod / 1000000.0;
+				benchmark.addPassTime("noise generation", (double)generation * timestampPeriod / 1000000.0);
+			}
+			noiseTimings.upload += (double)upload * timestampPeriod / 1000000.0;
+			benchmark.addPassTime("noise upload", (double)upload * timestampPeriod / 1000000.0);
+		}
+		if (nextSlice < texture.depth) {
+			return;
+		}
+		lastNoiseTimings = noiseTimings;
+		if (!continuousRegeneration) {
+			std::cout << "Generated " << texture.width << " x " << texture.height << " x " << texture.depth << " noise texture ";
+			if ((noisePath == NoisePathCompute) && compute.supported) {
+				std::cout << "with a compute shader in " << lastNoiseTimings.gpuGeneration << "ms";
+			} else {
+				std::cout << "on " << numThreads << " threads (" << simd::instructionSet() << ") in " << lastNoiseTimings.cpuGeneration << "ms";
+			}
+			if (timestampsSupported) {
+				std::cout << ", upload " << lastNoiseTimings.upload << "ms";
+			}
+			std::cout << " (" << lastNoiseTimings.frames << " frame" << ((lastNoiseTimings.frames > 1) ? "s" : "") << ")" << std::endl;
+		} else {
+			regenerateNoise();
+		}
 	}
 
 	// Free all Vulkan resources used a texture object
@@ -480,8 +910,10 @@ public:
 		VulkanExampleBase::prepareFrame();
 
 		// Command buffer to be submitted to the queue
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
+		// Newly generated noise slices are uploaded with the same submission, ahead of the frame's command buffer
+		std::array<VkCommandBuffer, 2> commandBuffers = { updateCmdBuffer, drawCmdBuffers[currentBuffer] };
+		submitInfo.commandBufferCount = updatePending ? 2 : 1;
+		submitInfo.pCommandBuffers = updatePending ? commandBuffers.data() : &drawCmdBuffers[currentBuffer];
 
 		// Submit to queue
 		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
@@ -566,11 +998,12 @@ public:
 
 	void setupDescriptorPool()
 	{
-		// Example uses one ubo and one image sampler
+		// Example uses one ubo and one image sampler, the noise compute shader uses two storage buffers
 		std::vector<VkDescriptorPoolSize> poolSizes =
 		{
 			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1)
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2)
 		};
 
 		VkDescriptorPoolCreateInfo descriptorPoolInfo =
@@ -623,6 +1056,15 @@ public:
 
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet));
 
+		allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &compute.descriptorSetLayout, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &compute.descriptorSet));
+
+		updateDescriptorSets();
+	}
+
+	// Also called when the texture has been recreated
+	void updateDescriptorSets()
+	{
 		std::vector<VkWriteDescriptorSet> writeDescriptorSets =
 		{
 			// Binding 0 : Vertex shader uniform buffer
@@ -636,7 +1078,19 @@ public:
 				descriptorSet,
 				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
 				1,
-				&texture.descriptor)
+				&texture.descriptor),
+			// Binding 0 : Compute shader permutation table
+			vks::initializers::writeDescriptorSet(
+				compute.descriptorSet,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				0,
+				&compute.permutations.descriptor),
+			// Binding 1 : Compute shader voxel output
+			vks::initializers::writeDescriptorSet(
+				compute.descriptorSet,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				1,
+				&compute.voxels.descriptor)
 		};
 
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
@@ -743,15 +1197,67 @@ public:
 		memcpy(uniformBufferVS.mapped, &uboVS, sizeof(uboVS));
 	}
 
+	// Prepare the resources used to generate the noise that don't depend on the texture size
+	void prepareNoiseGeneration()
+	{
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&compute.permutations,
+			512 * sizeof(int32_t)));
+		VK_CHECK_RESULT(compute.permutations.map());
+
+		// The compute shader is dispatched on the graphics queue
+		const VkQueueFamilyProperties& queueFamilyProperties = vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.graphics];
+		compute.supported = (queueFamilyProperties.queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+		if (!compute.supported) {
+			noisePath = NoisePathCPU;
+		}
+
+		const uint32_t timestampValidBits = queueFamilyProperties.timestampValidBits;
+		timestampsSupported = (timestampValidBits > 0) && (vulkanDevice->properties.limits.timestampPeriod > 0.0f);
+		if (timestampsSupported) {
+			timestampMask = (timestampValidBits >= 64) ? ~0ull : ((1ull << timestampValidBits) - 1);
+			timestampQueries.create(device, VK_QUERY_TYPE_TIMESTAMP, 3, 1);
+		}
+
+		VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(cmdPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &updateCmdBuffer));
+	}
+
+	void prepareCompute()
+	{
+		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+			// Binding 0 : Permutation table
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+			// Binding 1 : Packed voxels
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1)
+		};
+		VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), static_cast<uint32_t>(setLayoutBindings.size()));
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &compute.descriptorSetLayout));
+
+		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&compute.descriptorSetLayout, 1);
+		VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(NoisePushConstants), 0);
+		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &compute.pipelineLayout));
+
+		VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(compute.pipelineLayout, 0);
+		computePipelineCreateInfo.stage = loadShader(getShadersPath() + "texture3d/noise.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.pipeline));
+	}
+
 	void prepare()
 	{
 		VulkanExampleBase::prepare();
 		generateQuad();
 		setupVertexDescriptions();
 		prepareUniformBuffers();
-		prepareNoiseTexture(128, 128, 128);
+		prepareNoiseGeneration();
+		prepareNoiseTexture(textureSizes[textureSizeIndex], textureSizes[textureSizeIndex], textureSizes[textureSizeIndex]);
 		setupDescriptorSetLayout();
 		preparePipelines();
+		prepareCompute();
 		setupDescriptorPool();
 		setupDescriptorSet();
 		buildCommandBuffers();
@@ -762,7 +1268,12 @@ public:
 	{
 		if (!prepared)
 			return;
+		updateNoiseTexture();
 		draw();
+		// The queue is idle after each frame, so the timings of the update can be read right away
+		if (updatePending) {
+			finishNoiseUpdate();
+		}
 		if (!paused) {
 			updateUniformBuffers();
 		}
@@ -772,8 +1283,31 @@ public:
 	{
 		if (overlay->header("Settings")) {
 			if (overlay->button("Generate new texture")) {
-				updateNoiseTexture();
+				regenerateNoise();
+			}
+			if (overlay->comboBox("Size", &textureSizeIndex, { "64 x 64 x 64", "128 x 128 x 128", "256 x 256 x 256" })) {
+				setTextureSize(textureSizes[textureSizeIndex]);
+			}
+			if (compute.supported) {
+				overlay->comboBox("Generation", &noisePath, { "CPU", "Compute shader" });
+			}
+			overlay->checkBox("Incremental regeneration", &incrementalRegeneration);
+			if (incrementalRegeneration) {
+				overlay->sliderInt("Slices per frame", &slicesPerFrame, 1, 64);
+			}
+			overlay->checkBox("Continuous regeneration", &continuousRegeneration);
+		}
+		if (overlay->header("Noise generation")) {
+			if (noisePath == NoisePathCPU) {
+				overlay->text("%s, %d voxels per call, %d threads", simd::instructionSet(), simd::width, numThreads);
+				overlay->text("CPU generation: %.2f ms", lastNoiseTimings.cpuGeneration);
+			} else {
+				overlay->text("GPU generation: %.2f ms", lastNoiseTimings.gpuGeneration);
+			}
+			if (timestampsSupported) {
+				overlay->text("Upload: %.2f ms", lastNoiseTimings.upload);
 			}
+			overlay->text("Frames: %d", lastNoiseTimings.frames);
 		}
 	}
 };
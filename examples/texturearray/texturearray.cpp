@@ -498,12 +498,11 @@ public:
 		}
 
 		// Update instanced part of the uniform buffer
-		uint8_t *pData;
 		uint32_t dataOffset = sizeof(uboVS.matrices);
 		uint32_t dataSize = layerCount * sizeof(UboInstanceData);
-		VK_CHECK_RESULT(vkMapMemory(device, uniformBufferVS.memory, dataOffset, dataSize, 0, (void **)&pData));
-		memcpy(pData, uboVS.instance, dataSize);
-		vkUnmapMemory(device, uniformBufferVS.memory);
+		VK_CHECK_RESULT(uniformBufferVS.map(dataSize, dataOffset));
+		memcpy(uniformBufferVS.mapped, uboVS.instance, dataSize);
+		uniformBufferVS.unmap();
 
 		// Map persistent
 		VK_CHECK_RESULT(uniformBufferVS.map());
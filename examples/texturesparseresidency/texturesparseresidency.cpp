@@ -7,7 +7,9 @@
 */
 
 /*
-* Note : This sample is work-in-progress and works basically, but it's not yet finished
+* Streams the pages of a partially resident (sparse) texture based on GPU feedback
+* The fragment shader records the pages it wants to sample from, the host reads these requests back, binds pages from a fixed size memory pool
+* (evicting the least recently requested ones if the pool is full) and uploads their contents asynchronously on the transfer queue
 */
 
 #include "texturesparseresidency.h"
@@ -21,6 +23,8 @@ VirtualTexturePage::VirtualTexturePage()
 {
 	// Pages are initially not backed up by memory (non-resident)
 	imageMemoryBind.memory = VK_NULL_HANDLE;
+	poolSlot = UINT32_MAX;
+	lastRequested = 0;
 }
 
 bool VirtualTexturePage::resident()
@@ -28,44 +32,75 @@ bool VirtualTexturePage::resident()
 	return (imageMemoryBind.memory != VK_NULL_HANDLE);
 }
 
-// Allocate Vulkan memory for the virtual page
-bool VirtualTexturePage::allocate(VkDevice device, uint32_t memoryTypeIndex)
+// Back the virtual page with a slot of the page pool, takes effect with the next sparse binding that includes this page
+void VirtualTexturePage::bind(VkDeviceMemory memory, VkDeviceSize memoryOffset, uint32_t slot)
 {
-	if (imageMemoryBind.memory != VK_NULL_HANDLE)
-	{
-		return false;
-	};
+	imageMemoryBind.memory = memory;
+	imageMemoryBind.memoryOffset = memoryOffset;
+	poolSlot = slot;
+}
 
-	imageMemoryBind = {};
+// Remove the memory backing, takes effect with the next sparse binding that includes this page
+void VirtualTexturePage::unbind()
+{
+	imageMemoryBind.memory = VK_NULL_HANDLE;
+	imageMemoryBind.memoryOffset = 0;
+	poolSlot = UINT32_MAX;
+}
 
+/*
+	Page pool
+	Device memory for resident pages
+ */
+
+void PagePool::create(VkDevice device, uint32_t memoryTypeIndex, VkDeviceSize pageSize, uint32_t pageCount, uint32_t pagesPerBlock)
+{
+	this->device = device;
+	this->pageSize = pageSize;
+	this->pagesPerBlock = pagesPerBlock;
+	const uint32_t blockCount = (pageCount + pagesPerBlock - 1) / pagesPerBlock;
+	capacity = blockCount * pagesPerBlock;
+	// Page size is the sparse block size, which is also the required alignment of the memory offsets
 	VkMemoryAllocateInfo allocInfo = vks::initializers::memoryAllocateInfo();
-	allocInfo.allocationSize = size;
+	allocInfo.allocationSize = pageSize * pagesPerBlock;
 	allocInfo.memoryTypeIndex = memoryTypeIndex;
-	VK_CHECK_RESULT(vkAllocateMemory(device, &allocInfo, nullptr, &imageMemoryBind.memory));
-
-	VkImageSubresource subResource{};
-	subResource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	subResource.mipLevel = mipLevel;
-	subResource.arrayLayer = layer;
+	blocks.resize(blockCount);
+	for (auto& block : blocks)
+	{
+		VK_CHECK_RESULT(vkAllocateMemory(device, &allocInfo, nullptr, &block));
+	}
+	// Lowest slots are handed out first
+	freeSlots.resize(capacity);
+	for (uint32_t i = 0; i < capacity; i++)
+	{
+		freeSlots[i] = capacity - 1 - i;
+	}
+}
 
-	// Sparse image memory binding
-	imageMemoryBind.subresource = subResource;
-	imageMemoryBind.extent = extent;
-	imageMemoryBind.offset = offset;
+bool PagePool::allocate(uint32_t& slot)
+{
+	if (freeSlots.empty())
+	{
+		return false;
+	}
+	slot = freeSlots.back();
+	freeSlots.pop_back();
 	return true;
 }
 
-// Release Vulkan memory allocated for this page
-bool VirtualTexturePage::release(VkDevice device)
+void PagePool::free(uint32_t slot)
+{
+	freeSlots.push_back(slot);
+}
+
+void PagePool::destroy()
 {
-	del= false;
-	if (imageMemoryBind.memory != VK_NULL_HANDLE)
+	for (auto block : blocks)
 	{
-		vkFreeMemory(device, imageMemoryBind.memory, nullptr);
-		imageMemoryBind.memory = VK_NULL_HANDLE;
-		return true;
+		vkFreeMemory(device, block, nullptr);
 	}
-	return false;
+	blocks.clear();
+	freeSlots.clear();
 }
 
 /*
@@ -85,30 +120,37 @@ VirtualTexturePage* VirtualTexture::addPage(VkOffset3D offset, VkExtent3D extent
 	newPage.imageMemoryBind = {};
 	newPage.imageMemoryBind.offset = offset;
 	newPage.imageMemoryBind.extent = extent;
-	newPage.del = false;
 	pages.push_back(newPage);
 	return &pages.back();
 }
 
+// Returns the index of the page covering the same area in the next coarser mip level, UINT32_MAX if that level is part of the mip tail
+uint32_t VirtualTexture::getParentPage(const VirtualTexturePage& page)
+{
+	const uint32_t parentLevel = page.mipLevel + 1;
+	if ((page.layer != 0) || (parentLevel >= levels.size()))
+	{
+		return UINT32_MAX;
+	}
+	const VkExtent3D& granularity = sparseImageMemoryRequirements.formatProperties.imageGranularity;
+	const PageLevel& level = levels[parentLevel];
+	const uint32_t x = std::min(static_cast<uint32_t>(page.offset.x) / granularity.width / 2, level.pagesX - 1);
+	const uint32_t y = std::min(static_cast<uint32_t>(page.offset.y) / granularity.height / 2, level.pagesY - 1);
+	return level.firstPage + y * level.pagesX + x;
+}
+
 // Call before sparse binding to update memory bind list etc.
-void VirtualTexture::updateSparseBindInfo(std::vector<VirtualTexturePage> &bindingChangedPages, bool del)
+// Pages are bound to their current memory, pages without memory are unbound
+void VirtualTexture::updateSparseBindInfo(const std::vector<VirtualTexturePage*> &bindingChangedPages, bool bindMipTail)
 {
-	// Update list of memory-backed sparse image memory binds
-	//sparseImageMemoryBinds.resize(pages.size());
+	// Update list of changed sparse image memory binds
 	sparseImageMemoryBinds.clear();
 	for (auto page : bindingChangedPages)
 	{
-		sparseImageMemoryBinds.push_back(page.imageMemoryBind);
-		if (del)
-		{
-			sparseImageMemoryBinds[sparseImageMemoryBinds.size() - 1].memory = VK_NULL_HANDLE;
-		}
+		sparseImageMemoryBinds.push_back(page->imageMemoryBind);
 	}
 	// Update sparse bind info
 	bindSparseInfo = vks::initializers::bindSparseInfo();
-	// todo: Semaphore for queue submission
-	// bindSparseInfo.signalSemaphoreCount = 1;
-	// bindSparseInfo.pSignalSemaphores = &bindSparseSemaphore;
 
 	// Image memory binds
 	imageMemoryBindInfo = {};
@@ -118,29 +160,21 @@ void VirtualTexture::updateSparseBindInfo(std::vector<VirtualTexturePage> &bindi
 	bindSparseInfo.imageBindCount = (imageMemoryBindInfo.bindCount > 0) ? 1 : 0;
 	bindSparseInfo.pImageBinds = &imageMemoryBindInfo;
 
-	// Opaque image memory binds for the mip tail
+	// Opaque image memory binds for the mip tail, which stays resident once it has been bound
 	opaqueMemoryBindInfo.image = image;
 	opaqueMemoryBindInfo.bindCount = static_cast<uint32_t>(opaqueMemoryBinds.size());
 	opaqueMemoryBindInfo.pBinds = opaqueMemoryBinds.data();
-	bindSparseInfo.imageOpaqueBindCount = (opaqueMemoryBindInfo.bindCount > 0) ? 1 : 0;
+	bindSparseInfo.imageOpaqueBindCount = (bindMipTail && (opaqueMemoryBindInfo.bindCount > 0)) ? 1 : 0;
 	bindSparseInfo.pImageOpaqueBinds = &opaqueMemoryBindInfo;
 }
 
-// Release all Vulkan resources
+// Release all Vulkan resources, page memory is owned by the page pool
 void VirtualTexture::destroy()
 {
-	for (auto page : pages)
-	{
-		page.release(device);
-	}
 	for (auto bind : opaqueMemoryBinds)
 	{
 		vkFreeMemory(device, bind.memory, nullptr);
 	}
-	// Clean up mip tail
-	if (mipTailimageMemoryBind.memory != VK_NULL_HANDLE) {
-		vkFreeMemory(device, mipTailimageMemoryBind.memory, nullptr);
-	}
 }
 
 /*
@@ -154,13 +188,26 @@ VulkanExample::VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
 	camera.setPosition(glm::vec3(0.0f, 0.0f, -12.0f));
 	camera.setRotation(glm::vec3(-90.0f, 0.0f, 0.0f));
 	camera.setPerspective(60.0f, (float)width / (float)height, 0.1f, 256.0f);
+	// Sample specific arguments to measure streaming with different amounts of page memory (e.g. in benchmark mode)
+	commandLineParser.add("pagepool", { "--pagepool" }, 1, "Set the number of pages in the page pool");
+	commandLineParser.add("pagesperframe", { "--pagesperframe" }, 1, "Set the max. number of pages uploaded per frame");
+	commandLineParser.parse(args);
+	if (commandLineParser.isSet("pagepool")) {
+		streaming.poolPages = static_cast<uint32_t>(std::max(commandLineParser.getValueAsInt("pagepool", 512), 1));
+	}
+	if (commandLineParser.isSet("pagesperframe")) {
+		streaming.pagesPerFrame = std::max(commandLineParser.getValueAsInt("pagesperframe", 32), 1);
+	}
 }
 
 VulkanExample::~VulkanExample()
 {
 	// Clean up used Vulkan resources
 	// Note : Inherited destructor cleans up resources stored in base class
+	vulkanDevice->stagingUploader.waitIdle();
 	destroyTextureImage(texture);
+	streaming.pagePool.destroy();
+	streaming.feedbackBuffer.destroy();
 	vkDestroySemaphore(device, bindSparseSemaphore, nullptr);
 	vkDestroyPipeline(device, pipeline, nullptr);
 	vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
@@ -178,6 +225,10 @@ void VulkanExample::getEnabledFeatures()
 	else {
 		std::cout << "Sparse binding not supported" << std::endl;
 	}
+	// The fragment shader writes the page requests to a storage buffer
+	if (deviceFeatures.fragmentStoresAndAtomics) {
+		enabledFeatures.fragmentStoresAndAtomics = VK_TRUE;
+	}
 }
 
 glm::uvec3 VulkanExample::alignedDivision(const VkExtent3D& extent, const VkExtent3D& granularity)
@@ -241,14 +292,25 @@ void VulkanExample::prepareSparseTexture(uint32_t width, uint32_t height, uint32
 	sparseImageCreateInfo.samples = sampleCount;
 	sparseImageCreateInfo.tiling = imageTiling;
 	sparseImageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	// Pages are uploaded on the transfer queue while the graphics queue samples other pages of the same mip level
+	// Sharing the image avoids queue family ownership transfers, which would also cover the pages in use
+	uint32_t sharedQueueFamilies[2] = { vulkanDevice->queueFamilyIndices.graphics, vulkanDevice->queueFamilyIndices.transfer };
+	texture.concurrentSharing = (sharedQueueFamilies[0] != sharedQueueFamilies[1]);
+	if (texture.concurrentSharing)
+	{
+		sparseImageCreateInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		sparseImageCreateInfo.queueFamilyIndexCount = 2;
+		sparseImageCreateInfo.pQueueFamilyIndices = sharedQueueFamilies;
+	}
 	sparseImageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 	sparseImageCreateInfo.extent = { texture.width, texture.height, 1 };
 	sparseImageCreateInfo.usage = imageUsage;
 	sparseImageCreateInfo.flags = VK_IMAGE_CREATE_SPARSE_BINDING_BIT | VK_IMAGE_CREATE_SPARSE_RESIDENCY_BIT;
 	VK_CHECK_RESULT(vkCreateImage(device, &sparseImageCreateInfo, nullptr, &texture.image));
 
+	// The image stays in the general layout, so pages can be uploaded without changing the layout of the levels that are being sampled
 	VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-	vks::tools::setImageLayout(copyCmd, texture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, texture.subRange);
+	vks::tools::setImageLayout(copyCmd, texture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, texture.subRange);
 	vulkanDevice->flushCommandBuffer(copyCmd, queue);
 
 	// Get memory requirements
@@ -352,6 +414,12 @@ void VulkanExample::prepareSparseTexture(uint32_t width, uint32_t height, uint32
 			lastBlockExtent.y = (extent.height % imageGranularity.height) ? extent.height % imageGranularity.height : imageGranularity.height;
 			lastBlockExtent.z = (extent.depth % imageGranularity.depth) ? extent.depth % imageGranularity.depth : imageGranularity.depth;
 
+			// Page layout of the first layer's levels for the feedback
+			if ((layer == 0) && (texture.levels.size() < MAX_PAGE_LEVELS))
+			{
+				texture.levels.push_back({ static_cast<uint32_t>(texture.pages.size()), sparseBindCounts.x, sparseBindCounts.y });
+			}
+
 			// @todo: Comment
 			uint32_t index = 0;
 			for (uint32_t z = 0; z < sparseBindCounts.z; z++)
@@ -432,14 +500,10 @@ void VulkanExample::prepareSparseTexture(uint32_t width, uint32_t height, uint32
 	VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
 	VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &bindSparseSemaphore));
 
-	// Prepare bind sparse info for reuse in queue submission
-	texture.updateSparseBindInfo(texture.pages);
-
-	// Bind to queue
-	// todo: in draw?
-	vkQueueBindSparse(queue, 1, &texture.bindSparseInfo, VK_NULL_HANDLE);
-	//todo: use sparse bind semaphore
-	vkQueueWaitIdle(queue);
+	// Only the mip tail is bound initially, pages are bound on demand
+	texture.updateSparseBindInfo({}, true);
+	VK_CHECK_RESULT(vkQueueBindSparse(queue, 1, &texture.bindSparseInfo, VK_NULL_HANDLE));
+	VK_CHECK_RESULT(vkQueueWaitIdle(queue));
 
 	// Create sampler
 	VkSamplerCreateInfo sampler = vks::initializers::samplerCreateInfo();
@@ -472,7 +536,7 @@ void VulkanExample::prepareSparseTexture(uint32_t width, uint32_t height, uint32
 	VK_CHECK_RESULT(vkCreateImageView(device, &view, nullptr, &texture.view));
 
 	// Fill image descriptor image info that can be used during the descriptor set setup
-	texture.descriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	texture.descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 	texture.descriptor.imageView = texture.view;
 	texture.descriptor.sampler = texture.sampler;
 }
@@ -525,6 +589,12 @@ void VulkanExample::buildCommandBuffers()
 
 		vkCmdEndRenderPass(drawCmdBuffers[i]);
 
+		// Make the page requests written by the fragment shader available to the host
+		VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
 		VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
 	}
 }
@@ -532,6 +602,8 @@ void VulkanExample::buildCommandBuffers()
 void VulkanExample::draw()
 {
 	VulkanExampleBase::prepareFrame();
+	// Only a single frame is in flight, so the feedback of the previous frame is complete at this point
+	updateResidency();
 	submitInfo.commandBufferCount = 1;
 	submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
 	VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
@@ -546,11 +618,12 @@ void VulkanExample::loadAssets()
 
 void VulkanExample::setupDescriptorPool()
 {
-	// Example uses one ubo and one image sampler
+	// Example uses one ubo, one image sampler and one storage buffer for the feedback
 	std::vector<VkDescriptorPoolSize> poolSizes =
 	{
 		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1),
-		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1)
+		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1),
+		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1)
 	};
 
 	VkDescriptorPoolCreateInfo descriptorPoolInfo =
@@ -566,16 +639,21 @@ void VulkanExample::setupDescriptorSetLayout()
 {
 	std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings =
 	{
-		// Binding 0 : Vertex shader uniform buffer
+		// Binding 0 : Vertex and fragment shader uniform buffer
 		vks::initializers::descriptorSetLayoutBinding(
 			VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-			VK_SHADER_STAGE_VERTEX_BIT,
+			VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
 			0),
 		// Binding 1 : Fragment shader image sampler
 		vks::initializers::descriptorSetLayoutBinding(
 			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
 			VK_SHADER_STAGE_FRAGMENT_BIT,
-			1)
+			1),
+		// Binding 2 : Fragment shader page request feedback
+		vks::initializers::descriptorSetLayoutBinding(
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			VK_SHADER_STAGE_FRAGMENT_BIT,
+			2)
 	};
 
 	VkDescriptorSetLayoutCreateInfo descriptorLayout =
@@ -605,7 +683,7 @@ void VulkanExample::setupDescriptorSet()
 
 	std::vector<VkWriteDescriptorSet> writeDescriptorSets =
 	{
-		// Binding 0 : Vertex shader uniform buffer
+		// Binding 0 : Vertex and fragment shader uniform buffer
 		vks::initializers::writeDescriptorSet(
 			descriptorSet,
 			VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
@@ -616,7 +694,13 @@ void VulkanExample::setupDescriptorSet()
 			descriptorSet,
 			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
 			1,
-			&texture.descriptor)
+			&texture.descriptor),
+		// Binding 2 : Fragment shader page request feedback
+		vks::initializers::writeDescriptorSet(
+			descriptorSet,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			2,
+			&streaming.feedbackBuffer.descriptor)
 	};
 
 	vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
@@ -662,6 +746,8 @@ void VulkanExample::prepareUniformBuffers()
 		&uniformBufferVS,
 		sizeof(uboVS),
 		&uboVS));
+	// The frame index changes every frame, so the buffer stays mapped
+	VK_CHECK_RESULT(uniformBufferVS.map());
 
 	updateUniformBuffers();
 }
@@ -671,10 +757,8 @@ void VulkanExample::updateUniformBuffers()
 	uboVS.projection = camera.matrices.perspective;
 	uboVS.model = camera.matrices.view;
 	uboVS.viewPos = camera.viewPos;
-
-	VK_CHECK_RESULT(uniformBufferVS.map());
+	uboVS.frameIndex = streaming.frameIndex;
 	memcpy(uniformBufferVS.mapped, &uboVS, sizeof(uboVS));
-	uniformBufferVS.unmap();
 }
 
 void VulkanExample::prepare()
@@ -684,10 +768,14 @@ void VulkanExample::prepare()
 	if (!vulkanDevice->features.sparseResidencyImage2D) {
 		vks::tools::exitFatal("Device does not support sparse residency for 2D images!", VK_ERROR_FEATURE_NOT_PRESENT);
 	}
+	if (!vulkanDevice->features.fragmentStoresAndAtomics) {
+		vks::tools::exitFatal("Device does not support stores in fragment shaders, which are required for the page feedback!", VK_ERROR_FEATURE_NOT_PRESENT);
+	}
 	loadAssets();
-	prepareUniformBuffers();
 	// Create a virtual texture with max. possible dimension (does not take up any VRAM yet)
 	prepareSparseTexture(4096, 4096, 1, VK_FORMAT_R8G8B8A8_UNORM);
+	prepareStreaming();
+	prepareUniformBuffers();
 	setupDescriptorSetLayout();
 	preparePipelines();
 	setupDescriptorPool();
@@ -701,9 +789,6 @@ void VulkanExample::render()
 	if (!prepared)
 		return;
 	draw();
-	if (camera.updated) {
-		updateUniformBuffers();
-	}
 }
 
 void VulkanExample::viewChanged()
@@ -711,190 +796,254 @@ void VulkanExample::viewChanged()
 	updateUniformBuffers();
 }
 
-// Fills a buffer with random colors
-void VulkanExample::randomPattern(uint8_t* buffer, uint32_t width, uint32_t height)
+// Generates the contents of a texture region, a checkerboard with the same cell size in all mip levels tinted with a different color per level
+void VulkanExample::generateTexels(uint32_t mipLevel, VkOffset3D offset, VkExtent3D extent, uint8_t* buffer)
 {
-	std::random_device rd;
-	std::mt19937 rndEngine(rd());
-	std::uniform_int_distribution<uint32_t> rndDist(0, 255);
-	uint8_t rndVal[4] = { 0, 0, 0, 0 };
-	while (rndVal[0] + rndVal[1] + rndVal[2] < 10) {
-		rndVal[0] = (uint8_t)rndDist(rndEngine);
-		rndVal[1] = (uint8_t)rndDist(rndEngine);
-		rndVal[2] = (uint8_t)rndDist(rndEngine);
-	}
-	rndVal[3] = 255;
-	for (uint32_t y = 0; y < height; y++) {
-		for (uint32_t x = 0; x < width; x++) {
-			for (uint32_t c = 0; c < 4; c++, ++buffer) {
-				*buffer = rndVal[c];
+	static const uint8_t levelColors[8][3] = {
+		{ 255, 64, 64 }, { 255, 160, 64 }, { 240, 240, 64 }, { 64, 224, 64 }, { 64, 224, 224 }, { 64, 128, 255 }, { 160, 64, 255 }, { 255, 64, 192 }
+	};
+	const uint8_t* color = levelColors[mipLevel % 8];
+	// Cells are 256 texels wide in the first mip level
+	const uint32_t cellShift = (mipLevel < 8) ? 8 - mipLevel : 0;
+	// Page borders are darkened, so streaming can be followed visually
+	const VkExtent3D& granularity = texture.sparseImageMemoryRequirements.formatProperties.imageGranularity;
+	for (uint32_t y = 0; y < extent.height; y++) {
+		const uint32_t texelY = offset.y + y;
+		for (uint32_t x = 0; x < extent.width; x++) {
+			const uint32_t texelX = offset.x + x;
+			uint32_t intensity = (((texelX >> cellShift) ^ (texelY >> cellShift)) & 1) ? 160 : 255;
+			if ((texelX % granularity.width == 0) || (texelY % granularity.height == 0)) {
+				intensity = 64;
 			}
+			for (uint32_t c = 0; c < 3; c++) {
+				*buffer++ = static_cast<uint8_t>(color[c] * intensity / 255);
+			}
+			*buffer++ = 255;
 		}
 	}
 }
 
-void VulkanExample::uploadContent(VirtualTexturePage page, VkImage image)
+void VulkanExample::prepareStreaming()
 {
-	// Generate some random image data and upload as a buffer
-	const size_t bufferSize = 4 * page.extent.width * page.extent.height;
+	// All pages have the size of a sparse block, so the pool can back any page with any of its slots
+	if (!texture.pages.empty()) {
+		streaming.pagePool.create(device, texture.memoryTypeIndex, texture.pages[0].size, streaming.poolPages, 64);
+	}
 
-	vks::Buffer imageBuffer;
+	// Feedback buffer with one request entry per page, read on the host after each frame
 	VK_CHECK_RESULT(vulkanDevice->createBuffer(
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
 		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		&imageBuffer,
-		bufferSize));
-	imageBuffer.map();
+		&streaming.feedbackBuffer,
+		std::max(texture.pages.size(), (size_t)1) * sizeof(uint32_t)));
+	VK_CHECK_RESULT(streaming.feedbackBuffer.map());
+	memset(streaming.feedbackBuffer.mapped, 0, streaming.feedbackBuffer.size);
+
+	// Page layout used by the fragment shader to find the page of a texel
+	const VkExtent3D& granularity = texture.sparseImageMemoryRequirements.formatProperties.imageGranularity;
+	uboVS.pageScale = glm::vec2((float)texture.width / (float)granularity.width, (float)texture.height / (float)granularity.height);
+	uboVS.mipTailStart = static_cast<uint32_t>(texture.levels.size());
+	for (size_t i = 0; i < texture.levels.size(); i++) {
+		uboVS.levels[i] = glm::uvec4(texture.levels[i].firstPage, texture.levels[i].pagesX, texture.levels[i].pagesY, 0);
+	}
 
-	uint8_t* data = (uint8_t*)imageBuffer.mapped;
-	randomPattern(data, page.extent.height, page.extent.width);
+	uploadMipTail();
+	stats.bandwidthStart = std::chrono::high_resolution_clock::now();
+}
+
+// Uploads the contents of a page, the page needs to be bound before the upload is submitted
+void VulkanExample::uploadPage(const VirtualTexturePage& page)
+{
+	const VkDeviceSize dataSize = 4 * page.extent.width * page.extent.height;
+	streaming.pageData.resize(dataSize);
+	generateTexels(page.mipLevel, page.offset, page.extent, streaming.pageData.data());
 
-	VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-	vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, texture.subRange, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
 	VkBufferImageCopy region{};
 	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	region.imageSubresource.layerCount = 1;
 	region.imageSubresource.mipLevel = page.mipLevel;
+	region.imageSubresource.baseArrayLayer = page.layer;
+	region.imageSubresource.layerCount = 1;
 	region.imageOffset = page.offset;
 	region.imageExtent = page.extent;
-	vkCmdCopyBufferToImage(copyCmd, imageBuffer.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-	vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, texture.subRange, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
-	vulkanDevice->flushCommandBuffer(copyCmd, queue);
 
-	imageBuffer.destroy();
+	vks::StagingUploader::ImageUploadInfo uploadInfo;
+	uploadInfo.image = texture.image;
+	uploadInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, page.mipLevel, 1, page.layer, 1 };
+	// Other pages of the level may be resident and in use, so the level keeps its contents and layout
+	uploadInfo.initialLayout = VK_IMAGE_LAYOUT_GENERAL;
+	uploadInfo.finalLayout = VK_IMAGE_LAYOUT_GENERAL;
+	uploadInfo.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	uploadInfo.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	uploadInfo.concurrentSharing = texture.concurrentSharing;
+	vulkanDevice->stagingUploader.uploadImage(uploadInfo, streaming.pageData.data(), dataSize, { region });
+
+	stats.uploadedBytes += dataSize;
+	stats.bandwidthBytes += dataSize;
 }
 
-void VulkanExample::fillRandomPages()
+// The mip tail is bound when the texture is created and stays resident, so it's only uploaded once
+void VulkanExample::uploadMipTail()
 {
-	vkDeviceWaitIdle(device);
-
-	std::default_random_engine rndEngine(std::random_device{}());
-	std::uniform_real_distribution<float> rndDist(0.0f, 1.0f);
-
-	std::vector<VirtualTexturePage> updatedPages;
-	std::vector<VirtualTexturePage> bindingChangedPages;
-	for (auto& page : texture.pages) {
-		if (rndDist(rndEngine) < 0.5f) {
-			continue;
-		}
-		if (page.allocate(device, texture.memoryTypeIndex))
-		{
-			bindingChangedPages.push_back(page);
+	if (texture.mipTailStart >= texture.mipLevels) {
+		return;
+	}
+	std::vector<VkBufferImageCopy> regions;
+	VkDeviceSize dataSize = 0;
+	for (uint32_t level = texture.mipTailStart; level < texture.mipLevels; level++) {
+		VkBufferImageCopy region{};
+		region.bufferOffset = dataSize;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = level;
+		region.imageSubresource.layerCount = texture.layerCount;
+		region.imageExtent = { std::max(texture.width >> level, 1u), std::max(texture.height >> level, 1u), 1 };
+		regions.push_back(region);
+		dataSize += 4 * region.imageExtent.width * region.imageExtent.height * texture.layerCount;
+	}
+	std::vector<uint8_t> data(dataSize);
+	for (auto& region : regions) {
+		const VkDeviceSize layerSize = 4 * region.imageExtent.width * region.imageExtent.height;
+		for (uint32_t layer = 0; layer < texture.layerCount; layer++) {
+			generateTexels(region.imageSubresource.mipLevel, region.imageOffset, region.imageExtent, &data[region.bufferOffset + layer * layerSize]);
 		}
-		updatedPages.push_back(page);
 	}
 
-	// Update sparse queue binding
-	texture.updateSparseBindInfo(bindingChangedPages);
-	VkFenceCreateInfo fenceInfo = vks::initializers::fenceCreateInfo(VK_FLAGS_NONE);
-	VkFence fence;
-	VK_CHECK_RESULT(vkCreateFence(device, &fenceInfo, nullptr, &fence));
-	vkQueueBindSparse(queue, 1, &texture.bindSparseInfo, fence);
-	vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
-	vkDestroyFence(device, fence, nullptr);
-
-	for (auto &page: updatedPages) {
-		uploadContent(page, texture.image);
-	}
+	vks::StagingUploader::ImageUploadInfo uploadInfo;
+	uploadInfo.image = texture.image;
+	uploadInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, texture.mipTailStart, texture.mipLevels - texture.mipTailStart, 0, texture.layerCount };
+	uploadInfo.initialLayout = VK_IMAGE_LAYOUT_GENERAL;
+	uploadInfo.finalLayout = VK_IMAGE_LAYOUT_GENERAL;
+	uploadInfo.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	uploadInfo.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	uploadInfo.concurrentSharing = texture.concurrentSharing;
+	vulkanDevice->stagingUploader.uploadImage(uploadInfo, data.data(), dataSize, regions);
+	vulkanDevice->stagingUploader.flush();
+	stats.uploadedBytes += dataSize;
 }
 
-void VulkanExample::fillMipTail()
+/*
+	Reads the page requests of the last frame and streams in missing pages
+	Requested pages (and the coarser pages covering the same area) are moved to the front of the LRU list. Missing pages are bound to slots of the
+	page pool, coarse pages first, and the least recently requested pages are evicted if the pool is full. All binding changes of a frame are done
+	with a single sparse binding and the contents of the new pages are uploaded on the transfer queue with a single batch that waits for the binding.
+	The frame's command buffer is submitted after the upload batch, which makes the new contents visible to the fragment shader
+*/
+void VulkanExample::updateResidency()
 {
-	// Clean up previous mip tail memory allocation
-	if (texture.mipTailimageMemoryBind.memory != VK_NULL_HANDLE) {
-		vkFreeMemory(device, texture.mipTailimageMemoryBind.memory, nullptr);
-	}
+	auto tStart = std::chrono::high_resolution_clock::now();
+
+	stats.requestedPages = 0;
+	stats.misses = 0;
+	stats.uploads = 0;
+	stats.evictions = 0;
+
+	const uint32_t frame = streaming.frameIndex;
+	if ((frame > 0) && !texture.pages.empty()) {
+		const uint32_t* requests = static_cast<const uint32_t*>(streaming.feedbackBuffer.mapped);
+		streaming.missedPages.clear();
+		for (uint32_t i = 0; i < static_cast<uint32_t>(texture.pages.size()); i++) {
+			if (requests[i] != frame) {
+				continue;
+			}
+			stats.requestedPages++;
+			// Coarser pages are kept resident as fallbacks for the pages of the finer levels
+			for (uint32_t index = i; index != UINT32_MAX; index = texture.getParentPage(texture.pages[index])) {
+				VirtualTexturePage& page = texture.pages[index];
+				if (page.lastRequested == frame) {
+					// Page and its parents have already been visited for another request
+					break;
+				}
+				page.lastRequested = frame;
+				if (page.resident()) {
+					streaming.lru.splice(streaming.lru.begin(), streaming.lru, page.lruPosition);
+				}
+				else {
+					streaming.missedPages.push_back(&page);
+				}
+			}
+		}
+		stats.misses = static_cast<uint32_t>(streaming.missedPages.size());
+
+		if (streaming.enabled && !streaming.missedPages.empty()) {
+			// Coarse pages are streamed in first, as they cover more of the missing area
+			std::stable_sort(streaming.missedPages.begin(), streaming.missedPages.end(), [](const VirtualTexturePage* a, const VirtualTexturePage* b) { return a->mipLevel > b->mipLevel; });
+			const uint32_t maxLoads = std::min(static_cast<uint32_t>(streaming.missedPages.size()), static_cast<uint32_t>(streaming.pagesPerFrame));
+			streaming.bindingChangedPages.clear();
+			uint32_t loadCount = 0;
+			for (; loadCount < maxLoads; loadCount++) {
+				uint32_t slot;
+				if (!streaming.pagePool.allocate(slot)) {
+					// Pool is full, reuse the slot of the least recently requested page unless it's still part of the working set
+					if (streaming.lru.empty()) {
+						break;
+					}
+					VirtualTexturePage& victim = texture.pages[streaming.lru.back()];
+					if (frame - victim.lastRequested <= streaming.keepFrames) {
+						break;
+					}
+					slot = victim.poolSlot;
+					victim.unbind();
+					streaming.lru.pop_back();
+					streaming.bindingChangedPages.push_back(&victim);
+					stats.evictions++;
+				}
+				VirtualTexturePage* page = streaming.missedPages[loadCount];
+				page->bind(streaming.pagePool.getMemory(slot), streaming.pagePool.getOffset(slot), slot);
+				streaming.lru.push_front(page->index);
+				page->lruPosition = streaming.lru.begin();
+				streaming.bindingChangedPages.push_back(page);
+			}
 
-	//@todo: WIP
-	VkDeviceSize imageMipTailSize = texture.sparseImageMemoryRequirements.imageMipTailSize;
-	VkDeviceSize imageMipTailOffset = texture.sparseImageMemoryRequirements.imageMipTailOffset;
-	// Stride between memory bindings for each mip level if not single mip tail (VK_SPARSE_IMAGE_FORMAT_SINGLE_MIPTAIL_BIT not set)
-	VkDeviceSize imageMipTailStride = texture.sparseImageMemoryRequirements.imageMipTailStride;
+			// Pages are only evicted to make room for new ones, so there are uploads whenever the bindings changed
+			if (loadCount > 0) {
+				texture.updateSparseBindInfo(streaming.bindingChangedPages);
+				texture.bindSparseInfo.signalSemaphoreCount = 1;
+				texture.bindSparseInfo.pSignalSemaphores = &bindSparseSemaphore;
+				VK_CHECK_RESULT(vkQueueBindSparse(queue, 1, &texture.bindSparseInfo, VK_NULL_HANDLE));
+				vulkanDevice->stagingUploader.addWaitSemaphore(bindSparseSemaphore, VK_PIPELINE_STAGE_TRANSFER_BIT);
+				for (uint32_t i = 0; i < loadCount; i++) {
+					uploadPage(*streaming.missedPages[i]);
+				}
+				vulkanDevice->stagingUploader.flush();
+				stats.uploads = loadCount;
+			}
+		}
+	}
 
-	VkMemoryAllocateInfo allocInfo = vks::initializers::memoryAllocateInfo();
-	allocInfo.allocationSize = imageMipTailSize;
-	allocInfo.memoryTypeIndex = texture.memoryTypeIndex;
-	VK_CHECK_RESULT(vkAllocateMemory(device, &allocInfo, nullptr, &texture.mipTailimageMemoryBind.memory));
-
-	uint32_t mipLevel = texture.sparseImageMemoryRequirements.imageMipTailFirstLod;
-	uint32_t width = std::max(texture.width >> texture.sparseImageMemoryRequirements.imageMipTailFirstLod, 1u);
-	uint32_t height = std::max(texture.height >> texture.sparseImageMemoryRequirements.imageMipTailFirstLod, 1u);
-	uint32_t depth = 1;
-
-	for (uint32_t i = texture.mipTailStart; i < texture.mipLevels; i++) {
-
-		const uint32_t width = std::max(texture.width >> i, 1u);
-		const uint32_t height = std::max(texture.height >> i, 1u);
-
-		// Generate some random image data and upload as a buffer
-		const size_t bufferSize = 4 * width * height;
-
-		vks::Buffer imageBuffer;
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&imageBuffer,
-			bufferSize));
-		imageBuffer.map();
-
-		// Fill buffer with random colors
-		std::random_device rd;
-		std::mt19937 rndEngine(rd());
-		std::uniform_int_distribution<uint32_t> rndDist(0, 255);
-		uint8_t* data = (uint8_t*)imageBuffer.mapped;
-		randomPattern(data, width, height);
-
-		VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-		vks::tools::setImageLayout(copyCmd, texture.image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, texture.subRange, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
-		VkBufferImageCopy region{};
-		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		region.imageSubresource.layerCount = 1;
-		region.imageSubresource.mipLevel = i;
-		region.imageOffset = {};
-		region.imageExtent = { width, height, 1 };
-		vkCmdCopyBufferToImage(copyCmd, imageBuffer.buffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-		vks::tools::setImageLayout(copyCmd, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, texture.subRange, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
-		vulkanDevice->flushCommandBuffer(copyCmd, queue);
+	// Requests of the next frame are tagged with a new index, so the buffer never needs to be cleared
+	streaming.frameIndex++;
+	updateUniformBuffers();
 
-		imageBuffer.destroy();
+	auto tEnd = std::chrono::high_resolution_clock::now();
+	benchmark.addTaskTime("page streaming", std::chrono::duration<double, std::milli>(tEnd - tStart).count());
+	const double elapsed = std::chrono::duration<double>(tEnd - stats.bandwidthStart).count();
+	if (elapsed >= 1.0) {
+		stats.uploadBandwidth = (double)stats.bandwidthBytes / (1024.0 * 1024.0) / elapsed;
+		stats.bandwidthBytes = 0;
+		stats.bandwidthStart = tEnd;
 	}
 }
 
-void VulkanExample::flushRandomPages()
+// Evicts all pages, only the mip tail stays resident
+void VulkanExample::flushPages()
 {
-	vkDeviceWaitIdle(device);
-
-	std::default_random_engine rndEngine(std::random_device{}());
-	std::uniform_real_distribution<float> rndDist(0.0f, 1.0f);
-
-	std::vector<VirtualTexturePage> updatedPages;
-	std::vector<VirtualTexturePage> bindingChangedPages;
-	for (auto& page : texture.pages)
-	{
-		if (rndDist(rndEngine) < 0.5f) {
-			continue;
-		}
-		if (page.imageMemoryBind.memory != VK_NULL_HANDLE){
-			page.del = true;
-			bindingChangedPages.push_back(page);
-		}
+	VK_CHECK_RESULT(vkQueueWaitIdle(queue));
+	vulkanDevice->stagingUploader.waitIdle();
+
+	streaming.bindingChangedPages.clear();
+	for (uint32_t index : streaming.lru) {
+		VirtualTexturePage& page = texture.pages[index];
+		streaming.pagePool.free(page.poolSlot);
+		page.unbind();
+		streaming.bindingChangedPages.push_back(&page);
 	}
-
-	// Update sparse queue binding
-	texture.updateSparseBindInfo(bindingChangedPages, true);
-	VkFenceCreateInfo fenceInfo = vks::initializers::fenceCreateInfo(VK_FLAGS_NONE);
-	VkFence fence;
-	VK_CHECK_RESULT(vkCreateFence(device, &fenceInfo, nullptr, &fence));
-	vkQueueBindSparse(queue, 1, &texture.bindSparseInfo, fence);
-	vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
-	vkDestroyFence(device, fence, nullptr);
-	for (auto& page : texture.pages)
-	{
-		if (page.del)
-		{
-			page.release(device);
-		}
+	streaming.lru.clear();
+	if (streaming.bindingChangedPages.empty()) {
+		return;
 	}
+
+	texture.updateSparseBindInfo(streaming.bindingChangedPages);
+	VK_CHECK_RESULT(vkQueueBindSparse(queue, 1, &texture.bindSparseInfo, VK_NULL_HANDLE));
+	VK_CHECK_RESULT(vkQueueWaitIdle(queue));
 }
 
 void VulkanExample::OnUpdateUIOverlay(vks::UIOverlay* overlay)
@@ -903,23 +1052,22 @@ void VulkanExample::OnUpdateUIOverlay(vks::UIOverlay* overlay)
 		if (overlay->sliderFloat("LOD bias", &uboVS.lodBias, -(float)texture.mipLevels, (float)texture.mipLevels)) {
 			updateUniformBuffers();
 		}
-		if (overlay->button("Fill random pages")) {
-			fillRandomPages();
-		}
-		if (overlay->button("Flush random pages")) {
-			flushRandomPages();
-		}
-		if (overlay->button("Fill mip tail")) {
-			fillMipTail();
+		overlay->checkBox("Stream pages", &streaming.enabled);
+		overlay->sliderInt("Pages per frame", &streaming.pagesPerFrame, 1, 128);
+		if (overlay->button("Flush pages")) {
+			flushPages();
 		}
 	}
 	if (overlay->header("Statistics")) {
-		uint32_t respages = 0;
-		std::for_each(texture.pages.begin(), texture.pages.end(), [&respages](VirtualTexturePage page) { respages += (page.resident()) ? 1 : 0; });
-		overlay->text("Resident pages: %d of %d", respages, static_cast<uint32_t>(texture.pages.size()));
+		overlay->text("Resident pages: %d of %d", static_cast<uint32_t>(streaming.lru.size()), static_cast<uint32_t>(texture.pages.size()));
+		overlay->text("Page pool: %d of %d (%.1f MB)", streaming.pagePool.getUsedCount(), streaming.pagePool.capacity, (float)(streaming.pagePool.capacity * streaming.pagePool.pageSize) / (1024.0f * 1024.0f));
+		overlay->text("Requested pages: %d", stats.requestedPages);
+		overlay->text("Misses: %d", stats.misses);
+		overlay->text("Uploads: %d, evictions: %d", stats.uploads, stats.evictions);
+		overlay->text("Upload bandwidth: %.2f MB/s", stats.uploadBandwidth);
+		overlay->text("Uploaded: %.1f MB", (float)stats.uploadedBytes / (1024.0f * 1024.0f));
 		overlay->text("Mip tail starts at: %d", texture.mipTailStart);
 	}
-
 }
 
 VULKAN_EXAMPLE_MAIN()
@@ -7,14 +7,22 @@
 */
 
 /*
-* Note : This sample is work-in-progress and works basically, but it's not yet finished
+* Streams the pages of a partially resident (sparse) texture based on GPU feedback
+* The fragment shader records the pages it wants to sample from, the host reads these requests back, binds pages from a fixed size memory pool
+* (evicting the least recently requested ones if the pool is full) and uploads their contents asynchronously on the transfer queue
 */
 
+#include <list>
+#include <chrono>
+
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
 
 #define ENABLE_VALIDATION false
 
+// Max. number of mip levels outside of the mip tail that are passed to the shader
+#define MAX_PAGE_LEVELS 16
+
 // Virtual texture page as a part of the partially resident texture
 // Contains memory bindings, offsets and status information
 struct VirtualTexturePage
@@ -26,12 +34,34 @@ struct VirtualTexturePage
 	uint32_t mipLevel;													// Mip level that this page belongs to
 	uint32_t layer;														// Array layer that this page belongs to
 	uint32_t index;
-    bool del;
+	uint32_t poolSlot;													// Slot of the page pool backing this page (if resident)
+	uint32_t lastRequested;												// Last frame that requested this page or one of its finer pages
+	std::list<uint32_t>::iterator lruPosition;							// Position in the least recently used list (if resident)
 
 	VirtualTexturePage();
 	bool resident();
-	bool allocate(VkDevice device, uint32_t memoryTypeIndex);
-	bool release(VkDevice device);
+	void bind(VkDeviceMemory memory, VkDeviceSize memoryOffset, uint32_t slot);
+	void unbind();
+};
+
+// Fixed size pool of device memory backing the resident pages
+// Memory is allocated in a few large blocks that are split into page sized slots, so binding a page never allocates
+struct PagePool
+{
+	VkDevice device = VK_NULL_HANDLE;
+	std::vector<VkDeviceMemory> blocks;
+	std::vector<uint32_t> freeSlots;
+	VkDeviceSize pageSize = 0;
+	uint32_t pagesPerBlock = 0;
+	uint32_t capacity = 0;
+
+	void create(VkDevice device, uint32_t memoryTypeIndex, VkDeviceSize pageSize, uint32_t pageCount, uint32_t pagesPerBlock);
+	bool allocate(uint32_t& slot);
+	void free(uint32_t slot);
+	VkDeviceMemory getMemory(uint32_t slot) const { return blocks[slot / pagesPerBlock]; }
+	VkDeviceSize getOffset(uint32_t slot) const { return (slot % pagesPerBlock) * pageSize; }
+	uint32_t getUsedCount() const { return capacity - static_cast<uint32_t>(freeSlots.size()); }
+	void destroy();
 };
 
 // Virtual texture object containing all pages
@@ -48,8 +78,15 @@ struct VirtualTexture
 	uint32_t mipTailStart;												// First mip level in mip tail
 	VkSparseImageMemoryRequirements sparseImageMemoryRequirements;		// @todo: Comment
 	uint32_t memoryTypeIndex;											// @todo: Comment
+	bool concurrentSharing;												// Image is shared by the graphics and transfer queue families
 
-	VkSparseImageMemoryBind mipTailimageMemoryBind{};
+	// Page layout of a mip level outside of the mip tail, pages are stored row by row
+	struct PageLevel {
+		uint32_t firstPage;
+		uint32_t pagesX;
+		uint32_t pagesY;
+	};
+	std::vector<PageLevel> levels;
 
 	// @todo: comment
 	struct MipTailInfo {
@@ -58,7 +95,8 @@ struct VirtualTexture
 	} mipTailInfo;
 
 	VirtualTexturePage *addPage(VkOffset3D offset, VkExtent3D extent, const VkDeviceSize size, const uint32_t mipLevel, uint32_t layer);
-	void updateSparseBindInfo(std::vector<VirtualTexturePage> &bindingChangedPages, bool del = false);
+	uint32_t getParentPage(const VirtualTexturePage& page);
+	void updateSparseBindInfo(const std::vector<VirtualTexturePage*> &bindingChangedPages, bool bindMipTail = false);
 	// @todo: replace with dtor?
 	void destroy();
 };
@@ -86,6 +124,12 @@ public:
 		glm::mat4 model;
 		glm::vec4 viewPos;
 		float lodBias = 0.0f;
+		// Feedback
+		uint32_t frameIndex = 0;
+		glm::vec2 pageScale;
+		uint32_t mipTailStart = 0;
+		uint32_t padding[3];
+		glm::uvec4 levels[MAX_PAGE_LEVELS];
 	} uboVS;
 	vks::Buffer uniformBufferVS;
 
@@ -94,14 +138,46 @@ public:
 	VkDescriptorSet descriptorSet;
 	VkDescriptorSetLayout descriptorSetLayout;
 
-	//todo: comment
+	// Signalled by the sparse binding of new pages and waited on by the upload of their contents
 	VkSemaphore bindSparseSemaphore = VK_NULL_HANDLE;
 
+	struct Streaming {
+		PagePool pagePool;
+		// Number of pages in the pool, can be changed via command line
+		uint32_t poolPages = 512;
+		// Resident pages, most recently requested first
+		std::list<uint32_t> lru;
+		// Index of the last frame that requested a page, written by the fragment shader
+		vks::Buffer feedbackBuffer;
+		// Frame index written to the feedback buffer by the frame currently being rendered
+		uint32_t frameIndex = 0;
+		// Max. number of pages bound and uploaded per frame
+		int32_t pagesPerFrame = 32;
+		// Pages requested within this many frames are not evicted (the dithered feedback covers each fragment once every 16 frames)
+		uint32_t keepFrames = 32;
+		bool enabled = true;
+		std::vector<VirtualTexturePage*> missedPages;
+		std::vector<VirtualTexturePage*> bindingChangedPages;
+		std::vector<uint8_t> pageData;
+	} streaming;
+
+	struct StreamingStats {
+		uint32_t requestedPages = 0;
+		uint32_t misses = 0;
+		uint32_t uploads = 0;
+		uint32_t evictions = 0;
+		uint64_t uploadedBytes = 0;
+		// Upload bandwidth in MB/s, averaged over one second
+		double uploadBandwidth = 0.0;
+		uint64_t bandwidthBytes = 0;
+		std::chrono::time_point<std::chrono::high_resolution_clock> bandwidthStart;
+	} stats;
+
 	VulkanExample();
 	~VulkanExample();
 	virtual void getEnabledFeatures();
 	glm::uvec3 alignedDivision(const VkExtent3D& extent, const VkExtent3D& granularity);
-	void randomPattern(uint8_t* buffer, uint32_t width, uint32_t height);
+	void generateTexels(uint32_t mipLevel, VkOffset3D offset, VkExtent3D extent, uint8_t* buffer);
 	void prepareSparseTexture(uint32_t width, uint32_t height, uint32_t layerCount, VkFormat format);
 	// @todo: move to dtor of texture
 	void destroyTextureImage(SparseTexture texture);
@@ -117,9 +193,10 @@ public:
 	void prepare();
 	virtual void render();
 	virtual void viewChanged();
-	void uploadContent(VirtualTexturePage page, VkImage image);
-	void fillRandomPages();
-	void fillMipTail();
-	void flushRandomPages();
+	void prepareStreaming();
+	void uploadPage(const VirtualTexturePage& page);
+	void uploadMipTail();
+	void updateResidency();
+	void flushPages();
 	virtual void OnUpdateUIOverlay(vks::UIOverlay* overlay);
 };
@@ -54,6 +54,9 @@ public:
 
 	glm::vec4 lightPos = glm::vec4(1.0f, 4.0f, 0.0f, 0.0f);
 
+	// Cull the models' primitives in a compute shader and draw them with indirect draws (see vkglTF::Model::gpuDriven)
+	bool gpuDrivenRendering = false;
+
 	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
 	{
 		title = "Vulkan Demo Scene - (c) by Sascha Willems";
@@ -84,6 +87,22 @@ public:
 		textures.skybox.destroy();
 	}
 
+	virtual void getEnabledFeatures()
+	{
+		// Indirect draws of a material range are issued at once if multi draw indirect is available
+		if (deviceFeatures.multiDrawIndirect) {
+			enabledFeatures.multiDrawIndirect = VK_TRUE;
+		}
+	}
+
+	virtual void getEnabledExtensions()
+	{
+		// Lets the GPU driven path only draw the visible commands of a material range
+		if (vulkanDevice->extensionSupported(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)) {
+			enabledDeviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+		}
+	}
+
 	void loadAssets()
 	{
 		// Models
@@ -118,12 +137,24 @@ public:
 		renderPassBeginInfo.clearValueCount = 2;
 		renderPassBeginInfo.pClearValues = clearValues;
 
+		for (auto model : demoModels) {
+			model.glTF->gpuDriven.enabled = gpuDrivenRendering && model.glTF->gpuDriven.prepared;
+		}
+
 		for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
 		{
 			renderPassBeginInfo.framebuffer = frameBuffers[i];
 
 			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
+			// The culling passes need to be recorded outside of the render pass, the frustum is stored in the command buffers, so they're rebuilt when the view changes
+			if (gpuDrivenRendering) {
+				const glm::mat4 viewProjection = camera.matrices.perspective * camera.matrices.view;
+				for (auto model : demoModels) {
+					model.glTF->recordGpuDrivenCulling(drawCmdBuffers[i], viewProjection);
+				}
+			}
+
 			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 			VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
@@ -309,6 +340,9 @@ public:
 	{
 		VulkanExampleBase::prepare();
 		loadAssets();
+		for (auto model : demoModels) {
+			model.glTF->prepareGpuDrivenRendering(getShadersPath(), pipelineCache);
+		}
 		prepareUniformBuffers();
 		setupDescriptorSetLayout();
 		preparePipelines();
@@ -328,6 +362,28 @@ public:
 	virtual void viewChanged()
 	{
 		updateUniformBuffers();
+		if (gpuDrivenRendering) {
+			buildCommandBuffers();
+		}
+	}
+
+	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
+	{
+		if (overlay->header("Settings")) {
+			if (overlay->checkBox("GPU driven rendering", &gpuDrivenRendering)) {
+				buildCommandBuffers();
+			}
+		}
+		if (gpuDrivenRendering && overlay->header("Statistics")) {
+			uint32_t drawCount = 0;
+			uint32_t visibleCount = 0;
+			for (auto model : demoModels) {
+				drawCount += model.glTF->gpuDriven.drawCount;
+				visibleCount += model.glTF->getGpuDrivenVisibleDrawCount();
+			}
+			overlay->text("Drawn primitives: %d", visibleCount);
+			overlay->text("Culled primitives: %d", drawCount - visibleCount);
+		}
 	}
 
 };
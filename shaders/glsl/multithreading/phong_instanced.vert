@@ -0,0 +1,34 @@
+#version 450
+
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec3 inNormal;
+layout (location = 2) in vec3 inColor;
+
+// Per-instance data streamed by the CPU, same layout as the push constant block of phong.vert
+layout (location = 4) in mat4 instanceMvp;
+layout (location = 8) in vec3 instanceColor;
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec3 outColor;
+layout (location = 3) out vec3 outViewVec;
+layout (location = 4) out vec3 outLightVec;
+
+void main() 
+{
+	if ( (inColor.r == 1.0) && (inColor.g == 0.0) && (inColor.b == 0.0))
+	{	
+		outColor = instanceColor;
+	}
+	else
+	{
+		outColor = inColor;
+	}
+	
+	vec4 pos = instanceMvp * vec4(inPos, 1.0);
+	gl_Position = pos;
+
+	outNormal = mat3(instanceMvp) * inNormal;
+	vec3 lPos = vec3(0.0);
+	outLightVec = lPos - pos.xyz;
+	outViewVec = -pos.xyz;
+}
@@ -1,10 +1,29 @@
 #version 450
 
 #extension GL_ARB_sparse_texture2 : enable
-#extension GL_ARB_sparse_texture_clamp : enable
+
+layout (binding = 0) uniform UBO 
+{
+	mat4 projection;
+	mat4 model;
+	vec4 viewPos;
+	float lodBias;
+	uint frameIndex;
+	// Number of pages covering the first mip level
+	vec2 pageScale;
+	uint mipTailStart;
+	// x = index of the level's first page, y = number of pages in x, z = number of pages in y
+	uvec4 levels[16];
+} ubo;
 
 layout (binding = 1) uniform sampler2D samplerColor;
 
+// Index of the last frame that requested a page, read back on the host
+layout (binding = 2) buffer Feedback 
+{
+	uint requests[];
+} feedback;
+
 layout (location = 0) in vec2 inUV;
 layout (location = 1) in float inLodBias;
 
@@ -12,28 +31,26 @@ layout (location = 0) out vec4 outFragColor;
 
 void main() 
 {
-	vec4 color = vec4(0.0);
-
-	// Get residency code for current texel
-	int residencyCode = sparseTextureARB(samplerColor, inUV, color, inLodBias);
-
-	// Fetch sparse until we get a valid texel
-	/*
-	float minLod = 1.0;
-	while (!sparseTexelsResidentARB(residencyCode)) 
-	{
-		residencyCode = sparseTextureClampARB(samplerColor, inUV, minLod, color);
-		minLod += 1.0f;
+	// Mip level the texel would be fetched from with nearest mip filtering
+	float lod = max(textureQueryLod(samplerColor, inUV).y + inLodBias, 0.0);
+	uint level = uint(lod + 0.5);
+
+	// Only one fragment of each 4x4 block writes feedback per frame, the pattern rotates so all fragments are covered within 16 frames
+	uvec2 pixel = uvec2(gl_FragCoord.xy) & 3u;
+	if ((level < ubo.mipTailStart) && (pixel.y * 4u + pixel.x == (ubo.frameIndex & 15u))) {
+		uvec4 levelInfo = ubo.levels[level];
+		uvec2 page = min(uvec2(inUV * ubo.pageScale / float(1u << level)), levelInfo.yz - 1u);
+		feedback.requests[levelInfo.x + page.y * levelInfo.y + page.x] = ubo.frameIndex;
 	}
-	*/
 
-	// Check if texel is resident
-	bool texelResident = sparseTexelsResidentARB(residencyCode);
-
-	if (!texelResident)
-	{
-		color = vec4(0.0, 0.0, 0.0, 0.0);
+	// Fall back to coarser mip levels until a resident texel is found, the mip tail is always resident
+	vec4 color = vec4(0.0);
+	float sampleLod = float(level);
+	int residencyCode = sparseTextureLodARB(samplerColor, inUV, sampleLod, color);
+	while (!sparseTexelsResidentARB(residencyCode) && (sampleLod < float(ubo.mipTailStart))) {
+		sampleLod += 1.0;
+		residencyCode = sparseTextureLodARB(samplerColor, inUV, sampleLod, color);
 	}
 
 	outFragColor = color;
-}
\ No newline at end of file
+}
@@ -0,0 +1,49 @@
+// Copyright 2020 Google LLC
+
+struct VSInput
+{
+[[vk::location(0)]] float3 Pos : POSITION0;
+[[vk::location(1)]] float3 Normal : NORMAL0;
+[[vk::location(2)]] float3 Color : COLOR0;
+// Per-instance data streamed by the CPU, same layout as the push constant block of phong.vert
+// The model view projection matrix is passed as one column per location
+[[vk::location(4)]] float4 InstanceMvp0 : TEXCOORD4;
+[[vk::location(5)]] float4 InstanceMvp1 : TEXCOORD5;
+[[vk::location(6)]] float4 InstanceMvp2 : TEXCOORD6;
+[[vk::location(7)]] float4 InstanceMvp3 : TEXCOORD7;
+[[vk::location(8)]] float3 InstanceColor : TEXCOORD8;
+};
+
+struct VSOutput
+{
+	float4 Pos : SV_POSITION;
+[[vk::location(0)]] float3 Normal : NORMAL0;
+[[vk::location(1)]] float3 Color : COLOR0;
+[[vk::location(3)]] float3 ViewVec : TEXCOORD1;
+[[vk::location(4)]] float3 LightVec : TEXCOORD2;
+};
+
+VSOutput main(VSInput input)
+{
+	VSOutput output = (VSOutput)0;
+
+	if ( (input.Color.r == 1.0) && (input.Color.g == 0.0) && (input.Color.b == 0.0))
+	{
+		output.Color = input.InstanceColor;
+	}
+	else
+	{
+		output.Color = input.Color;
+	}
+
+	// Rows of this matrix are the columns of the instance matrix, so it's multiplied from the left
+	float4x4 mvp = float4x4(input.InstanceMvp0, input.InstanceMvp1, input.InstanceMvp2, input.InstanceMvp3);
+	float4 pos = mul(float4(input.Pos, 1.0), mvp);
+	output.Pos = pos;
+
+	output.Normal = mul(input.Normal, (float3x3)mvp);
+	float3 lPos = float3(0.0, 0.0, 0.0);
+	output.LightVec = lPos - pos.xyz;
+	output.ViewVec = -pos.xyz;
+	return output;
+}
@@ -3,34 +3,54 @@
 Texture2D textureColor : register(t1);
 SamplerState samplerColor : register(s1);
 
+struct UBO
+{
+	float4x4 projection;
+	float4x4 model;
+	float4 viewPos;
+	float lodBias;
+	uint frameIndex;
+	// Number of pages covering the first mip level
+	float2 pageScale;
+	uint mipTailStart;
+	// x = index of the level's first page, y = number of pages in x, z = number of pages in y
+	uint4 levels[16];
+};
+
+cbuffer ubo : register(b0) { UBO ubo; }
+
+// Index of the last frame that requested a page, read back on the host
+RWStructuredBuffer<uint> feedback : register(u2);
+
 struct VSOutput
 {
+	float4 Pos : SV_POSITION;
 [[vk::location(0)]] float2 UV : TEXCOORD0;
 [[vk::location(1)]] float LodBias : TEXCOORD3;
-[[vk::location(2)]] float3 Normal : NORMAL0;
-[[vk::location(3)]] float3 ViewVec : TEXCOORD1;
-[[vk::location(4)]] float3 LightVec : TEXCOORD2;
 };
 
 float4 main(VSOutput input) : SV_TARGET
 {
-	float4 color = float4(0.0, 0.0, 0.0, 0.0);
+	// Mip level the texel would be fetched from with nearest mip filtering
+	float lod = max(textureColor.CalculateLevelOfDetailUnclamped(samplerColor, input.UV) + input.LodBias, 0.0);
+	uint level = uint(lod + 0.5);
+
+	// Only one fragment of each 4x4 block writes feedback per frame, the pattern rotates so all fragments are covered within 16 frames
+	uint2 pixel = uint2(input.Pos.xy) & 3u;
+	if ((level < ubo.mipTailStart) && (pixel.y * 4u + pixel.x == (ubo.frameIndex & 15u))) {
+		uint4 levelInfo = ubo.levels[level];
+		uint2 page = min(uint2(input.UV * ubo.pageScale / float(1u << level)), levelInfo.yz - 1u);
+		feedback[levelInfo.x + page.y * levelInfo.y + page.x] = ubo.frameIndex;
+	}
 
-	// Fetch sparse until we get a valid texel
+	// Fall back to coarser mip levels until a resident texel is found, the mip tail is always resident
 	uint status;
-	float minLod = input.LodBias;
-	do
-	{
-		color = textureColor.SampleLevel(samplerColor, input.UV, minLod, 0, status);
-		minLod += 1.0f;
-	} while(!CheckAccessFullyMapped(status));
-
-	float3 N = normalize(input.Normal);
-
-	N = normalize((input.Normal - 0.5) * 2.0);
-
-	float3 L = normalize(input.LightVec);
-	float3 R = reflect(-L, N);
-	float3 diffuse = max(dot(N, L), 0.25) * color.rgb;
-	return float4(diffuse, 1.0);
-}
\ No newline at end of file
+	float sampleLod = float(level);
+	float4 color = textureColor.SampleLevel(samplerColor, input.UV, sampleLod, 0, status);
+	while (!CheckAccessFullyMapped(status) && (sampleLod < float(ubo.mipTailStart))) {
+		sampleLod += 1.0;
+		color = textureColor.SampleLevel(samplerColor, input.UV, sampleLod, 0, status);
+	}
+
+	return color;
+}